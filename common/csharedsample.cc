@@ -0,0 +1,180 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include "csharedsample.h"
+#include <new>
+#include <cassert>
+#include <vfwmsgs.h>
+
+
+HRESULT CSharedSample::Factory::CreateSample(
+    CMemAllocator* pAllocator,
+    IMemSample*& pResult)
+{
+    assert(pAllocator);
+    pResult = 0;
+
+    CSharedSample* const pSample =
+        new (std::nothrow) CSharedSample(pAllocator);
+
+    if (pSample == 0)
+        return E_OUTOFMEMORY;
+
+    //We still allocate a buffer of our own, for the payloads that cannot
+    //be shared (because they span pages of the source, say).
+
+    HRESULT hr = pSample->Create();
+
+    if (FAILED(hr))
+    {
+        delete pSample;
+        return hr;
+    }
+
+    assert(pSample->m_cRef == 0);
+
+    pResult = pSample;
+
+    return S_OK;
+}
+
+
+HRESULT CSharedSample::CreateAllocator(IMemAllocator** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    IMemAllocator*& p = *pp;
+    p = 0;
+
+    Factory* const pFactory = new (std::nothrow) Factory;
+
+    if (pFactory == 0)
+        return E_OUTOFMEMORY;
+
+    const HRESULT hr = CMemAllocator::CreateInstance(pFactory, pp);
+
+    if (FAILED(hr))
+        delete pFactory;
+
+    return hr;
+}
+
+
+CSharedSample::CSharedSample(CMemAllocator* p) :
+    CMediaSample(p),
+    m_pOwner(0),
+    m_ptr(0),
+    m_len(0)
+{
+}
+
+
+CSharedSample::~CSharedSample()
+{
+    ReleaseOwner();
+}
+
+
+HRESULT CSharedSample::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    if (iid == __uuidof(ISharedSample))
+    {
+        ISharedSample* const p = this;
+        *ppv = p;
+
+        p->AddRef();
+        return S_OK;
+    }
+
+    return CMediaSample::QueryInterface(iid, ppv);
+}
+
+
+ULONG CSharedSample::AddRef()
+{
+    return CMediaSample::AddRef();
+}
+
+
+ULONG CSharedSample::Release()
+{
+    return CMediaSample::Release();
+}
+
+
+HRESULT CSharedSample::SetBuffer(IUnknown* pOwner, BYTE* ptr, long len)
+{
+    if (pOwner == 0)
+        return E_INVALIDARG;
+
+    if (ptr == 0)
+        return E_POINTER;
+
+    if (len < 0)
+        return E_INVALIDARG;
+
+    pOwner->AddRef();
+    ReleaseOwner();
+
+    m_pOwner = pOwner;
+    m_ptr = ptr;
+    m_len = len;
+
+    return SetActualDataLength(len);
+}
+
+
+HRESULT CSharedSample::Finalize()
+{
+    //Called by the allocator when the sample is released, which is when
+    //the downstream filter is done reading the owner's memory.
+
+    ReleaseOwner();
+
+    return CMediaSample::Finalize();
+}
+
+
+HRESULT CSharedSample::GetPointer(BYTE** pp)
+{
+    if (m_pOwner == 0)
+        return CMediaSample::GetPointer(pp);
+
+    if (pp == 0)
+        return E_POINTER;
+
+    *pp = m_ptr;
+    return S_OK;
+}
+
+
+long CSharedSample::GetSize()
+{
+    if (m_pOwner == 0)
+        return CMediaSample::GetSize();
+
+    return m_len;
+}
+
+
+void CSharedSample::ReleaseOwner()
+{
+    if (m_pOwner == 0)
+        return;
+
+    const ULONG n = m_pOwner->Release();
+    n;
+
+    m_pOwner = 0;
+    m_ptr = 0;
+    m_len = 0;
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include "cmediasample.h"
+#include "isharedsample.h"
+
+//A media sample that can refer to memory owned by some other object
+//(typically a cache page of the source filter), so that a payload can be
+//delivered downstream without being copied.  Until SetBuffer is called,
+//the sample behaves like a CMediaSample, using its own buffer.
+
+class CSharedSample : public CMediaSample,
+                      public ISharedSample
+{
+    CSharedSample(const CSharedSample&);
+    CSharedSample& operator=(const CSharedSample&);
+
+protected:
+
+    explicit CSharedSample(CMemAllocator*);
+    virtual ~CSharedSample();
+
+    struct Factory : CMediaSample::Factory
+    {
+        HRESULT CreateSample(CMemAllocator*, IMemSample*&);
+    };
+
+public:
+
+    static HRESULT CreateAllocator(IMemAllocator**);
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+    //ISharedSample interface:
+
+    HRESULT STDMETHODCALLTYPE SetBuffer(IUnknown*, BYTE*, long);
+
+    //IMemSample interface:
+
+    HRESULT STDMETHODCALLTYPE Finalize();
+
+    //IMediaSample interface:
+
+    HRESULT STDMETHODCALLTYPE GetPointer(
+        BYTE** ppBuffer);
+
+    long STDMETHODCALLTYPE GetSize();
+
+private:
+
+    IUnknown* m_pOwner;
+    BYTE* m_ptr;
+    long m_len;
+
+    void ReleaseOwner();
+
+};
@@ -65,11 +65,11 @@ HRESULT CVP8Sample::GetFrame(CMemAllocator* pAlloc, IVP8Sample::Frame& f)
 
     if (!pool.empty())
     {
-        f = pool.front();
+        f = pool.back();
         assert(f.buf);
         assert(f.buflen >= buflen);
 
-        pool.pop_front();
+        pool.pop_back();
     }
     else
     {
@@ -192,12 +192,12 @@ void CVP8Sample::SampleFactory::PurgePool()
 {
     while (!m_pool.empty())
     {
-        IVP8Sample::Frame& f = m_pool.front();
+        IVP8Sample::Frame& f = m_pool.back();
         assert(f.buf);
 
         delete[] f.buf;
 
-        m_pool.pop_front();
+        m_pool.pop_back();
     }
 }
 
@@ -10,7 +10,7 @@
 #include "cmemallocator.h"
 #include "imemsample.h"
 #include "ivp8sample.h"
-#include <list>
+#include <vector>
 
 class CVP8Sample : public IMediaSample,
                    public IMemSample,
@@ -115,7 +115,10 @@ protected:
         HRESULT DestroySample(IMemSample*);
         HRESULT Destroy(CMemAllocator*);
 
-        typedef std::list<IVP8Sample::Frame> frames_t;
+        //LIFO, so that the most recently released (cache-warm) buffer
+        //is handed out first, and so that recycling a frame doesn't
+        //cost a list node allocation.
+        typedef std::vector<IVP8Sample::Frame> frames_t;
         frames_t m_pool;  //for reuse
 
     private:
@@ -0,0 +1,313 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <algorithm>
+#include <cassert>
+
+#include "indexcache.h"
+
+namespace
+{
+
+// Layout of the image; all values are little-endian.
+//
+//   magic            4 bytes, "WMIX"
+//   version          4
+//   file size        8
+//   mtime            8
+//   header hash      4
+//   cluster count    4
+//   keyframe count   4
+//   reserved         4
+//   clusters         16 each (pos, time)
+//   keyframes        24 each (track, time, cluster pos)
+//   checksum         4, hash of all of the preceding bytes
+
+const unsigned char kMagic[4] = { 'W', 'M', 'I', 'X' };
+const unsigned long kVersion = 1;
+
+enum
+{
+    kHeaderSize = 40,
+    kClusterSize = 16,
+    kKeyframeSize = 24,
+    kChecksumSize = 4
+};
+
+void Put32(std::vector<unsigned char>& buf, unsigned long val)
+{
+    for (int i = 0; i < 4; ++i)
+        buf.push_back(static_cast<unsigned char>((val >> (8 * i)) & 0xFF));
+}
+
+void Put64(std::vector<unsigned char>& buf, long long val_)
+{
+    const unsigned long long val = static_cast<unsigned long long>(val_);
+
+    for (int i = 0; i < 8; ++i)
+        buf.push_back(static_cast<unsigned char>((val >> (8 * i)) & 0xFF));
+}
+
+unsigned long Get32(const unsigned char* p)
+{
+    unsigned long val = 0;
+
+    for (int i = 3; i >= 0; --i)
+        val = (val << 8) | p[i];
+
+    return val;
+}
+
+long long Get64(const unsigned char* p)
+{
+    unsigned long long val = 0;
+
+    for (int i = 7; i >= 0; --i)
+        val = (val << 8) | p[i];
+
+    return static_cast<long long>(val);
+}
+
+bool KeyframeLess(const WebmUtil::IndexCache::Keyframe& lhs,
+                  const WebmUtil::IndexCache::Keyframe& rhs)
+{
+    if (lhs.track != rhs.track)
+        return (lhs.track < rhs.track);
+
+    return (lhs.time_ns < rhs.time_ns);
+}
+
+bool ClusterPosLess(long long pos, const WebmUtil::IndexCache::Cluster& rhs)
+{
+    return (pos < rhs.pos);
+}
+
+} // namespace
+
+namespace WebmUtil
+{
+
+IndexCache::IndexCache()
+{
+    Clear();
+}
+
+IndexCache::~IndexCache()
+{
+}
+
+void IndexCache::Clear()
+{
+    key_.file_size = -1;
+    key_.mtime = -1;
+    key_.header_hash = 0;
+
+    clusters_.clear();
+    keyframes_.clear();
+}
+
+unsigned long IndexCache::Hash(const unsigned char* buf, long len)
+{
+    unsigned long h = 2166136261UL;
+
+    for (long i = 0; i < len; ++i)
+    {
+        h ^= buf[i];
+        h = (h * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    return h;
+}
+
+void IndexCache::AddCluster(long long pos, long long time_ns)
+{
+    assert(clusters_.empty() || (clusters_.back().pos < pos));
+
+    Cluster c;
+
+    c.pos = pos;
+    c.time_ns = time_ns;
+
+    clusters_.push_back(c);
+}
+
+void IndexCache::AddKeyframe(long long track,
+                             long long time_ns,
+                             long long cluster_pos)
+{
+    Keyframe k;
+
+    k.track = track;
+    k.time_ns = time_ns;
+    k.cluster_pos = cluster_pos;
+
+    // Keyframes are normally added in order, so this is an append.
+
+    const Keyframes::iterator i =
+        std::upper_bound(keyframes_.begin(), keyframes_.end(), k, KeyframeLess);
+
+    keyframes_.insert(i, k);
+}
+
+const IndexCache::Keyframe* IndexCache::FindKeyframe(long long track,
+                                                     long long time_ns) const
+{
+    Keyframe k;
+
+    k.track = track;
+    k.time_ns = time_ns;
+    k.cluster_pos = 0;
+
+    const Keyframes::const_iterator begin = keyframes_.begin();
+    const Keyframes::const_iterator end = keyframes_.end();
+
+    Keyframes::const_iterator i = std::upper_bound(begin, end, k, KeyframeLess);
+
+    if ((i != begin) && ((i - 1)->track == track))
+        return &*(i - 1);  // last keyframe at or before time_ns
+
+    if ((i != end) && (i->track == track))
+        return &*i;  // time_ns precedes the track's first keyframe
+
+    return 0;
+}
+
+long long IndexCache::GetNextClusterPos(long long pos) const
+{
+    const Clusters::const_iterator i =
+        std::upper_bound(clusters_.begin(), clusters_.end(), pos,
+                         ClusterPosLess);
+
+    if (i == clusters_.end())
+        return -1;
+
+    return i->pos;
+}
+
+void IndexCache::Write(std::vector<unsigned char>& buf) const
+{
+    const size_t start = buf.size();
+
+    buf.reserve(start +
+                kHeaderSize +
+                kClusterSize * clusters_.size() +
+                kKeyframeSize * keyframes_.size() +
+                kChecksumSize);
+
+    buf.insert(buf.end(), kMagic, kMagic + sizeof(kMagic));
+    Put32(buf, kVersion);
+    Put64(buf, key_.file_size);
+    Put64(buf, key_.mtime);
+    Put32(buf, key_.header_hash);
+    Put32(buf, static_cast<unsigned long>(clusters_.size()));
+    Put32(buf, static_cast<unsigned long>(keyframes_.size()));
+    Put32(buf, 0);  // reserved
+
+    for (Clusters::const_iterator i = clusters_.begin();
+         i != clusters_.end();
+         ++i)
+    {
+        Put64(buf, i->pos);
+        Put64(buf, i->time_ns);
+    }
+
+    for (Keyframes::const_iterator i = keyframes_.begin();
+         i != keyframes_.end();
+         ++i)
+    {
+        Put64(buf, i->track);
+        Put64(buf, i->time_ns);
+        Put64(buf, i->cluster_pos);
+    }
+
+    const long len = static_cast<long>(buf.size() - start);
+    Put32(buf, Hash(&buf[start], len));
+}
+
+bool IndexCache::Read(const unsigned char* buf,
+                      long long len,
+                      const Key& key)
+{
+    Clear();
+
+    if ((buf == 0) || (len < kHeaderSize + kChecksumSize))
+        return false;
+
+    if (!std::equal(kMagic, kMagic + sizeof(kMagic), buf))
+        return false;
+
+    if (Get32(buf + 4) != kVersion)
+        return false;
+
+    if ((Get64(buf + 8) != key.file_size) ||
+        (Get64(buf + 16) != key.mtime) ||
+        (Get32(buf + 24) != key.header_hash))
+    {
+        return false;  // stale
+    }
+
+    const long long cluster_count = Get32(buf + 28);
+    const long long keyframe_count = Get32(buf + 32);
+
+    const long long size = kHeaderSize +
+                           kClusterSize * cluster_count +
+                           kKeyframeSize * keyframe_count +
+                           kChecksumSize;
+
+    if (len != size)
+        return false;
+
+    const long body = static_cast<long>(size - kChecksumSize);
+
+    if (Get32(buf + body) != Hash(buf, body))
+        return false;
+
+    const unsigned char* p = buf + kHeaderSize;
+
+    clusters_.reserve(static_cast<size_t>(cluster_count));
+
+    for (long long i = 0; i < cluster_count; ++i, p += kClusterSize)
+    {
+        Cluster c;
+
+        c.pos = Get64(p);
+        c.time_ns = Get64(p + 8);
+
+        if (!clusters_.empty() && (clusters_.back().pos >= c.pos))
+        {
+            Clear();
+            return false;
+        }
+
+        clusters_.push_back(c);
+    }
+
+    keyframes_.reserve(static_cast<size_t>(keyframe_count));
+
+    for (long long i = 0; i < keyframe_count; ++i, p += kKeyframeSize)
+    {
+        Keyframe k;
+
+        k.track = Get64(p);
+        k.time_ns = Get64(p + 8);
+        k.cluster_pos = Get64(p + 16);
+
+        if (!keyframes_.empty() && KeyframeLess(k, keyframes_.back()))
+        {
+            Clear();
+            return false;
+        }
+
+        keyframes_.push_back(k);
+    }
+
+    key_ = key;
+    return true;
+}
+
+} // WebmUtil namespace
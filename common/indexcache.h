@@ -0,0 +1,105 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef __WEBMDSHOW_COMMON_INDEXCACHE_HPP__
+#define __WEBMDSHOW_COMMON_INDEXCACHE_HPP__
+
+#pragma once
+
+#include <vector>
+
+namespace WebmUtil
+{
+
+// Seek information for a WebM file (the position and time of each cluster,
+// and the keyframes of each video track), as discovered by parsing the
+// whole file.  It can be written to a compact binary image, kept in a
+// sidecar file, so that a later open of the same file can seek and read
+// ahead without parsing the clusters again.  The image records a key
+// (size, modification time and a hash of the first bytes of the file),
+// and is only accepted if the key still matches.
+class IndexCache
+{
+public:
+    struct Key
+    {
+        long long file_size;
+        long long mtime;
+        unsigned long header_hash;
+    };
+
+    // Positions are relative to the start of the segment payload, as
+    // reported by mkvparser::Cluster::GetPosition.
+    struct Cluster
+    {
+        long long pos;
+        long long time_ns;
+    };
+
+    struct Keyframe
+    {
+        long long track;
+        long long time_ns;
+        long long cluster_pos;
+    };
+
+    typedef std::vector<Cluster> Clusters;
+    typedef std::vector<Keyframe> Keyframes;
+
+    // Number of bytes at the start of the file that are hashed into the key.
+    enum { kHeaderHashSize = 4096 };
+
+    IndexCache();
+    ~IndexCache();
+
+    void Clear();
+    bool empty() const { return clusters_.empty(); }
+
+    // Returns the FNV-1a hash of |len| bytes.
+    static unsigned long Hash(const unsigned char* buf, long len);
+
+    const Key& key() const { return key_; }
+    void set_key(const Key& key) { key_ = key; }
+
+    // Clusters must be added in file order.  Keyframes may be added in any
+    // order; they are kept sorted by track, then time.
+    void AddCluster(long long pos, long long time_ns);
+    void AddKeyframe(long long track, long long time_ns, long long cluster_pos);
+
+    const Clusters& clusters() const { return clusters_; }
+    const Keyframes& keyframes() const { return keyframes_; }
+
+    // Returns the last keyframe of |track| at or before |time_ns| (or the
+    // first keyframe of the track, if |time_ns| precedes it), or NULL if
+    // the track has no keyframes.
+    const Keyframe* FindKeyframe(long long track, long long time_ns) const;
+
+    // Returns the position of the first cluster that begins after |pos|,
+    // or -1 if there is none.
+    long long GetNextClusterPos(long long pos) const;
+
+    // Appends the binary image of the cache to |buf|.
+    void Write(std::vector<unsigned char>& buf) const;
+
+    // Replaces the contents of the cache with the image in |buf|, if the
+    // image is well formed and its key matches |key|.  Returns false
+    // otherwise, leaving the cache empty.
+    bool Read(const unsigned char* buf, long long len, const Key& key);
+
+private:
+    Key key_;
+    Clusters clusters_;
+    Keyframes keyframes_;
+
+    IndexCache(const IndexCache&);
+    IndexCache& operator=(const IndexCache&);
+};
+
+} // WebmUtil namespace
+
+#endif // __WEBMDSHOW_COMMON_INDEXCACHE_HPP__
@@ -0,0 +1,25 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+
+[
+    uuid(3E2F223F-AF32-4700-A41B-C9F2E576939D)
+]
+interface ISharedSample : IUnknown
+{
+    //Makes the sample refer to len bytes at ptr, which belong to pOwner,
+    //instead of to its own buffer.  The sample holds a reference to
+    //pOwner until the sample is returned to its allocator.
+
+    virtual HRESULT STDMETHODCALLTYPE SetBuffer(
+        IUnknown* pOwner,
+        BYTE* ptr,
+        long len) = 0;
+
+};
@@ -55,4 +55,138 @@ bool LibyuvScaleI420(uint32_t width, uint32_t height,
   return true;
 }
 
+bool LibyuvPackedToPlanar(vpx_img_fmt_t source_fmt, const uint8_t* source,
+                          uint32_t width, uint32_t height,
+                          vpx_img_fmt_t target_fmt, uint8_t* target) {
+  if (target_fmt != VPX_IMG_FMT_I420 && target_fmt != VPX_IMG_FMT_YV12) {
+    assert(target_fmt == VPX_IMG_FMT_I420 || target_fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  const int source_stride = 2 * width;
+  const int y_stride = width;
+  const int uv_stride = (width + 1) / 2;
+
+  uint8_t* const y_plane = target;
+  uint8_t* const first_chroma_plane = y_plane + width * height;
+  uint8_t* const second_chroma_plane =
+      first_chroma_plane + uv_stride * ((height + 1) / 2);
+
+  // YV12 stores the V plane ahead of the U plane.
+  uint8_t* u_plane = first_chroma_plane;
+  uint8_t* v_plane = second_chroma_plane;
+  if (target_fmt == VPX_IMG_FMT_YV12) {
+    u_plane = second_chroma_plane;
+    v_plane = first_chroma_plane;
+  }
+
+  int convert_status;
+  if (source_fmt == VPX_IMG_FMT_YUY2) {
+    convert_status = libyuv::YUY2ToI420(source, source_stride,
+                                        y_plane, y_stride,
+                                        u_plane, uv_stride,
+                                        v_plane, uv_stride,
+                                        width, height);
+  } else if (source_fmt == VPX_IMG_FMT_UYVY) {
+    convert_status = libyuv::UYVYToI420(source, source_stride,
+                                        y_plane, y_stride,
+                                        u_plane, uv_stride,
+                                        v_plane, uv_stride,
+                                        width, height);
+  } else {
+    assert(source_fmt == VPX_IMG_FMT_YUY2 || source_fmt == VPX_IMG_FMT_UYVY);
+    return false;
+  }
+
+  if (convert_status != 0) {
+    assert(convert_status == 0 && "libyuv packed to planar failed.");
+    return false;
+  }
+
+  return true;
+}
+
+bool LibyuvScaleToPlanar(const vpx_image_t* source,
+                         uint32_t width, uint32_t height,
+                         vpx_img_fmt_t target_fmt, int stride,
+                         uint8_t* target) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  if (target_fmt != VPX_IMG_FMT_I420 && target_fmt != VPX_IMG_FMT_YV12) {
+    assert(target_fmt == VPX_IMG_FMT_I420 || target_fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  const int uv_stride = (stride + 1) / 2;
+
+  uint8_t* const y_plane = target;
+  uint8_t* const first_chroma_plane = y_plane + stride * height;
+  uint8_t* const second_chroma_plane =
+      first_chroma_plane + uv_stride * ((height + 1) / 2);
+
+  // YV12 stores the V plane ahead of the U plane.
+  uint8_t* u_plane = first_chroma_plane;
+  uint8_t* v_plane = second_chroma_plane;
+  if (target_fmt == VPX_IMG_FMT_YV12) {
+    u_plane = second_chroma_plane;
+    v_plane = first_chroma_plane;
+  }
+
+  const int scale_status = libyuv::I420Scale(
+      source->planes[VPX_PLANE_Y], source->stride[VPX_PLANE_Y],
+      source->planes[VPX_PLANE_U], source->stride[VPX_PLANE_U],
+      source->planes[VPX_PLANE_V], source->stride[VPX_PLANE_V],
+      source->d_w, source->d_h,
+      y_plane, stride,
+      u_plane, uv_stride,
+      v_plane, uv_stride,
+      width, height,
+      libyuv::kFilterBox);
+  if (scale_status != 0) {
+    assert(scale_status == 0 && "libyuv::I420Scale failed.");
+    return false;
+  }
+
+  return true;
+}
+
+bool LibyuvPlanarToPacked(const vpx_image_t* source,
+                          vpx_img_fmt_t target_fmt, int stride,
+                          uint8_t* target) {
+  if (source->fmt != VPX_IMG_FMT_I420 && source->fmt != VPX_IMG_FMT_YV12) {
+    assert(source->fmt == VPX_IMG_FMT_I420 || source->fmt == VPX_IMG_FMT_YV12);
+    return false;
+  }
+
+  int convert_status;
+  if (target_fmt == VPX_IMG_FMT_YUY2) {
+    convert_status = libyuv::I420ToYUY2(
+        source->planes[VPX_PLANE_Y], source->stride[VPX_PLANE_Y],
+        source->planes[VPX_PLANE_U], source->stride[VPX_PLANE_U],
+        source->planes[VPX_PLANE_V], source->stride[VPX_PLANE_V],
+        target, stride,
+        source->d_w, source->d_h);
+  } else if (target_fmt == VPX_IMG_FMT_UYVY) {
+    convert_status = libyuv::I420ToUYVY(
+        source->planes[VPX_PLANE_Y], source->stride[VPX_PLANE_Y],
+        source->planes[VPX_PLANE_U], source->stride[VPX_PLANE_U],
+        source->planes[VPX_PLANE_V], source->stride[VPX_PLANE_V],
+        target, stride,
+        source->d_w, source->d_h);
+  } else {
+    assert(target_fmt == VPX_IMG_FMT_YUY2 || target_fmt == VPX_IMG_FMT_UYVY);
+    return false;
+  }
+
+  if (convert_status != 0) {
+    assert(convert_status == 0 && "libyuv planar to packed failed.");
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace webmdshow
\ No newline at end of file
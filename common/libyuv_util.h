@@ -21,6 +21,33 @@ namespace webmdshow {
 bool LibyuvScaleI420(uint32_t width, uint32_t height,
                      const vpx_image_t* source, vpx_image_t** target);
 
+// Converts |width|x|height| packed 4:2:2 pixels in |source| to planar 4:2:0
+// pixels in |target|, which must have room for the chroma planes of an even
+// sized image. |source_fmt| must be VPX_IMG_FMT_YUY2 or VPX_IMG_FMT_UYVY, and
+// |target_fmt| must be VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12. libyuv selects
+// SIMD row functions at run time. Returns true upon success.
+bool LibyuvPackedToPlanar(vpx_img_fmt_t source_fmt, const uint8_t* source,
+                          uint32_t width, uint32_t height,
+                          vpx_img_fmt_t target_fmt, uint8_t* target);
+
+// Scales |source| to |width|x|height| directly into |target|, which holds a
+// planar 4:2:0 image laid out as DirectShow expects: a luma plane with rows
+// of |stride| bytes, followed by the two chroma planes at half that stride.
+// |source| must be VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12, and |target_fmt|
+// must be VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12. Returns true upon success.
+bool LibyuvScaleToPlanar(const vpx_image_t* source,
+                         uint32_t width, uint32_t height,
+                         vpx_img_fmt_t target_fmt, int stride,
+                         uint8_t* target);
+
+// Converts |source| to packed 4:2:2 pixels in |target|, with rows of
+// |stride| bytes. |source| must be VPX_IMG_FMT_I420 or VPX_IMG_FMT_YV12, and
+// |target_fmt| must be VPX_IMG_FMT_YUY2 or VPX_IMG_FMT_UYVY. Returns true
+// upon success.
+bool LibyuvPlanarToPacked(const vpx_image_t* source,
+                          vpx_img_fmt_t target_fmt, int stride,
+                          uint8_t* target);
+
 }  // namespace webmdshow
 
 #endif  // WEBMDSHOW_COMMON_LIBYUV_UTIL_H_
@@ -0,0 +1,234 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cassert>
+#include <cstring>
+
+#include "mappedfile.h"
+
+namespace WebmUtil
+{
+
+MappedFile::MappedFile() :
+#ifdef _WIN32
+    map_(0),
+#else
+    fd_(-1),
+#endif
+    length_(0),
+    window_size_(0),
+    granularity_(0),
+    view_(0),
+    view_pos_(0),
+    view_len_(0)
+{
+    stats_.reads = 0;
+    stats_.remaps = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(FileHandle file, long long length, long long window_size)
+{
+    Close();
+
+    if (length <= 0 || window_size <= 0)
+        return false;
+
+#ifdef _WIN32
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    granularity_ = info.dwAllocationGranularity;
+
+    map_ = CreateFileMapping(file, 0, PAGE_READONLY, 0, 0, 0);
+
+    if (map_ == 0)
+        return false;
+#else
+    if (file < 0)
+        return false;
+
+    granularity_ = sysconf(_SC_PAGESIZE);
+    fd_ = file;
+#endif
+
+    assert(granularity_ > 0);
+
+    length_ = length;
+
+    const long long n = (window_size + granularity_ - 1) / granularity_;
+    window_size_ = n * granularity_;
+
+    stats_.reads = 0;
+    stats_.remaps = 0;
+
+    return Map(0);
+}
+
+void MappedFile::Close()
+{
+    Unmap();
+
+#ifdef _WIN32
+    if (map_)
+    {
+        const BOOL b = CloseHandle(map_);
+        b;
+        assert(b);
+
+        map_ = 0;
+    }
+#else
+    fd_ = -1;
+#endif
+
+    length_ = 0;
+}
+
+bool MappedFile::IsOpen() const
+{
+    return (view_ != 0);
+}
+
+int MappedFile::Read(long long pos, long len, unsigned char* buf)
+{
+    if (len <= 0)
+        return 0;
+
+    if (buf == 0)
+        return -1;
+
+    const unsigned char* const src = GetView(pos, len);
+
+    if (src == 0)
+        return -1;
+
+    ++stats_.reads;
+
+#ifdef _MSC_VER
+    // An I/O error on a mapped file (e.g. a network share going away)
+    // surfaces as an exception when the page is touched.
+    __try
+    {
+        memcpy(buf, src, len);
+    }
+    __except(GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+             EXCEPTION_EXECUTE_HANDLER :
+             EXCEPTION_CONTINUE_SEARCH)
+    {
+        return -1;
+    }
+#else
+    memcpy(buf, src, len);
+#endif
+
+    return 0;
+}
+
+const unsigned char* MappedFile::GetView(long long pos, long len)
+{
+    if (view_ == 0 || pos < 0 || len <= 0)
+        return 0;
+
+    if (pos > length_ - len)
+        return 0;
+
+    if (pos < view_pos_ || (pos + len) > (view_pos_ + view_len_))
+    {
+        if (!Map(pos))
+            return 0;
+
+        ++stats_.remaps;
+
+        if ((pos + len) > (view_pos_ + view_len_))  // larger than window
+            return 0;
+    }
+
+    return view_ + (pos - view_pos_);
+}
+
+bool MappedFile::Map(long long pos)
+{
+    Unmap();
+
+    const long long base = (pos / granularity_) * granularity_;
+    assert(base < length_);
+
+    const long long remaining = length_ - base;
+    const long long size = (remaining < window_size_) ?
+                           remaining :
+                           window_size_;
+
+    if (static_cast<long long>(static_cast<size_t>(size)) != size)
+        return false;  // window too large for address space
+
+#ifdef _WIN32
+    const DWORD hi = static_cast<DWORD>(base >> 32);
+    const DWORD lo = static_cast<DWORD>(base & 0xFFFFFFFF);
+
+    void* const p = MapViewOfFile(map_,
+                                  FILE_MAP_READ,
+                                  hi,
+                                  lo,
+                                  static_cast<SIZE_T>(size));
+
+    if (p == 0)
+        return false;
+#else
+    void* const p = mmap(0,
+                         static_cast<size_t>(size),
+                         PROT_READ,
+                         MAP_SHARED,
+                         fd_,
+                         static_cast<off_t>(base));
+
+    if (p == MAP_FAILED)
+        return false;
+#endif
+
+    view_ = static_cast<const unsigned char*>(p);
+    view_pos_ = base;
+    view_len_ = size;
+
+    return true;
+}
+
+void MappedFile::Unmap()
+{
+    if (view_ == 0)
+        return;
+
+#ifdef _WIN32
+    const BOOL b = UnmapViewOfFile(view_);
+    b;
+    assert(b);
+#else
+    const int status = munmap(const_cast<unsigned char*>(view_),
+                              static_cast<size_t>(view_len_));
+    (void)status;
+    assert(status == 0);
+#endif
+
+    view_ = 0;
+    view_pos_ = 0;
+    view_len_ = 0;
+}
+
+} // WebmUtil namespace
@@ -0,0 +1,90 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef __WEBMDSHOW_COMMON_MAPPEDFILE_HPP__
+#define __WEBMDSHOW_COMMON_MAPPEDFILE_HPP__
+
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace WebmUtil
+{
+
+// Read-only memory mapping of an open file.  Rather than mapping the
+// whole file, which can exhaust the address space of a 32-bit process,
+// a window of the file is mapped and moved as reads fall outside of it.
+// Uses CreateFileMapping on Windows, and mmap elsewhere.
+class MappedFile
+{
+public:
+#ifdef _WIN32
+    typedef HANDLE FileHandle;
+#else
+    typedef int FileHandle;
+#endif
+
+    struct Stats
+    {
+        unsigned long long reads;
+        unsigned long long remaps;
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    // Prepares to map |file|, which remains owned by the caller and must
+    // stay open until Close.  |length| is the size of the file.  Windows
+    // span |window_size| bytes (rounded up to the allocation granularity),
+    // or the whole file if that is smaller.  Returns false if the file
+    // cannot be mapped (an empty file, for example).
+    bool Open(FileHandle file, long long length, long long window_size);
+    void Close();
+    bool IsOpen() const;
+
+    long long length() const { return length_; }
+
+    // Copies |len| bytes starting at |pos| into |buf|.  Returns 0 on
+    // success, or negative if the range lies outside the file, does not
+    // fit in a single window, or the underlying I/O failed.
+    int Read(long long pos, long len, unsigned char* buf);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    // Returns a pointer to |pos|, moving the window if necessary so that
+    // it also spans |len| bytes, or NULL on failure.
+    const unsigned char* GetView(long long pos, long len);
+
+    bool Map(long long pos);
+    void Unmap();
+
+#ifdef _WIN32
+    HANDLE map_;
+#else
+    int fd_;
+#endif
+    long long length_;
+    long long window_size_;
+    long long granularity_;
+
+    const unsigned char* view_;
+    long long view_pos_;
+    long long view_len_;
+
+    Stats stats_;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+} // WebmUtil namespace
+
+#endif // __WEBMDSHOW_COMMON_MAPPEDFILE_HPP__
@@ -0,0 +1,345 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cassert>
+#include <cstring>
+
+#include "pagecache.h"
+
+namespace WebmUtil
+{
+
+PageCache::PageCache() :
+    page_size_(0),
+    page_count_(0),
+    table_mask_(0),
+    clock_hand_(0)
+{
+    ResetStats();
+}
+
+PageCache::~PageCache()
+{
+}
+
+bool PageCache::Init(long page_size, long page_count)
+{
+    if (page_size <= 0 || page_count <= 0)
+        return false;
+
+    Clear();
+
+    unsigned long table_size = 1;
+
+    while (table_size < 2UL * page_count)
+        table_size <<= 1;
+
+    page_size_ = page_size;
+    page_count_ = page_count;
+
+    data_.resize(static_cast<size_t>(page_size) * page_count);
+
+    const Page empty_page = { kEmpty, 0, 0, false };
+    pages_.assign(page_count, empty_page);
+
+    table_.assign(table_size, kEmpty);
+    table_mask_ = table_size - 1;
+
+    clock_hand_ = 0;
+
+    return true;
+}
+
+void PageCache::Clear()
+{
+    typedef std::vector<Page>::iterator iter_t;
+
+    for (iter_t iter = pages_.begin(); iter != pages_.end(); ++iter)
+    {
+        Page& page = *iter;
+        assert(page.pin_count == 0);
+
+        page.index = kEmpty;
+        page.valid = 0;
+        page.pin_count = 0;
+        page.referenced = false;
+    }
+
+    table_.assign(table_.size(), kEmpty);
+    clock_hand_ = 0;
+}
+
+int PageCache::Read(Source* source,
+                    long long pos,
+                    long len,
+                    unsigned char* buf)
+{
+    if (pos < 0 || buf == 0 || page_size_ <= 0)
+        return -1;
+
+    while (len > 0)
+    {
+        const long long index = pos / page_size_;
+        const long off = static_cast<long>(pos - index * page_size_);
+
+        const long slot = GetPage(source, index);
+
+        if (slot < 0)
+            return -1;
+
+        const Page& page = pages_[slot];
+
+        if (off >= page.valid)  // past end of file
+            return -1;
+
+        const long avail = page.valid - off;
+        const long n = (len <= avail) ? len : avail;
+
+        const unsigned char* const src = &data_[slot * page_size_ + off];
+        memcpy(buf, src, n);
+
+        buf += n;
+        pos += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int PageCache::Pin(Source* source, long long pos, long len)
+{
+    if (pos < 0 || page_size_ <= 0)
+        return -1;
+
+    long long curr = pos;
+    long remaining = len;
+
+    while (remaining > 0)
+    {
+        const long long index = curr / page_size_;
+        const long off = static_cast<long>(curr - index * page_size_);
+
+        const long slot = GetPage(source, index);
+
+        if (slot < 0 || off >= pages_[slot].valid)
+        {
+            Unpin(pos, static_cast<long>(curr - pos));
+            return -1;
+        }
+
+        ++pages_[slot].pin_count;
+
+        const long avail = page_size_ - off;
+        const long n = (remaining <= avail) ? remaining : avail;
+
+        curr += n;
+        remaining -= n;
+    }
+
+    return 0;
+}
+
+void PageCache::Unpin(long long pos, long len)
+{
+    while (len > 0)
+    {
+        const long long index = pos / page_size_;
+        const long off = static_cast<long>(pos - index * page_size_);
+
+        const long slot = Find(index);
+        assert(slot >= 0);
+
+        if (slot >= 0)
+        {
+            Page& page = pages_[slot];
+            assert(page.pin_count > 0);
+
+            --page.pin_count;
+        }
+
+        const long avail = page_size_ - off;
+        const long n = (len <= avail) ? len : avail;
+
+        pos += n;
+        len -= n;
+    }
+}
+
+bool PageCache::IsCached(long long pos) const
+{
+    if (pos < 0 || page_size_ <= 0)
+        return false;
+
+    return (Find(pos / page_size_) >= 0);
+}
+
+void PageCache::ResetStats()
+{
+    stats_.hits = 0;
+    stats_.misses = 0;
+    stats_.evictions = 0;
+}
+
+long PageCache::GetPage(Source* source, long long index)
+{
+    long slot = Find(index);
+
+    if (slot >= 0)
+    {
+        ++stats_.hits;
+        pages_[slot].referenced = true;
+
+        return slot;
+    }
+
+    ++stats_.misses;
+
+    if (source == 0)
+        return -1;
+
+    slot = Evict();
+
+    if (slot < 0)  // every page is pinned
+        return -1;
+
+    Page& page = pages_[slot];
+    assert(page.index == kEmpty);
+
+    unsigned char* const dst = &data_[slot * page_size_];
+
+    const long n = source->ReadPage(index * page_size_, page_size_, dst);
+
+    if (n <= 0)
+        return -1;
+
+    assert(n <= page_size_);
+
+    page.index = index;
+    page.valid = n;
+    page.referenced = true;
+
+    HashInsert(index, slot);
+
+    return slot;
+}
+
+long PageCache::Find(long long index) const
+{
+    if (table_.empty())
+        return kEmpty;
+
+    unsigned long i = HashSlot(index);
+
+    for (;;)
+    {
+        const long slot = table_[i];
+
+        if (slot == kEmpty || pages_[slot].index == index)
+            return slot;
+
+        i = (i + 1) & table_mask_;
+    }
+}
+
+long PageCache::Evict()
+{
+    // Clock: sweep past referenced pages (clearing their bit), and take the
+    // first page that is neither referenced nor pinned.  Two revolutions
+    // are enough to find a victim, unless every page is pinned.
+
+    for (long n = 0; n < 2 * page_count_; ++n)
+    {
+        const long slot = clock_hand_;
+        clock_hand_ = (clock_hand_ + 1) % page_count_;
+
+        Page& page = pages_[slot];
+
+        if (page.pin_count > 0)
+            continue;
+
+        if (page.index == kEmpty)
+            return slot;
+
+        if (page.referenced)
+        {
+            page.referenced = false;
+            continue;
+        }
+
+        HashErase(page.index);
+        ++stats_.evictions;
+
+        page.index = kEmpty;
+        page.valid = 0;
+
+        return slot;
+    }
+
+    return kEmpty;
+}
+
+long PageCache::HashSlot(long long index) const
+{
+    // Fibonacci hashing; consecutive page indices spread across the table.
+    const unsigned long long h =
+        static_cast<unsigned long long>(index) * 0x9E3779B97F4A7C15ULL;
+
+    return static_cast<long>((h >> 32) & table_mask_);
+}
+
+void PageCache::HashInsert(long long index, long slot)
+{
+    unsigned long i = HashSlot(index);
+
+    while (table_[i] != kEmpty)
+        i = (i + 1) & table_mask_;
+
+    table_[i] = slot;
+}
+
+void PageCache::HashErase(long long index)
+{
+    unsigned long i = HashSlot(index);
+
+    while (pages_[table_[i]].index != index)
+    {
+        i = (i + 1) & table_mask_;
+        assert(table_[i] != kEmpty);
+    }
+
+    // Backward-shift deletion: move later entries of the probe sequence
+    // up into the hole, so that lookups never need tombstones.
+
+    unsigned long j = i;
+
+    for (;;)
+    {
+        table_[i] = kEmpty;
+
+        for (;;)
+        {
+            j = (j + 1) & table_mask_;
+
+            if (table_[j] == kEmpty)
+                return;
+
+            const unsigned long k = HashSlot(pages_[table_[j]].index);
+
+            // Entry at j may stay iff its home k lies cyclically in (i, j].
+            const bool stay = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+
+            if (!stay)
+                break;
+        }
+
+        table_[i] = table_[j];
+        i = j;
+    }
+}
+
+} // WebmUtil namespace
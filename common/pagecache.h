@@ -0,0 +1,127 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef __WEBMDSHOW_COMMON_PAGECACHE_HPP__
+#define __WEBMDSHOW_COMMON_PAGECACHE_HPP__
+
+#pragma once
+
+#include <vector>
+
+namespace WebmUtil
+{
+
+// Fixed-size cache of aligned file pages, shared by the stream readers.
+// Pages are found through an open-addressed hash table keyed on page
+// index, and evicted using the clock algorithm.  Pages may be pinned
+// (e.g. while the parser holds a block) to keep them from being evicted.
+// The cache does no locking of its own; callers serialize access.
+//
+// Only WebmSource::MkvFile uses it so far.  The webmsplit and webmmfsource
+// readers fill pages with async reads into buffers they don't own
+// (allocator samples, and MF async results), and webmsplit lends pages to
+// downstream samples, so they keep their own caches.
+class PageCache
+{
+public:
+    // Supplies page data on a cache miss.  ReadPage fills |buf| with |len|
+    // bytes starting at |pos|, returning the number of bytes read (which
+    // is less than |len| only at the end of the file), or negative on
+    // error.
+    class Source
+    {
+    public:
+        virtual long ReadPage(long long pos, long len, unsigned char* buf) = 0;
+
+    protected:
+        virtual ~Source() {}
+    };
+
+    struct Stats
+    {
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long evictions;
+    };
+
+    PageCache();
+    ~PageCache();
+
+    // Allocates storage for |page_count| pages of |page_size| bytes.
+    // Returns false if the arguments are invalid or allocation fails.
+    bool Init(long page_size, long page_count);
+
+    // Discards all pages.  No page may be pinned.
+    void Clear();
+
+    long page_size() const { return page_size_; }
+    long page_count() const { return page_count_; }
+
+    // Copies |len| bytes starting at |pos| into |buf|, reading pages that
+    // are not cached from |source|.  Returns 0 on success, or negative if
+    // the source failed, the range extends past the end of the file, or
+    // every page is pinned.
+    int Read(Source* source, long long pos, long len, unsigned char* buf);
+
+    // Loads (as necessary) and pins the pages that cover |len| bytes
+    // starting at |pos|.  Returns 0 on success; on failure no page remains
+    // pinned by this call.
+    int Pin(Source* source, long long pos, long len);
+
+    // Releases pins acquired by a successful call to Pin.
+    void Unpin(long long pos, long len);
+
+    // Returns true if the page containing |pos| is cached.
+    bool IsCached(long long pos) const;
+
+    const Stats& stats() const { return stats_; }
+    void ResetStats();
+
+private:
+    enum { kEmpty = -1 };
+
+    struct Page
+    {
+        long long index;  // page index (pos / page_size), or kEmpty
+        long valid;       // bytes of data on page
+        int pin_count;
+        bool referenced;  // clock bit
+    };
+
+    // Returns the slot of the page with |index|, loading it from |source|
+    // if necessary, or negative on failure.
+    long GetPage(Source* source, long long index);
+
+    long Find(long long index) const;
+    long Evict();
+
+    long HashSlot(long long index) const;
+    void HashInsert(long long index, long page);
+    void HashErase(long long index);
+
+    long page_size_;
+    long page_count_;
+
+    std::vector<unsigned char> data_;
+    std::vector<Page> pages_;
+
+    // Open-addressed (linear probe) table of page slots, or kEmpty.
+    // Capacity is a power of two, at least twice page_count_.
+    std::vector<long> table_;
+    unsigned long table_mask_;
+
+    long clock_hand_;
+    Stats stats_;
+
+    PageCache(const PageCache&);
+    PageCache& operator=(const PageCache&);
+};
+
+} // WebmUtil namespace
+
+#endif // __WEBMDSHOW_COMMON_PAGECACHE_HPP__
@@ -0,0 +1,224 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PCMRING_SSE2
+#endif
+
+#include "pcmring.h"
+
+namespace
+{
+
+// Interleaves |count| frames from the planar |src| arrays into |dst|.
+void Interleave(const float* const* src, int channels, long count, float* dst)
+{
+    if (channels == 1)
+    {
+        memcpy(dst, src[0], count * sizeof(float));
+        return;
+    }
+
+    long i = 0;
+
+    if (channels == 2)
+    {
+        const float* const l = src[0];
+        const float* const r = src[1];
+
+#ifdef PCMRING_SSE2
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 lv = _mm_loadu_ps(l + i);
+            const __m128 rv = _mm_loadu_ps(r + i);
+
+            _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(lv, rv));
+            _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(lv, rv));
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            dst[2 * i] = l[i];
+            dst[2 * i + 1] = r[i];
+        }
+
+        return;
+    }
+
+    // Multichannel (e.g. 5.1, 7.1): one strided pass per channel, which
+    // touches each source array sequentially, rather than a gather per
+    // output frame.
+
+    for (int c = 0; c < channels; ++c)
+    {
+        const float* s = src[c];
+        float* d = dst + c;
+
+        for (i = 0; i < count; ++i)
+        {
+            *d = *s++;
+            d += channels;
+        }
+    }
+}
+
+} // namespace
+
+namespace WebmUtil
+{
+
+PcmRing::PcmRing() :
+    channels_(0),
+    capacity_(0),
+    head_(0),
+    size_(0)
+{
+}
+
+PcmRing::~PcmRing()
+{
+}
+
+void PcmRing::Init(int channels, long capacity)
+{
+    assert(channels >= 0);
+
+    long n = 1;
+
+    while (n < capacity)
+        n <<= 1;
+
+    channels_ = channels;
+    capacity_ = n;
+    head_ = 0;
+    size_ = 0;
+
+    samples_.assign(static_cast<size_t>(channels_) * capacity_, 0.0f);
+    src_.assign(channels_ + 1, 0);  // never empty
+}
+
+void PcmRing::Clear()
+{
+    head_ = 0;
+    size_ = 0;
+}
+
+void PcmRing::Reserve(long capacity)
+{
+    if (capacity > capacity_)
+        Grow(capacity);
+}
+
+void PcmRing::Write(const float* const* planes, long count)
+{
+    if (count <= 0)
+        return;
+
+    assert(planes);
+
+    if (size_ + count > capacity_)
+        Grow(size_ + count);
+
+    const long mask = capacity_ - 1;
+    const long tail = (head_ + size_) & mask;
+
+    const long n1 = (capacity_ - tail < count) ? capacity_ - tail : count;
+    const long n2 = count - n1;
+
+    for (int c = 0; c < channels_; ++c)
+    {
+        float* const base = &samples_[c * capacity_];
+        const float* const src = planes[c];
+
+        memcpy(base + tail, src, n1 * sizeof(float));
+
+        if (n2 > 0)
+            memcpy(base, src + n1, n2 * sizeof(float));
+    }
+
+    size_ += count;
+}
+
+void PcmRing::ReadInterleaved(float* dst, long count, const int* map)
+{
+    assert(count <= size_);
+
+    if (count <= 0)
+        return;
+
+    assert(dst);
+
+    // The frames to read lie in at most two contiguous runs.
+
+    const long n1 = (capacity_ - head_ < count) ? capacity_ - head_ : count;
+    const long n2 = count - n1;
+
+    const float** const src = &src_[0];
+
+    for (int c = 0; c < channels_; ++c)
+    {
+        const int k = map ? map[c] : c;
+        assert(k >= 0 && k < channels_);
+
+        src[c] = &samples_[k * capacity_ + head_];
+    }
+
+    Interleave(src, channels_, n1, dst);
+
+    if (n2 > 0)
+    {
+        for (int c = 0; c < channels_; ++c)
+            src[c] -= head_;
+
+        Interleave(src, channels_, n2, dst + n1 * channels_);
+    }
+
+    head_ = (head_ + count) & (capacity_ - 1);
+    size_ -= count;
+
+    if (size_ == 0)
+        head_ = 0;
+}
+
+void PcmRing::Grow(long count)
+{
+    long n = (capacity_ > 0) ? capacity_ : 1;
+
+    while (n < count)
+        n <<= 1;
+
+    std::vector<float> samples(static_cast<size_t>(channels_) * n);
+
+    // Move the frames to the start of the new rings.
+
+    const long n1 = (capacity_ - head_ < size_) ? capacity_ - head_ : size_;
+    const long n2 = size_ - n1;
+
+    for (int c = 0; c < channels_; ++c)
+    {
+        const float* const src = &samples_[c * capacity_];
+        float* const dst = &samples[c * n];
+
+        if (n1 > 0)
+            memcpy(dst, src + head_, n1 * sizeof(float));
+
+        if (n2 > 0)
+            memcpy(dst + n1, src, n2 * sizeof(float));
+    }
+
+    samples_.swap(samples);
+    capacity_ = n;
+    head_ = 0;
+}
+
+} // WebmUtil namespace
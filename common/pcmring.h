@@ -0,0 +1,71 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef __WEBMDSHOW_COMMON_PCMRING_HPP__
+#define __WEBMDSHOW_COMMON_PCMRING_HPP__
+
+#pragma once
+
+#include <vector>
+
+namespace WebmUtil
+{
+
+// Planar staging buffer for decoded float PCM.  Each channel is a ring of
+// the same capacity; frames are appended a block at a time in planar form
+// (as returned by vorbis_synthesis_pcmout) and removed in interleaved form,
+// ready to be copied into an output media sample.
+class PcmRing
+{
+public:
+    PcmRing();
+    ~PcmRing();
+
+    // Discards any frames, and sets the channel count and the initial
+    // capacity (rounded up to a power of two).
+    void Init(int channels, long capacity);
+
+    // Discards all frames, keeping the channel count and capacity.
+    void Clear();
+
+    // Grows the ring, if necessary, so that it holds at least |capacity|
+    // frames without reallocating.
+    void Reserve(long capacity);
+
+    int channels() const { return channels_; }
+    long capacity() const { return capacity_; }
+    long size() const { return size_; }
+
+    // Appends |count| frames, where |planes[c]| points to the samples of
+    // channel c.  The ring grows if it lacks room.
+    void Write(const float* const* planes, long count);
+
+    // Removes |count| frames (no more than size()), writing them to |dst|
+    // as interleaved samples.  If |map| is non-NULL, output channel c is
+    // taken from ring channel map[c]; this reorders channels at no extra
+    // cost.
+    void ReadInterleaved(float* dst, long count, const int* map = 0);
+
+private:
+    void Grow(long count);
+
+    int channels_;
+    long capacity_;  // frames per channel; a power of two
+    long head_;      // index of oldest frame
+    long size_;
+
+    std::vector<float> samples_;  // channel c occupies [c*capacity_, ...)
+    std::vector<const float*> src_;  // scratch, for ReadInterleaved
+
+    PcmRing(const PcmRing&);
+    PcmRing& operator=(const PcmRing&);
+};
+
+} // WebmUtil namespace
+
+#endif // __WEBMDSHOW_COMMON_PCMRING_HPP__
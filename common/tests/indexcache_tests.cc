@@ -0,0 +1,179 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "indexcache.h"
+
+namespace
+{
+
+WebmUtil::IndexCache::Key MakeKey()
+{
+    const unsigned char header[] = { 0x1A, 0x45, 0xDF, 0xA3, 0x42, 0x86 };
+
+    WebmUtil::IndexCache::Key key;
+
+    key.file_size = 123456789012LL;
+    key.mtime = 130000000000000000LL;
+    key.header_hash = WebmUtil::IndexCache::Hash(header, sizeof(header));
+
+    return key;
+}
+
+void Populate(WebmUtil::IndexCache& cache)
+{
+    cache.set_key(MakeKey());
+
+    for (long long i = 0; i < 10; ++i)
+        cache.AddCluster(1000 + i * 50000, i * 5000000000LL);
+
+    // Track 2 is added before track 1 to exercise the sorted insert.
+    cache.AddKeyframe(2, 0, 1000);
+    cache.AddKeyframe(2, 20000000000LL, 1000 + 4 * 50000);
+    cache.AddKeyframe(1, 0, 1000);
+    cache.AddKeyframe(1, 10000000000LL, 1000 + 2 * 50000);
+    cache.AddKeyframe(1, 30000000000LL, 1000 + 6 * 50000);
+}
+
+} // namespace
+
+TEST(IndexCacheTest, HashIsFnv1a)
+{
+    EXPECT_EQ(2166136261UL, WebmUtil::IndexCache::Hash(0, 0));
+
+    const unsigned char a = 'a';
+    EXPECT_EQ(0xE40C292CUL, WebmUtil::IndexCache::Hash(&a, 1));
+}
+
+TEST(IndexCacheTest, FindKeyframe)
+{
+    WebmUtil::IndexCache cache;
+    Populate(cache);
+
+    const WebmUtil::IndexCache::Keyframe* k = cache.FindKeyframe(1, 0);
+    ASSERT_TRUE(k != 0);
+    EXPECT_EQ(1, k->track);
+    EXPECT_EQ(0, k->time_ns);
+
+    k = cache.FindKeyframe(1, 29999999999LL);
+    ASSERT_TRUE(k != 0);
+    EXPECT_EQ(10000000000LL, k->time_ns);
+    EXPECT_EQ(1000 + 2 * 50000, k->cluster_pos);
+
+    k = cache.FindKeyframe(1, 99000000000LL);
+    ASSERT_TRUE(k != 0);
+    EXPECT_EQ(30000000000LL, k->time_ns);
+
+    k = cache.FindKeyframe(2, 25000000000LL);
+    ASSERT_TRUE(k != 0);
+    EXPECT_EQ(2, k->track);
+    EXPECT_EQ(20000000000LL, k->time_ns);
+
+    k = cache.FindKeyframe(2, -1);
+    ASSERT_TRUE(k != 0);
+    EXPECT_EQ(2, k->track);
+    EXPECT_EQ(0, k->time_ns);
+
+    EXPECT_TRUE(cache.FindKeyframe(3, 0) == 0);
+}
+
+TEST(IndexCacheTest, GetNextClusterPos)
+{
+    WebmUtil::IndexCache cache;
+    Populate(cache);
+
+    EXPECT_EQ(1000, cache.GetNextClusterPos(0));
+    EXPECT_EQ(51000, cache.GetNextClusterPos(1000));
+    EXPECT_EQ(51000, cache.GetNextClusterPos(50999));
+    EXPECT_EQ(-1, cache.GetNextClusterPos(1000 + 9 * 50000));
+}
+
+TEST(IndexCacheTest, RoundTrip)
+{
+    WebmUtil::IndexCache cache;
+    Populate(cache);
+
+    std::vector<unsigned char> buf;
+    cache.Write(buf);
+    EXPECT_EQ(40u + 10 * 16 + 5 * 24 + 4, buf.size());
+
+    WebmUtil::IndexCache loaded;
+    ASSERT_TRUE(loaded.Read(&buf[0], buf.size(), MakeKey()));
+
+    ASSERT_EQ(cache.clusters().size(), loaded.clusters().size());
+    ASSERT_EQ(cache.keyframes().size(), loaded.keyframes().size());
+
+    for (size_t i = 0; i < cache.clusters().size(); ++i)
+    {
+        EXPECT_EQ(cache.clusters()[i].pos, loaded.clusters()[i].pos);
+        EXPECT_EQ(cache.clusters()[i].time_ns, loaded.clusters()[i].time_ns);
+    }
+
+    for (size_t i = 0; i < cache.keyframes().size(); ++i)
+    {
+        const WebmUtil::IndexCache::Keyframe& k = cache.keyframes()[i];
+        const WebmUtil::IndexCache::Keyframe& l = loaded.keyframes()[i];
+
+        EXPECT_EQ(k.track, l.track);
+        EXPECT_EQ(k.time_ns, l.time_ns);
+        EXPECT_EQ(k.cluster_pos, l.cluster_pos);
+    }
+}
+
+TEST(IndexCacheTest, RejectsStaleKey)
+{
+    WebmUtil::IndexCache cache;
+    Populate(cache);
+
+    std::vector<unsigned char> buf;
+    cache.Write(buf);
+
+    WebmUtil::IndexCache loaded;
+
+    WebmUtil::IndexCache::Key key = MakeKey();
+    key.file_size += 1;
+    EXPECT_FALSE(loaded.Read(&buf[0], buf.size(), key));
+    EXPECT_TRUE(loaded.empty());
+
+    key = MakeKey();
+    key.mtime += 1;
+    EXPECT_FALSE(loaded.Read(&buf[0], buf.size(), key));
+
+    key = MakeKey();
+    key.header_hash ^= 1;
+    EXPECT_FALSE(loaded.Read(&buf[0], buf.size(), key));
+}
+
+TEST(IndexCacheTest, RejectsCorruptImage)
+{
+    WebmUtil::IndexCache cache;
+    Populate(cache);
+
+    std::vector<unsigned char> buf;
+    cache.Write(buf);
+
+    WebmUtil::IndexCache loaded;
+
+    EXPECT_FALSE(loaded.Read(&buf[0], buf.size() - 1, MakeKey()));
+    EXPECT_FALSE(loaded.Read(&buf[0], 10, MakeKey()));
+    EXPECT_FALSE(loaded.Read(0, 0, MakeKey()));
+
+    std::vector<unsigned char> bad(buf);
+    bad[60] ^= 0x80;
+    EXPECT_FALSE(loaded.Read(&bad[0], bad.size(), MakeKey()));
+    EXPECT_TRUE(loaded.empty());
+
+    bad = buf;
+    bad[0] = 'X';
+    EXPECT_FALSE(loaded.Read(&bad[0], bad.size(), MakeKey()));
+
+    ASSERT_TRUE(loaded.Read(&buf[0], buf.size(), MakeKey()));
+    EXPECT_EQ(10u, loaded.clusters().size());
+}
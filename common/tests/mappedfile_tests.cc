@@ -0,0 +1,165 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mappedfile.h"
+
+namespace
+{
+
+unsigned char ByteAt(long long pos)
+{
+    return static_cast<unsigned char>((pos * 13) & 0xFF);
+}
+
+// Creates a temporary file of |length| bytes, and opens it for reading.
+class TempFile
+{
+public:
+    explicit TempFile(long long length) : length_(length)
+    {
+        std::vector<unsigned char> buf(static_cast<size_t>(length));
+
+        for (size_t i = 0; i < buf.size(); ++i)
+            buf[i] = ByteAt(i);
+
+#ifdef _WIN32
+        char dir[MAX_PATH];
+        GetTempPathA(MAX_PATH, dir);
+        GetTempFileNameA(dir, "wmf", 0, path_);
+
+        FILE* const f = fopen(path_, "wb");
+#else
+        snprintf(path_, sizeof(path_), "/tmp/mappedfile_testXXXXXX");
+
+        const int fd = mkstemp(path_);
+        FILE* const f = fdopen(fd, "wb");
+#endif
+        if (!buf.empty())
+            fwrite(&buf[0], 1, buf.size(), f);
+
+        fclose(f);
+
+#ifdef _WIN32
+        handle_ = CreateFileA(path_,
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              0,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              0);
+#else
+        handle_ = open(path_, O_RDONLY);
+#endif
+    }
+
+    ~TempFile()
+    {
+#ifdef _WIN32
+        CloseHandle(handle_);
+#else
+        close(handle_);
+#endif
+        remove(path_);
+    }
+
+    WebmUtil::MappedFile::FileHandle handle_;
+    long long length_;
+
+private:
+#ifdef _WIN32
+    char path_[MAX_PATH];
+#else
+    char path_[64];
+#endif
+};
+
+bool CheckRange(const std::vector<unsigned char>& buf, long long pos)
+{
+    for (size_t i = 0; i < buf.size(); ++i)
+    {
+        if (buf[i] != ByteAt(pos + i))
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+TEST(MappedFileTest, EmptyFileIsNotMapped)
+{
+    TempFile file(0);
+    WebmUtil::MappedFile map;
+    EXPECT_FALSE(map.Open(file.handle_, 0, 1 << 20));
+    EXPECT_FALSE(map.IsOpen());
+}
+
+TEST(MappedFileTest, WholeFileInOneWindow)
+{
+    const long long kLength = 100000;
+
+    TempFile file(kLength);
+    WebmUtil::MappedFile map;
+    ASSERT_TRUE(map.Open(file.handle_, kLength, 1 << 20));
+
+    std::vector<unsigned char> buf(1000);
+
+    for (long long pos = 0; pos + 1000 <= kLength; pos += 777)
+    {
+        ASSERT_EQ(0, map.Read(pos, 1000, &buf[0]));
+        ASSERT_TRUE(CheckRange(buf, pos));
+    }
+
+    EXPECT_EQ(0u, map.stats().remaps);
+
+    // Reads that extend past the end of the file fail.
+    EXPECT_GT(0, map.Read(kLength - 10, 11, &buf[0]));
+    EXPECT_EQ(0, map.Read(kLength - 10, 10, &buf[0]));
+}
+
+TEST(MappedFileTest, WindowMovesWithReads)
+{
+    const long long kLength = 1 << 20;
+
+    TempFile file(kLength);
+    WebmUtil::MappedFile map;
+
+    // The window is rounded up to the allocation granularity, which is
+    // at most 64KB on the platforms we support.
+    ASSERT_TRUE(map.Open(file.handle_, kLength, 1));
+
+    std::vector<unsigned char> buf(100);
+
+    ASSERT_EQ(0, map.Read(0, 100, &buf[0]));
+    EXPECT_TRUE(CheckRange(buf, 0));
+
+    ASSERT_EQ(0, map.Read(kLength - 100, 100, &buf[0]));
+    EXPECT_TRUE(CheckRange(buf, kLength - 100));
+    EXPECT_EQ(1u, map.stats().remaps);
+
+    ASSERT_EQ(0, map.Read(12345, 100, &buf[0]));
+    EXPECT_TRUE(CheckRange(buf, 12345));
+    EXPECT_EQ(2u, map.stats().remaps);
+
+    // A read larger than the window cannot be satisfied.
+    buf.resize(static_cast<size_t>(kLength));
+    EXPECT_GT(0, map.Read(0, static_cast<long>(kLength), &buf[0]));
+
+    map.Close();
+    EXPECT_FALSE(map.IsOpen());
+}
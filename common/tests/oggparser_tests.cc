@@ -0,0 +1,310 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "oggparser.h"
+
+namespace
+{
+
+using oggparser::IOggReader;
+using oggparser::OggPage;
+
+// Serves reads from memory, and counts them.
+class MemReader : public IOggReader
+{
+public:
+    explicit MemReader(const std::vector<unsigned char>& buf)
+        : buf_(buf), reads_(0)
+    {
+    }
+
+    virtual long Read(long long pos, long len, unsigned char* buf)
+    {
+        ++reads_;
+
+        if ((pos < 0) || (len < 0))
+            return -1;
+
+        if ((pos + len) > static_cast<long long>(buf_.size()))
+            return oggparser::E_END_OF_FILE;
+
+        if (len > 0)
+            memcpy(buf, &buf_[0] + pos, len);
+
+        return 0;
+    }
+
+    int reads() const { return reads_; }
+
+    std::vector<unsigned char> buf_;
+
+private:
+    int reads_;
+};
+
+void PutInt(std::vector<unsigned char>& buf, unsigned long long val, int len)
+{
+    for (int i = 0; i < len; ++i)
+        buf.push_back(static_cast<unsigned char>(val >> (i * 8)));
+}
+
+// Returns an Ogg page holding packets of the given lengths.  The last
+// packet is continued on the next page if |lengths| ends with a multiple
+// of 255.
+std::vector<unsigned char> MakePage(const std::vector<long>& lengths,
+                                    unsigned long serial_num,
+                                    unsigned long sequence_num,
+                                    long long granule_pos)
+{
+    std::vector<unsigned char> page;
+
+    page.insert(page.end(), "OggS", "OggS" + 4);
+    page.push_back(0);  // version
+    page.push_back(0);  // header type
+    PutInt(page, granule_pos, 8);
+    PutInt(page, serial_num, 4);
+    PutInt(page, sequence_num, 4);
+    PutInt(page, 0, 4);  // crc, filled in below
+
+    std::vector<unsigned char> lacing;
+    std::vector<unsigned char> payload;
+
+    for (size_t i = 0; i < lengths.size(); ++i)
+    {
+        long len = lengths[i];
+
+        for (long j = 0; j < len; ++j)
+            payload.push_back(static_cast<unsigned char>(i + j));
+
+        while (len >= 255)
+        {
+            lacing.push_back(255);
+            len -= 255;
+        }
+
+        if ((len > 0) || (i + 1 < lengths.size()) || lacing.empty())
+            lacing.push_back(static_cast<unsigned char>(len));
+    }
+
+    page.push_back(static_cast<unsigned char>(lacing.size()));
+    page.insert(page.end(), lacing.begin(), lacing.end());
+    page.insert(page.end(), payload.begin(), payload.end());
+
+    const unsigned long crc =
+        OggPage::ComputeCrc(0, &page[0], static_cast<long>(page.size()));
+
+    for (int i = 0; i < 4; ++i)
+        page[22 + i] = static_cast<unsigned char>(crc >> (i * 8));
+
+    return page;
+}
+
+}  // namespace
+
+TEST(OggParserTest, CrcOfKnownInput)
+{
+    // The CRC-32/CKSUM check value, without its final xor: polynomial
+    // 0x04C11DB7, initial value 0, unreflected.
+    const unsigned char buf[] = "123456789";
+    EXPECT_EQ(0x89A1897FUL, OggPage::ComputeCrc(0, buf, 9));
+
+    // Computing in pieces gives the same result.
+    const unsigned long crc = OggPage::ComputeCrc(0, buf, 4);
+    EXPECT_EQ(0x89A1897FUL, OggPage::ComputeCrc(crc, buf + 4, 5));
+}
+
+TEST(OggParserTest, ReadsHeaderAndSegmentTableInTwoReads)
+{
+    std::vector<long> lengths;
+    lengths.push_back(30);
+    lengths.push_back(600);
+    lengths.push_back(7);
+
+    MemReader reader(MakePage(lengths, 0x12345678, 3, 0x0102030405060708LL));
+
+    OggPage page;
+    long long pos = 0;
+
+    ASSERT_EQ(0, page.Read(&reader, pos));
+    EXPECT_EQ(2, reader.reads());
+
+    EXPECT_EQ(0x0102030405060708LL, page.granule_pos);
+    EXPECT_EQ(0x12345678UL, page.serial_num);
+    EXPECT_EQ(3UL, page.sequence_num);
+    EXPECT_TRUE((page.header & OggPage::fDone) != 0);
+    EXPECT_EQ(static_cast<long long>(reader.buf_.size()), pos);
+
+    ASSERT_EQ(3U, page.descriptors.size());
+
+    OggPage::descriptors_t::const_iterator i = page.descriptors.begin();
+    // 30 takes one lacing value, 600 takes three, and 7 takes one.
+    const long long payload_pos = OggPage::kHeaderSize + 5;
+
+    EXPECT_EQ(payload_pos, i->pos);
+    EXPECT_EQ(30, i->len);
+    ++i;
+    EXPECT_EQ(payload_pos + 30, i->pos);
+    EXPECT_EQ(600, i->len);
+    ++i;
+    EXPECT_EQ(payload_pos + 630, i->pos);
+    EXPECT_EQ(7, i->len);
+}
+
+TEST(OggParserTest, ContinuedPacketHasNegativeLength)
+{
+    std::vector<long> lengths;
+    lengths.push_back(10);
+    lengths.push_back(510);
+
+    MemReader reader(MakePage(lengths, 1, 0, -1));
+
+    OggPage page;
+    long long pos = 0;
+
+    ASSERT_EQ(0, page.Read(&reader, pos, true));
+    EXPECT_EQ(-1, page.granule_pos);
+    EXPECT_EQ(0, page.header & OggPage::fDone);
+
+    ASSERT_EQ(2U, page.descriptors.size());
+    EXPECT_EQ(-510, page.descriptors.back().len);
+}
+
+TEST(OggParserTest, VerifiesCrc)
+{
+    std::vector<long> lengths;
+    lengths.push_back(100);
+
+    MemReader reader(MakePage(lengths, 1, 0, 0));
+
+    OggPage page;
+    long long pos = 0;
+
+    ASSERT_EQ(0, page.Read(&reader, pos, true));
+
+    // Corrupt a payload byte: only a CRC check notices.
+    reader.buf_.back() ^= 0x01;
+
+    pos = 0;
+    EXPECT_EQ(0, page.Read(&reader, pos));
+
+    pos = 0;
+    EXPECT_EQ(oggparser::E_FILE_FORMAT_INVALID, page.Read(&reader, pos, true));
+}
+
+TEST(OggParserTest, RejectsBadCapturePattern)
+{
+    std::vector<long> lengths;
+    lengths.push_back(1);
+
+    MemReader reader(MakePage(lengths, 1, 0, 0));
+    reader.buf_[0] = 'X';
+
+    OggPage page;
+    long long pos = 0;
+
+    EXPECT_EQ(oggparser::E_FILE_FORMAT_INVALID, page.Read(&reader, pos));
+}
+
+TEST(OggParserTest, ReportsTruncatedPage)
+{
+    std::vector<long> lengths;
+    lengths.push_back(1);
+
+    MemReader reader(MakePage(lengths, 1, 0, 0));
+    reader.buf_.resize(OggPage::kHeaderSize - 1);
+
+    OggPage page;
+    long long pos = 0;
+
+    EXPECT_EQ(oggparser::E_END_OF_FILE, page.Read(&reader, pos));
+}
+
+TEST(OggParserTest, MatchComparesPayload)
+{
+    std::vector<long> lengths;
+    lengths.push_back(7);
+
+    std::vector<unsigned char> buf = MakePage(lengths, 1, 0, 0);
+    memcpy(&buf[OggPage::kHeaderSize + 1], "\x01vorbis", 7);
+
+    MemReader reader(buf);
+
+    OggPage page;
+    long long pos = 0;
+
+    ASSERT_EQ(0, page.Read(&reader, pos));
+    EXPECT_EQ(1, OggPage::Match(page.descriptors, &reader, "\x01vorbis"));
+    EXPECT_EQ(0, OggPage::Match(page.descriptors, &reader, "\x03vorbis"));
+}
+
+// Throughput benchmark; run with --gtest_also_run_disabled_tests.
+// Parses a long synthetic stream of pages shaped like those of a Vorbis
+// stream (about 4 KB of packets each), with and without checking the
+// page CRC.
+TEST(OggParserTest, DISABLED_PageThroughput)
+{
+    const unsigned long kPages = 20000;
+
+    std::vector<long> lengths;
+
+    for (int i = 0; i < 16; ++i)
+        lengths.push_back(200 + (i * 37) % 100);
+
+    std::vector<unsigned char> buf;
+
+    for (unsigned long n = 0; n < kPages; ++n)
+    {
+        const std::vector<unsigned char> page =
+            MakePage(lengths, 1, n, 1024LL * (n + 1));
+
+        buf.insert(buf.end(), page.begin(), page.end());
+    }
+
+    MemReader reader(buf);
+    const double mb = buf.size() / 1048576.0;
+
+    for (int verify = 0; verify < 2; ++verify)
+    {
+        const int kIterations = 10;
+        long total = 0;
+
+        OggPage page;
+
+        const std::clock_t start = std::clock();
+
+        for (int i = 0; i < kIterations; ++i)
+        {
+            long long pos = 0;
+
+            while (pos < static_cast<long long>(buf.size()))
+            {
+                ASSERT_EQ(0, page.Read(&reader, pos, verify != 0));
+                ++total;
+            }
+        }
+
+        const double secs = double(std::clock() - start) / CLOCKS_PER_SEC;
+        ASSERT_GT(secs, 0);
+        ASSERT_EQ(static_cast<long>(kIterations * kPages), total);
+
+        const double rate = total / secs;
+        std::printf("crc %s: parsed %ld pages in %.3f s: %.0f pages/s"
+                    " (%.0f MB/s)\n",
+                    verify ? "on" : "off", total, secs, rate,
+                    kIterations * mb / secs);
+
+        RecordProperty(verify ? "pages_per_second_crc" : "pages_per_second",
+                       static_cast<int>(rate));
+    }
+}
@@ -0,0 +1,279 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pagecache.h"
+
+namespace
+{
+
+// In-memory "file" whose byte at offset i is (i * 7) & 0xFF.
+class MemorySource : public WebmUtil::PageCache::Source
+{
+public:
+    explicit MemorySource(long long length) :
+        length_(length),
+        reads_(0),
+        fail_(false)
+    {
+    }
+
+    virtual long ReadPage(long long pos, long len, unsigned char* buf)
+    {
+        ++reads_;
+
+        if (fail_ || pos >= length_)
+            return -1;
+
+        const long long remaining = length_ - pos;
+        const long n = (remaining < len) ? static_cast<long>(remaining) : len;
+
+        for (long i = 0; i < n; ++i)
+            buf[i] = ByteAt(pos + i);
+
+        return n;
+    }
+
+    static unsigned char ByteAt(long long pos)
+    {
+        return static_cast<unsigned char>((pos * 7) & 0xFF);
+    }
+
+    long long length_;
+    int reads_;
+    bool fail_;
+};
+
+bool CheckRange(const std::vector<unsigned char>& buf, long long pos)
+{
+    for (size_t i = 0; i < buf.size(); ++i)
+    {
+        if (buf[i] != MemorySource::ByteAt(pos + i))
+            return false;
+    }
+
+    return true;
+}
+
+const long kPageSize = 16;
+const long kPageCount = 4;
+
+} // namespace
+
+TEST(PageCacheTest, InitRejectsBadArguments)
+{
+    WebmUtil::PageCache cache;
+    EXPECT_FALSE(cache.Init(0, kPageCount));
+    EXPECT_FALSE(cache.Init(kPageSize, 0));
+    EXPECT_TRUE(cache.Init(kPageSize, kPageCount));
+    EXPECT_EQ(kPageSize, cache.page_size());
+    EXPECT_EQ(kPageCount, cache.page_count());
+}
+
+TEST(PageCacheTest, ReadAcrossPages)
+{
+    MemorySource source(1000);
+    WebmUtil::PageCache cache;
+    ASSERT_TRUE(cache.Init(kPageSize, kPageCount));
+
+    std::vector<unsigned char> buf(40);
+    ASSERT_EQ(0, cache.Read(&source, 10, 40, &buf[0]));
+    EXPECT_TRUE(CheckRange(buf, 10));
+
+    // Bytes 10..49 touch pages 0 through 3.
+    EXPECT_EQ(4, source.reads_);
+    EXPECT_EQ(4u, cache.stats().misses);
+
+    ASSERT_EQ(0, cache.Read(&source, 20, 20, &buf[0]));
+    EXPECT_EQ(4, source.reads_);
+    EXPECT_EQ(2u, cache.stats().hits);
+    EXPECT_TRUE(cache.IsCached(63));
+    EXPECT_FALSE(cache.IsCached(64));
+}
+
+TEST(PageCacheTest, ReadPastEndFails)
+{
+    MemorySource source(40);
+    WebmUtil::PageCache cache;
+    ASSERT_TRUE(cache.Init(kPageSize, kPageCount));
+
+    std::vector<unsigned char> buf(8);
+    ASSERT_EQ(0, cache.Read(&source, 32, 8, &buf[0]));
+    EXPECT_TRUE(CheckRange(buf, 32));
+
+    EXPECT_GT(0, cache.Read(&source, 36, 8, &buf[0]));
+    EXPECT_GT(0, cache.Read(&source, 48, 1, &buf[0]));
+}
+
+TEST(PageCacheTest, SourceFailureIsNotCached)
+{
+    MemorySource source(1000);
+    WebmUtil::PageCache cache;
+    ASSERT_TRUE(cache.Init(kPageSize, kPageCount));
+
+    unsigned char byte;
+    source.fail_ = true;
+    EXPECT_GT(0, cache.Read(&source, 0, 1, &byte));
+    EXPECT_FALSE(cache.IsCached(0));
+
+    source.fail_ = false;
+    EXPECT_EQ(0, cache.Read(&source, 0, 1, &byte));
+    EXPECT_EQ(MemorySource::ByteAt(0), byte);
+}
+
+TEST(PageCacheTest, ClockEvictsUnreferencedPage)
+{
+    MemorySource source(1000);
+    WebmUtil::PageCache cache;
+    ASSERT_TRUE(cache.Init(kPageSize, kPageCount));
+
+    unsigned char byte;
+
+    for (long i = 0; i < kPageCount; ++i)
+        ASSERT_EQ(0, cache.Read(&source, i * kPageSize, 1, &byte));
+
+    // Cache is full; loading a fifth page must evict exactly one.
+    ASSERT_EQ(0, cache.Read(&source, kPageCount * kPageSize, 1, &byte));
+    EXPECT_EQ(1u, cache.stats().evictions);
+    EXPECT_TRUE(cache.IsCached(kPageCount * kPageSize));
+
+    int cached = 0;
+
+    for (long i = 0; i <= kPageCount; ++i)
+        cached += cache.IsCached(i * kPageSize) ? 1 : 0;
+
+    EXPECT_EQ(kPageCount, cached);
+}
+
+TEST(PageCacheTest, PinnedPagesAreNotEvicted)
+{
+    MemorySource source(kPageSize * 1000);
+    WebmUtil::PageCache cache;
+    ASSERT_TRUE(cache.Init(kPageSize, kPageCount));
+
+    // Pin the first two pages.
+    ASSERT_EQ(0, cache.Pin(&source, 0, 2 * kPageSize));
+
+    unsigned char byte;
+
+    for (long i = 2; i < 20; ++i)
+        ASSERT_EQ(0, cache.Read(&source, i * kPageSize, 1, &byte));
+
+    EXPECT_TRUE(cache.IsCached(0));
+    EXPECT_TRUE(cache.IsCached(kPageSize));
+
+    // Pin the remaining two pages; now nothing can be evicted.
+    ASSERT_EQ(0, cache.Pin(&source, 2 * kPageSize, 2 * kPageSize));
+    EXPECT_GT(0, cache.Read(&source, 100 * kPageSize, 1, &byte));
+
+    // A failed pin leaves no pages pinned.
+    cache.Unpin(2 * kPageSize, 2 * kPageSize);
+    ASSERT_EQ(0, cache.Read(&source, 2 * kPageSize, 1, &byte));
+    EXPECT_GT(0, cache.Pin(&source, 2 * kPageSize, 4 * kPageSize));
+
+    cache.Unpin(0, 2 * kPageSize);
+    EXPECT_EQ(0, cache.Read(&source, 100 * kPageSize, 1, &byte));
+}
+
+TEST(PageCacheTest, ManyPagesSurviveHashChurn)
+{
+    const long kCount = 64;
+
+    MemorySource source(kPageSize * 10000);
+    WebmUtil::PageCache cache;
+    ASSERT_TRUE(cache.Init(kPageSize, kCount));
+
+    std::vector<unsigned char> buf(kPageSize);
+
+    // Mixed sequential and strided access exercises the backward-shift
+    // deletion in the hash table.
+    for (long i = 0; i < 5000; ++i)
+    {
+        const long long pos = ((i * 37) % 9000) * kPageSize + (i % 5);
+        const long len = kPageSize - (i % 5);
+
+        buf.resize(len);
+        ASSERT_EQ(0, cache.Read(&source, pos, len, &buf[0]));
+        ASSERT_TRUE(CheckRange(buf, pos));
+    }
+
+    const WebmUtil::PageCache::Stats& stats = cache.stats();
+    EXPECT_EQ(stats.misses, static_cast<unsigned long long>(source.reads_));
+    EXPECT_EQ(stats.misses - kCount, stats.evictions);
+}
+
+// Throughput benchmark; run with --gtest_also_run_disabled_tests.
+// The reads mimic the parser: element headers a few bytes long, each
+// followed by a frame payload, walking a long file from start to end.
+// The cache is configured as WebmSource::MkvFile configures it.
+TEST(PageCacheTest, DISABLED_ReadThroughput)
+{
+    // Cheap source, so that the time measured is that of the cache.
+    class ZeroSource : public WebmUtil::PageCache::Source
+    {
+    public:
+        virtual long ReadPage(long long, long len, unsigned char* buf)
+        {
+            memset(buf, 0, len);
+            return len;
+        }
+    };
+
+    const long kBigPageSize = 64 * 1024;
+    const long kBigPageCount = 64;
+    const long long kLength = 1024LL * 1024 * 1024;
+
+    ZeroSource source;
+    WebmUtil::PageCache cache;
+    ASSERT_TRUE(cache.Init(kBigPageSize, kBigPageCount));
+
+    std::vector<unsigned char> buf(16 * 1024);
+
+    long long reads = 0;
+    long long bytes = 0;
+    long long pos = 0;
+
+    const std::clock_t start = std::clock();
+
+    for (long i = 0; pos < kLength; ++i)
+    {
+        const long header_len = 1 + (i % 8);
+        const long frame_len = 100 + (i * 7919) % 16000;
+
+        if (pos + header_len + frame_len > kLength)
+            break;
+
+        ASSERT_EQ(0, cache.Read(&source, pos, header_len, &buf[0]));
+        pos += header_len;
+
+        ASSERT_EQ(0, cache.Read(&source, pos, frame_len, &buf[0]));
+        pos += frame_len;
+
+        reads += 2;
+        bytes += header_len + frame_len;
+    }
+
+    const double secs = double(std::clock() - start) / CLOCKS_PER_SEC;
+    ASSERT_GT(secs, 0);
+
+    const WebmUtil::PageCache::Stats& stats = cache.stats();
+    const double hit_rate =
+        double(stats.hits) / double(stats.hits + stats.misses);
+
+    std::printf("%lld reads (%.0f MB) in %.3f s: %.0f reads/s, %.0f MB/s,"
+                " %.1f%% hits\n",
+                reads, bytes / 1048576.0, secs, reads / secs,
+                bytes / 1048576.0 / secs, 100 * hit_rate);
+
+    RecordProperty("reads_per_second", static_cast<int>(reads / secs));
+}
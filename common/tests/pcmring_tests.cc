@@ -0,0 +1,177 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pcmring.h"
+
+namespace
+{
+
+float SampleValue(int channel, long frame)
+{
+    return static_cast<float>(channel * 100000 + frame);
+}
+
+// Writes |count| frames numbered from |first| to |ring|.
+void WriteFrames(WebmUtil::PcmRing& ring, long first, long count)
+{
+    const int channels = ring.channels();
+
+    std::vector<std::vector<float> > planes(channels);
+    std::vector<const float*> ptrs(channels);
+
+    for (int c = 0; c < channels; ++c)
+    {
+        for (long i = 0; i < count; ++i)
+            planes[c].push_back(SampleValue(c, first + i));
+
+        ptrs[c] = planes[c].empty() ? 0 : &planes[c][0];
+    }
+
+    ring.Write(&ptrs[0], count);
+}
+
+// Reads |count| frames from |ring|, and checks they are numbered from
+// |first| and correctly interleaved.
+bool ReadFrames(WebmUtil::PcmRing& ring, long first, long count)
+{
+    const int channels = ring.channels();
+
+    std::vector<float> buf(count * channels);
+    ring.ReadInterleaved(&buf[0], count);
+
+    for (long i = 0; i < count; ++i)
+    {
+        for (int c = 0; c < channels; ++c)
+        {
+            if (buf[i * channels + c] != SampleValue(c, first + i))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+TEST(PcmRingTest, CapacityIsPowerOfTwo)
+{
+    WebmUtil::PcmRing ring;
+    ring.Init(2, 1000);
+    EXPECT_EQ(2, ring.channels());
+    EXPECT_EQ(1024, ring.capacity());
+    EXPECT_EQ(0, ring.size());
+}
+
+TEST(PcmRingTest, InterleavesEveryChannelCount)
+{
+    for (int channels = 1; channels <= 8; ++channels)
+    {
+        WebmUtil::PcmRing ring;
+        ring.Init(channels, 64);
+
+        WriteFrames(ring, 0, 37);
+        EXPECT_EQ(37, ring.size());
+        EXPECT_TRUE(ReadFrames(ring, 0, 37)) << "channels=" << channels;
+        EXPECT_EQ(0, ring.size());
+    }
+}
+
+TEST(PcmRingTest, WrapsAround)
+{
+    WebmUtil::PcmRing ring;
+    ring.Init(2, 16);
+
+    long written = 0;
+    long read = 0;
+
+    // Keep the ring partially full so that writes and reads straddle the
+    // end of the buffer.
+    for (int pass = 0; pass < 50; ++pass)
+    {
+        const long w = 3 + (pass % 7);
+        WriteFrames(ring, written, w);
+        written += w;
+
+        const long r = ring.size() > 5 ? ring.size() - 5 : ring.size();
+        ASSERT_TRUE(ReadFrames(ring, read, r));
+        read += r;
+    }
+
+    EXPECT_EQ(16, ring.capacity());
+    ASSERT_TRUE(ReadFrames(ring, read, ring.size()));
+}
+
+TEST(PcmRingTest, GrowsPreservingOrder)
+{
+    WebmUtil::PcmRing ring;
+    ring.Init(6, 8);
+
+    WriteFrames(ring, 0, 6);
+    ASSERT_TRUE(ReadFrames(ring, 0, 4));
+
+    // Wrapped contents must survive the reallocation.
+    WriteFrames(ring, 6, 100);
+    EXPECT_EQ(102, ring.size());
+    EXPECT_EQ(128, ring.capacity());
+
+    EXPECT_TRUE(ReadFrames(ring, 4, 102));
+}
+
+TEST(PcmRingTest, ReordersChannels)
+{
+    // Vorbis 5.1 (L, C, R, BL, BR, LFE) to WAVEFORMATEXTENSIBLE order.
+    const int map[6] = { 0, 2, 1, 5, 3, 4 };
+
+    WebmUtil::PcmRing ring;
+    ring.Init(6, 16);
+
+    // Straddle the end of the ring.
+    WriteFrames(ring, 0, 10);
+    ASSERT_TRUE(ReadFrames(ring, 0, 10));
+    WriteFrames(ring, 10, 12);
+
+    std::vector<float> buf(12 * 6);
+    ring.ReadInterleaved(&buf[0], 12, map);
+
+    for (long i = 0; i < 12; ++i)
+    {
+        for (int c = 0; c < 6; ++c)
+            EXPECT_EQ(SampleValue(map[c], 10 + i), buf[i * 6 + c]);
+    }
+}
+
+TEST(PcmRingTest, ReserveKeepsFrames)
+{
+    WebmUtil::PcmRing ring;
+    ring.Init(2, 8);
+
+    WriteFrames(ring, 0, 5);
+    ring.Reserve(100);
+    EXPECT_EQ(128, ring.capacity());
+
+    ring.Reserve(10);
+    EXPECT_EQ(128, ring.capacity());
+
+    EXPECT_TRUE(ReadFrames(ring, 0, 5));
+}
+
+TEST(PcmRingTest, ClearDiscardsFrames)
+{
+    WebmUtil::PcmRing ring;
+    ring.Init(2, 8);
+
+    WriteFrames(ring, 0, 5);
+    ring.Clear();
+    EXPECT_EQ(0, ring.size());
+
+    WriteFrames(ring, 10, 3);
+    EXPECT_TRUE(ReadFrames(ring, 10, 3));
+}
@@ -0,0 +1,307 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "vorbis/codec.h"
+#include "vorbis/vorbisenc.h"
+#include "vorbisdecoder.h"
+
+namespace
+{
+
+// Count of calls to the global operator new, replaced below.  Allocations
+// made by libvorbis itself (through malloc) are not counted.
+long g_allocation_count = 0;
+
+typedef std::vector<unsigned char> packet_t;
+typedef std::vector<packet_t> packets_t;
+
+// Encodes |frames| frames of a sine tone, returning the three headers and
+// the audio packets.
+void Encode(int channels, long rate, long frames,
+            packets_t& headers, packets_t& packets)
+{
+    vorbis_info vi;
+    vorbis_info_init(&vi);
+
+    int status = vorbis_encode_init_vbr(&vi, channels, rate, 0.4f);
+    ASSERT_EQ(0, status);
+
+    vorbis_comment vc;
+    vorbis_comment_init(&vc);
+
+    vorbis_dsp_state vd;
+    status = vorbis_analysis_init(&vd, &vi);
+    ASSERT_EQ(0, status);
+
+    vorbis_block vb;
+    status = vorbis_block_init(&vd, &vb);
+    ASSERT_EQ(0, status);
+
+    ogg_packet op[3];
+    status = vorbis_analysis_headerout(&vd, &vc, &op[0], &op[1], &op[2]);
+    ASSERT_EQ(0, status);
+
+    headers.clear();
+
+    for (int i = 0; i < 3; ++i)
+        headers.push_back(packet_t(op[i].packet, op[i].packet + op[i].bytes));
+
+    packets.clear();
+
+    const long kChunk = 1024;
+    long frame = 0;
+
+    for (;;)
+    {
+        const long n = (frames - frame < kChunk) ? frames - frame : kChunk;
+
+        if (n <= 0)
+            vorbis_analysis_wrote(&vd, 0);
+        else
+        {
+            float** const buf = vorbis_analysis_buffer(&vd, n);
+
+            for (int c = 0; c < channels; ++c)
+            {
+                const double hz = 220.0 * (c + 1);
+
+                for (long i = 0; i < n; ++i)
+                {
+                    const double t = double(frame + i) / rate;
+                    buf[c][i] = float(0.25 * std::sin(2 * 3.14159265 * hz * t));
+                }
+            }
+
+            vorbis_analysis_wrote(&vd, n);
+            frame += n;
+        }
+
+        while (vorbis_analysis_blockout(&vd, &vb) == 1)
+        {
+            vorbis_analysis(&vb, 0);
+            vorbis_bitrate_addblock(&vb);
+
+            ogg_packet p;
+
+            while (vorbis_bitrate_flushpacket(&vd, &p))
+                packets.push_back(packet_t(p.packet, p.packet + p.bytes));
+        }
+
+        if (n <= 0)
+            break;
+    }
+
+    vorbis_block_clear(&vb);
+    vorbis_dsp_clear(&vd);
+    vorbis_comment_clear(&vc);
+    vorbis_info_clear(&vi);
+}
+
+void CreateDecoder(WebmMfVorbisDecLib::VorbisDecoder& decoder,
+                   const packets_t& headers)
+{
+    const unsigned char* ptrs[3];
+    unsigned long lengths[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ptrs[i] = &headers[i][0];
+        lengths[i] = static_cast<unsigned long>(headers[i].size());
+    }
+
+    ASSERT_EQ(0, decoder.CreateDecoder(ptrs, lengths, 3));
+}
+
+int Decode(WebmMfVorbisDecLib::VorbisDecoder& decoder, packet_t& packet)
+{
+    const unsigned int len = static_cast<unsigned int>(packet.size());
+    return decoder.Decode(&packet[0], len);
+}
+
+// Consumes whole output buffers of |count| frames, as the decoder filters
+// do, and returns the number of frames consumed.  If |drain| is true the
+// remainder is consumed too.
+long Consume(WebmMfVorbisDecLib::VorbisDecoder& decoder,
+             std::vector<float>& buf,
+             unsigned int count,
+             bool drain)
+{
+    long total = 0;
+
+    for (;;)
+    {
+        unsigned int available;
+
+        if (decoder.GetOutputSamplesAvailable(&available) != 0)
+            return -1;
+
+        if (available == 0)
+            break;
+
+        if (available < count)
+        {
+            if (!drain)
+                break;
+
+            count = available;
+        }
+
+        if (decoder.ConsumeOutputSamples(&buf[0], count) != 0)
+            return -1;
+
+        total += count;
+    }
+
+    return total;
+}
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    ++g_allocation_count;
+
+    void* const p = std::malloc(size ? size : 1);
+
+    if (p == 0)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete(void* p) throw()
+{
+    std::free(p);
+}
+
+TEST(VorbisDecoderTest, DecodesEveryFrame)
+{
+    const long kRate = 44100;
+    const long kFrames = 3 * kRate;
+
+    packets_t headers, packets;
+    Encode(2, kRate, kFrames, headers, packets);
+    ASSERT_FALSE(packets.empty());
+
+    WebmMfVorbisDecLib::VorbisDecoder decoder;
+    CreateDecoder(decoder, headers);
+    EXPECT_EQ(kRate, decoder.GetVorbisRate());
+    EXPECT_EQ(2, decoder.GetVorbisChannels());
+
+    const unsigned int kCount = kRate / 10;
+    std::vector<float> buf(kCount * 2);
+
+    long total = 0;
+
+    for (size_t i = 0; i < packets.size(); ++i)
+    {
+        ASSERT_EQ(0, Decode(decoder, packets[i]));
+        total += Consume(decoder, buf, kCount, false);
+    }
+
+    total += Consume(decoder, buf, kCount, true);
+
+    // Without granule positions to trim the last packet, the decoder may
+    // return up to a long block more than was encoded.
+    EXPECT_GE(total, kFrames);
+    EXPECT_LE(total, kFrames + 8192);
+}
+
+TEST(VorbisDecoderTest, SteadyStateDoesNotAllocate)
+{
+    const long kRate = 48000;
+    const int kChannels = 6;  // exercises the channel map
+
+    packets_t headers, packets;
+    Encode(kChannels, kRate, 5 * kRate, headers, packets);
+    ASSERT_GT(packets.size(), 20u);
+
+    WebmMfVorbisDecLib::VorbisDecoder decoder;
+    CreateDecoder(decoder, headers);
+
+    // Room for one output buffer, plus the largest Vorbis block, as the
+    // DirectShow inpin reserves.
+    const unsigned int kCount = kRate / 10;
+    decoder.ReserveOutputSamples(kCount + 8192);
+
+    std::vector<float> buf(kCount * kChannels);
+
+    const size_t kWarmup = 10;
+
+    for (size_t i = 0; i < kWarmup; ++i)
+    {
+        ASSERT_EQ(0, Decode(decoder, packets[i]));
+        ASSERT_GE(Consume(decoder, buf, kCount, false), 0);
+    }
+
+    const long count_before = g_allocation_count;
+
+    for (size_t i = kWarmup; i < packets.size(); ++i)
+    {
+        ASSERT_EQ(0, Decode(decoder, packets[i]));
+        ASSERT_GE(Consume(decoder, buf, kCount, false), 0);
+    }
+
+    ASSERT_GE(Consume(decoder, buf, kCount, true), 0);
+
+    EXPECT_EQ(count_before, g_allocation_count);
+}
+
+// Throughput benchmark; run with --gtest_also_run_disabled_tests.
+TEST(VorbisDecoderTest, DISABLED_DecodeThroughput)
+{
+    const long kRate = 48000;
+    const int kChannels = 2;
+    const long kFrames = 60 * kRate;
+
+    packets_t headers, packets;
+    Encode(kChannels, kRate, kFrames, headers, packets);
+
+    WebmMfVorbisDecLib::VorbisDecoder decoder;
+    CreateDecoder(decoder, headers);
+
+    const unsigned int kCount = kRate / 10;
+    decoder.ReserveOutputSamples(kCount + 8192);
+
+    std::vector<float> buf(kCount * kChannels);
+
+    const int kIterations = 10;
+    long total = 0;
+
+    const std::clock_t start = std::clock();
+
+    for (int n = 0; n < kIterations; ++n)
+    {
+        decoder.Flush();
+
+        for (size_t i = 0; i < packets.size(); ++i)
+        {
+            ASSERT_EQ(0, Decode(decoder, packets[i]));
+            total += Consume(decoder, buf, kCount, false);
+        }
+
+        total += Consume(decoder, buf, kCount, true);
+    }
+
+    const double secs = double(std::clock() - start) / CLOCKS_PER_SEC;
+    ASSERT_GT(secs, 0);
+
+    const double rate = total / secs;
+    std::printf("decoded %ld frames in %.3f s: %.0f frames/s (%.0fx)\n",
+                total, secs, rate, rate / kRate);
+
+    RecordProperty("frames_per_second", static_cast<int>(rate));
+}
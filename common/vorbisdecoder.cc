@@ -7,38 +7,111 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #include <cassert>
-#include <cmath>
-#include <vector>
+#include <cstring>
 
 #ifdef _WIN32
 #include "mferror.h"
 #include "windows.h"
 #include "mmreg.h"
 #else
-// note: need SPEAKER_X_Y definitions w/o mmreg.h
-//
-// Define HRESULT and MF_E_TRANSFORM_NEED_MORE_INPUT in a very very lame
-// first step toward making VorbisDecoder cross platform:
+// Elsewhere, define the status codes and speaker positions we use, with the
+// same values as the Windows SDK, so that callers see identical results.
 typedef long HRESULT;
 #define _HRESULT_TYPEDEF_(_sc) ((HRESULT)_sc)
+#define S_OK                             ((HRESULT)0L)
+#define E_FAIL                           _HRESULT_TYPEDEF_(0x80004005L)
+#define E_INVALIDARG                     _HRESULT_TYPEDEF_(0x80070057L)
 #define MF_E_TRANSFORM_NEED_MORE_INPUT   _HRESULT_TYPEDEF_(0xC00D6D72L)
+#define FAILED(hr)                       (((HRESULT)(hr)) < 0)
+
+#define SPEAKER_FRONT_LEFT               0x1
+#define SPEAKER_FRONT_RIGHT              0x2
+#define SPEAKER_FRONT_CENTER             0x4
+#define SPEAKER_LOW_FREQUENCY            0x8
+#define SPEAKER_BACK_LEFT                0x10
+#define SPEAKER_BACK_RIGHT               0x20
+#define SPEAKER_BACK_CENTER              0x100
+#define SPEAKER_SIDE_LEFT                0x200
+#define SPEAKER_SIDE_RIGHT               0x400
 #endif
 
-#include "debugutil.h"
 #include "vorbisdecoder.h"
 
+namespace
+{
+
+// On channel ordering, from the vorbis spec:
+// http://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-800004.3.9
+// one channel
+//   the stream is monophonic
+// two channels
+//   the stream is stereo. channel order: left, right
+// three channels
+//   the stream is a 1d-surround encoding. channel order: left, center,
+//   right
+// four channels
+//   the stream is quadraphonic surround. channel order: front left, front
+//   right, rear left, rear right
+// five channels
+//   the stream is five-channel surround. channel order: front left,
+//   center, front right, rear left, rear right
+// six channels
+//   the stream is 5.1 surround. channel order: front left, center,
+//   front right, rear left, rear right, LFE
+// seven channels
+//   the stream is 6.1 surround. channel order: front left, center,
+//   front right, side left, side right, rear center, LFE
+// eight channels
+//   the stream is 7.1 surround. channel order: front left, center,
+//   front right, side left, side right, rear left, rear right, LFE
+// greater than eight channels
+//   channel use and order is defined by the application
+//
+// Each table gives, for each output (WAVEFORMATEXTENSIBLE) channel, the
+// libvorbis channel it is taken from.  For mono/stereo/quadrophonic
+// stereo/>8 channels the libvorbis order is used as is: it's correct for the
+// formats named, and at present the Vorbis spec says streams w/>8 channels
+// have user defined channel order.
+
+const int kMap3[3] = { 0, 2, 1 };  // FL FR FC
+const int kMap5[5] = { 0, 2, 1, 3, 4 };  // FL FR FC BL BR
+const int kMap6[6] = { 0, 2, 1, 5, 3, 4 };  // FL FR FC LFE BL BR
+const int kMap7[7] = { 0, 2, 1, 6, 5, 3, 4 };  // FL FR FC LFE BC SL SR
+const int kMap8[8] = { 0, 2, 1, 7, 5, 6, 3, 4 };  // FL FR FC LFE BL BR SL SR
+
+const int* GetChannelMap(int vorbis_channels)
+{
+    switch (vorbis_channels)
+    {
+        case 3:
+            return kMap3;
+        case 5:
+            return kMap5;
+        case 6:
+            return kMap6;
+        case 7:
+            return kMap7;
+        case 8:
+            return kMap8;
+        default:
+            return 0;
+    }
+}
+
+}  // namespace
+
 namespace WebmMfVorbisDecLib
 {
 
 VorbisDecoder::VorbisDecoder() :
   m_ogg_packet_count(0),
-  m_bytes_per_sample(sizeof(float))
+  m_channel_map(0)
 {
-    ::memset(&m_vorbis_info, 0, sizeof vorbis_info);
-    ::memset(&m_vorbis_comment, 0, sizeof vorbis_comment);
-    ::memset(&m_vorbis_state, 0, sizeof vorbis_dsp_state);
-    ::memset(&m_vorbis_block, 0, sizeof vorbis_block);
-    ::memset(&m_ogg_packet, 0, sizeof ogg_packet);
+    ::memset(&m_vorbis_info, 0, sizeof(vorbis_info));
+    ::memset(&m_vorbis_comment, 0, sizeof(vorbis_comment));
+    ::memset(&m_vorbis_state, 0, sizeof(vorbis_dsp_state));
+    ::memset(&m_vorbis_block, 0, sizeof(vorbis_block));
+    ::memset(&m_ogg_packet, 0, sizeof(ogg_packet));
 }
 
 VorbisDecoder::~VorbisDecoder()
@@ -46,7 +119,8 @@ VorbisDecoder::~VorbisDecoder()
     DestroyDecoder();
 }
 
-int VorbisDecoder::NextOggPacket_(const BYTE* ptr_packet, DWORD packet_size)
+int VorbisDecoder::NextOggPacket_(const unsigned char* ptr_packet,
+                                  unsigned long packet_size)
 {
     if (!ptr_packet || packet_size == 0)
         return E_INVALIDARG;
@@ -57,14 +131,14 @@ int VorbisDecoder::NextOggPacket_(const BYTE* ptr_packet, DWORD packet_size)
     // TODO(tomfinegan): implement End Of Stream handling
     m_ogg_packet.e_o_s = 0;
     m_ogg_packet.granulepos = 0;
-    m_ogg_packet.packet = const_cast<BYTE*>(ptr_packet);
+    m_ogg_packet.packet = const_cast<unsigned char*>(ptr_packet);
     m_ogg_packet.packetno = m_ogg_packet_count++;
 
     return S_OK;
 }
 
-int VorbisDecoder::CreateDecoder(const BYTE** const ptr_headers,
-                                 const DWORD* const header_lengths,
+int VorbisDecoder::CreateDecoder(const unsigned char** const ptr_headers,
+                                 const unsigned long* const header_lengths,
                                  unsigned int num_headers)
 {
     assert(ptr_headers);
@@ -80,7 +154,7 @@ int VorbisDecoder::CreateDecoder(const BYTE** const ptr_headers,
     int status;
 
     // feed the ident and comment headers into libvorbis
-    for (BYTE header_num = 0; header_num < 3; ++header_num)
+    for (unsigned int header_num = 0; header_num < 3; ++header_num)
     {
         assert(header_lengths[header_num] > 0);
 
@@ -109,32 +183,41 @@ int VorbisDecoder::CreateDecoder(const BYTE** const ptr_headers,
     assert(m_vorbis_info.rate > 0);
     assert(m_vorbis_info.channels > 0);
 
+    // A packet yields at most half a long block of samples, so this holds
+    // the output of two packets before the arena must grow.
+    const int blocksize_1 = vorbis_info_blocksize(&m_vorbis_info, 1);
+    assert(blocksize_1 > 0);
+
+    m_output_samples.Init(m_vorbis_info.channels, blocksize_1);
+    m_channel_map = GetChannelMap(m_vorbis_info.channels);
+
     return S_OK;
 }
 
-int VorbisDecoder::CreateDecoderFromBuffer(const BYTE* const ptr_buffer,
-                                           UINT size)
+int VorbisDecoder::CreateDecoderFromBuffer(
+    const unsigned char* const ptr_buffer,
+    unsigned int size)
 {
-    const BYTE* ptr_vorbis_headers = ptr_buffer;
-    const BYTE* const end = ptr_vorbis_headers + size;
+    const unsigned char* ptr_vorbis_headers = ptr_buffer;
+    const unsigned char* const end = ptr_vorbis_headers + size;
 
     // read the id and comment header lengths
-    const DWORD id_len = *ptr_vorbis_headers++;
-    const DWORD comments_len = *ptr_vorbis_headers++;
+    const unsigned long id_len = *ptr_vorbis_headers++;
+    const unsigned long comments_len = *ptr_vorbis_headers++;
     // |ptr_vorbis_headers| points to first header, set full private data
     // length:
-    const INT64 total_len_ = end - ptr_vorbis_headers;
-    const DWORD total_len = (DWORD)total_len_;
+    const long long total_len_ = end - ptr_vorbis_headers;
+    const unsigned long total_len = (unsigned long)total_len_;
     // and calculate the length of the setup header
-    const DWORD setup_len = total_len - id_len + comments_len;
+    const unsigned long setup_len = total_len - id_len + comments_len;
     // set the pointer to each vorbis header
-    const BYTE* const ptr_id = ptr_vorbis_headers;
-    const BYTE* const ptr_comments = ptr_id + id_len;
-    const BYTE* const ptr_setup = ptr_comments + comments_len;
+    const unsigned char* const ptr_id = ptr_vorbis_headers;
+    const unsigned char* const ptr_comments = ptr_id + id_len;
+    const unsigned char* const ptr_setup = ptr_comments + comments_len;
 
     // store the header pointers and lengths for CreateDecoder's use
-    const BYTE* header_ptrs[3] = {ptr_id, ptr_comments, ptr_setup};
-    const DWORD header_lengths[3] = {id_len, comments_len, setup_len};
+    const unsigned char* header_ptrs[3] = {ptr_id, ptr_comments, ptr_setup};
+    const unsigned long header_lengths[3] = {id_len, comments_len, setup_len};
 
     return CreateDecoder(header_ptrs, header_lengths,
                          VORBIS_SETUP_HEADER_COUNT);
@@ -151,10 +234,17 @@ void VorbisDecoder::DestroyDecoder()
     // note, from vorbis decoder sample: vorbis_info_clear must be last call
     vorbis_info_clear(&m_vorbis_info);
 
-    m_output_samples.clear();
+    m_output_samples.Init(0, 0);
+    m_channel_map = 0;
+}
+
+bool VorbisDecoder::IsOpen() const
+{
+    // vorbis_info_clear zeroes the info struct
+    return (m_vorbis_info.channels > 0);
 }
 
-int VorbisDecoder::Decode(BYTE* ptr_samples, UINT32 length)
+int VorbisDecoder::Decode(unsigned char* ptr_samples, unsigned int length)
 {
     int status = NextOggPacket_(ptr_samples, length);
     if (FAILED(status))
@@ -171,59 +261,47 @@ int VorbisDecoder::Decode(BYTE* ptr_samples, UINT32 length)
     if (status != 0)
       return E_FAIL;
 
-    // Consume all PCM samples from libvorbis
-    // Notes:
-    // - channel reordering is performed only when necessary
-    // - all streams w/>2 channels require inteleaving
-    return ReorderAndInterleave_();
+    // Consume all PCM samples from libvorbis; channel reordering and
+    // interleaving are deferred until the samples are consumed.
+    return ReadPcm_();
 }
 
-int VorbisDecoder::GetOutputSamplesAvailable(UINT32* ptr_num_samples_available)
+void VorbisDecoder::ReserveOutputSamples(unsigned int count)
+{
+    m_output_samples.Reserve(count);
+}
+
+int VorbisDecoder::GetOutputSamplesAvailable(
+    unsigned int* ptr_num_samples_available)
 {
     if (!ptr_num_samples_available)
         return E_INVALIDARG;
 
-    const pcm_samples_t::size_type samples_size = m_output_samples.size();
-    const UINT32 total_samples_available = static_cast<UINT32>(samples_size);
-    const UINT32 channels = m_vorbis_info.channels;
-
-    if (channels > 1)
-    {
-        // caller wants the total samples, not the size of the sample vector
-        *ptr_num_samples_available =
-            (total_samples_available + (channels - 1)) / channels;
-    }
-    else
-    {
-        // for mono the size of the samples vector is the number of samples
-        *ptr_num_samples_available = total_samples_available;
-    }
+    // the arena counts samples (blocks), not individual channel values
+    *ptr_num_samples_available =
+        static_cast<unsigned int>(m_output_samples.size());
 
     return S_OK;
 }
 
 int VorbisDecoder::ConsumeOutputSamples(float* ptr_out_sample_buffer,
-                                        UINT32 blocks_to_consume)
+                                        unsigned int blocks_to_consume)
 {
     if (!ptr_out_sample_buffer || !blocks_to_consume)
         return E_INVALIDARG;
 
-    if (m_output_samples.empty())
+    if (m_output_samples.size() <= 0)
         return MF_E_TRANSFORM_NEED_MORE_INPUT;
 
-    const UINT32 samples_to_consume = blocks_to_consume *
-                                      m_vorbis_info.channels;
-
-    const UINT32 bytes_to_copy = samples_to_consume * m_bytes_per_sample;
-    ::memcpy(ptr_out_sample_buffer, &m_output_samples[0], bytes_to_copy);
+    const long count = blocks_to_consume;
 
-    typedef pcm_samples_t::const_iterator pcm_iterator;
-    pcm_iterator pcm_begin = m_output_samples.begin();
-
-    assert(samples_to_consume <= m_output_samples.size());
-    const pcm_iterator pcm_end = pcm_begin + samples_to_consume;
+    assert(count <= m_output_samples.size());
+    if (count > m_output_samples.size())
+        return E_INVALIDARG;
 
-    m_output_samples.erase(pcm_begin, pcm_end);
+    m_output_samples.ReadInterleaved(ptr_out_sample_buffer,
+                                     count,
+                                     m_channel_map);
 
     return S_OK;
 }
@@ -231,137 +309,28 @@ int VorbisDecoder::ConsumeOutputSamples(float* ptr_out_sample_buffer,
 void VorbisDecoder::Flush()
 {
     vorbis_synthesis_restart(&m_vorbis_state);
-    m_output_samples.clear();
+    m_output_samples.Clear();
 }
 
-void VorbisDecoder::ReorderAndInterleaveBlock_(float** ptr_blocks, int sample)
-{
-    const int vorbis_channels = m_vorbis_info.channels;
-    assert(vorbis_channels > 0);
-
-    // On channel ordering, from the vorbis spec:
-    // http://xiph.org/vorbis/doc/Vorbis_I_spec.html#x1-800004.3.9
-    // one channel
-    //   the stream is monophonic
-    // two channels
-    //   the stream is stereo. channel order: left, right
-    // three channels
-    //   the stream is a 1d-surround encoding. channel order: left, center,
-    //   right
-    // four channels
-    //   the stream is quadraphonic surround. channel order: front left, front
-    //   right, rear left, rear right
-    // five channels
-    //   the stream is five-channel surround. channel order: front left,
-    //   center, front right, rear left, rear right
-    // six channels
-    //   the stream is 5.1 surround. channel order: front left, center,
-    //   front right, rear left, rear right, LFE
-    // seven channels
-    //   the stream is 6.1 surround. channel order: front left, center,
-    //   front right, side left, side right, rear center, LFE
-    // eight channels
-    //   the stream is 7.1 surround. channel order: front left, center,
-    //   front right, side left, side right, rear left, rear right, LFE
-    // greater than eight channels
-    //   channel use and order is defined by the application
-
-    switch (vorbis_channels)
-    {
-        case 3:
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            break;
-        case 5:
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[3][sample]); // BL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // BR
-            break;
-        case 6:
-            // WebM Vorbis decode multi-channel ordering
-            // 5.1 Vorbis to PCM (Decoding)
-            // Vorbis                PCM
-            // 0 Front Left   => 0 Front Left
-            // 1 Front Center => 2 Front Right
-            // 2 Front Right  => 1 Front Center
-            // 3 Back Left    => 5 LFE
-            // 4 Back Right   => 3 Back Left
-            // 5 LFE          => 4 Back Right
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[5][sample]); // LFE
-            m_output_samples.push_back(ptr_blocks[3][sample]); // BL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // BR
-            break;
-        case 7:
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[6][sample]); // LFE
-            m_output_samples.push_back(ptr_blocks[5][sample]); // BC
-            m_output_samples.push_back(ptr_blocks[3][sample]); // SL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // SR
-            break;
-        case 8:
-            // 7.1 Vorbis to PCM (Decoding)
-            // Vorbis             PCM
-            // 0 Front Left   => 0 Front Left
-            // 1 Front Center => 2 Front Right
-            // 2 Front Right  => 1 Front Center
-            // 3 Side Left    => 7 LFE
-            // 4 Side Right   => 5 Back Left
-            // 5 Back Left    => 6 Back Right
-            // 6 Back Right   => 3 Side Left
-            // 7 LFE          => 4 Side Right
-            m_output_samples.push_back(ptr_blocks[0][sample]); // FL
-            m_output_samples.push_back(ptr_blocks[2][sample]); // FR
-            m_output_samples.push_back(ptr_blocks[1][sample]); // FC
-            m_output_samples.push_back(ptr_blocks[7][sample]); // LFE
-            m_output_samples.push_back(ptr_blocks[5][sample]); // BL
-            m_output_samples.push_back(ptr_blocks[6][sample]); // BR
-            m_output_samples.push_back(ptr_blocks[3][sample]); // SL
-            m_output_samples.push_back(ptr_blocks[4][sample]); // SR
-            break;
-        case 1:
-        case 2:
-        case 4:
-        default:
-            // For mono/stereo/quadrophonic stereo/>8 channels: output in the
-            // order libvorbis uses.  It's correct for the formats named, and
-            // at present the Vorbis spec says streams w/>8 channels have user
-            // defined channel order.
-            for (int channel = 0; channel < vorbis_channels; ++channel)
-                m_output_samples.push_back(ptr_blocks[channel][sample]);
-    }
-
-
-}
-
-int VorbisDecoder::ReorderAndInterleave_()
+int VorbisDecoder::ReadPcm_()
 {
     int samples = 0;
     float** pp_pcm;
     vorbis_dsp_state* const ptr_state = &m_vorbis_state;
     while ((samples = vorbis_synthesis_pcmout(ptr_state, &pp_pcm)) > 0)
     {
-        for (int sample = 0; sample < samples; ++sample)
-            ReorderAndInterleaveBlock_(pp_pcm, sample);
-
+        m_output_samples.Write(pp_pcm, samples);
         vorbis_synthesis_read(ptr_state, samples);
     }
     return S_OK;
 }
 
-UINT32 VorbisDecoder::GetChannelMask() const
+unsigned int VorbisDecoder::GetChannelMask() const
 {
     assert(m_vorbis_info.channels > 0);
     const int vorbis_channels = m_vorbis_info.channels;
 
-    UINT32 mask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+    unsigned int mask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
     switch (vorbis_channels)
     {
         case 2:
@@ -9,30 +9,41 @@
 #ifndef _MEDIAFOUNDATION_WEBMMFVORBISDEC_VORBISDECODER_HPP_
 #define _MEDIAFOUNDATION_WEBMMFVORBISDEC_VORBISDECODER_HPP_
 
+#include "pcmring.h"
 #include "vorbis/codec.h"
 
 namespace WebmMfVorbisDecLib
 {
 
-const UINT32 VORBIS_SETUP_HEADER_COUNT = 3;
+const unsigned int VORBIS_SETUP_HEADER_COUNT = 3;
 
+// Platform neutral Vorbis decoder, shared by the DirectShow and Media
+// Foundation decoder filters.  Decoded PCM is held in planar form in an
+// arena sized from the stream's long block size, and is reordered to
+// WAVEFORMATEXTENSIBLE channel order as it is interleaved into the
+// caller's buffer, so decoding does not allocate in the steady state.
 class VorbisDecoder
 {
 public:
     VorbisDecoder();
     ~VorbisDecoder();
-    int CreateDecoder(const BYTE** const ptr_headers,
-                      const DWORD* const header_lengths,
+    int CreateDecoder(const unsigned char** const ptr_headers,
+                      const unsigned long* const header_lengths,
                       unsigned int num_headers /* must be == 3 */);
-    int CreateDecoderFromBuffer(const BYTE* const ptr_buffer, UINT size);
+    int CreateDecoderFromBuffer(const unsigned char* const ptr_buffer,
+                                unsigned int size);
 
     void DestroyDecoder();
+    bool IsOpen() const;
 
-    int Decode(BYTE* ptr_samples, UINT32 length);
+    int Decode(unsigned char* ptr_samples, unsigned int length);
 
-    int GetOutputSamplesAvailable(UINT32* ptr_num_samples_available);
+    // Ensures that |count| samples can be buffered without reallocating.
+    void ReserveOutputSamples(unsigned int count);
+
+    int GetOutputSamplesAvailable(unsigned int* ptr_num_samples_available);
     int ConsumeOutputSamples(float* ptr_out_sample_buffer,
-                             UINT32 blocks_to_consume);
+                             unsigned int blocks_to_consume);
     void Flush();
 
     int GetVorbisRate() const
@@ -44,31 +55,31 @@ public:
         return m_vorbis_info.channels;
     };
 
-    UINT32 GetChannelMask() const;
+    unsigned int GetChannelMask() const;
 
 private:
-    int NextOggPacket_(const BYTE* ptr_packet, DWORD packet_size);
+    int NextOggPacket_(const unsigned char* ptr_packet,
+                       unsigned long packet_size);
 
-    void ReorderAndInterleaveBlock_(float** ptr_blocks, int sample);
-    int ReorderAndInterleave_();
+    int ReadPcm_();
 
     ogg_packet m_ogg_packet;
-    DWORD m_ogg_packet_count;
+    unsigned long m_ogg_packet_count;
 
     vorbis_info m_vorbis_info; // contains static bitstream settings
     vorbis_comment m_vorbis_comment; // contains user comments
     vorbis_dsp_state m_vorbis_state; // decoder state
     vorbis_block m_vorbis_block; // working space for packet->PCM decode
 
-    const int m_bytes_per_sample;
-
-    WAVEFORMATEX m_wave_format;
+    // decoded samples not yet consumed, in libvorbis channel order
+    WebmUtil::PcmRing m_output_samples;
 
-    typedef std::vector<float> pcm_samples_t;
-    pcm_samples_t m_output_samples;
+    // output channel to libvorbis channel, or NULL when they match
+    const int* m_channel_map;
 
     // disallow copy and assign
-    DISALLOW_COPY_AND_ASSIGN(VorbisDecoder);
+    VorbisDecoder(const VorbisDecoder&);
+    VorbisDecoder& operator=(const VorbisDecoder&);
 };
 
 } // namespace WebmMfVorbisDecLib
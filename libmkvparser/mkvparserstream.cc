@@ -25,7 +25,10 @@ namespace mkvparser
 
 Stream::Stream(const Track* pTrack) :
     m_pTrack(pTrack),
-    m_pLocked(0)
+    m_pLocked(0),
+    m_index_pos(0),
+    m_pIndexCluster(0),
+    m_bIndexComplete(false)
 {
     Init();
 }
@@ -42,6 +45,7 @@ void Stream::Init()
     m_base_time_ns = -1;
     //m_pBase = 0;
     SetCurr(0);  //lazy init this later
+    ClearIndex();
     m_pStop = m_pTrack->GetEOS();  //means play entire stream
     m_bDiscontinuity = true;
 }
@@ -276,6 +280,7 @@ void Stream::SetCurrPosition(
 {
     //m_pBase = pBase;
     SetCurr(pCurr);
+    ClearIndex();
     m_base_time_ns = base_time_ns;
     m_bDiscontinuity = true;
 }
@@ -335,7 +340,7 @@ void Stream::SetStopPosition(
 
         case AM_SEEKING_AbsolutePositioning:
         {
-            tStop_ns = stoppos_reftime;
+            tStop_ns = stoppos_ns;
             break;
         }
         case AM_SEEKING_RelativePositioning:
@@ -394,7 +399,7 @@ void Stream::SetStopPosition(
     const Cluster* pStopCluster = pSegment->FindCluster(tStop_ns);
     assert(pStopCluster);
 
-    if (pStopCluster == m_pCurr->GetCluster())
+    if ((m_pCurr != 0) && (pStopCluster == m_pCurr->GetCluster()))
         pStopCluster = pSegment->GetNext(pStopCluster);
 
     m_pStop = pStopCluster->GetEntry(m_pTrack);
@@ -534,11 +539,34 @@ HRESULT Stream::GetSampleCount(long& count)
         return S_FALSE;  //EOS
     }
 
-    const Block* const pCurrBlock = m_pCurr->GetBlock();
-    assert(pCurrBlock);
-    assert(pCurrBlock->GetTrackNumber() == m_pTrack->GetNumber());
+    assert(!m_pCurr->EOS());
+
+    UpdateIndex();
+
+    const IndexEntry& curr = m_index[m_index_pos];
+    assert(curr.pEntry == m_pCurr);
+
+    //If the next block isn't loaded yet, or the current block is to be
+    //thrown away, then PopulateSamples will deal with just this block.
+
+    if (((m_index_pos + 1) >= m_index.size()) || !IsBatchable(m_index_pos))
+    {
+        count = curr.frames;
+        return S_OK;
+    }
+
+    //Blocks are populated together, as many as fit in half of the
+    //buffers, so that the downstream filter can hold on to some samples
+    //while we wait for the rest.
+
+    long limit = GetBufferCount() / 2;
+
+    if (limit < curr.frames)
+        limit = curr.frames;
+
+    index_t::size_type n;
 
-    count = pCurrBlock->GetFrameCount();
+    count = GetBatch(limit, n);
     assert(count <= GetBufferCount());
 
     return S_OK;
@@ -567,54 +595,195 @@ HRESULT Stream::PopulateSamples(const samples_t& samples)
 
     assert(!m_pCurr->EOS());
 
-    const BlockEntry* pNext;
-    const long status = m_pTrack->GetNext(m_pCurr, pNext);
+    UpdateIndex();
 
-    if (status == E_BUFFER_NOT_FULL)
+    if ((m_index_pos + 1) >= m_index.size())
         return VFW_E_BUFFER_UNDERFLOW;
 
-    assert(status >= 0);  //success
-    assert(pNext);
+    if (!IsBatchable(m_index_pos))
+    {
+        Advance();  //throw curr block away
+        return 2;  //no samples, but not EOS either
+    }
 
-    const Block* const pCurrBlock = m_pCurr->GetBlock();
+    const long limit = static_cast<long>(samples.size());
 
-    const Cluster* const pCurrCluster = m_pCurr->GetCluster();
-    assert(pCurrCluster);
+    index_t::size_type n;
 
-    const __int64 start_ns = pCurrBlock->GetTime(pCurrCluster);
+    if ((limit <= 0) || (GetBatch(limit, n) != limit))
+        return 2;   //try again
 
-    if (start_ns < 0)
+    IMediaSample* const* pSamples = &samples[0];
+
+    while (n > 0)
     {
-        SetCurr(pNext);  //throw curr block away
-        return 2;  //no samples, but not EOS either
+        const IndexEntry& curr = m_index[m_index_pos];
+        const IndexEntry& next = m_index[m_index_pos + 1];
+
+        OnPopulateSample(curr, next.time_ns, pSamples);
+        pSamples += curr.frames;
+
+        hr = Advance();
+        m_bDiscontinuity = false;
+
+        if (FAILED(hr))
+            break;
+
+        --n;
     }
 
-    const LONGLONG base_ns = m_base_time_ns;
-    //assert(base_ns >= 0);
+    return hr;
+}
+
+
+void Stream::ClearIndex()
+{
+    m_index.clear();  //keep the storage for the next cluster
+    m_index_pos = 0;
+    m_pIndexCluster = 0;
+    m_bIndexComplete = false;
+}
+
+
+void Stream::UpdateIndex()
+{
+    assert(m_pCurr);
+    assert(!m_pCurr->EOS());
+
+    const Cluster* const pCluster = m_pCurr->GetCluster();
 
-    if (start_ns < base_ns)
+    if (m_index.empty() ||
+        (m_index[m_index_pos].pEntry != m_pCurr) ||
+        (pCluster != m_pIndexCluster))
     {
-        SetCurr(pNext);  //throw curr block away
-        return 2;  //no samples, but not EOS either
+        ClearIndex();
+
+        m_pIndexCluster = pCluster;
+        AppendIndex(m_pCurr);
     }
 
-    const int nFrames = pCurrBlock->GetFrameCount();
+    ExtendIndex();  //the rest of the cluster might not be loaded yet
+}
+
 
-    if (nFrames <= 0)   //should never happen
+void Stream::ExtendIndex()
+{
+    while (!m_bIndexComplete)
     {
-        SetCurr(pNext);  //throw curr block away
-        return 2;  //no samples, but not EOS either
+        const BlockEntry* const pLast = m_index.back().pEntry;
+        assert(pLast);
+        assert(!pLast->EOS());
+
+        const BlockEntry* pNext;
+        const long status = m_pTrack->GetNext(pLast, pNext);
+
+        if (status == E_BUFFER_NOT_FULL)
+            return;
+
+        assert(status >= 0);  //success
+        assert(pNext);
+
+        AppendIndex(pNext);
+
+        if (pNext->EOS() || (pNext->GetCluster() != m_pIndexCluster))
+            m_bIndexComplete = true;
     }
+}
 
-    if (samples.size() != samples_t::size_type(nFrames))
-        return 2;   //try again
 
-    OnPopulateSample(pNext, samples);
+void Stream::AppendIndex(const BlockEntry* pEntry)
+{
+    IndexEntry e;
 
-    hr = SetCurr(pNext);
-    m_bDiscontinuity = false;
+    e.pEntry = pEntry;
 
-    return hr;
+    if (pEntry->EOS())
+    {
+        e.time_ns = -1;
+        e.frames = 0;
+        e.key = false;
+        e.invisible = false;
+    }
+    else
+    {
+        const Block* const pBlock = pEntry->GetBlock();
+        assert(pBlock);
+        assert(pBlock->GetTrackNumber() == m_pTrack->GetNumber());
+
+        e.time_ns = pBlock->GetTime(pEntry->GetCluster());
+        e.frames = pBlock->GetFrameCount();
+        e.key = pBlock->IsKey();
+        e.invisible = pBlock->IsInvisible();
+    }
+
+    m_index.push_back(e);
+}
+
+
+bool Stream::IsBatchable(index_t::size_type pos) const
+{
+    assert(pos < m_index.size());
+
+    const IndexEntry& e = m_index[pos];
+
+    if (e.pEntry->EOS())
+        return false;
+
+    if (e.time_ns < 0)
+        return false;
+
+    if (e.time_ns < m_base_time_ns)
+        return false;
+
+    if (e.frames <= 0)  //should never happen
+        return false;
+
+    return true;
+}
+
+
+long Stream::GetBatch(long limit, index_t::size_type& count) const
+{
+    //The batch begins with the current block, and extends over the blocks
+    //that follow it, for as long as their frames fit within the limit.
+    //We stop at the stop block, at a block that must be thrown away, and
+    //at the last block indexed, since we need the time of the block after
+    //it to compute its stop time.
+
+    const index_t::size_type size = m_index.size();
+    assert(m_index_pos < size);
+
+    index_t::size_type pos = m_index_pos;
+    long frames = 0;
+
+    while ((pos + 1) < size)
+    {
+        const IndexEntry& e = m_index[pos];
+
+        if ((pos > m_index_pos) && (e.pEntry == m_pStop))
+            break;
+
+        if (!IsBatchable(pos))
+            break;
+
+        if ((frames + e.frames) > limit)
+            break;
+
+        frames += e.frames;
+        ++pos;
+    }
+
+    count = pos - m_index_pos;
+    return frames;
+}
+
+
+HRESULT Stream::Advance()
+{
+    assert((m_index_pos + 1) < m_index.size());
+
+    ++m_index_pos;
+    return SetCurr(m_index[m_index_pos].pEntry);
 }
 
 
@@ -86,15 +86,46 @@ protected:
     virtual long GetBufferSize() const = 0;
     virtual long GetBufferCount() const = 0;
 
+    //Summary of a block of this track, taken once when the cluster
+    //containing the block is indexed.
+    struct IndexEntry
+    {
+        const BlockEntry* pEntry;
+        LONGLONG time_ns;  //-1 for EOS
+        int frames;
+        bool key;
+        bool invisible;
+    };
+
+    //Populates the samples for the block described by the index entry,
+    //which is m_pCurr.  next_ns is the time of the next block of this
+    //track, or negative if there is no next block.
     virtual void OnPopulateSample(
-                const BlockEntry*,
-                const samples_t&) const = 0;
+                const IndexEntry&,
+                LONGLONG next_ns,
+                IMediaSample* const*) const = 0;
 
 private:
 
     const BlockEntry* m_pLocked;
     HRESULT SetCurr(const mkvparser::BlockEntry*);
 
+    //The blocks of this track, from m_pCurr to the end of its cluster,
+    //followed by the first entry (possibly EOS) past that cluster.
+    typedef std::vector<IndexEntry> index_t;
+    index_t m_index;
+    index_t::size_type m_index_pos;  //of m_pCurr
+    const Cluster* m_pIndexCluster;
+    bool m_bIndexComplete;
+
+    void ClearIndex();
+    void UpdateIndex();
+    void ExtendIndex();
+    void AppendIndex(const BlockEntry*);
+    bool IsBatchable(index_t::size_type) const;
+    long GetBatch(long limit, index_t::size_type& count) const;
+    HRESULT Advance();
+
 };
 
 }  //end namespace mkvparser
@@ -9,6 +9,7 @@
 #include <strmif.h>
 #include "mkvparserstreamaudio.h"
 #include "mkvparser.hpp"
+#include "mkvparserstreamreader.h"
 #include "vorbistypes.h"
 #include "cmediatypes.h"
 #include <cassert>
@@ -482,13 +483,15 @@ long AudioStream::GetBufferCount() const
 
 
 void AudioStream::OnPopulateSample(
-    const BlockEntry* pNextEntry,
-    const samples_t& samples) const
+    const IndexEntry& curr,
+    LONGLONG next_ns,
+    IMediaSample* const* samples) const
 {
-    assert(!samples.empty());
+    assert(samples);
     //assert(m_pBase);
     //assert(!m_pBase->EOS());
     assert(m_pCurr);
+    assert(m_pCurr == curr.pEntry);
     assert(m_pCurr != m_pStop);
     assert(!m_pCurr->EOS());
 
@@ -496,14 +499,10 @@ void AudioStream::OnPopulateSample(
     assert(pCurrBlock);
     assert(pCurrBlock->GetTrackNumber() == m_pTrack->GetNumber());
 
-    const int nFrames = pCurrBlock->GetFrameCount();
+    const int nFrames = curr.frames;
     assert(nFrames > 0);  //checked by caller
-    assert(samples.size() == samples_t::size_type(nFrames));
 
-    const Cluster* const pCurrCluster = m_pCurr->GetCluster();
-    assert(pCurrCluster);
-
-    const __int64 start_ns = pCurrBlock->GetTime(pCurrCluster);
+    const __int64 start_ns = curr.time_ns;
     assert(start_ns >= 0);
     //assert((start_ns % 100) == 0);
 
@@ -514,9 +513,11 @@ void AudioStream::OnPopulateSample(
     Segment* const pSegment = m_pTrack->m_pSegment;
     IMkvReader* const pFile = pSegment->m_pReader;
 
+    IStreamReader* const pReader = static_cast<IStreamReader*>(pFile);
+
     __int64 stop_ns;
 
-    if ((pNextEntry == 0) || pNextEntry->EOS())
+    if (next_ns < 0)  //no next block
     {
         const LONGLONG duration_ns = pSegment->GetDuration();
 
@@ -530,12 +531,7 @@ void AudioStream::OnPopulateSample(
     }
     else
     {
-        const Block* const pNextBlock = pNextEntry->GetBlock();
-        assert(pNextBlock);
-
-        const Cluster* const pNextCluster = pNextEntry->GetCluster();
-
-        stop_ns = pNextBlock->GetTime(pNextCluster);
+        stop_ns = next_ns;
         //assert(stop_ns > start_ns);
 
         if (stop_ns <= start_ns)
@@ -570,21 +566,30 @@ void AudioStream::OnPopulateSample(
         const LONG srcsize = f.len;
         assert(srcsize >= 0);
 
-        const long tgtsize = pSample->GetSize();
-        tgtsize;
-        assert(tgtsize >= 0);
-        assert(tgtsize >= srcsize);
+        //Laced audio frames are typically small, so rather than copying
+        //each one, we let the sample refer to the frame in the reader's
+        //cache if we can.
 
-        BYTE* ptr;
+        HRESULT hr = pReader->ShareFrame(f, pSample);
 
-        HRESULT hr = pSample->GetPointer(&ptr);
-        assert(SUCCEEDED(hr));
-        assert(ptr);
+        if (hr != S_OK)
+        {
+            const long tgtsize = pSample->GetSize();
+            tgtsize;
+            assert(tgtsize >= 0);
+            assert(tgtsize >= srcsize);
+
+            BYTE* ptr;
 
-        const long status = f.Read(pFile, ptr);
-        assert(status == 0);  //all bytes were read
+            hr = pSample->GetPointer(&ptr);
+            assert(SUCCEEDED(hr));
+            assert(ptr);
 
-        hr = pSample->SetActualDataLength(srcsize);
+            const long status = f.Read(pFile, ptr);
+            assert(status == 0);  //all bytes were read
+
+            hr = pSample->SetActualDataLength(srcsize);
+        }
 
         hr = pSample->SetPreroll(FALSE);
         assert(SUCCEEDED(hr));
@@ -1,4 +1,5 @@
 #include <objbase.h>
+#include <strmif.h>
 #include "mkvparserstreamreader.h"
 
 namespace mkvparser
@@ -21,4 +22,9 @@ void IStreamReader::UnlockPages(const BlockEntry*)
 {
 }
 
+HRESULT IStreamReader::ShareFrame(const Block::Frame&, IMediaSample*)
+{
+    return S_FALSE;
+}
+
 }  //end namespace mkvparser
@@ -17,6 +17,11 @@ namespace mkvparser
         virtual HRESULT LockPages(const BlockEntry*);
         virtual void UnlockPages(const BlockEntry*);
 
+        //Makes the sample refer to the frame's bytes where the reader
+        //keeps them, instead of copying them.  Returns S_FALSE if the
+        //frame can't be shared, in which case the caller must read it.
+        virtual HRESULT ShareFrame(const Block::Frame&, IMediaSample*);
+
     };
 
 }  //end namespace mkvparser
@@ -338,13 +338,15 @@ long VideoStream::GetBufferCount() const
 
 
 void VideoStream::OnPopulateSample(
-    const BlockEntry* pNextEntry,
-    const samples_t& samples) const
+    const IndexEntry& curr,
+    LONGLONG next_ns,
+    IMediaSample* const* samples) const
 {
-    assert(!samples.empty());
+    assert(samples);
     //assert(m_pBase);
     //assert(!m_pBase->EOS());
     assert(m_pCurr);
+    assert(m_pCurr == curr.pEntry);
     assert(m_pCurr != m_pStop);
     assert(!m_pCurr->EOS());
 
@@ -352,17 +354,13 @@ void VideoStream::OnPopulateSample(
     assert(pCurrBlock);
     assert(pCurrBlock->GetTrackNumber() == m_pTrack->GetNumber());
 
-    const Cluster* const pCurrCluster = m_pCurr->GetCluster();
-    assert(pCurrCluster);
-
     assert((m_pStop == 0) ||
            m_pStop->EOS() ||
            (m_pStop->GetBlock()->GetTimeCode(m_pStop->GetCluster()) >
-             pCurrBlock->GetTimeCode(pCurrCluster)));
+             pCurrBlock->GetTimeCode(m_pCurr->GetCluster())));
 
-    const int nFrames = pCurrBlock->GetFrameCount();
+    const int nFrames = curr.frames;
     assert(nFrames > 0);  //checked by caller
-    assert(samples.size() == samples_t::size_type(nFrames));
 
     const LONGLONG base_ns = m_base_time_ns;
     //assert(base_ns >= 0);
@@ -370,18 +368,18 @@ void VideoStream::OnPopulateSample(
     Segment* const pSegment = m_pTrack->m_pSegment;
     IMkvReader* const pFile = pSegment->m_pReader;
 
-    const bool bKey = pCurrBlock->IsKey();
+    const bool bKey = curr.key;
     assert(!m_bDiscontinuity || bKey);
 
-    const bool bInvisible = pCurrBlock->IsInvisible();
+    const bool bInvisible = curr.invisible;
 
-    const __int64 start_ns = pCurrBlock->GetTime(pCurrCluster);
+    const __int64 start_ns = curr.time_ns;
     assert(start_ns >= base_ns);
     //assert((start_ns % 100) == 0);
 
     __int64 stop_ns;
 
-    if ((pNextEntry == 0) || pNextEntry->EOS())
+    if (next_ns < 0)  //no next block
     {
         //TODO: read duration from block group, if present
 
@@ -394,12 +392,7 @@ void VideoStream::OnPopulateSample(
     }
     else
     {
-        const Block* const pNextBlock = pNextEntry->GetBlock();
-        assert(pNextBlock);
-
-        const Cluster* const pNextCluster = pNextEntry->GetCluster();
-
-        stop_ns = pNextBlock->GetTime(pNextCluster);
+        stop_ns = next_ns;
         assert(stop_ns >= start_ns);
         //assert((stop_ns % 100) == 0);
     }
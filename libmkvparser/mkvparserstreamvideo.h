@@ -33,7 +33,10 @@ protected:
     long GetBufferSize() const;
     long GetBufferCount() const;
 
-    void OnPopulateSample(const BlockEntry*, const samples_t&) const;
+    void OnPopulateSample(
+        const IndexEntry&,
+        LONGLONG,
+        IMediaSample* const*) const;
 
     void GetVpxMediaTypes(const GUID& subtype, CMediaTypes&) const;
     void GetVfwMediaTypes(CMediaTypes&) const;
@@ -20,9 +20,11 @@
 #include "vp8encoderidl.h"
 #include "webmmuxidl.h"
 #include "versionhandling.h"
+#include "webmchunks.h"
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <process.h>
 using std::hex;
 using std::dec;
 using std::wcout;
@@ -41,55 +43,84 @@ using GraphUtil::FindInpinAudio;
 
 extern HANDLE g_hQuit;
 
+namespace
+{
+
+//Holds the console lock of a chunked encode; a null lock is not held.
+
+class ConsoleLock
+{
+    ConsoleLock(const ConsoleLock&);
+    ConsoleLock& operator=(const ConsoleLock&);
+
+public:
+    ConsoleLock() : m_pcs(0)
+    {
+    }
+
+    ~ConsoleLock()
+    {
+        Release();
+    }
+
+    void Seize(CRITICAL_SECTION* pcs)
+    {
+        assert(m_pcs == 0);
+
+        if (pcs)
+            EnterCriticalSection(pcs);
+
+        m_pcs = pcs;
+    }
+
+    void Release()
+    {
+        if (m_pcs)
+            LeaveCriticalSection(m_pcs);
+
+        m_pcs = 0;
+    }
+
+private:
+    CRITICAL_SECTION* m_pcs;
+
+};
+
+}  //end unnamed namespace
+
+
+App::App() :
+    m_cmdline(m_own_cmdline),
+    m_pChunk(0)
+{
+}
 
-App::App()
+
+App::App(const CmdLine& cmdline) :
+    m_cmdline(cmdline),
+    m_pChunk(0)
 {
 }
 
 
 int App::operator()(int argc, wchar_t* argv[])
 {
-    int status = m_cmdline.Parse(argc, argv);
+    int status = m_own_cmdline.Parse(argc, argv);
 
     if (status)
         return status;
 
     const bool bVerbose = m_cmdline.GetVerbose();
 
-    assert(!bool(m_pGraph));
-
-    HRESULT hr = m_pGraph.CreateInstance(CLSID_FilterGraphNoThread);
-
-    if (FAILED(hr))
-    {
-        wcout << L"Unable to create filter graph instance.\n"
-              << hrtext(hr)
-              << " (0x" << hex << hr << dec << ")"
-              << endl;
-
-        return 1;  //error
-    }
+    status = CreateGraph();
 
-    assert(bool(m_pGraph));
+    if (status)
+        return status;
 
     const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
     assert(bool(pBuilder));
 
-    const GraphUtil::IMediaFilterPtr pGraphFilter(m_pGraph);
-    assert(bool(pGraphFilter));
-
-    hr = pGraphFilter->SetSyncSource(0);  //process as quickly as possible
-    //TODO: are we setting this too early?
-
-#ifdef _DEBUG
-    if (FAILED(hr))
-    {
-        wcout << L"IMediaFilter::SetSyncSource failed.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
-    }
-#endif
+    HRESULT hr;
 
     const wchar_t* const ext = wcsrchr(m_cmdline.GetInputFileName(), L'.');
 
@@ -304,6 +335,12 @@ int App::operator()(int argc, wchar_t* argv[])
     const bool bNoVideo = m_cmdline.GetNoVideo();
     const bool bTwoPass = (m_cmdline.GetTwoPass() >= 1);
 
+    if (!m_cmdline.GetLadder().empty())
+        return RunLadder(pDemuxOutpinVideo, pDemuxOutpinAudio);
+
+    if (bTwoPass && !bNoVideo && (m_cmdline.GetChunks() >= 2))
+        return RunChunked(pDemuxOutpinVideo, pDemuxOutpinAudio);
+
     if (bTwoPass && !bNoVideo)
     {
         assert(m_cmdline.GetSaveGraphFile() == 0);
@@ -386,6 +423,44 @@ int App::operator()(int argc, wchar_t* argv[])
 }
 
 
+int App::CreateGraph()
+{
+    assert(!bool(m_pGraph));
+
+    HRESULT hr = m_pGraph.CreateInstance(CLSID_FilterGraphNoThread);
+
+    if (FAILED(hr))
+    {
+        wcout << L"Unable to create filter graph instance.\n"
+              << hrtext(hr)
+              << " (0x" << hex << hr << dec << ")"
+              << endl;
+
+        return 1;  //error
+    }
+
+    assert(bool(m_pGraph));
+
+    const GraphUtil::IMediaFilterPtr pGraphFilter(m_pGraph);
+    assert(bool(pGraphFilter));
+
+    hr = pGraphFilter->SetSyncSource(0);  //process as quickly as possible
+    //TODO: are we setting this too early?
+
+#ifdef _DEBUG
+    if (FAILED(hr))
+    {
+        wcout << L"IMediaFilter::SetSyncSource failed.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+    }
+#endif
+
+    return 0;
+}
+
+
 int App::CreateMuxerGraph(
     bool bTwoPass,
     IPin* pDemuxOutpinVideo,
@@ -741,7 +816,7 @@ int App::CreateMuxerGraph(
     const GraphUtil::IFileSinkFilterPtr pSink(pWriter);
     assert(bool(pSink));
 
-    hr = pSink->SetFileName(m_cmdline.GetOutputFileName(), 0);
+    hr = pSink->SetFileName(GetOutputFileName(), 0);
 
     if (FAILED(hr))
     {
@@ -783,30 +858,846 @@ int App::CreateFirstPassGraph(
     assert(pDemuxOutpinVideo);
     assert(ppEncoderOutpin);
 
-    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
-    assert(bool(pBuilder));
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
+
+    //const bool bVerbose = m_cmdline.GetVerbose();
+
+    if (IsVPX(pDemuxOutpinVideo))
+    {
+        //TODO(matthewjheaney): we should probably handle this case,
+        //so that they can do a re-encode with different parameters.
+
+        wcout << "Video demux stream is already VPx"
+              << " -- two-pass not supported.\n";
+
+        return 1;
+    }
+
+    IBaseFilterPtr pCompressor;
+
+    HRESULT hr = pCompressor.CreateInstance(CLSID_VP8Encoder);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to create VPX encoder filter instance.\n"
+
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    assert(bool(pCompressor));
+
+    hr = m_pGraph->AddFilter(pCompressor, L"vp8enc");
+    assert(SUCCEEDED(hr));
+
+    if (m_cmdline.GetEncoderKind() == kVP9Encoder)
+    {
+        _COM_SMARTPTR_TYPEDEF(IVPXEncoder, __uuidof(IVPXEncoder));
+
+        const IVPXEncoderPtr pVPX(pCompressor);
+
+        if (!bool(pVPX))
+        {
+            wcout << L"Encoder filter instance does support VP9.\n";
+            return 1;
+        }
+
+        hr = pVPX->SetEncoderKind(kVP9Encoder);
+
+        if (FAILED(hr))
+        {
+            wcout << L"Unable to set encoder kind to VP9.\n";
+            return 1;
+        }
+    }
+
+    IPinPtr pVP8Inpin;
+
+    hr = pCompressor->FindPin(L"input", &pVP8Inpin);
+    assert(SUCCEEDED(hr));
+    assert(bool(pVP8Inpin));
+
+    hr = pBuilder->Connect(pDemuxOutpinVideo, pVP8Inpin);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to connect demux outpin to"
+              << " VPX encoder filter inpin.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    _COM_SMARTPTR_TYPEDEF(IVP8Encoder, __uuidof(IVP8Encoder));
+
+    const IVP8EncoderPtr pVP8(pCompressor);
+    assert(bool(pVP8));
+
+    hr = pVP8->SetPassMode(kPassModeFirstPass);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to set VPX encoder pass mode (first pass).\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    AM_MEDIA_TYPE mt;
+
+    const HRESULT hrMT = pVP8Inpin->ConnectionMediaType(&mt);
+
+    hr = SetVP8Options(pVP8, SUCCEEDED(hrMT) ? &mt : 0);
+
+    if (SUCCEEDED(hrMT))
+        MediaTypeUtil::Destroy(mt);
+
+    if (FAILED(hr))
+        return 1;
+
+    IBaseFilterPtr pWriter;
+
+    hr = pWriter.CreateInstance(CLSID_FileWriter);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to create writer filter instance.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    assert(bool(pWriter));
+    assert(GraphUtil::InpinCount(pWriter) == 1);
+
+    m_pGraph->AddFilter(pWriter, L"writer");
+    assert(SUCCEEDED(hr));
+
+    const GraphUtil::IFileSinkFilterPtr pSink(pWriter);
+    assert(bool(pSink));
+
+    const wchar_t* const filename = GetStatsFileName();
+
+    if (filename == 0)
+        return 1;
+
+    hr = pSink->SetFileName(filename, 0);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to set output filename (for two-pass stats)"
+              << " of file writer filter.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    IPin*& pEncoderOutpin = *ppEncoderOutpin;
+
+    hr = pCompressor->FindPin(L"output", &pEncoderOutpin);
+    assert(SUCCEEDED(hr));
+    assert(pEncoderOutpin);
+
+    const GraphUtil::IPinPtr pWriterInpin = GraphUtil::FindInpin(pWriter);
+    assert(bool(pWriterInpin));
+
+    hr = m_pGraph->ConnectDirect(pEncoderOutpin, pWriterInpin, 0);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to connect VPX encoder outpin to file writer inpin"
+              << " (for two-pass stats).\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    return 0;  //success
+}
+
+
+int App::RunLadder(IPin* pDemuxOutpinVideo, IPin* pDemuxOutpinAudio)
+{
+    assert(bool(m_pGraph));
+
+    if (pDemuxOutpinVideo == 0)
+    {
+        wcout << "Demuxer does not expose video output pin." << endl;
+        return 1;
+    }
+
+    if (IsVPX(pDemuxOutpinVideo))
+    {
+        wcout << "Video demux stream is already VPx"
+              << " -- ladder not supported.\n";
+
+        return 1;
+    }
+
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
+
+    const CmdLine::renditions_t& ladder = m_cmdline.GetLadder();
+    assert(!ladder.empty());
+
+    _COM_SMARTPTR_TYPEDEF(IVP8Encoder, __uuidof(IVP8Encoder));
+    _COM_SMARTPTR_TYPEDEF(IVPXEncoder4, __uuidof(IVPXEncoder4));
+
+    typedef std::vector<IBaseFilterPtr> filters_t;
+    filters_t encoders;
+
+    HRESULT hr;
+
+    for (size_t i = 0; i < ladder.size(); ++i)
+    {
+        const CmdLine::Rendition& r = ladder[i];
+
+        IBaseFilterPtr pCompressor;
+
+        hr = pCompressor.CreateInstance(CLSID_VP8Encoder);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to create VPX encoder filter instance.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+
+        assert(bool(pCompressor));
+
+        wostringstream os;
+        os << L"vp8enc " << r.width << L'x' << r.height;
+
+        hr = m_pGraph->AddFilter(pCompressor, os.str().c_str());
+        assert(SUCCEEDED(hr));
+
+        const IVPXEncoder4Ptr pVPX(pCompressor);
+
+        if (!bool(pVPX))
+        {
+            wcout << L"Encoder filter instance does not support scaling.\n";
+            return 1;
+        }
+
+        if (m_cmdline.GetEncoderKind() == kVP9Encoder)
+        {
+            hr = pVPX->SetEncoderKind(kVP9Encoder);
+
+            if (FAILED(hr))
+            {
+                wcout << L"Unable to set encoder kind to VP9.\n";
+                return 1;
+            }
+        }
+
+        //The encoder scales the decoded frame itself, so every encoder
+        //can share the single decoded sample delivered by the tee.
+
+        hr = pVPX->SetScaledSize(r.width, r.height);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to set VPX encoder frame size "
+                  << r.width << L'x' << r.height << L".\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            return 1;
+        }
+
+        encoders.push_back(pCompressor);
+    }
+
+    //Let the graph builder find a decoder (and color converter, if
+    //needed) for the first encoder, then move the decoded stream onto
+    //a tee that feeds all of the encoders.
+
+    IPinPtr pEncoderInpin;
+
+    hr = encoders[0]->FindPin(L"input", &pEncoderInpin);
+    assert(SUCCEEDED(hr));
+    assert(bool(pEncoderInpin));
+
+    hr = pBuilder->Connect(pDemuxOutpinVideo, pEncoderInpin);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to connect demux outpin to"
+              << " VPX encoder filter inpin.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    IPinPtr pDecoderOutpin;
+
+    hr = pEncoderInpin->ConnectedTo(&pDecoderOutpin);
+    assert(SUCCEEDED(hr));
+    assert(bool(pDecoderOutpin));
+
+    AM_MEDIA_TYPE mt;
+
+    hr = pEncoderInpin->ConnectionMediaType(&mt);
+    assert(SUCCEEDED(hr));
+
+    hr = m_pGraph->Disconnect(pDecoderOutpin);
+    assert(SUCCEEDED(hr));
+
+    hr = m_pGraph->Disconnect(pEncoderInpin);
+    assert(SUCCEEDED(hr));
+
+    int status = 1;
+
+    IBaseFilterPtr pTee;
+
+    hr = pTee.CreateInstance(CLSID_InfTee);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to create tee filter instance.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+    }
+    else
+    {
+        hr = m_pGraph->AddFilter(pTee, L"tee");
+        assert(SUCCEEDED(hr));
+
+        const IPinPtr pTeeInpin(GraphUtil::FindInpin(pTee));
+        assert(bool(pTeeInpin));
+
+        hr = m_pGraph->ConnectDirect(pDecoderOutpin, pTeeInpin, &mt);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to connect video decoder to tee.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+        }
+        else
+            status = 0;
+    }
+
+    typedef filters_t::const_iterator iter_t;
+
+    for (iter_t iter = encoders.begin(); iter != encoders.end(); ++iter)
+    {
+        if (status)
+            break;
+
+        IBaseFilter* const pCompressor = *iter;
+
+        IPinPtr pInpin;
+
+        hr = pCompressor->FindPin(L"input", &pInpin);
+        assert(SUCCEEDED(hr));
+        assert(bool(pInpin));
+
+        //The tee adds another outpin each time one is connected.
+
+        const IPinPtr pTeeOutpin(FindUnconnectedOutpin(pTee));
+        assert(bool(pTeeOutpin));
+
+        hr = m_pGraph->ConnectDirect(pTeeOutpin, pInpin, &mt);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to connect tee to VPX encoder filter inpin.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            status = 1;
+            break;
+        }
+
+        const IVP8EncoderPtr pVP8(pCompressor);
+        assert(bool(pVP8));
+
+        hr = pVP8->SetPassMode(kPassModeOnePass);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to set VPX encoder pass mode"
+                  << " (one pass).\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            status = 1;
+            break;
+        }
+
+        hr = SetVP8Options(pVP8, &mt);
+
+        if (FAILED(hr))
+        {
+            status = 1;
+            break;
+        }
+
+        const CmdLine::Rendition& r = ladder[iter - encoders.begin()];
+
+        hr = pVP8->SetTargetBitrate(r.target_bitrate);
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to set VPX encoder target bitrate.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            status = 1;
+            break;
+        }
+    }
+
+    MediaTypeUtil::Destroy(mt);
+
+    if (status)
+        return status;
+
+    //Each rendition is muxed into its own file.  Audio (if any) is
+    //encoded once, into a file of its own, instead of once for each
+    //rendition.
+
+    const wstring path = CmdLine::GetPath(m_cmdline.GetOutputFileName());
+    const wstring::size_type pos = path.rfind(L'.');
+    const wstring base = (pos == wstring::npos) ? path : path.substr(0, pos);
+
+    IBaseFilterPtr pFirstMux;
+
+    for (iter_t iter = encoders.begin(); iter != encoders.end(); ++iter)
+    {
+        const CmdLine::Rendition& r = ladder[iter - encoders.begin()];
+
+        wostringstream os;
+        os << base << L'-' << r.width << L'x' << r.height << L".webm";
+
+        m_output_filename = os.str();
+
+        IPinPtr pEncoderOutpin;
+
+        hr = (*iter)->FindPin(L"output", &pEncoderOutpin);
+        assert(SUCCEEDED(hr));
+        assert(bool(pEncoderOutpin));
+
+        IBaseFilterPtr pMux;
+
+        status = CreateMuxerGraph(false, pEncoderOutpin, 0, &pMux);
+
+        if (status)
+            return status;
+
+        if (!bool(pFirstMux))
+            pFirstMux = pMux;
+    }
+
+    if (pDemuxOutpinAudio && !m_cmdline.GetNoAudio())
+    {
+        m_output_filename = base + L"-audio.webm";
+
+        IBaseFilterPtr pMux;
+
+        status = CreateMuxerGraph(false, 0, pDemuxOutpinAudio, &pMux);
+
+        if (status)
+            return status;
+    }
+
+    m_output_filename.clear();
+
+    status = SaveGraph();
+
+    if (status)
+        return status;
+
+    //The first tee outpin is the one that passes seek requests
+    //upstream, so progress is tracked through the first rendition.
+
+    const GraphUtil::IMediaSeekingPtr pSeek(pFirstMux);
+    assert(bool(pSeek));
+
+    LONGLONG curr = 0;
+    LONGLONG stop = 0;
+
+    hr = pSeek->SetPositions(
+            &curr,
+            AM_SEEKING_AbsolutePositioning,
+            &stop,
+            AM_SEEKING_NoPositioning);
+
+    assert(SUCCEEDED(hr));
+
+    return RunGraph(pSeek);
+}
+
+
+int App::RunChunked(IPin* pDemuxOutpinVideo, IPin* pDemuxOutpinAudio)
+{
+    assert(bool(m_pGraph));
+
+    if (pDemuxOutpinVideo == 0)
+    {
+        wcout << "Demuxer does not expose video output pin." << endl;
+        return 1;
+    }
+
+    if (IsVPX(pDemuxOutpinVideo))
+    {
+        wcout << "Video demux stream is already VPx"
+              << " -- two-pass not supported.\n";
+
+        return 1;
+    }
+
+    //The chunks are cut at times, not at keyframes of the input.  The
+    //source is seeked to the start of a chunk (decoding from whatever
+    //keyframe precedes it), and the encoder drops the frames that come
+    //before the start, so any input that can be seeked may be chunked.
+
+    const GraphUtil::IMediaSeekingPtr pSeek(pDemuxOutpinVideo);
+
+    LONGLONG duration = -1;
+
+    if (bool(pSeek))
+    {
+        const HRESULT hr = pSeek->GetDuration(&duration);
+
+        if (FAILED(hr))
+            duration = -1;
+    }
+
+    if (duration <= 0)
+    {
+        wcout << "Unable to get duration of input"
+              << " -- chunked encoding not supported."
+              << endl;
+
+        return 1;
+    }
+
+    //A cut is moved to the nearest frame boundary, since the encoder
+    //gives the first frame of a chunk the time of the chunk start.
+
+    const LONGLONG frame = GetAvgTimePerFrame(pDemuxOutpinVideo);
+
+    const int n = m_cmdline.GetChunks();
+    assert(n >= 2);
+
+    std::vector<LONGLONG> starts;
+    starts.push_back(0);
+
+    for (int i = 1; i < n; ++i)
+    {
+        LONGLONG t = duration * i / n;
+
+        if (frame > 0)
+            t = ((t + frame / 2) / frame) * frame;
+
+        if ((t > starts.back()) && (t < duration))
+            starts.push_back(t);
+    }
+
+    //Sources differ in where they stop relative to the stop position:
+    //some stop at the keyframe or cluster that contains it.  So a chunk
+    //is encoded somewhat past its stop, and the frames past the stop
+    //are dropped when the chunks are joined.
+
+    const LONGLONG kStopMargin = 50000000;  //5 seconds
+
+    const wstring path = CmdLine::GetPath(m_cmdline.GetOutputFileName());
+    const wstring::size_type pos = path.rfind(L'.');
+    const wstring base = (pos == wstring::npos) ? path : path.substr(0, pos);
+
+    CRITICAL_SECTION console;
+    InitializeCriticalSection(&console);
+
+    chunks_t chunks(starts.size());
+
+    for (chunks_t::size_type i = 0; i < chunks.size(); ++i)
+    {
+        Chunk& c = chunks[i];
+
+        wostringstream os;
+        os << base << L"-CHUNK" << i << L".webm";
+
+        c.pCmdLine = &m_cmdline;
+        c.pConsole = &console;
+        c.filename = os.str();
+        c.start = starts[i];
+        c.stop = ((i + 1) < chunks.size()) ? starts[i + 1] : -1;
+
+        if ((c.stop < 0) || ((c.stop + kStopMargin) >= duration))
+            c.end = -1;
+        else
+            c.end = c.stop + kStopMargin;
+
+        c.pass = 0;
+        c.curr = 0;
+        c.status = 1;
+    }
+
+    if (!m_cmdline.ScriptMode())
+        wcout << "Encoding " << chunks.size() << " chunks..." << endl;
+
+    std::vector<HANDLE> threads;
+
+    for (chunks_t::size_type i = 0; i < chunks.size(); ++i)
+    {
+        const uintptr_t h = _beginthreadex(
+                                0,  //security
+                                0,  //stack size
+                                &App::ChunkThreadProc,
+                                &chunks[i],
+                                0,  //run immediately
+                                0);  //thread id
+
+        if (h == 0)
+        {
+            ConsoleLock lock;
+            lock.Seize(&console);
+
+            wcout << "Unable to create chunk encoding thread." << endl;
+            break;
+        }
+
+        threads.push_back(reinterpret_cast<HANDLE>(h));
+    }
+
+    if (!threads.empty())
+    {
+        m_progress = 0;
+
+        for (;;)
+        {
+            const DWORD dw = WaitForMultipleObjects(
+                                static_cast<DWORD>(threads.size()),
+                                &threads[0],
+                                TRUE,  //wait for all
+                                100);
+
+            if (dw != WAIT_TIMEOUT)
+            {
+                assert(dw != WAIT_FAILED);
+                break;
+            }
+
+            DisplayChunkProgress(chunks, duration, false);
+        }
+
+        DisplayChunkProgress(chunks, duration, true);
+
+        if (!m_cmdline.ScriptMode())
+            wcout << endl;
+
+        for (size_t i = 0; i < threads.size(); ++i)
+        {
+            const BOOL b = CloseHandle(threads[i]);
+            b;
+            assert(b);
+        }
+    }
+
+    DeleteCriticalSection(&console);
+
+    int status = 0;
+
+    if (WaitForSingleObject(g_hQuit, 0) == WAIT_OBJECT_0)
+        status = 1;
+
+    for (chunks_t::size_type i = 0; i < chunks.size(); ++i)
+    {
+        if (chunks[i].status)
+            status = 1;
+    }
+
+    //Audio is not chunked: it is encoded once, while the joined video
+    //is muxed with it.
+
+    const bool bAudio = (pDemuxOutpinAudio != 0) && !m_cmdline.GetNoAudio();
+
+    const wstring video_filename =
+        bAudio ? (base + L"-VIDEO.webm") : m_cmdline.GetOutputFileName();
+
+    if (status == 0)
+    {
+        ChunkWriter writer;
+
+        HRESULT hr = writer.Open(video_filename.c_str());
+
+        for (chunks_t::size_type i = 0; i < chunks.size(); ++i)
+        {
+            if (FAILED(hr))
+                break;
+
+            const Chunk& c = chunks[i];
+            hr = writer.Append(c.filename.c_str(), c.start, c.stop);
+        }
+
+        const HRESULT hrClose = writer.Close();
+
+        if (SUCCEEDED(hr))
+            hr = hrClose;
+
+        if (FAILED(hr))
+        {
+            wcout << "Unable to join chunk files.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
+            status = 1;
+        }
+    }
+
+    for (chunks_t::size_type i = 0; i < chunks.size(); ++i)
+        DeleteFile(chunks[i].filename.c_str());
+
+    if ((status != 0) || !bAudio)
+        return status;
+
+    status = MuxJoinedVideo(video_filename.c_str(), pDemuxOutpinAudio);
+
+    DeleteFile(video_filename.c_str());
+
+    return status;
+}
+
+
+int App::MuxJoinedVideo(
+    const wchar_t* video_filename,
+    IPin* pDemuxOutpinAudio)
+{
+    assert(bool(m_pGraph));
+    assert(video_filename);
+    assert(pDemuxOutpinAudio);
+
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
+
+    IBaseFilterPtr pVideoReader;
+
+    HRESULT hr = pBuilder->AddSourceFilter(
+                    video_filename,
+                    L"video source",
+                    &pVideoReader);
+
+    if (FAILED(hr))
+    {
+        wcout << "Unable to add joined video source filter to graph.\n"
+              << hrtext(hr)
+              << L" (0x" << hex << hr << dec << L")"
+              << endl;
+
+        return 1;
+    }
+
+    int status = 1;
+
+    const IBaseFilterPtr pVideoDemux =
+        AddDemuxFilter(pVideoReader, L"video demux");
+
+    IPinPtr pVideo;
+
+    if (bool(pVideoDemux))
+        pVideo = FindOutpinVideo(pVideoDemux);
+
+    if (!bool(pVideo))
+    {
+        wcout << "Joined video file does not expose video output pin."
+              << endl;
+    }
+    else
+    {
+        IBaseFilterPtr pMux;
+
+        status = CreateMuxerGraph(false, pVideo, pDemuxOutpinAudio, &pMux);
+
+        if (status == 0)
+        {
+            const GraphUtil::IMediaSeekingPtr pSeek(pMux);
+            assert(bool(pSeek));
+
+            LONGLONG curr = 0;
+            LONGLONG stop = 0;
+
+            hr = pSeek->SetPositions(
+                    &curr,
+                    AM_SEEKING_AbsolutePositioning,
+                    &stop,
+                    AM_SEEKING_NoPositioning);
+
+            assert(SUCCEEDED(hr));
+
+            status = RunGraph(pSeek);
+        }
+    }
+
+    //The joined video file is deleted by the caller, so the filters
+    //that hold it open must leave the graph.
+
+    if (bool(pVideoDemux) && (pVideoDemux != pVideoReader))
+    {
+        hr = m_pGraph->RemoveFilter(pVideoDemux);
+        assert(SUCCEEDED(hr));
+    }
+
+    hr = m_pGraph->RemoveFilter(pVideoReader);
+    assert(SUCCEEDED(hr));
+
+    return status;
+}
+
 
-    //const bool bVerbose = m_cmdline.GetVerbose();
+int App::EncodeChunk()
+{
+    assert(m_pChunk);
+    Chunk& c = *m_pChunk;
 
-    if (IsVPX(pDemuxOutpinVideo))
-    {
-        //TODO(matthewjheaney): we should probably handle this case,
-        //so that they can do a re-encode with different parameters.
+    ConsoleLock lock;
+    lock.Seize(c.pConsole);
 
-        wcout << "Video demux stream is already VPx"
-              << " -- two-pass not supported.\n";
+    int status = CreateGraph();
 
-        return 1;
-    }
+    if (status)
+        return status;
 
-    IBaseFilterPtr pCompressor;
+    const GraphUtil::IGraphBuilderPtr pBuilder(m_pGraph);
+    assert(bool(pBuilder));
 
-    HRESULT hr = pCompressor.CreateInstance(CLSID_VP8Encoder);
+    IBaseFilterPtr pReader;
+
+    HRESULT hr = pBuilder->AddSourceFilter(
+                    m_cmdline.GetInputFileName(),
+                    L"source",
+                    &pReader);
 
     if (FAILED(hr))
     {
-        wcout << "Unable to create VPX encoder filter instance.\n"
-
+        wcout << "Unable to add source filter to graph.\n"
               << hrtext(hr)
               << L" (0x" << hex << hr << dec << L")"
               << endl;
@@ -814,144 +1705,179 @@ int App::CreateFirstPassGraph(
         return 1;
     }
 
-    assert(bool(pCompressor));
+    const IBaseFilterPtr pDemux = AddDemuxFilter(pReader, L"demux");
 
-    hr = m_pGraph->AddFilter(pCompressor, L"vp8enc");
-    assert(SUCCEEDED(hr));
+    if (!bool(pDemux))
+        return 1;
 
-    if (m_cmdline.GetEncoderKind() == kVP9Encoder)
+    const IPinPtr pDemuxOutpinVideo = FindOutpinVideo(pDemux);
+
+    if (!bool(pDemuxOutpinVideo))
     {
-        _COM_SMARTPTR_TYPEDEF(IVPXEncoder, __uuidof(IVPXEncoder));
+        wcout << "Demuxer does not expose video output pin." << endl;
+        return 1;
+    }
 
-        const IVPXEncoderPtr pVPX(pCompressor);
+    IPinPtr pEncoderOutpin;
 
-        if (!bool(pVPX))
+    status = CreateFirstPassGraph(pDemuxOutpinVideo, &pEncoderOutpin);
+
+    if (status)
+        return status;
+
+    //The muxer does not accept a stop position, so both passes seek
+    //the splitter through the encoder outpin.
+
+    const GraphUtil::IMediaSeekingPtr pSeek(pEncoderOutpin);
+    assert(bool(pSeek));
+
+    const DWORD dwStop = (c.end < 0) ?
+                            AM_SEEKING_NoPositioning :
+                            AM_SEEKING_AbsolutePositioning;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        if (pass > 0)
         {
-            wcout << L"Encoder filter instance does support VP9.\n";
-            return 1;
+            IBaseFilterPtr pWriter;
+
+            hr = m_pGraph->FindFilterByName(L"writer", &pWriter);
+            assert(SUCCEEDED(hr));
+            assert(bool(pWriter));
+
+            hr = m_pGraph->RemoveFilter(pWriter);
+            assert(SUCCEEDED(hr));
+
+            IBaseFilterPtr pMux;
+
+            status = CreateMuxerGraph(true, pDemuxOutpinVideo, 0, &pMux);
+
+            if (status)
+                return status;
         }
 
-        hr = pVPX->SetEncoderKind(kVP9Encoder);
+        LONGLONG curr = c.start;
+        LONGLONG stop = c.end;
+
+        hr = pSeek->SetPositions(
+                &curr,
+                AM_SEEKING_AbsolutePositioning,
+                &stop,
+                dwStop);
 
         if (FAILED(hr))
         {
-            wcout << L"Unable to set encoder kind to VP9.\n";
+            wcout << "Unable to set position of chunk.\n"
+                  << hrtext(hr)
+                  << L" (0x" << hex << hr << dec << L")"
+                  << endl;
+
             return 1;
         }
-    }
 
-    IPinPtr pVP8Inpin;
+        lock.Release();
 
-    hr = pCompressor->FindPin(L"input", &pVP8Inpin);
-    assert(SUCCEEDED(hr));
-    assert(bool(pVP8Inpin));
+        status = RunGraph(pSeek);
 
-    hr = pBuilder->Connect(pDemuxOutpinVideo, pVP8Inpin);
+        if (status)
+            return status;
 
-    if (FAILED(hr))
-    {
-        wcout << "Unable to connect demux outpin to"
-              << " VPX encoder filter inpin.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+        if (WaitForSingleObject(g_hQuit, 0) == WAIT_OBJECT_0)
+            return 1;
 
-        return 1;
+        lock.Seize(c.pConsole);
+
+        c.pass = pass + 1;
+        c.curr = 0;
     }
 
-    _COM_SMARTPTR_TYPEDEF(IVP8Encoder, __uuidof(IVP8Encoder));
+    return 0;  //success
+}
 
-    const IVP8EncoderPtr pVP8(pCompressor);
-    assert(bool(pVP8));
 
-    hr = pVP8->SetPassMode(kPassModeFirstPass);
+unsigned App::ChunkThreadProc(void* pv)
+{
+    Chunk* const pChunk = static_cast<Chunk*>(pv);
+    assert(pChunk);
+
+    Chunk& c = *pChunk;
+    assert(c.pCmdLine);
+
+    const HRESULT hr = CoInitialize(0);
 
     if (FAILED(hr))
     {
-        wcout << "Unable to set VPX encoder pass mode (first pass).\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
-
-        return 1;
+        c.status = 1;
+        return 0;
     }
 
-    AM_MEDIA_TYPE mt;
-
-    const HRESULT hrMT = pVP8Inpin->ConnectionMediaType(&mt);
+    {
+        App app(*c.pCmdLine);
 
-    hr = SetVP8Options(pVP8, SUCCEEDED(hrMT) ? &mt : 0);
+        app.m_output_filename = c.filename;
+        app.m_pChunk = pChunk;
 
-    if (SUCCEEDED(hrMT))
-        MediaTypeUtil::Destroy(mt);
+        c.status = app.EncodeChunk();
+    }
 
-    if (FAILED(hr))
-        return 1;
+    CoUninitialize();
 
-    IBaseFilterPtr pWriter;
+    return 0;
+}
 
-    hr = pWriter.CreateInstance(CLSID_FileWriter);
 
-    if (FAILED(hr))
-    {
-        wcout << "Unable to create writer filter instance.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+void App::ReportChunkProgress(IMediaSeeking* pSeek)
+{
+    assert(m_pChunk);
+    assert(pSeek);
 
-        return 1;
-    }
+    LONGLONG curr;
 
-    assert(bool(pWriter));
-    assert(GraphUtil::InpinCount(pWriter) == 1);
+    const HRESULT hr = pSeek->GetCurrentPosition(&curr);
 
-    m_pGraph->AddFilter(pWriter, L"writer");
-    assert(SUCCEEDED(hr));
+    if (FAILED(hr))
+        return;
 
-    const GraphUtil::IFileSinkFilterPtr pSink(pWriter);
-    assert(bool(pSink));
+    ConsoleLock lock;
+    lock.Seize(m_pChunk->pConsole);
 
-    const wchar_t* const filename = GetStatsFileName();
+    m_pChunk->curr = curr;
+}
 
-    if (filename == 0)
-        return 1;
 
-    hr = pSink->SetFileName(filename, 0);
+void App::DisplayChunkProgress(
+    const chunks_t& chunks,
+    LONGLONG duration,
+    bool last)
+{
+    assert(!chunks.empty());
+    assert(duration > 0);
 
-    if (FAILED(hr))
-    {
-        wcout << "Unable to set output filename (for two-pass stats)"
-              << " of file writer filter.\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+    ConsoleLock lock;
+    lock.Seize(chunks[0].pConsole);
 
-        return 1;
-    }
+    //Each pass of a chunk counts for half of its length.
 
-    IPin*& pEncoderOutpin = *ppEncoderOutpin;
+    LONGLONG curr = 0;
 
-    hr = pCompressor->FindPin(L"output", &pEncoderOutpin);
-    assert(SUCCEEDED(hr));
-    assert(pEncoderOutpin);
+    for (chunks_t::size_type i = 0; i < chunks.size(); ++i)
+    {
+        const Chunk& c = chunks[i];
 
-    const GraphUtil::IPinPtr pWriterInpin = GraphUtil::FindInpin(pWriter);
-    assert(bool(pWriterInpin));
+        const LONGLONG stop = (c.stop < 0) ? duration : c.stop;
+        const LONGLONG len = stop - c.start;
 
-    hr = m_pGraph->ConnectDirect(pEncoderOutpin, pWriterInpin, 0);
+        LONGLONG t = c.curr;
 
-    if (FAILED(hr))
-    {
-        wcout << "Unable to connect VPX encoder outpin to file writer inpin"
-              << " (for two-pass stats).\n"
-              << hrtext(hr)
-              << L" (0x" << hex << hr << dec << L")"
-              << endl;
+        if (t < 0)
+            t = 0;
+        else if (t > len)
+            t = len;
 
-        return 1;
+        curr += c.pass * len + t;
     }
 
-    return 0;  //success
+    DisplayProgress(curr / 2, duration, last);
 }
 
 
@@ -1124,6 +2050,11 @@ int App::RunGraph(IMediaSeeking* pSeek)
 
     if (FAILED(hr))
     {
+        ConsoleLock lock;
+
+        if (m_pChunk)
+            lock.Seize(m_pChunk->pConsole);
+
         wcout << "Unable to run graph.\n"
               << hrtext(hr)
               << L" (0x" << hex << hr << dec << L")"
@@ -1156,7 +2087,11 @@ int App::RunGraph(IMediaSeeking* pSeek)
 
         if (dw == WAIT_TIMEOUT)
         {
-            DisplayProgress(pSeek, false);
+            if (m_pChunk)
+                ReportChunkProgress(pSeek);
+            else
+                DisplayProgress(pSeek, false);
+
             continue;
         }
 
@@ -1198,10 +2133,13 @@ int App::RunGraph(IMediaSeeking* pSeek)
         //    break;
     }
 
-    DisplayProgress(pSeek, true);
+    if (m_pChunk == 0)
+    {
+        DisplayProgress(pSeek, true);
 
-    if (!m_cmdline.ScriptMode())
-        wcout << endl;
+        if (!m_cmdline.ScriptMode())
+            wcout << endl;
+    }
 
     hr = pControl->Stop();
     assert(SUCCEEDED(hr));
@@ -1234,15 +2172,6 @@ void App::DisplayProgress(IMediaSeeking* pSeek, bool last)
 
     assert(curr >= 0);
 
-    double val = double(curr) / 10000000;
-
-    wcout << std::fixed << std::setprecision(1);
-
-    if (m_cmdline.ScriptMode())
-        wcout << "TIME=" << val;
-    else
-        wcout << "\rtime[sec]=" << val;
-
     __int64 d;
 
     //TODO: it's not clear whether we're allowed to call
@@ -1258,7 +2187,25 @@ void App::DisplayProgress(IMediaSeeking* pSeek, bool last)
     hr = pSeek->GetDuration(&d);
 #endif
 
-    if (SUCCEEDED(hr))  //have duration
+    if (FAILED(hr))
+        d = -1;
+
+    DisplayProgress(curr, d, last);
+}
+
+
+void App::DisplayProgress(LONGLONG curr, LONGLONG d, bool last)
+{
+    double val = double(curr) / 10000000;
+
+    wcout << std::fixed << std::setprecision(1);
+
+    if (m_cmdline.ScriptMode())
+        wcout << "TIME=" << val;
+    else
+        wcout << "\rtime[sec]=" << val;
+
+    if (d >= 0)  //have duration
     {
         val = double(d) / 10000000;
 
@@ -1892,6 +2839,83 @@ bool App::IsVPX(IPin* pPin)
 }
 
 
+//Returns the frame duration of the first video media type that has
+//one, or 0 if none does.
+
+LONGLONG App::GetAvgTimePerFrame(IPin* pPin)
+{
+    assert(pPin);
+
+    GraphUtil::IEnumMediaTypesPtr e;
+
+    HRESULT hr = pPin->EnumMediaTypes(&e);
+
+    if (FAILED(hr))
+        return 0;
+
+    for (;;)
+    {
+        AM_MEDIA_TYPE* pmt;
+
+        hr = e->Next(1, &pmt, 0);
+
+        if (hr != S_OK)
+            return 0;
+
+        const double r = (pmt->majortype == MEDIATYPE_Video) ?
+                            GetFramerate(*pmt) :
+                            -1;
+
+        MediaTypeUtil::Free(pmt);
+        pmt = 0;
+
+        if (r > 0)
+            return static_cast<LONGLONG>(10000000.0 / r + 0.5);
+    }
+}
+
+
+GraphUtil::IPinPtr App::FindUnconnectedOutpin(IBaseFilter* f)
+{
+    assert(f);
+
+    GraphUtil::IEnumPinsPtr e;
+
+    HRESULT hr = f->EnumPins(&e);
+
+    if (FAILED(hr))
+        return 0;
+
+    assert(bool(e));
+
+    for (;;)
+    {
+        IPinPtr p;
+
+        hr = e->Next(1, &p, 0);
+
+        if (hr != S_OK)
+            return 0;
+
+        assert(bool(p));
+
+        PIN_DIRECTION dir;
+
+        hr = p->QueryDirection(&dir);
+
+        if (FAILED(hr) || (dir != PINDIR_OUTPUT))
+            continue;
+
+        IPinPtr pConnection;
+
+        hr = p->ConnectedTo(&pConnection);
+
+        if (hr == VFW_E_NOT_CONNECTED)
+            return p;
+    }
+}
+
+
 GUID App::GetSubtype(IPin* pPin)
 {
     assert(pPin);
@@ -3125,9 +4149,18 @@ HRESULT App::SetVP8Options(
 }
 
 
+const wchar_t* App::GetOutputFileName() const
+{
+    if (m_output_filename.empty())
+        return m_cmdline.GetOutputFileName();
+
+    return m_output_filename.c_str();
+}
+
+
 const wchar_t* App::GetStatsFileName()
 {
-    wstring path = CmdLine::GetPath(m_cmdline.GetOutputFileName());
+    wstring path = CmdLine::GetPath(GetOutputFileName());
 
     const wstring::size_type pos = path.rfind(L'.');
 
@@ -16,6 +16,7 @@
 #include <amvideo.h>
 #include <dvdmedia.h>
 #include <list>
+#include <vector>
 
 interface IVP8Encoder;
 
@@ -27,13 +28,16 @@ class App
 public:
 
     App();
+    explicit App(const CmdLine&);  //encodes a chunk
     int operator()(int, wchar_t*[]);
 
 private:
 
-    CmdLine m_cmdline;
+    CmdLine m_own_cmdline;
+    const CmdLine& m_cmdline;
     GraphUtil::IFilterGraphPtr m_pGraph;
 
+    int CreateGraph();
     int LoadGraph();
     int SaveGraph();
 
@@ -49,8 +53,44 @@ private:
 
     int RunGraph(IMediaSeeking* pSeek);
 
+    int RunChunked(IPin* pDemuxVideo, IPin* pDemuxAudio);
+    int EncodeChunk();
+    int MuxJoinedVideo(const wchar_t*, IPin* pDemuxAudio);
+
+    int RunLadder(IPin* pDemuxVideo, IPin* pDemuxAudio);
+
+    //The chunk threads write to the console only while they hold the
+    //console lock, which they release while a pass runs.  Progress is
+    //displayed by the coordinating thread.
+
+    struct Chunk
+    {
+        const CmdLine* pCmdLine;
+        CRITICAL_SECTION* pConsole;
+        std::wstring filename;
+        LONGLONG start;  //reftime
+        LONGLONG stop;   //reftime, or -1 for end of input
+        LONGLONG end;    //stop position of source (reftime), or -1
+        int pass;        //passes completed; guarded by console lock
+        LONGLONG curr;   //reftime within pass; guarded by console lock
+        int status;
+    };
+
+    typedef std::vector<Chunk> chunks_t;
+
+    static unsigned __stdcall ChunkThreadProc(void*);
+
+    void ReportChunkProgress(IMediaSeeking*);
+    void DisplayChunkProgress(const chunks_t&, LONGLONG duration, bool last);
+
+    const wchar_t* GetOutputFileName() const;
+    std::wstring m_output_filename;  //of chunk
+    Chunk* m_pChunk;  //being encoded by this instance, or 0
+
     static bool IsVPX(IPin*);
+    static GraphUtil::IPinPtr FindUnconnectedOutpin(IBaseFilter*);
     static GUID GetSubtype(IPin*);
+    static LONGLONG GetAvgTimePerFrame(IPin*);
 
     GraphUtil::IBaseFilterPtr AddDemuxFilter(
         IBaseFilter*,
@@ -97,6 +137,7 @@ private:
                     void (*)(const AM_MEDIA_TYPE&));
 
     void DisplayProgress(IMediaSeeking*, bool);
+    void DisplayProgress(LONGLONG curr, LONGLONG duration, bool last);
 
     static void DumpVideoMediaType(const AM_MEDIA_TYPE&);
     static void DumpVideoInfoHeader(const VIDEOINFOHEADER&);
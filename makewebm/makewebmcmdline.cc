@@ -70,7 +70,8 @@ CmdLine::CmdLine() :
     m_arnr_strength(-1),
     m_arnr_type(-1),
     m_ogg_to_webm(-1),
-    m_cpu_used(-17)
+    m_cpu_used(-17),
+    m_chunks(-1)
 {
 }
 
@@ -132,6 +133,10 @@ void CmdLine::PrintUsage() const
           << L"  --two-pass-vbr-bias-pct         CBR/VBR bias\n"
           << L"  --two-pass-vbr-minsection-pct   minimum bitrate\n"
           << L"  --two-pass-vbr-maxsection-pct   maximum bitrate\n"
+          << L"  --chunks                        "
+          << L"encode two-pass video as parallel chunks\n"
+          << L"  --ladder                        "
+          << L"encode renditions WxH:kbps[,WxH:kbps...]\n"
           << L"  --undershoot-pct                "
           << L"percent of target bitrate for easier frames\n"
           << L"  --overshoot-pct                 "
@@ -186,6 +191,19 @@ void CmdLine::PrintUsage() const
           << L"  1 (or \"realtime\") means real-time encoding\n"
           << L"  1000000 (or \"good\") means good quality (the default)\n";
 
+    wcout << L'\n'
+          << L"The chunks value splits a two-pass encode into that many\n"
+          << L"pieces of about equal duration, whose passes run\n"
+          << L"concurrently.  The input may be in any format that can be\n"
+          << L"seeked.  Each chunk starts with a keyframe, and audio is\n"
+          << L"encoded once, after the chunks are joined.\n";
+
+    wcout << L'\n'
+          << L"The ladder value lists renditions to encode from a single\n"
+          << L"decode of the input, e.g. 1280x720:2500,640x360:800.  Each\n"
+          << L"rendition is written to <output>-<W>x<H>.webm, and audio\n"
+          << L"(if any) is encoded once, to <output>-audio.webm.\n";
+
     wcout << '\n'
           << "TODO: MORE PARAMS TO BE DESCRIBED HERE\n";
 
@@ -325,6 +343,48 @@ int CmdLine::Parse(int argc, wchar_t* argv[])
             SynthesizeSaveGraph();
     }
 
+    if (m_chunks >= 2)  //chunked encoding requested
+    {
+        if (m_two_pass < 1)
+        {
+            wcout << L"Chunked encoding requires two-pass mode." << endl;
+            return 1;
+        }
+
+        if (m_live)
+        {
+            wcout << L"Chunked encoding is not supported in live mode."
+                  << endl;
+
+            return 1;
+        }
+    }
+
+    if (!m_ladder.empty())  //multi-rendition encoding requested
+    {
+        if (m_two_pass >= 1)
+        {
+            wcout << L"Two-pass encoding is not supported with a ladder."
+                  << endl;
+
+            return 1;
+        }
+
+        if (m_chunks >= 2)
+        {
+            wcout << L"Chunked encoding is not supported with a ladder."
+                  << endl;
+
+            return 1;
+        }
+
+        if (m_no_video)
+        {
+            wcout << L"A ladder requires video." << endl;
+            return 1;
+        }
+    }
+
     if (i < j)  //not all args consumed
     {
         if (m_list)
@@ -1637,6 +1697,43 @@ int CmdLine::ParseLongPost(
     if (status)
         return status;
 
+    status = ParseOpt(i, arg, len, L"chunks", m_chunks, 1, 64);
+
+    if (status)
+        return status;
+
+    if (_wcsnicmp(arg, L"ladder", len) == 0)
+    {
+        int n;
+        const wchar_t* value;
+
+        if (has_value)
+        {
+            value = arg + len + 1;
+            n = 1;
+        }
+        else
+        {
+            value = *++i;
+
+            if (value == 0)
+            {
+                wcout << "No value specified for ladder switch." << endl;
+                return -1;  //error
+            }
+
+            n = 2;
+        }
+
+        if (!ParseLadder(value))
+        {
+            wcout << "Bad value specified for ladder switch." << endl;
+            return -1;  //error
+        }
+
+        return n;
+    }
+
     wcout << "Unknown switch: " << *i
           << "\nUse /help or --help to get usage info."
           << endl;
@@ -1901,6 +1998,69 @@ int CmdLine::GetCPUUsed() const
     return m_cpu_used;
 }
 
+int CmdLine::GetChunks() const
+{
+    return m_chunks;
+}
+
+const CmdLine::renditions_t& CmdLine::GetLadder() const
+{
+    return m_ladder;
+}
+
+bool CmdLine::ParseLadder(const wchar_t* value)
+{
+    assert(value);
+
+    //WxH:kbps[,WxH:kbps...]
+
+    m_ladder.clear();
+
+    for (;;)
+    {
+        Rendition r;
+        wchar_t* end;
+
+        r.width = wcstol(value, &end, 10);
+
+        if ((end == value) || ((*end != L'x') && (*end != L'X')))
+            return false;
+
+        value = end + 1;
+        r.height = wcstol(value, &end, 10);
+
+        if ((end == value) || (*end != L':'))
+            return false;
+
+        value = end + 1;
+        r.target_bitrate = wcstol(value, &end, 10);
+
+        if (end == value)
+            return false;
+
+        //The encoder requires even frame sizes.
+
+        if ((r.width <= 0) || (r.width % 2))
+            return false;
+
+        if ((r.height <= 0) || (r.height % 2))
+            return false;
+
+        if (r.target_bitrate <= 0)
+            return false;
+
+        m_ladder.push_back(r);
+
+        if (*end == L'\0')
+            return true;
+
+        if (*end != L',')
+            return false;
+
+        value = end + 1;
+    }
+}
+
 void CmdLine::PrintVersion() const
 {
     wcout << "makewebm ";
@@ -2219,6 +2379,20 @@ void CmdLine::ListArgs() const
     if (m_cpu_used >= -16)
         wcout << L"cpu-used: " << m_cpu_used << L'\n';
 
+    if (m_chunks >= 0)
+        wcout << L"chunks: " << m_chunks << L'\n';
+
+    typedef renditions_t::const_iterator iter_t;
+
+    for (iter_t iter = m_ladder.begin(); iter != m_ladder.end(); ++iter)
+    {
+        const Rendition& r = *iter;
+
+        wcout << L"ladder: "
+              << r.width << L'x' << r.height
+              << L" @ " << r.target_bitrate << L" kbps\n";
+    }
+
     wcout << endl;
 }
 
@@ -8,6 +8,7 @@
 
 #pragma once
 #include <string>
+#include <vector>
 //#include <limits>
 #include <climits>
 
@@ -66,6 +67,17 @@ public:
     int GetOggToWebm() const;
     int GetCPUUsed() const;
     int GetEncoderKind() const;
+    int GetChunks() const;
+
+    struct Rendition
+    {
+        int width;
+        int height;
+        int target_bitrate;  //kbps
+    };
+
+    typedef std::vector<Rendition> renditions_t;
+    const renditions_t& GetLadder() const;
 
     static std::wstring GetPath(const wchar_t*);
 
@@ -119,6 +131,8 @@ private:
     int m_arnr_type;
     int m_ogg_to_webm;
     int m_cpu_used;
+    int m_chunks;
+    renditions_t m_ladder;
 
     std::wstring m_save_graph_file_str;
     const wchar_t* m_save_graph_file_ptr;
@@ -134,6 +148,7 @@ private:
     void ListArgs() const;
     void SynthesizeOutput();
     void SynthesizeSaveGraph();
+    bool ParseLadder(const wchar_t*);
 
 //doesn't compile for some reason
 //    enum { kValueIsRequired = std::numeric_limits<int>::min() };
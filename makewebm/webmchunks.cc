@@ -0,0 +1,528 @@
+// Copyright (c) 2010 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <objbase.h>
+#include <vfwmsgs.h>
+#include "webmchunks.h"
+#include "mkvparser.hpp"
+#include <cassert>
+#include <memory>
+
+namespace
+{
+
+//Reads a chunk file for mkvparser.  The chunk files are local and
+//complete, so all of a file is always available.
+
+class Reader : public mkvparser::IMkvReader
+{
+    Reader(const Reader&);
+    Reader& operator=(const Reader&);
+
+public:
+    Reader();
+    virtual ~Reader();
+
+    HRESULT Open(const wchar_t*);
+
+    int Read(long long pos, long len, unsigned char* buf);
+    int Length(long long* total, long long* available);
+
+private:
+    HANDLE m_hFile;
+    LONGLONG m_pos;
+    LONGLONG m_size;
+
+};
+
+
+Reader::Reader() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_pos(0),
+    m_size(0)
+{
+}
+
+
+Reader::~Reader()
+{
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        const BOOL b = CloseHandle(m_hFile);
+        b;
+        assert(b);
+    }
+}
+
+
+HRESULT Reader::Open(const wchar_t* strFileName)
+{
+    if (strFileName == 0)
+        return E_INVALIDARG;
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+        return E_UNEXPECTED;
+
+    m_hFile = CreateFile(
+                strFileName,
+                GENERIC_READ,
+                FILE_SHARE_READ,
+                0,  //security attributes
+                OPEN_EXISTING,
+                FILE_FLAG_SEQUENTIAL_SCAN,
+                0);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    LARGE_INTEGER size;
+
+    const BOOL b = GetFileSizeEx(m_hFile, &size);
+
+    if (!b)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_size = size.QuadPart;
+    assert(m_size >= 0);
+
+    m_pos = 0;
+
+    return S_OK;
+}
+
+
+int Reader::Read(long long pos, long len, unsigned char* buf)
+{
+    if ((pos < 0) || (len < 0))
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    if (pos >= m_size)
+        return -1;
+
+    if (len > (m_size - pos))
+        return -1;
+
+    if (pos != m_pos)
+    {
+        LARGE_INTEGER li;
+        li.QuadPart = pos;
+
+        const BOOL b = SetFilePointerEx(m_hFile, li, 0, FILE_BEGIN);
+
+        if (!b)
+            return -1;
+
+        m_pos = pos;
+    }
+
+    while (len > 0)
+    {
+        DWORD cb;
+
+        const BOOL b = ReadFile(m_hFile, buf, DWORD(len), &cb, 0);
+
+        if (!b || (cb == 0))
+            return -1;
+
+        buf += cb;
+        len -= cb;
+        m_pos += cb;
+    }
+
+    return 0;  //success
+}
+
+
+int Reader::Length(long long* total, long long* available)
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return -1;
+
+    if (total)
+        *total = m_size;
+
+    if (available)
+        *available = m_size;
+
+    return 0;
+}
+
+
+HRESULT LoadSegment(Reader& reader, std::auto_ptr<mkvparser::Segment>& seg)
+{
+    long long pos;
+
+    mkvparser::EBMLHeader h;
+
+    long long result = h.Parse(&reader, pos);
+
+    if (result != 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    mkvparser::Segment* p;
+
+    result = mkvparser::Segment::CreateInstance(&reader, pos, p);
+
+    if (result != 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    assert(p);
+    seg.reset(p);
+
+    const long status = p->Load();
+
+    if (status < 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    return S_OK;
+}
+
+
+const mkvparser::VideoTrack* FindVideoTrack(const mkvparser::Segment* p)
+{
+    const mkvparser::Tracks* const pTracks = p->GetTracks();
+
+    if (pTracks == 0)
+        return 0;
+
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const mkvparser::Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if ((pTrack != 0) && (pTrack->GetType() == 1))  //video
+            return static_cast<const mkvparser::VideoTrack*>(pTrack);
+    }
+
+    return 0;
+}
+
+}  //end unnamed namespace
+
+
+ChunkWriter::ChunkWriter() :
+    m_track(0)
+{
+}
+
+
+ChunkWriter::~ChunkWriter()
+{
+}
+
+
+HRESULT ChunkWriter::Open(const wchar_t* strFileName)
+{
+    HRESULT hr = m_file.Open(strFileName);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (!m_segment.Init(&m_file))
+        return E_FAIL;
+
+    m_segment.set_mode(mkvmuxer::Segment::kFile);
+
+    mkvmuxer::SegmentInfo* const pInfo = m_segment.GetSegmentInfo();
+    assert(pInfo);
+
+    pInfo->set_writing_app("makewebm");
+
+    m_track = 0;
+
+    return S_OK;
+}
+
+
+HRESULT ChunkWriter::Append(
+    const wchar_t* strFileName,
+    LONGLONG start,
+    LONGLONG stop)
+{
+    assert(start >= 0);
+    assert((stop < 0) || (stop > start));
+
+    Reader reader;
+
+    HRESULT hr = reader.Open(strFileName);
+
+    if (FAILED(hr))
+        return hr;
+
+    std::auto_ptr<mkvparser::Segment> pSegment;
+
+    hr = LoadSegment(reader, pSegment);
+
+    if (FAILED(hr))
+        return hr;
+
+    const mkvparser::VideoTrack* const pTrack = FindVideoTrack(pSegment.get());
+
+    if (pTrack == 0)
+        return VFW_E_INVALID_FILE_FORMAT;
+
+    //The track of the joined file is created from the first chunk.
+
+    if (m_track == 0)
+    {
+        const mkvmuxer::uint64 n = m_segment.AddVideoTrack(
+                                    static_cast<int>(pTrack->GetWidth()),
+                                    static_cast<int>(pTrack->GetHeight()),
+                                    0);  //assign track number
+
+        if (n == 0)
+            return E_FAIL;
+
+        typedef mkvmuxer::VideoTrack VT;
+        VT* const t = static_cast<VT*>(m_segment.GetTrackByNumber(n));
+        assert(t);
+
+        t->set_codec_id(pTrack->GetCodecId());
+
+        size_t cp_size;
+        const unsigned char* const cp = pTrack->GetCodecPrivate(cp_size);
+
+        if ((cp != 0) && (cp_size > 0) && !t->set_codec_private(cp, cp_size))
+            return E_OUTOFMEMORY;
+
+        const double r = pTrack->GetFrameRate();
+
+        if (r > 0)
+            t->set_frame_rate(r);
+
+        if (!m_segment.CuesTrack(n))
+            return E_FAIL;
+
+        m_track = n;
+    }
+
+    const long long track = pTrack->GetNumber();
+    const LONGLONG offset_ns = start * 100;
+    const LONGLONG stop_ns = (stop < 0) ? -1 : (stop - start) * 100;
+
+    using mkvparser::Cluster;
+    using mkvparser::BlockEntry;
+    using mkvparser::Block;
+
+    const Cluster* pCluster = pSegment->GetFirst();
+
+    while ((pCluster != 0) && !pCluster->EOS())
+    {
+        const BlockEntry* pEntry;
+
+        long status = pCluster->GetFirst(pEntry);
+
+        if (status < 0)
+            return VFW_E_INVALID_FILE_FORMAT;
+
+        while ((pEntry != 0) && !pEntry->EOS())
+        {
+            const Block* const pBlock = pEntry->GetBlock();
+            assert(pBlock);
+
+            if (pBlock->GetTrackNumber() == track)
+            {
+                const LONGLONG ns = pBlock->GetTime(pCluster);
+
+                //VPx frames are stored in presentation order, so
+                //every frame that follows is past the stop too.
+
+                if ((stop_ns >= 0) && (ns >= stop_ns))
+                    return S_OK;
+
+                const int n = pBlock->GetFrameCount();
+
+                for (int i = 0; i < n; ++i)
+                {
+                    const Block::Frame& f = pBlock->GetFrame(i);
+
+                    if (f.len <= 0)
+                        return VFW_E_INVALID_FILE_FORMAT;
+
+                    m_buf.resize(f.len);
+
+                    if (f.Read(&reader, &m_buf[0]) != 0)
+                        return VFW_E_INVALID_FILE_FORMAT;
+
+                    const bool b = m_segment.AddFrame(
+                                    &m_buf[0],
+                                    m_buf.size(),
+                                    m_track,
+                                    offset_ns + ns,
+                                    pBlock->IsKey());
+
+                    if (!b)
+                        return E_FAIL;
+                }
+            }
+
+            status = pCluster->GetNext(pEntry, pEntry);
+
+            if (status < 0)
+                return VFW_E_INVALID_FILE_FORMAT;
+        }
+
+        pCluster = pSegment->GetNext(pCluster);
+    }
+
+    return S_OK;
+}
+
+
+HRESULT ChunkWriter::Close()
+{
+    //The muxer writes the last cluster, the Cues and the SeekHead, and
+    //then rewrites the segment size and duration.
+
+    const bool b = (m_track != 0) && m_segment.Finalize();
+
+    const HRESULT hr = m_file.Close();
+
+    if (!b)
+        return E_FAIL;
+
+    return hr;
+}
+
+
+ChunkWriter::File::File() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_pos(0)
+{
+}
+
+
+ChunkWriter::File::~File()
+{
+    const HRESULT hr = Close();
+    hr;
+    assert(SUCCEEDED(hr));
+}
+
+
+HRESULT ChunkWriter::File::Open(const wchar_t* strFileName)
+{
+    if (strFileName == 0)
+        return E_INVALIDARG;
+
+    if (m_hFile != INVALID_HANDLE_VALUE)
+        return E_UNEXPECTED;
+
+    m_hFile = CreateFile(
+                strFileName,
+                GENERIC_WRITE,
+                0,  //no sharing
+                0,  //security attributes
+                CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL,
+                0);
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    m_pos = 0;
+
+    return S_OK;
+}
+
+
+HRESULT ChunkWriter::File::Close()
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return S_FALSE;
+
+    const BOOL b = CloseHandle(m_hFile);
+
+    m_hFile = INVALID_HANDLE_VALUE;
+
+    if (!b)
+    {
+        const DWORD e = GetLastError();
+        return HRESULT_FROM_WIN32(e);
+    }
+
+    return S_OK;
+}
+
+
+mkvmuxer::int32 ChunkWriter::File::Write(
+    const void* buf,
+    mkvmuxer::uint32 len)
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return -1;
+
+    const BYTE* ptr = static_cast<const BYTE*>(buf);
+
+    while (len > 0)
+    {
+        DWORD cb;
+
+        const BOOL b = WriteFile(m_hFile, ptr, len, &cb, 0);
+
+        if (!b)
+            return -1;
+
+        ptr += cb;
+        len -= cb;
+        m_pos += cb;
+    }
+
+    return 0;  //success
+}
+
+
+mkvmuxer::int64 ChunkWriter::File::Position() const
+{
+    return m_pos;
+}
+
+
+mkvmuxer::int32 ChunkWriter::File::Position(mkvmuxer::int64 pos)
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return -1;
+
+    LARGE_INTEGER li;
+    li.QuadPart = pos;
+
+    const BOOL b = SetFilePointerEx(m_hFile, li, 0, FILE_BEGIN);
+
+    if (!b)
+        return -1;
+
+    m_pos = pos;
+
+    return 0;  //success
+}
+
+
+bool ChunkWriter::File::Seekable() const
+{
+    return true;
+}
+
+
+void ChunkWriter::File::ElementStartNotify(
+    mkvmuxer::uint64,
+    mkvmuxer::int64)
+{
+}
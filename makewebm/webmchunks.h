@@ -0,0 +1,77 @@
+// Copyright (c) 2010 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <vector>
+#include "mkvmuxer.hpp"
+
+//Chunked two-pass encoding splits the input into pieces of about equal
+//duration, encodes the pieces concurrently, and then joins the chunk
+//files together.
+
+//Joins the video of chunk files into one WebM file.  The frames of each
+//chunk are read with mkvparser and written with mkvmuxer, which builds
+//the Cues, SeekHead, segment size and duration when the file is closed.
+
+class ChunkWriter
+{
+    ChunkWriter(const ChunkWriter&);
+    ChunkWriter& operator=(const ChunkWriter&);
+
+public:
+    ChunkWriter();
+    ~ChunkWriter();
+
+    HRESULT Open(const wchar_t*);
+
+    //The frame times of a chunk file are relative to the chunk start.
+    //Frames at or past the chunk stop are dropped, since a source may
+    //deliver frames past its stop position; the stop is -1 for the
+    //last chunk.
+
+    HRESULT Append(
+        const wchar_t*,
+        LONGLONG start,  //reftime
+        LONGLONG stop);  //reftime
+
+    HRESULT Close();
+
+private:
+
+    class File : public mkvmuxer::IMkvWriter
+    {
+        File(const File&);
+        File& operator=(const File&);
+
+    public:
+        File();
+        ~File();
+
+        HRESULT Open(const wchar_t*);
+        HRESULT Close();
+
+        mkvmuxer::int32 Write(const void*, mkvmuxer::uint32);
+        mkvmuxer::int64 Position() const;
+        mkvmuxer::int32 Position(mkvmuxer::int64);
+        bool Seekable() const;
+        void ElementStartNotify(mkvmuxer::uint64, mkvmuxer::int64);
+
+    private:
+        HANDLE m_hFile;
+        LONGLONG m_pos;
+
+    };
+
+    File m_file;
+    mkvmuxer::Segment m_segment;
+    mkvmuxer::uint64 m_track;  //video track number, or 0 if none yet
+
+    typedef std::vector<BYTE> buf_t;
+    buf_t m_buf;  //frame being copied
+
+};
@@ -83,7 +83,13 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_bDirty(false),
       m_bForceKeyframe(false),
       m_keyframe_interval(0),
-      m_decimate(0)
+      m_decimate(0),
+      m_encode_queue_depth(kDefaultEncodeQueue),
+      m_encode_queue_mode(kEncodeQueueBlock),
+      m_timebase_num(1),
+      m_timebase_den(kDefaultTimebaseDen),
+      m_scaled_width(0),
+      m_scaled_height(0)
 {
     m_pClassFactory->LockServer(TRUE);
 
@@ -192,6 +198,18 @@ HRESULT Filter::CNondelegating::QueryInterface(
     {
         pUnk = static_cast<IPersistStream*>(m_pFilter);
     }
+    else if (iid == __uuidof(IVPXEncoder4))
+    {
+        pUnk = static_cast<IVPXEncoder4*>(m_pFilter);
+    }
+    else if (iid == __uuidof(IVPXEncoder3))
+    {
+        pUnk = static_cast<IVPXEncoder3*>(m_pFilter);
+    }
+    else if (iid == __uuidof(IVPXEncoder2))
+    {
+        pUnk = static_cast<IVPXEncoder2*>(m_pFilter);
+    }
     else if (iid == __uuidof(IVPXEncoder))
     {
         pUnk = static_cast<IVPXEncoder*>(m_pFilter);
@@ -299,6 +317,16 @@ HRESULT Filter::Stop()
             break;
     }
 
+    //With the outpins' allocators decommitted, the encoder thread cannot
+    //be blocked, so it's safe to wait for it.  If we were stopped already,
+    //a Stop on another thread might still be waiting for it, and we must
+    //not return before it terminates either.
+
+    hr = m_inpin.JoinThread(lock);
+
+    if (FAILED(hr))
+        return hr;
+
     return S_OK;
 }
 
@@ -318,6 +346,14 @@ HRESULT Filter::Pause()
     //odbgstream os;
     //os << "mkvsplit::Filter::Pause" << endl;
 
+    if (m_state == State_Stopped)  //Stop might still be joining the thread
+    {
+        hr = m_inpin.JoinThread(lock);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
     switch (m_state)
     {
         case State_Stopped:
@@ -351,6 +387,14 @@ HRESULT Filter::Run(REFERENCE_TIME start)
     //odbgstream os;
     //os << "mkvsplit::Filter::Run" << endl;
 
+    if (m_state == State_Stopped)  //Stop might still be joining the thread
+    {
+        hr = m_inpin.JoinThread(lock);
+
+        if (FAILED(hr))
+            return hr;
+    }
+
     switch (m_state)
     {
         case State_Stopped:
@@ -1953,6 +1997,157 @@ HRESULT Filter::GetEncoderKind(VPXEncoderKind* pEncoderKind)
 }
 
 
+HRESULT Filter::SetEncodeQueue(int depth, VPXEncodeQueueMode mode)
+{
+    if ((depth < 1) || (depth > kMaxEncodeQueue))
+        return E_INVALIDARG;
+
+    switch (mode)
+    {
+        case kEncodeQueueBlock:
+        case kEncodeQueueDropOldest:
+        case kEncodeQueueDropNewest:
+            break;
+
+        default:
+            return E_INVALIDARG;
+    }
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_encode_queue_depth = depth;
+    m_encode_queue_mode = mode;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetEncodeQueue(int* pDepth, VPXEncodeQueueMode* pMode)
+{
+    if ((pDepth == 0) || (pMode == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pDepth = m_encode_queue_depth;
+    *pMode = m_encode_queue_mode;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetTimebase(int num, int den)
+{
+    //A tick finer than a reftime unit buys nothing.  The conversions in
+    //Inpin::ToTimebase and FromTimebase rely on this bound.
+
+    if ((num < 1) || (den < 1) || (den > kMaxTimebaseDen))
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_timebase_num = num;
+    m_timebase_den = den;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetTimebase(int* pNum, int* pDen)
+{
+    if ((pNum == 0) || (pDen == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pNum = m_timebase_num;
+    *pDen = m_timebase_den;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetScaledSize(int width, int height)
+{
+    if ((width == 0) != (height == 0))
+        return E_INVALIDARG;
+
+    if ((width < 0) || (width > kMaxScaledSize) || (width % 2))
+        return E_INVALIDARG;
+
+    if ((height < 0) || (height > kMaxScaledSize) || (height % 2))
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    if (bool(m_outpin_video.m_pPinConnection))
+        return VFW_E_ALREADY_CONNECTED;
+
+    m_scaled_width = width;
+    m_scaled_height = height;
+
+    //The size is part of the media types the video outpin offers.
+
+    if (bool(m_inpin.m_pPinConnection))
+        m_outpin_video.OnInpinConnect();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetScaledSize(int* pWidth, int* pHeight)
+{
+    if ((pWidth == 0) || (pHeight == 0))
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pWidth = m_scaled_width;
+    *pHeight = m_scaled_height;
+
+    return S_OK;
+}
+
+
 HRESULT Filter::IsDirty()
 {
     Lock lock;
@@ -2105,6 +2300,8 @@ HRESULT Filter::OnStart()
         return hr;
     }
 
+    m_inpin.StartThread();
+
     return S_OK;
 }
 
@@ -19,7 +19,7 @@ namespace VP8EncoderLib
 {
 
 class Filter : public IBaseFilter,
-               public IVPXEncoder,
+               public IVPXEncoder4,
                public IPersistStream,
                public ISpecifyPropertyPages,
                public CLockable
@@ -175,6 +175,21 @@ public:
     HRESULT STDMETHODCALLTYPE SetEncoderKind(VPXEncoderKind);
     HRESULT STDMETHODCALLTYPE GetEncoderKind(VPXEncoderKind*);
 
+    //IVPXEncoder2
+
+    HRESULT STDMETHODCALLTYPE SetEncodeQueue(int, VPXEncodeQueueMode);
+    HRESULT STDMETHODCALLTYPE GetEncodeQueue(int*, VPXEncodeQueueMode*);
+
+    //IVPXEncoder3
+
+    HRESULT STDMETHODCALLTYPE SetTimebase(int, int);
+    HRESULT STDMETHODCALLTYPE GetTimebase(int*, int*);
+
+    //IVPXEncoder4
+
+    HRESULT STDMETHODCALLTYPE SetScaledSize(int, int);
+    HRESULT STDMETHODCALLTYPE GetScaledSize(int*, int*);
+
     //IPersistStream
 
     HRESULT STDMETHODCALLTYPE IsDirty();
@@ -268,6 +283,18 @@ public:
     int m_decimate;
     VP8PassMode GetPassMode() const;
 
+    enum { kMaxEncodeQueue = 32, kDefaultEncodeQueue = 4 };
+    int m_encode_queue_depth;
+    VPXEncodeQueueMode m_encode_queue_mode;
+
+    enum { kMaxTimebaseDen = 10000000, kDefaultTimebaseDen = 90000 };
+    int m_timebase_num;
+    int m_timebase_den;
+
+    enum { kMaxScaledSize = 16382 };  //even, and within VP8's 14 bits
+    int m_scaled_width;   //0 means input width
+    int m_scaled_height;  //0 means input height
+
 private:
     HRESULT OnStart();
     void OnStop();
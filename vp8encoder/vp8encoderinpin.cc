@@ -10,6 +10,7 @@
 #include "vp8encoderfilter.h"
 #include "vp8encoderoutpin.h"
 #include "mediatypeutil.h"
+#include "libyuv_util.h"
 #include "webmtypes.h"
 #include "vpx/vp8cx.h"
 #include <vfwmsgs.h>
@@ -17,6 +18,7 @@
 #include <cassert>
 #include <amvideo.h>   //VideoInfoHeader
 #include <dvdmedia.h>  //VideoInfoHeader2
+#include <process.h>
 #ifdef _DEBUG
 #include "odbgstream.h"
 #include <iomanip>
@@ -32,9 +34,13 @@ Inpin::Inpin(Filter* p) :
     Pin(p, PINDIR_INPUT, L"input"),
     m_bEndOfStream(false),
     m_bFlush(false),
+    m_bStopped(true),
     m_bDiscontinuity(true),
-    m_buf(0),
-    m_buflen(0),
+    m_queue_count(0),
+    m_hThread(0),
+    m_cThreads(0),
+    m_hrDeliver(S_OK),
+    m_bConfigChanged(false),
     m_last_keyframe_time(0),
     m_frames_received(0),
     m_decimate_start_time(0)
@@ -61,14 +67,29 @@ Inpin::Inpin(Filter* p) :
 
     mt.subtype = MEDIASUBTYPE_YUYV;
     m_preferred_mtv.Add(mt);
+
+    mt.subtype = MEDIASUBTYPE_UYVY;
+    m_preferred_mtv.Add(mt);
+
+    m_hQueue = CreateEvent(0, 0, 0, 0);
+    assert(m_hQueue);
+
+    m_hRoom = CreateEvent(0, 0, 0, 0);
+    assert(m_hRoom);
 }
 
 
 Inpin::~Inpin()
 {
+    assert(m_hThread == 0);
+
     PurgePending();
 
-    delete[] m_buf;
+    BOOL b = CloseHandle(m_hQueue);
+    assert(b);
+
+    b = CloseHandle(m_hRoom);
+    assert(b);
 }
 
 
@@ -238,104 +259,16 @@ HRESULT Inpin::EndOfStream()
 
     m_bEndOfStream = true;
 
-    const vpx_codec_err_t err = vpx_codec_encode(&m_ctx, 0, 0, 0, 0, 0);
-    err;
-    assert(err == VPX_CODEC_OK);  //TODO
-
-    const VP8PassMode m = m_pFilter->GetPassMode();
-
-    OutpinVideo& outpin = m_pFilter->m_outpin_video;
-
-    vpx_codec_iter_t iter = 0;
-
-    for (;;)
-    {
-        const vpx_codec_cx_pkt_t* const pkt =
-            vpx_codec_get_cx_data(&m_ctx, &iter);
+    //The end-of-stream marker is not subject to the queue depth.  The
+    //encoder thread flushes the encoder when it reaches the marker,
+    //and then sends end-of-stream downstream.
 
-        if (pkt == 0)
-            break;
+    images_t staged;
 
-        switch (pkt->kind)
-        {
-            case VPX_CODEC_CX_FRAME_PKT:
-                assert(m != kPassModeFirstPass);
-                AppendFrame(pkt);
-                break;
+    Image& image = StageImage(staged);
+    image.eos = true;
 
-            case VPX_CODEC_STATS_PKT:
-                assert(m == kPassModeFirstPass);
-                outpin.WriteStats(pkt);
-                break;
-
-            default:
-                assert(false);
-                return E_FAIL;
-        }
-    }
-
-    if (m != kPassModeFirstPass)
-    {
-        while (!m_pending.empty())
-        {
-            if (!bool(outpin.m_pAllocator))
-                break;
-
-            lock.Release();
-
-            GraphUtil::IMediaSamplePtr pOutSample;
-
-            const HRESULT hrGetBuffer =
-                outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
-
-            hr = lock.Seize(m_pFilter);
-
-            if (FAILED(hr))
-                return hr;
-
-            if (FAILED(hrGetBuffer))
-                break;
-
-            assert(bool(pOutSample));
-
-            PopulateSample(pOutSample);  //consume pending frame
-
-            if (!bool(outpin.m_pInputPin))
-                break;
-
-            lock.Release();
-
-            const HRESULT hrReceive = outpin.m_pInputPin->Receive(pOutSample);
-
-            hr = lock.Seize(m_pFilter);
-
-            if (FAILED(hr))
-                return hr;
-
-            if (hrReceive != S_OK)
-                break;
-        }
-    }
-
-    //We hold the lock.
-
-    if (IPin* pPin = m_pFilter->m_outpin_preview.m_pPinConnection)
-    {
-        lock.Release();
-
-        hr = pPin->EndOfStream();
-
-        hr = lock.Seize(m_pFilter);
-        assert(SUCCEEDED(hr));  //TODO
-    }
-
-    //We hold the lock.
-
-    if (IPin* pPin = outpin.m_pPinConnection)
-    {
-        lock.Release();
-        hr = pPin->EndOfStream();
-    }
+    QueueImage(staged);
 
     return S_OK;
 }
@@ -358,6 +291,13 @@ HRESULT Inpin::BeginFlush()
     //    return S_FALSE;
 
     m_bFlush = true;
+    m_bEndOfStream = false;  //queued end-of-stream is flushed too
+
+    FlushQueue();
+
+    const BOOL b = SetEvent(m_hRoom);  //release Receive, if waiting
+    b;
+    assert(b);
 
     //We hold the lock
 
@@ -396,6 +336,7 @@ HRESULT Inpin::EndFlush()
         return VFW_E_NOT_CONNECTED;
 
     m_bFlush = false;
+    m_hrDeliver = S_OK;
 
     //We hold the lock
 
@@ -482,6 +423,9 @@ HRESULT Inpin::QueryAccept(const AM_MEDIA_TYPE* pmt)
     else if (mt.subtype == MEDIASUBTYPE_YUYV)
         __noop;
 
+    else if (mt.subtype == MEDIASUBTYPE_UYVY)
+        __noop;
+
     else
         return S_FALSE;
 
@@ -621,6 +565,9 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     if (m_bFlush)
         return S_FALSE;
 
+    if (m_hrDeliver != S_OK)  //downstream refused a frame
+        return m_hrDeliver;
+
     const BITMAPINFOHEADER& bmih = GetBMIH();
 
     const LONG w = bmih.biWidth;
@@ -650,6 +597,9 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     {
         fmt = VPX_IMG_FMT_YUY2;
     }
+    else if (mt.subtype == MEDIASUBTYPE_UYVY)
+        fmt = VPX_IMG_FMT_UYVY;
+
     else
     {
         assert(false);
@@ -662,28 +612,68 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     assert(SUCCEEDED(hr));
     assert(inbuf);
 
-    BYTE* imgbuf;
+    __int64 st, sp;
+
+    hr = pInSample->GetTime(&st, &sp);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_pFilter->m_decimate > 1)
+    {
+        if (m_frames_received++ % m_pFilter->m_decimate)
+            return S_OK;
+    }
+
+    //The frame is copied (or converted) into a queue buffer, since
+    //the encoder thread consumes it after the input sample has been
+    //returned to upstream.
+
+    //When a scaled size has been requested, the input frame is scaled
+    //straight into the queue buffer, so the full size frame is never
+    //copied (packed input is first converted into m_convert_buf).
+
+    LONG ew, eh;
+    GetEncodedSize(ew, eh);
+
+    const bool bScale = (ew != w) || (eh != h);
+
+    images_t staged;
+    Image& image = StageImage(staged);
+
+    const ULONG imglen = ew*eh + 2*((ew+1)/2)*((eh+1)/2);
+    image.buf.resize(imglen);  //reuses buffer's storage
+
+    BYTE* const imgbuf = &image.buf[0];
+    BYTE* srcbuf = imgbuf;  //frame at input size
 
     switch (fmt)
     {
         case VPX_IMG_FMT_YV12:
         case VPX_IMG_FMT_I420:
         {
-            assert(len == (w*h + 2*((w+1)/2)*((h+1)/2)));
+            assert(len == long(w*h + 2*((w+1)/2)*((h+1)/2)));
 
-            imgbuf = inbuf;
-            assert(imgbuf);
+            if (bScale)
+                srcbuf = inbuf;
+            else
+                memcpy(imgbuf, inbuf, imglen);
 
             break;
         }
         case VPX_IMG_FMT_YUY2:
+        case VPX_IMG_FMT_UYVY:
         {
             assert(len == ((2*w) * h));
 
-            fmt = VPX_IMG_FMT_YV12;
+            if (bScale)
+            {
+                m_convert_buf.resize(w*h + 2*((w+1)/2)*((h+1)/2));
+                srcbuf = &m_convert_buf[0];
+            }
 
-            imgbuf = ConvertYUY2ToYV12(inbuf, w, h);
-            assert(imgbuf);
+            ConvertToYV12(fmt, inbuf, w, h, srcbuf);
+            fmt = VPX_IMG_FMT_YV12;
 
             break;
         }
@@ -692,21 +682,8 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
             return E_FAIL;
     }
 
-    __int64 st, sp;
-
-    hr = pInSample->GetTime(&st, &sp);
-
-    if (FAILED(hr))
-        return hr;
-
-    if (m_pFilter->m_decimate > 1)
-    {
-        if (m_frames_received++ % m_pFilter->m_decimate)
-            return S_OK;
-    }
-
     vpx_image_t img_;
-    vpx_image_t* const img = vpx_img_wrap(&img_, fmt, w, h, 1, imgbuf);
+    vpx_image_t* const img = vpx_img_wrap(&img_, fmt, w, h, 1, srcbuf);
     assert(img);
     assert(img == &img_);
 
@@ -715,12 +692,36 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     status;
     assert(status == 0);
 
+    if (bScale)
+    {
+        const bool b = webmdshow::LibyuvScaleToPlanar(
+                        img,
+                        ew,
+                        eh,
+                        fmt,
+                        ew,
+                        imgbuf);
+
+        if (!b)
+        {
+            m_pool.splice(m_pool.end(), staged);
+            return E_FAIL;
+        }
+    }
+
+    image.w = ew;
+    image.h = eh;
+    image.fmt = fmt;
+
     m_pFilter->m_outpin_preview.Render(lock, img);
 
     OutpinVideo& outpin = m_pFilter->m_outpin_video;
 
     if (!bool(outpin.m_pPinConnection))
+    {
+        m_pool.splice(m_pool.end(), staged);
         return S_OK;
+    }
 
     if (st < 0)  //?
     {
@@ -740,6 +741,7 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
            << endl;
 #endif
 
+        m_pool.splice(m_pool.end(), staged);
         return S_OK;
     }
 
@@ -787,6 +789,7 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
            << endl;
 #endif
 
+        m_pool.splice(m_pool.end(), staged);
         return S_OK;
     }
     else
@@ -841,15 +844,175 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     const Filter::Config::int32_t deadline_ = m_pFilter->m_cfg.deadline;
     const ULONG dl = (deadline_ >= 0) ? deadline_ : kDeadlineGoodQuality;
 
-    const __int64 st2 = m_start_reftime / 10000;  // scale to ms
-    const unsigned long d2 = (d + 9999) / 10000;  // scale to ms
+    //The duration is the distance between the rounded start and stop
+    //ticks, so that consecutive frames tile the timeline exactly.
+
+    image.pts = ToTimebase(m_start_reftime);
+
+    const vpx_codec_pts_t stop = ToTimebase(m_start_reftime + d);
+    image.duration = (stop > image.pts) ? ULONG(stop - image.pts) : 1;
+    image.flags = f;
+    image.deadline = dl;
+    image.eos = false;
+
+    //The encoder has fallen behind.  Depending on the queue mode,
+    //either wait for it to make room, or drop a frame.  A forced
+    //keyframe is never lost with a dropped frame: it moves to the
+    //frame that replaces it.
+
+    while (m_queue_count >= m_pFilter->m_encode_queue_depth)
+    {
+        switch (m_pFilter->m_encode_queue_mode)
+        {
+            case kEncodeQueueDropNewest:
+                if (image.flags & VPX_EFLAG_FORCE_KF)
+                    m_pFilter->m_bForceKeyframe = true;
+
+                m_pool.splice(m_pool.end(), staged);
+                return S_OK;
+
+            case kEncodeQueueDropOldest:
+            {
+                const Image& oldest = m_queue.front();
+                assert(!oldest.eos);
+
+                const vpx_enc_frame_flags_t kf =
+                    oldest.flags & VPX_EFLAG_FORCE_KF;
+
+                m_pool.splice(m_pool.end(), m_queue, m_queue.begin());
+                --m_queue_count;
+
+                if (m_queue.empty())
+                    image.flags |= kf;
+                else
+                    m_queue.front().flags |= kf;
+
+                continue;
+            }
+            case kEncodeQueueBlock:
+            default:
+                break;
+        }
+
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return hr;
+
+        const DWORD dw = WaitForSingleObject(m_hRoom, INFINITE);
+
+        if (dw == WAIT_FAILED)
+            return E_FAIL;
+
+        assert(dw == WAIT_OBJECT_0);
+
+        hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return hr;
+
+        if (m_bStopped)
+            return VFW_E_NOT_RUNNING;
+
+        if (m_bFlush)
+            return S_FALSE;
+    }
+
+    QueueImage(staged);
+
+    return S_OK;
+}
+
+
+Inpin::Image& Inpin::StageImage(images_t& staged)
+{
+    //Filter is locked.
+
+    assert(staged.empty());
+
+    if (m_pool.empty())
+        m_pool.push_back(Image());
+
+    staged.splice(staged.end(), m_pool, m_pool.begin());
+
+    return staged.back();
+}
+
+
+void Inpin::QueueImage(images_t& staged)
+{
+    //Filter is locked.
+
+    assert(staged.size() == 1);
+
+    m_queue.splice(m_queue.end(), staged);
+    ++m_queue_count;
+
+    const BOOL b = SetEvent(m_hQueue);
+    b;
+    assert(b);
+}
+
+
+void Inpin::FlushQueue()
+{
+    //Filter is locked.
+
+    m_pool.splice(m_pool.end(), m_queue);
+    m_queue_count = 0;
+}
+
+
+void Inpin::Encode(Image& image)
+{
+    //Called on the encoder thread, without the filter lock.
+
+    if (image.eos)
+    {
+        const vpx_codec_err_t err = vpx_codec_encode(&m_ctx, 0, 0, 0, 0, 0);
+        err;
+        assert(err == VPX_CODEC_OK);  //TODO
+
+        return;
+    }
+
+    vpx_image_t img_;
+    vpx_image_t* const img = vpx_img_wrap(
+                                &img_,
+                                image.fmt,
+                                image.w,
+                                image.h,
+                                1,
+                                &image.buf[0]);
+    assert(img);
+    assert(img == &img_);
 
-    const vpx_codec_err_t err = vpx_codec_encode(&m_ctx, img, st2, d2, f, dl);
+    //TODO: set this based on vih.rcSource
+    const int status = vpx_img_set_rect(img, 0, 0, image.w, image.h);
+    status;
+    assert(status == 0);
+
+    const vpx_codec_err_t err = vpx_codec_encode(
+                                    &m_ctx,
+                                    img,
+                                    image.pts,
+                                    image.duration,
+                                    image.flags,
+                                    image.deadline);
     err;
     assert(err == VPX_CODEC_OK);  //TODO
+}
+
+
+HRESULT Inpin::DeliverFrames(CLockable::Lock& lock, bool bEOS)
+{
+    //Called on the encoder thread, with the filter locked.
 
     const VP8PassMode m = m_pFilter->GetPassMode();
 
+    OutpinVideo& outpin = m_pFilter->m_outpin_video;
+
     vpx_codec_iter_t iter = 0;
 
     for (;;)
@@ -878,41 +1041,78 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
         }
     }
 
-    if (m == kPassModeFirstPass)
-        return S_OK;  //nothing else to do
+    HRESULT hr;
 
-    while (!m_pending.empty())
+    if (m != kPassModeFirstPass)
     {
-        if (!bool(outpin.m_pAllocator))
-            return VFW_E_NO_ALLOCATOR;
+        while (!m_pending.empty() && (m_hrDeliver == S_OK))
+        {
+            if (!bool(outpin.m_pAllocator))
+                break;
 
-        lock.Release();
+            lock.Release();
 
-        GraphUtil::IMediaSamplePtr pOutSample;
+            GraphUtil::IMediaSamplePtr pOutSample;
 
-        hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+            const HRESULT hrGetBuffer =
+                outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
 
-        if (FAILED(hr))
-            return hr;
+            hr = lock.Seize(m_pFilter);
 
-        assert(bool(pOutSample));
+            if (FAILED(hr))
+                return hr;
 
-        hr = lock.Seize(m_pFilter);
+            if (m_bStopped || FAILED(hrGetBuffer))
+                return S_FALSE;
 
-        if (FAILED(hr))
-            return hr;
+            assert(bool(pOutSample));
 
-        PopulateSample(pOutSample);  //consume pending frame
+            PopulateSample(pOutSample);  //consume pending frame
 
-        if (!bool(outpin.m_pInputPin))
-            return S_FALSE;
+            if (!bool(outpin.m_pInputPin))
+                break;
+
+            lock.Release();
+
+            const HRESULT hrReceive = outpin.m_pInputPin->Receive(pOutSample);
+
+            hr = lock.Seize(m_pFilter);
+
+            if (FAILED(hr))
+                return hr;
 
+            if (m_bStopped)
+                return S_FALSE;
+
+            if ((hrReceive != S_OK) && !m_bFlush)
+                m_hrDeliver = hrReceive;  //stop upstream
+        }
+    }
+
+    if (!bEOS)
+        return S_OK;
+
+    //We hold the lock.
+
+    if (IPin* pPin = m_pFilter->m_outpin_preview.m_pPinConnection)
+    {
         lock.Release();
 
-        hr = outpin.m_pInputPin->Receive(pOutSample);
+        hr = pPin->EndOfStream();
 
-        if (hr != S_OK)
+        hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
             return hr;
+    }
+
+    //We hold the lock.
+
+    if (IPin* pPin = outpin.m_pPinConnection)
+    {
+        lock.Release();
+
+        hr = pPin->EndOfStream();
 
         hr = lock.Seize(m_pFilter);
 
@@ -987,15 +1187,26 @@ void Inpin::AppendFrame(const vpx_codec_cx_pkt_t* pkt)
 
     f.len = len;
 
-    f.start = pkt->data.frame.pts * 10000; // scale to 100 ns ticks
-    assert(f.start >= 0);
+    const vpx_codec_pts_t pts = pkt->data.frame.pts;
 
-#if 0
-    f.stop = f.start + pkt->data.frame.duration;
-    assert(f.stop > f.start);
-#else
-    f.stop = -1;  //don't send stop time
-#endif
+    if (pkt->data.frame.flags & VPX_FRAME_IS_INVISIBLE)
+    {
+        //The encoder stamps an altref frame one tick after the frame
+        //that precedes it.  At a fine timebase that tick vanishes in
+        //the muxer's millisecond timecodes, so place the altref 1ms
+        //after the preceding frame instead.
+
+        f.start = FromTimebase(pts - 1) + 10000;
+        f.stop = -1;  //altref has no duration
+    }
+    else
+    {
+        f.start = FromTimebase(pts);
+        f.stop = FromTimebase(pts + pkt->data.frame.duration);
+        assert(f.stop > f.start);
+    }
+
+    assert(f.start >= 0);
 
     const uint32_t bKey = pkt->data.frame.flags & VPX_FRAME_IS_KEY;
 #if 0 //def _DEBUG
@@ -1063,6 +1274,9 @@ HRESULT Inpin::ReceiveCanBlock()
     if (FAILED(hr))
         return S_OK;  //?
 
+    if (m_pFilter->m_encode_queue_mode == kEncodeQueueBlock)
+        return S_OK;  //Receive waits when the encode queue is full
+
     if (IMemInputPin* pPin = m_pFilter->m_outpin_video.m_pInputPin)
     {
         lock.Release();
@@ -1107,22 +1321,18 @@ void Inpin::PurgePending()
 
 HRESULT Inpin::Start()
 {
+    assert(m_hThread == 0);
+
     m_bDiscontinuity = true;
     m_bEndOfStream = false;
     m_bFlush = false;
+    m_bStopped = false;
+    m_hrDeliver = S_OK;
+    m_bConfigChanged = false;
     m_start_reftime = -1;  //first-time flag
 
     PurgePending();
-
-    const BITMAPINFOHEADER& bmih = GetBMIH();
-
-    const LONG w = bmih.biWidth;
-    assert(w > 0);
-    assert((w % 2) == 0);  //TODO
-
-    const LONG h = labs(bmih.biHeight);
-    assert(h > 0);
-    assert((h % 2) == 0);  //TODO
+    FlushQueue();
 
     vpx_codec_iface_t* codec;
 
@@ -1145,14 +1355,17 @@ HRESULT Inpin::Start()
     if (err != VPX_CODEC_OK)
         return E_FAIL;
 
-    tgt.g_w = w;
-    tgt.g_h = h;
-    tgt.g_timebase.num = 1;
-    tgt.g_timebase.den = 1000;  // millisecond ticks
-    // The filter scales to milliseconds because the encoder will generate
-    // altref frames that is one timestamp tick different than another frame.
-    // The default downstream filter has a resolution of milliseconds so set
-    // the encoder timebase to milliseconds.
+    LONG ew, eh;
+    GetEncodedSize(ew, eh);
+
+    tgt.g_w = ew;
+    tgt.g_h = eh;
+
+    // Rate control sees exact frame durations only if the timebase is
+    // fine enough to represent them; milliseconds round 29.97 and 59.94
+    // content.  See AppendFrame for how altref frames are stamped.
+    tgt.g_timebase.num = m_pFilter->m_timebase_num;
+    tgt.g_timebase.den = m_pFilter->m_timebase_den;
 
     SetConfig();
 
@@ -1249,6 +1462,26 @@ HRESULT Inpin::Start()
 }
 
 void Inpin::Stop()
+{
+    m_bStopped = true;
+
+    FlushQueue();
+
+    BOOL b = SetEvent(m_hQueue);  //tell encoder thread to terminate
+    assert(b);
+
+    b = SetEvent(m_hRoom);  //release Receive, if waiting
+    assert(b);
+
+    //The encoder thread might be inside vpx_codec_encode, so
+    //the codec is destroyed only after the thread has terminated.
+
+    if (m_hThread == 0)
+        DestroyCodec();
+}
+
+
+void Inpin::DestroyCodec()
 {
     const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
     err;
@@ -1258,8 +1491,189 @@ void Inpin::Stop()
 }
 
 
+void Inpin::StartThread()
+{
+    assert(m_hThread == 0);
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Inpin::ThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+
+    ++m_cThreads;
+}
+
+
+HRESULT Inpin::JoinThread(CLockable::Lock& lock)
+{
+    //Stop has released the encoder thread from its waits, and the
+    //outpins' allocators must be decommitted, so that the thread cannot
+    //be blocked in GetBuffer.  The thread needs the lock to terminate, so
+    //we wait without it.  Since the thread owns the codec while it runs,
+    //we wait for as long as it takes, and destroy the codec only after.
+    //
+    //Stop is not the only caller: a Pause or Run on another thread that
+    //finds the filter stopped must also wait for the thread, before
+    //Start reinitializes the codec.  Each caller waits on its own copy of
+    //the handle, and whoever gets back the lock first cleans up.
+
+    if (m_hThread == 0)
+        return S_OK;
+
+    const ULONG id = m_cThreads;
+    const HANDLE hProcess = GetCurrentProcess();
+
+    HANDLE hThread;
+
+    BOOL b = DuplicateHandle(
+                hProcess,
+                m_hThread,
+                hProcess,
+                &hThread,
+                SYNCHRONIZE,
+                FALSE,
+                0);
+
+    if (!b)
+        return E_FAIL;
+
+    HRESULT hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    const DWORD dw = WaitForSingleObject(hThread, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
+
+    b = CloseHandle(hThread);
+    assert(b);
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if ((m_hThread == 0) || (m_cThreads != id))  //already cleaned up
+        return S_OK;
+
+    b = CloseHandle(m_hThread);
+    assert(b);
+
+    m_hThread = 0;
+
+    DestroyCodec();
+
+    return S_OK;
+}
+
+
+unsigned Inpin::ThreadProc(void* pv)
+{
+    Inpin* const pPin = static_cast<Inpin*>(pv);
+    assert(pPin);
+
+    return pPin->Main();
+}
+
+
+unsigned Inpin::Main()
+{
+    images_t image;  //frame being encoded
+
+    for (;;)
+    {
+        Filter::Lock lock;
+
+        HRESULT hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return 0;
+
+        m_pool.splice(m_pool.end(), image);  //recycle storage
+
+        if (m_bStopped)
+            return 0;  //terminate thread
+
+        if (m_bFlush || m_queue.empty())
+        {
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            if (FAILED(hr))
+                return 0;
+
+            const DWORD dw = WaitForSingleObject(m_hQueue, INFINITE);
+
+            if (dw == WAIT_FAILED)
+                return 0;
+
+            assert(dw == WAIT_OBJECT_0);
+            continue;
+        }
+
+        image.splice(image.end(), m_queue, m_queue.begin());
+        --m_queue_count;
+
+        const BOOL b = SetEvent(m_hRoom);
+        b;
+        assert(b);
+
+        //Settings changed while running are applied between frames,
+        //since this thread is the only one touching the codec.
+
+        if (m_bConfigChanged)
+        {
+            m_bConfigChanged = false;
+
+            SetConfig();
+
+            const vpx_codec_err_t err =
+                vpx_codec_enc_config_set(&m_ctx, &m_cfg);
+            err;
+            assert(err == VPX_CODEC_OK);
+        }
+
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return 0;
+
+        Encode(image.front());
+
+        hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return 0;
+
+        if (m_bStopped)
+            return 0;
+
+        hr = DeliverFrames(lock, image.front().eos);
+
+        if (FAILED(hr))
+            return 0;
+    }
+}
+
+
 HRESULT Inpin::OnApplySettings(std::wstring& msg)
 {
+    if (m_hThread)  //encoder thread owns the codec
+    {
+        m_bConfigChanged = true;
+
+        msg.clear();
+        return S_OK;
+    }
+
     SetConfig();
 
     const vpx_codec_err_t err = vpx_codec_enc_config_set(&m_ctx, &m_cfg);
@@ -1506,102 +1920,109 @@ vpx_codec_err_t Inpin::SetStaticThreshold()
         &m_ctx, VP8E_SET_STATIC_THRESHOLD, src.static_threshold);
 }
 
-BYTE* Inpin::ConvertYUY2ToYV12(
-    const BYTE* srcbuf,
-    ULONG w,
-    ULONG h)
+vpx_codec_pts_t Inpin::ToTimebase(__int64 reftime) const
 {
-    assert(srcbuf);
-    assert((w % 2) == 0);  //TODO
-    assert((h % 2) == 0);  //TODO
-
-    const ULONG len = w*h + 2*((w+1)/2)*((h+1)/2);
+    //Rounds to the nearest tick of the encoder's timebase.  The product
+    //reftime * den overflows after about a day when den is large, so we
+    //convert whole seconds and the fraction separately.
 
-    if (m_buflen < len)
-    {
-        delete[] m_buf;
+    if (reftime < 0)
+        return -ToTimebase(-reftime);
 
-        m_buf = 0;
-        m_buflen = 0;
+    const vpx_rational_t& tb = m_cfg.g_timebase;
+    assert(tb.num > 0);
+    assert(tb.den > 0);
 
-        m_buf = new (std::nothrow) BYTE[len];
-        assert(m_buf);  //TODO
+    const __int64 secs = reftime / 10000000;
+    const __int64 frac = reftime % 10000000;
 
-        m_buflen = len;
-    }
+    //secs * den cannot overflow, because den <= 10000000.
 
-    BYTE* dst_y = m_buf;
-    BYTE* dst_v = dst_y + w*h;
-    BYTE* dst_u = dst_v + ((w/2)*(h/2));
+    const __int64 whole = secs * tb.den;
 
-    const ULONG src_stride = 2*w;
+    const __int64 ticks = whole / tb.num;
+    const __int64 rem = whole % tb.num;  //ticks left over, times num
 
-    const ULONG dst_y_stride = w;
-    const ULONG dst_uv_stride = w/2;
+    const __int64 den = __int64(tb.num) * 10000000;
+    const __int64 num = rem * 10000000 + frac * tb.den;
 
-    const BYTE* src = srcbuf;
+    return ticks + (num + den / 2) / den;
+}
 
-    for (ULONG i = 0; i < h; ++i)
-    {
-        const BYTE* src0_y = src;
-        src = src0_y + src_stride;
 
-        BYTE* dst0_y = dst_y;
-        dst_y = dst0_y + dst_y_stride;
+__int64 Inpin::FromTimebase(vpx_codec_pts_t pts) const
+{
+    //Rounds to the nearest 100ns tick.  As in ToTimebase, we avoid
+    //forming pts * num * 10000000, converting whole seconds first.
 
-        for (ULONG j = 0; j < dst_y_stride; ++j)
-        {
-            *dst0_y = *src0_y;
+    if (pts < 0)
+        return -FromTimebase(-pts);
 
-            src0_y += 2;
-            ++dst0_y;
-        }
-    }
+    const vpx_rational_t& tb = m_cfg.g_timebase;
+    assert(tb.num > 0);
+    assert(tb.den > 0);
 
-    src = srcbuf;
+    const __int64 q = pts / tb.den;
+    const __int64 r = pts % tb.den;
 
-    for (ULONG i = 0; i < h; i += 2)
-    {
-        const BYTE* src0_u = src + 1;
-        const BYTE* src1_u = src0_u + src_stride;
+    const __int64 part = r * tb.num;  //< den * num
 
-        const BYTE* src0_v = src + 3;
-        const BYTE* src1_v = src0_v + src_stride;
+    const __int64 secs = q * tb.num + part / tb.den;
+    const __int64 rem = part % tb.den;
 
-        src += 2 * src_stride;
+    return secs * 10000000 + (rem * 10000000 + tb.den / 2) / tb.den;
+}
 
-        BYTE* dst0_u = dst_u;
-        dst_u += dst_uv_stride;
 
+void Inpin::GetEncodedSize(LONG& w, LONG& h) const
+{
+    const int sw = m_pFilter->m_scaled_width;
+    const int sh = m_pFilter->m_scaled_height;
 
-        BYTE* dst0_v = dst_v;
-        dst_v += dst_uv_stride;
+    if ((sw > 0) && (sh > 0))
+    {
+        w = sw;
+        h = sh;
 
-        for (ULONG j = 0; j < dst_uv_stride; ++j)
-        {
-            const UINT u0 = *src0_u;
-            const UINT u1 = *src1_u;
-            const UINT src_u = (u0 + u1) / 2;  //?
+        return;
+    }
 
-            const UINT v0 = *src0_v;
-            const UINT v1 = *src1_v;
-            const UINT src_v = (v0 + v1) / 2;  //?
+    const BITMAPINFOHEADER& bmih = GetBMIH();
 
-            *dst0_u = static_cast<BYTE>(src_u);
-            *dst0_v = static_cast<BYTE>(src_v);
+    w = bmih.biWidth;
+    assert(w > 0);
+    assert((w % 2) == 0);  //TODO
 
-            src0_u += 4;
-            src1_u += 4;
+    h = labs(bmih.biHeight);
+    assert(h > 0);
+    assert((h % 2) == 0);  //TODO
+}
 
-            src0_v += 4;
-            src1_v += 4;
 
-            ++dst0_u;
-            ++dst0_v;
-        }
-    }
+void Inpin::ConvertToYV12(
+    vpx_img_fmt_t fmt,
+    const BYTE* srcbuf,
+    ULONG w,
+    ULONG h,
+    BYTE* tgtbuf)
+{
+    assert(srcbuf);
+    assert(tgtbuf);
+    assert((w % 2) == 0);  //TODO
+    assert((h % 2) == 0);  //TODO
 
-    return m_buf;
+    //libyuv picks SSE2/AVX2 row kernels at run time, so capture-card
+    //input at HD resolutions no longer costs a scalar loop per byte.
+
+    const bool b = webmdshow::LibyuvPackedToPlanar(
+                    fmt,
+                    srcbuf,
+                    w,
+                    h,
+                    VPX_IMG_FMT_YV12,
+                    tgtbuf);
+    b;
+    assert(b);
 }
 
 
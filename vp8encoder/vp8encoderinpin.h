@@ -12,6 +12,7 @@
 #include "vpx/vpx_encoder.h"
 #include "ivp8sample.h"
 #include <list>
+#include <vector>
 
 namespace VP8EncoderLib
 {
@@ -83,8 +84,13 @@ public:
     HRESULT Start();  //from stopped to running/paused
     void Stop();      //from running/paused to stopped
 
+    void StartThread();
+    HRESULT JoinThread(CLockable::Lock&);  //call after Stop, filter locked
+
     HRESULT OnApplySettings(std::wstring&);
 
+    void GetEncodedSize(LONG& w, LONG& h) const;
+
 protected:
     //HRESULT GetName(PIN_INFO&) const;
     std::wstring GetName() const;
@@ -100,8 +106,49 @@ private:
     bool m_bDiscontinuity;
     bool m_bEndOfStream;
     bool m_bFlush;
+    bool m_bStopped;
     vpx_codec_ctx_t m_ctx;
 
+    //Receive converts each frame into a queue buffer and returns;
+    //vpx_codec_encode runs on a dedicated thread without the filter
+    //lock held, so upstream is not stalled by the encoder.
+
+    struct Image
+    {
+        std::vector<BYTE> buf;
+        LONG w;
+        LONG h;
+        vpx_img_fmt_t fmt;
+        vpx_codec_pts_t pts;
+        unsigned long duration;
+        vpx_enc_frame_flags_t flags;
+        unsigned long deadline;
+        bool eos;  //flush the encoder and send end-of-stream downstream
+    };
+
+    typedef std::list<Image> images_t;
+    images_t m_queue;
+    images_t m_pool;     //recycled buffers
+    long m_queue_count;  //frames in m_queue
+
+    HANDLE m_hQueue;  //signalled when a frame is queued, or to terminate
+    HANDLE m_hRoom;   //signalled when space is available in the queue
+    HANDLE m_hThread;
+    ULONG m_cThreads;  //threads started, to tell m_hThread's apart
+
+    HRESULT m_hrDeliver;  //downstream result, reported by next Receive
+    bool m_bConfigChanged;  //m_cfg must be applied by encoder thread
+
+    static unsigned __stdcall ThreadProc(void*);
+    unsigned Main();
+
+    Image& StageImage(images_t&);
+    void QueueImage(images_t&);
+    void FlushQueue();
+    void Encode(Image&);
+    HRESULT DeliverFrames(CLockable::Lock&, bool bEOS);
+    void DestroyCodec();
+
     typedef std::list<IVP8Sample::Frame> frames_t;
     frames_t m_pending;  //waiting to be pushed downstream
 
@@ -117,14 +164,16 @@ private:
     vpx_codec_err_t SetCPUUsed();
     vpx_codec_err_t SetStaticThreshold();
 
-    BYTE* m_buf;
-    size_t m_buflen;
-
     REFERENCE_TIME m_last_keyframe_time;
     __int64 m_frames_received;
     __int64 m_decimate_start_time;
 
-    BYTE* ConvertYUY2ToYV12(const BYTE*, ULONG, ULONG);
+    std::vector<BYTE> m_convert_buf;  //packed input, when scaling
+
+    void ConvertToYV12(vpx_img_fmt_t, const BYTE*, ULONG, ULONG, BYTE*);
+
+    vpx_codec_pts_t ToTimebase(__int64 reftime) const;
+    __int64 FromTimebase(vpx_codec_pts_t) const;
 
 };
 
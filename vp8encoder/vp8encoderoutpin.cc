@@ -246,12 +246,10 @@ HRESULT Outpin::EndFlush()
 void Outpin::OnInpinConnect()
 {
     const Inpin& inpin = m_pFilter->m_inpin;
-    const BITMAPINFOHEADER& bmihIn = inpin.GetBMIH();
 
-    const LONG ww = bmihIn.biWidth;
+    LONG ww, hh;
+    GetFrameSize(ww, hh);  //dispatch to subclass
     assert(ww > 0);
-
-    const LONG hh = labs(bmihIn.biHeight);
     assert(hh > 0);
 
     //TODO: does this really need to be a conditional expr?
@@ -344,6 +342,15 @@ void Outpin::OnInpinConnect()
 }
 
 
+void Outpin::GetFrameSize(LONG& w, LONG& h) const
+{
+    const BITMAPINFOHEADER& bmih = m_pFilter->m_inpin.GetBMIH();
+
+    w = bmih.biWidth;
+    h = labs(bmih.biHeight);
+}
+
+
 HRESULT Outpin::OnInpinDisconnect()
 {
     if (bool(m_pPinConnection))
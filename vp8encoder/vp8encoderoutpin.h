@@ -73,6 +73,7 @@ protected:
     virtual HRESULT PostConnect(IPin*) = 0;
     HRESULT InitAllocator(IMemInputPin*, IMemAllocator*);
     virtual void GetSubtype(GUID&) const = 0;
+    virtual void GetFrameSize(LONG& w, LONG& h) const;
 
 };
 
@@ -888,6 +888,13 @@ void OutpinVideo::GetSubtype(GUID& subtype) const
 }
 
 
+void OutpinVideo::GetFrameSize(LONG& w, LONG& h) const
+{
+    //Frames are encoded at the scaled size, if one has been set.
+    m_pFilter->m_inpin.GetEncodedSize(w, h);
+}
+
+
 void OutpinVideo::OnInpinConnect()
 {
     assert(!bool(m_pPinConnection));
@@ -91,6 +91,7 @@ protected:
     virtual HRESULT PostConnect(IPin*);
     HRESULT GetAllocator(IMemInputPin*, IMemAllocator**) const;
     void GetSubtype(GUID&) const;
+    void GetFrameSize(LONG&, LONG&) const;
 
     HRESULT PostConnectVideo(IPin*);
     HRESULT PostConnectStats(IPin*);
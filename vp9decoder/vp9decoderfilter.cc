@@ -77,6 +77,8 @@ HRESULT Filter::CNondelegating::QueryInterface(const IID& iid, void** ppv) {
              iid == __uuidof(IMediaFilter) ||
              iid == __uuidof(IPersist)) {
     pUnk = static_cast<IBaseFilter*>(m_pFilter);
+  } else if (iid == __uuidof(IVP9Decoder)) {
+    pUnk = static_cast<IVP9Decoder*>(m_pFilter);
   } else {
     pUnk = 0;
     return E_NOINTERFACE;
@@ -121,6 +123,10 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
   m_info.pGraph = 0;
   m_info.achName[0] = L'\0';
 
+  m_threading.thread_count = 0;
+  m_threading.frame_parallel = false;
+  m_threading.row_mt = false;
+
 #ifdef _DEBUG
   odbgstream os;
   os << "vp9dec::filter::ctor" << endl;
@@ -157,6 +163,99 @@ HRESULT Filter::GetClassID(CLSID* p) {
   return S_OK;
 }
 
+HRESULT Filter::SetThreadCount(int count) {
+  if ((count < 0) || (count > kMaxThreads))
+    return E_INVALIDARG;
+
+  Lock lock;
+
+  const HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_state != kStateStopped)
+    return VFW_E_NOT_STOPPED;
+
+  m_threading.thread_count = count;
+  return S_OK;
+}
+
+HRESULT Filter::GetThreadCount(int* count) {
+  if (count == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  const HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *count = m_threading.thread_count;
+  return S_OK;
+}
+
+HRESULT Filter::SetFrameParallelMode(boolean enable) {
+  Lock lock;
+
+  const HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_state != kStateStopped)
+    return VFW_E_NOT_STOPPED;
+
+  m_threading.frame_parallel = (enable != 0);
+  return S_OK;
+}
+
+HRESULT Filter::GetFrameParallelMode(boolean* enable) {
+  if (enable == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  const HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *enable = m_threading.frame_parallel;
+  return S_OK;
+}
+
+HRESULT Filter::SetRowMT(boolean enable) {
+  Lock lock;
+
+  const HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  if (m_state != kStateStopped)
+    return VFW_E_NOT_STOPPED;
+
+  m_threading.row_mt = (enable != 0);
+  return S_OK;
+}
+
+HRESULT Filter::GetRowMT(boolean* enable) {
+  if (enable == 0)
+    return E_POINTER;
+
+  Lock lock;
+
+  const HRESULT hr = lock.Seize(this);
+
+  if (FAILED(hr))
+    return hr;
+
+  *enable = m_threading.row_mt;
+  return S_OK;
+}
+
 HRESULT Filter::Stop() {
   // Stop is a synchronous operation: when it completes,
   // the filter is stopped.
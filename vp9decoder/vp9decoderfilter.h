@@ -13,13 +13,24 @@
 #include <string>
 
 #include "clockable.h"
+#include "vp9decoderidl.h"
 #include "vp9decoderinpin.h"
 #include "vp9decoderoutpin.h"
 
 namespace VP9DecoderLib {
 
-class Filter : public IBaseFilter, public CLockable {
+class Filter : public IBaseFilter, public IVP9Decoder, public CLockable {
  public:
+  enum { kMaxThreads = 16 };
+
+  // Decoder configuration set through IVP9Decoder, and applied by the
+  // inpin when it initializes the decoder.
+  struct ThreadingConfig {
+    int thread_count;  // 0 means one per processor
+    bool frame_parallel;
+    bool row_mt;
+  };
+
   // IUnknown
   HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
   ULONG STDMETHODCALLTYPE AddRef();
@@ -39,11 +50,20 @@ class Filter : public IBaseFilter, public CLockable {
   HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph*, LPCWSTR);
   HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR*);
 
+  // IVP9Decoder
+  HRESULT STDMETHODCALLTYPE SetThreadCount(int);
+  HRESULT STDMETHODCALLTYPE GetThreadCount(int*);
+  HRESULT STDMETHODCALLTYPE SetFrameParallelMode(boolean);
+  HRESULT STDMETHODCALLTYPE GetFrameParallelMode(boolean*);
+  HRESULT STDMETHODCALLTYPE SetRowMT(boolean);
+  HRESULT STDMETHODCALLTYPE GetRowMT(boolean*);
+
   FILTER_STATE GetStateLocked() const;
   HRESULT OnDecodeFailureLocked();
   void OnDecodeSuccessLocked(bool is_key);
 
   FILTER_INFO m_info;
+  ThreadingConfig m_threading;
   Inpin m_inpin;
   Outpin m_outpin;
 
@@ -38,7 +38,10 @@ using std::setprecision;
 namespace VP9DecoderLib {
 
 Inpin::Inpin(Filter* p)
-    : Pin(p, PINDIR_INPUT, L"input"), m_bEndOfStream(false), m_bFlush(false) {
+    : Pin(p, PINDIR_INPUT, L"input"),
+      m_bEndOfStream(false),
+      m_bFlush(false),
+      m_sample_id(0) {
   AM_MEDIA_TYPE mt;
 
   mt.majortype = MEDIATYPE_Video;
@@ -186,6 +189,21 @@ HRESULT Inpin::EndOfStream() {
 
   m_bEndOfStream = true;
 
+  if ((m_pFilter->GetStateLocked() != State_Stopped) && !m_bFlush) {
+    // In frame-parallel mode the decoder still holds the last few frames,
+    // which we must deliver before the end of stream.
+    const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, 0, 0, 0, 0);
+
+    if (err == VPX_CODEC_OK) {
+      DeliverFrames(lock);  // releases lock
+
+      hr = lock.Seize(m_pFilter);
+
+      if (FAILED(hr))
+        return hr;
+    }
+  }
+
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
     lock.Release();
 
@@ -254,6 +272,9 @@ HRESULT Inpin::EndFlush() {
   m_bFlush = false;
   m_bEndOfStream = false;
 
+  if (m_pFilter->GetStateLocked() != State_Stopped)
+    DiscardFrames();
+
   if (IPin* pPin = m_pFilter->m_outpin.m_pPinConnection) {
     lock.Release();
 
@@ -435,23 +456,102 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   const long len = pInSample->GetActualDataLength();
   assert(len >= 0);
 
-  const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, buf, len, 0, 0);
+  SampleInfo info;
+
+  info.id = ++m_sample_id;
+  info.time_hr = pInSample->GetTime(&info.start, &info.stop);
+  info.preroll = (pInSample->IsPreroll() == S_OK);
+  info.discontinuity = (pInSample->IsDiscontinuity() == S_OK);
+
+  void* const user_priv = reinterpret_cast<void*>(ULONG_PTR(info.id));
+
+  const vpx_codec_err_t err =
+      vpx_codec_decode(&m_ctx, buf, len, user_priv, 0);
 
   if (err != VPX_CODEC_OK)
     return m_pFilter->OnDecodeFailureLocked();
 
+  m_sample_info.push_back(info);
+
   hr = pInSample->IsSyncPoint();
 
   m_pFilter->OnDecodeSuccessLocked(hr == S_OK);
 
-  if (pInSample->IsPreroll() == S_OK)
-    return S_OK;
+  return DeliverFrames(lock);
+}
+
+HRESULT Inpin::DeliverFrames(CLockable::Lock& lock) {
+  // The iterator is passed back unchanged until the decoder returns no
+  // more frames.  Only this thread decodes, and we stop if the filter is
+  // stopped (destroying the decoder) while the lock is released.
+  vpx_codec_iter_t iter = 0;
+
+  for (;;) {
+    const vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter);
+
+    if (f == 0)
+      break;
+
+    // Frames come out in the order their samples went in, so the queue
+    // entries ahead of this frame's belong to samples that didn't produce
+    // a frame.
+
+    const ULONG id = static_cast<ULONG>(ULONG_PTR(f->user_priv));
+
+    while (!m_sample_info.empty() && (m_sample_info.front().id != id))
+      m_sample_info.pop_front();
+
+    if (m_sample_info.empty())  // should never happen
+      continue;
+
+    const SampleInfo info = m_sample_info.front();
+    m_sample_info.pop_front();
+
+    if (info.preroll)
+      continue;
+
+    HRESULT hr = DeliverFrame(lock, f, info);
+
+    // DeliverFrame returns with the lock held or not, depending on where
+    // it stopped.  Lock::Release does nothing if the lock isn't held.
+    lock.Release();
+
+    if (hr != S_OK)
+      return hr;
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+      return hr;
+
+    if (m_pFilter->GetStateLocked() == State_Stopped)
+      hr = VFW_E_NOT_RUNNING;
+    else if (m_bFlush)
+      hr = S_FALSE;
+
+    if (hr != S_OK) {
+      lock.Release();
+      return hr;
+    }
+  }
+
+  lock.Release();
+  return S_OK;
+}
+
+HRESULT Inpin::DeliverFrame(CLockable::Lock& lock, const vpx_image_t* f,
+                            const SampleInfo& info) {
+  Outpin& outpin = m_pFilter->m_outpin;
 
   lock.Release();
 
+  // The frame remains valid while we wait for a buffer: only this thread
+  // decodes, and if the filter is stopped in the meantime (which destroys
+  // the decoder) we find out below, before touching the frame.
+
   GraphUtil::IMediaSamplePtr pOutSample;
 
-  hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
+  HRESULT hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
 
   if (FAILED(hr))
     return S_FALSE;
@@ -472,12 +572,8 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   if (outpin.m_pInputPin == NULL)
     return S_FALSE;
 
-  vpx_codec_iter_t iter = 0;
-
-  vpx_image_t* const f = vpx_codec_get_frame(&m_ctx, &iter);
-
-  if (f == 0)
-    return S_OK;
+  if (m_bFlush)
+    return S_FALSE;
 
   AM_MEDIA_TYPE* pmt;
 
@@ -545,14 +641,13 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   else
     return E_FAIL;
 
-  __int64 st, sp;
-
-  hr = pInSample->GetTime(&st, &sp);
+  __int64 st = info.start;
+  __int64 sp = info.stop;
 
-  if (FAILED(hr)) {
+  if (FAILED(info.time_hr)) {
     hr = pOutSample->SetTime(0, 0);
     assert(SUCCEEDED(hr));
-  } else if (hr == S_OK) {
+  } else if (info.time_hr == S_OK) {
     hr = pOutSample->SetTime(&st, &sp);
     assert(SUCCEEDED(hr));
   } else {
@@ -566,8 +661,7 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   hr = pOutSample->SetPreroll(FALSE);
   assert(SUCCEEDED(hr));
 
-  hr = pInSample->IsDiscontinuity();
-  hr = pOutSample->SetDiscontinuity(hr == S_OK);
+  hr = pOutSample->SetDiscontinuity(info.discontinuity);
 
   hr = pOutSample->SetMediaTime(0, 0);
 
@@ -585,6 +679,21 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
   return outpin.m_pInputPin->Receive(pOutSample);
 }
 
+void Inpin::DiscardFrames() {
+  const vpx_codec_err_t err = vpx_codec_decode(&m_ctx, 0, 0, 0, 0);
+
+  if (err == VPX_CODEC_OK) {
+    for (;;) {
+      vpx_codec_iter_t iter = 0;
+
+      if (vpx_codec_get_frame(&m_ctx, &iter) == 0)
+        break;
+    }
+  }
+
+  m_sample_info.clear();
+}
+
 HRESULT Inpin::ReceiveMultiple(IMediaSample** pSamples,
                                long n,  // in
                                long* pm) { // out
@@ -908,11 +1017,37 @@ HRESULT Inpin::Start() {
   m_bEndOfStream = false;
   m_bFlush = false;
 
+  m_sample_info.clear();
+  m_sample_id = 0;
+
+  const Filter::ThreadingConfig& config = m_pFilter->m_threading;
+
+  vpx_codec_dec_cfg_t cfg;
+
+  cfg.threads = config.thread_count;
+  cfg.w = 0;
+  cfg.h = 0;
+
+  if (cfg.threads <= 0) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    cfg.threads = info.dwNumberOfProcessors;
+  }
+
+  if (cfg.threads > Filter::kMaxThreads)
+    cfg.threads = Filter::kMaxThreads;
+
   vpx_codec_iface_t& vp9 = vpx_codec_vp9_dx_algo;
 
-  const int flags = 0;
+  int flags = 0;
+
+#ifdef VPX_CODEC_USE_FRAME_THREADING
+  if (config.frame_parallel && (cfg.threads > 1))
+    flags |= VPX_CODEC_USE_FRAME_THREADING;
+#endif
 
-  const vpx_codec_err_t err = vpx_codec_dec_init(&m_ctx, &vp9, 0, flags);
+  const vpx_codec_err_t err = vpx_codec_dec_init(&m_ctx, &vp9, &cfg, flags);
 
   if (err == VPX_CODEC_MEM_ERROR)
     return E_OUTOFMEMORY;
@@ -920,6 +1055,14 @@ HRESULT Inpin::Start() {
   if (err != VPX_CODEC_OK)
     return E_FAIL;
 
+#ifdef VPX_CTRL_VP9D_SET_ROW_MT
+  if (config.row_mt && (cfg.threads > 1)) {
+    // Not fatal: the decoder falls back to tile threading.
+    const vpx_codec_err_t e = vpx_codec_control(&m_ctx, VP9D_SET_ROW_MT, 1);
+    e;
+  }
+#endif
+
   return S_OK;
 }
 
@@ -927,6 +1070,8 @@ void Inpin::Stop() {
   const vpx_codec_err_t err = vpx_codec_destroy(&m_ctx);
   err;
   assert(err == VPX_CODEC_OK);
+
+  m_sample_info.clear();
 }
 
 }  // namespace VP9DecoderLib
@@ -10,8 +10,11 @@
 
 #include <amvideo.h>
 
+#include <deque>
+
 #include "vpx/vpx_decoder.h"
 
+#include "clockable.h"
 #include "graphutil.h"
 #include "vp9decoderpin.h"
 
@@ -53,6 +56,33 @@ class Inpin : public Pin, public IMemInputPin {
   HRESULT OnDisconnect();
 
  private:
+  // Properties of an input sample that its decoded frame inherits.  In
+  // frame-parallel mode the frame comes out of the decoder some samples
+  // later, so we queue these, and pass the id through the decoder as the
+  // frame's user data.
+  struct SampleInfo {
+    ULONG id;
+    HRESULT time_hr;  // result of IMediaSample::GetTime
+    REFERENCE_TIME start;
+    REFERENCE_TIME stop;
+    bool preroll;
+    bool discontinuity;
+  };
+
+  typedef std::deque<SampleInfo> sample_info_queue_t;
+
+  // Deliver the frames that are ready, in decode order.  The lock is held
+  // on entry and released on return.
+  HRESULT DeliverFrames(CLockable::Lock&);
+
+  // Deliver one frame.  The lock is held on entry, and might or might not
+  // be held on return.
+  HRESULT DeliverFrame(CLockable::Lock&, const vpx_image_t*,
+                       const SampleInfo&);
+
+  // Drops the frames still in the decoder's pipeline.
+  void DiscardFrames();
+
   static void CopyToPlanar(const vpx_image_t* image, IMediaSample* sample,
                            const GUID& subtype_out,
                            const BITMAPINFOHEADER& bmih_out);
@@ -67,6 +97,8 @@ class Inpin : public Pin, public IMemInputPin {
   bool m_bEndOfStream;
   bool m_bFlush;
   vpx_codec_ctx_t m_ctx;
+  sample_info_queue_t m_sample_info;
+  ULONG m_sample_id;
 };
 
 }  // namespace VP9DecoderLib
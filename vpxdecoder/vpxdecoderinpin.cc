@@ -546,35 +546,47 @@ HRESULT Inpin::Receive(IMediaSample* pInSample) {
     return E_FAIL;
   }
 
-  // Scale (if necessary).
   const uint32_t out_width = bmih_ptr->biWidth;
   const uint32_t out_height = std::abs(bmih_ptr->biHeight);
-  if (frame->d_h != out_height || frame->d_w != out_width) {
-    if (!webmdshow::LibyuvScaleI420(out_width, out_height,
-                                    frame, &scaled_frame)) {
-      assert(false && "webmdshow::LibyuvScale failed.");
+  const bool scale = (frame->d_h != out_height || frame->d_w != out_width);
+
+  if (scale && (mt.subtype == MEDIASUBTYPE_YV12 ||
+                mt.subtype == WebmTypes::MEDIASUBTYPE_I420)) {
+    // Scale straight into the output sample, instead of into
+    // |scaled_frame| and then copying that.
+    if (!ScaleToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr)) {
+      assert(false && "Inpin::ScaleToPlanar failed.");
       return E_FAIL;
     }
-    frame = scaled_frame;
-  }
+  } else {
+    // Scale (if necessary).
+    if (scale) {
+      if (!webmdshow::LibyuvScaleI420(out_width, out_height,
+                                      frame, &scaled_frame)) {
+        assert(false && "webmdshow::LibyuvScale failed.");
+        return E_FAIL;
+      }
+      frame = scaled_frame;
+    }
 
-  // Color convert (if necessary).
-  if (mt.subtype == MEDIASUBTYPE_NV12)
-    CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YV12)
-    CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
-  else if (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)
-    CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_UYVY)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YUY2)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YUYV)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else if (mt.subtype == MEDIASUBTYPE_YVYU)
-    CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
-  else
-    return E_FAIL;
+    // Color convert (if necessary).
+    if (mt.subtype == MEDIASUBTYPE_NV12)
+      CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
+    else if (mt.subtype == MEDIASUBTYPE_YV12)
+      CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
+    else if (mt.subtype == WebmTypes::MEDIASUBTYPE_I420)
+      CopyToPlanar(frame, pOutSample, mt.subtype, *bmih_ptr);
+    else if (mt.subtype == MEDIASUBTYPE_UYVY)
+      CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+    else if (mt.subtype == MEDIASUBTYPE_YUY2)
+      CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+    else if (mt.subtype == MEDIASUBTYPE_YUYV)
+      CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+    else if (mt.subtype == MEDIASUBTYPE_YVYU)
+      CopyToPacked(frame, pOutSample, mt.subtype, *rc_ptr, *bmih_ptr);
+    else
+      return E_FAIL;
+  }
 
   __int64 st, sp;
 
@@ -646,6 +658,39 @@ HRESULT Inpin::ReceiveMultiple(IMediaSample** pSamples,
   return S_OK;
 }
 
+bool Inpin::ScaleToPlanar(const vpx_image_t* f, IMediaSample* pOutSample,
+                          const GUID& subtype_out,
+                          const BITMAPINFOHEADER& bmih_out) {
+  BYTE* pOutBuf;
+
+  HRESULT hr = pOutSample->GetPointer(&pOutBuf);
+  assert(SUCCEEDED(hr));
+  assert(pOutBuf);
+
+  const LONG width_out = bmih_out.biWidth;
+  const LONG height_out = labs(bmih_out.biHeight);
+
+  const LONG strideOut = bmih_out.biWidth;
+  assert(strideOut);
+  assert((strideOut % 2) == 0);  //?
+
+  const vpx_img_fmt_t fmt_out = (subtype_out == MEDIASUBTYPE_YV12) ?
+      VPX_IMG_FMT_YV12 : VPX_IMG_FMT_I420;
+
+  if (!webmdshow::LibyuvScaleToPlanar(f, width_out, height_out, fmt_out,
+                                      strideOut, pOutBuf)) {
+    return false;
+  }
+
+  const long lenOut =
+      strideOut * height_out + 2 * (strideOut / 2) * ((height_out + 1) / 2);
+
+  hr = pOutSample->SetActualDataLength(lenOut);
+  assert(SUCCEEDED(hr));
+
+  return true;
+}
+
 void Inpin::CopyToPlanar(const vpx_image_t* f, IMediaSample* pOutSample,
                          const GUID& subtype_out,
                          const BITMAPINFOHEADER& bmih_out) {
@@ -807,6 +852,18 @@ void Inpin::CopyToPacked(const vpx_image_t* f, IMediaSample* pOutSample,
   else
     strideOut = bmih_out.biWidth;
 
+  if (subtype_out != MEDIASUBTYPE_YVYU) {
+    // libyuv has SIMD row functions for these layouts.
+    const vpx_img_fmt_t fmt_out = (subtype_out == MEDIASUBTYPE_UYVY) ?
+        VPX_IMG_FMT_UYVY : VPX_IMG_FMT_YUY2;
+
+    if (webmdshow::LibyuvPlanarToPacked(f, fmt_out, strideOut, pOutBuf)) {
+      hr = pOutSample->SetActualDataLength(strideOut * LONG(height_in));
+      assert(SUCCEEDED(hr));
+      return;
+    }
+  }
+
   const LONG uv_width = width_in / 2;
   const LONG uv_height = height_in / 2;
 
@@ -58,6 +58,10 @@ class Inpin : public Pin, public IMemInputPin {
  private:
   HRESULT PopulateSample(IMediaSample*, const vpx_image_t*);
 
+  static bool ScaleToPlanar(const vpx_image_t* image, IMediaSample* sample,
+                            const GUID& subtype_out,
+                            const BITMAPINFOHEADER& bmih_out);
+
   static void CopyToPlanar(const vpx_image_t* image, IMediaSample* sample,
                            const GUID& subtype_out,
                            const BITMAPINFOHEADER& bmih_out);
@@ -6,6 +6,7 @@
 // in the file PATENTS.  All contributing project authors may
 // be found in the AUTHORS file in the root of the source tree.
 
+#include <algorithm>
 #include <cassert>
 #include <ctime>
 #include <sstream>
@@ -27,18 +28,56 @@ using std::endl;
 using std::wstring;
 using std::wostringstream;
 
-enum { kAudioClusterSizeInTimeMs = 5000 };  //TODO: parameterize this
+//Default cluster durations, used when IWebmMux2::SetMaxClusterDuration
+//has not been called.
+enum { kVideoClusterSizeInTimeMs = 1000 };
+enum { kAudioClusterSizeInTimeMs = 5000 };
+
+//Size of the write-behind buffer in front of the output stream.  It is
+//large enough to hold a typical cluster, so that the cluster size can
+//be patched in memory before the cluster goes out in one write.
+enum { kFileBufferSize = 4 * 1024 * 1024 };
+
+//Frames at least this large are written to the stream directly from the
+//media sample that holds them, rather than being copied into the buffer.
+enum { kFileWriteThroughSize = 64 * 1024 };
 
 namespace WebmMuxLib
 {
 
 extern HMODULE s_hModule;
 
+namespace
+{
+
+//Used with the std heap algorithms to keep a min-heap of audio streams,
+//ordered by the timecode of each stream's oldest queued frame.  Ties go
+//to the lower track number, so that the interleave is deterministic.
+
+struct LaterAudio
+{
+    bool operator()(const StreamAudio* lhs, const StreamAudio* rhs) const
+    {
+        const ULONG lt = lhs->GetFrames().front()->GetTimecode();
+        const ULONG rt = rhs->GetFrames().front()->GetTimecode();
+
+        if (lt != rt)
+            return (lt > rt);
+
+        return (lhs->GetTrackNumber() > rhs->GetTrackNumber());
+    }
+};
+
+}  //end anonymous namespace
+
 Context::Context() :
    m_bLiveMux(false),
-   m_bBufferData(false),
+   m_bKeyframeClusters(false),
+   m_max_cluster_duration(0),
+   m_max_cluster_size(0),
+   m_cBufferData(0),
    m_pVideo(0),
-   m_pAudio(0),
+   m_cClusters(0),
    m_timecode_scale(1000000),  //TODO
    m_info_pos(0),
    m_seekhead_pos(0),
@@ -56,7 +95,7 @@ Context::Context() :
 Context::~Context()
 {
    assert(m_pVideo == 0);
-   assert(m_pAudio == 0);
+   assert(m_audio.empty());
    assert(m_file.GetStream() == 0);
 }
 
@@ -66,19 +105,36 @@ void Context::SetVideoStream(StreamVideo* pVideo)
    assert((pVideo == 0) || (m_pVideo == 0));
    assert((pVideo == 0) || (pVideo->GetFrames().empty()));
    assert((pVideo == 0) || (pVideo->GetKeyFrames().empty()));
-   assert(m_clusters.empty());
+   assert(m_cClusters == 0);
 
    m_pVideo = pVideo;
 }
 
 
-void Context::SetAudioStream(StreamAudio* pAudio)
+void Context::AddAudioStream(StreamAudio* pAudio)
+{
+   assert(pAudio);
+   assert(pAudio->GetFrames().empty());
+   assert(std::find(m_audio.begin(), m_audio.end(), pAudio) == m_audio.end());
+   assert(m_cClusters == 0);
+
+   m_audio.push_back(pAudio);
+}
+
+
+void Context::RemoveAudioStream(StreamAudio* pAudio)
 {
-   assert((pAudio == 0) || (m_pAudio == 0));
-   assert((pAudio == 0) || (pAudio->GetFrames().empty()));
-   assert(m_clusters.empty());
+   assert(pAudio);
+   assert(pAudio->GetFrames().empty());
+   assert(m_cClusters == 0);
+
+   const audio_streams_t::iterator i =
+      std::find(m_audio.begin(), m_audio.end(), pAudio);
+
+   assert(i != m_audio.end());
 
-   m_pAudio = pAudio;  //TODO: generlize this to many audio streams
+   if (i != m_audio.end())
+      m_audio.erase(i);
 }
 
 
@@ -88,10 +144,12 @@ void Context::Open(IStream* pStream)
     assert(m_file.GetStream() == 0);
     assert((m_pVideo == 0) || (m_pVideo->GetFrames().empty()));
     assert((m_pVideo == 0) || (m_pVideo->GetKeyFrames().empty()));
-    assert((m_pAudio == 0) || (m_pAudio->GetFrames().empty()));
-    assert(m_clusters.empty());
+    assert(m_audio_heap.empty());
+    assert(m_cClusters == 0);
 
     m_max_timecode = 0;        //to keep track of duration
+    m_rframe_bytes = 0;
+    m_audio_bytes = 0;
     m_cEOS = 0;
     m_bEOSVideo = false;  //means we haven't seen EOS yet (from either
     m_bEOSAudio = false;  //the stream itself, or because of stop)
@@ -104,15 +162,24 @@ void Context::Open(IStream* pStream)
         ++m_cEOS;
     }
 
-    if (m_pAudio)
+    typedef audio_streams_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
     {
-        m_pAudio->SetTrackNumber(++tn);
+        StreamAudio* const pAudio = *i;
+        assert(pAudio);
+        assert(pAudio->GetFrames().empty());
+
+        pAudio->SetTrackNumber(++tn);
+        pAudio->SetEOS(false);
         ++m_cEOS;
     }
 
     if (pStream)
     {
         m_file.SetStream(pStream);
+        m_file.SetBufferSize(kFileBufferSize);
+        m_file.SetWriteThroughSize(kFileWriteThroughSize);
 
 #if 0   //TODO: parameterize this (with default of 0)
         const __int64 One_GB = 1024i64 * 1024i64 * 1024i64;
@@ -138,6 +205,9 @@ void Context::Open(IStream* pStream)
 
         WriteEbmlHeader();
         InitSegment();
+
+        if (m_bLiveMux)
+            m_file.Flush();  //don't hold back the header
     }
 }
 
@@ -147,7 +217,7 @@ void Context::Close()
     if (m_pVideo)
         NotifyVideoEOS(0);
 
-    if (m_pAudio)
+    if (!m_audio.empty())
         NotifyAudioEOS(0);
 
     Final();
@@ -161,17 +231,19 @@ void Context::Final()
         if (m_pVideo)
             m_pVideo->Final();  //grant last wishes
 
-        if (m_pAudio)
-            m_pAudio->Final();  //grant last wishes
+        typedef audio_streams_t::const_iterator iter_t;
+
+        for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+            (*i)->Final();  //grant last wishes
 
         FinalSegment();
         m_file.SetStream(0);
     }
 
-    assert(m_clusters.empty());
+    assert(m_cClusters == 0);
     assert((m_pVideo == 0) || (m_pVideo->GetFrames().empty()));
     assert((m_pVideo == 0) || (m_pVideo->GetKeyFrames().empty()));
-    assert((m_pAudio == 0) || (m_pAudio->GetFrames().empty()));
+    assert(m_audio_heap.empty());
 }
 
 
@@ -306,7 +378,10 @@ void Context::FinalSegment()
         FinalInfo();
     }
 
-    m_clusters.clear();
+    m_cClusters = 0;
+
+    cues_t cues;
+    m_cues.swap(cues);  //release storage as well as the cue points
 }
 
 
@@ -500,7 +575,7 @@ void Context::WriteTrack()
     if (!m_bLiveMux)
         m_track_pos = m_file.GetPosition();
 
-    assert(m_bBufferData == false);
+    assert(m_cBufferData == 0);
 
     m_buf.WriteID4(WebmUtil::kEbmlTracksID);
 
@@ -521,10 +596,12 @@ void Context::WriteTrack()
     if (m_pVideo)
         m_pVideo->WriteTrackEntry(++track_num);
 
-    if (m_pAudio)  //TODO: allow for multiple audio streams
-        m_pAudio->WriteTrackEntry(++track_num);
+    typedef audio_streams_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+        (*i)->WriteTrackEntry(++track_num);
 
-    if (m_bBufferData)
+    if (m_cBufferData > 0)
     {
         // Buffering was enabled by one of the tracks while writing the entry.
         // Currently this should only happen with Vorbis audio from the
@@ -574,7 +651,18 @@ void Context::Cluster::Final(
 #endif
 
 
-void Context::WriteCuePoints(const Cluster& c)
+Context::CuePoint::CuePoint(
+   __int64 pos,
+   ULONG t,
+   ULONG n) :
+   m_pos(pos),
+   m_timecode(t),
+   m_block(n)
+{
+}
+
+
+void Context::WriteCuePoint(const CuePoint& k)
 {
     //cue point container = 1 + size len(2) + payload len
     //  time = 1 + size len(1) + payload len(4)
@@ -589,42 +677,6 @@ void Context::WriteCuePoints(const Cluster& c)
 
     //TODO: write this at beginning of file
 
-    const Cluster::keyframes_t& kk = c.m_keyframes;
-    assert(kk.size() <= 255);
-
-    typedef Cluster::keyframes_t::const_iterator iter_t;
-
-    iter_t i = kk.begin();
-    const iter_t j = kk.end();
-
-    while (i != j)
-    {
-        const Keyframe& k = *i++;
-        WriteCuePoint(c, k);
-    }
-}
-
-
-Context::Keyframe::Keyframe() :
-   m_timecode(0),
-   m_block(0)
-{
-}
-
-
-Context::Keyframe::Keyframe(
-   ULONG t,
-   ULONG n) :
-   m_timecode(t),
-   m_block(n)
-{
-}
-
-
-void Context::WriteCuePoint(
-    const Cluster& c,
-    const Keyframe& k)
-{
     assert(m_pVideo);
 
     EbmlIO::File& f = m_file;
@@ -657,7 +709,7 @@ void Context::WriteCuePoint(
     f.Write1UInt(1);         //payload size is 1 byte
     f.Serialize1UInt(tn);    //payload
 
-    const __int64 off = c.m_pos - m_segment_pos - 12;
+    const __int64 off = k.m_pos - m_segment_pos - 12;
     assert(off >= 0);
 
     f.WriteID1(0xF1);        //CueClusterPosition ID
@@ -696,15 +748,15 @@ void Context::WriteCues()
     //allocate 4 bytes of storage for size of cues element
     const __int64 start_pos = m_file.SetPosition(4, STREAM_SEEK_CUR);
 
-    typedef clusters_t::const_iterator iter_t;
+    typedef cues_t::const_iterator iter_t;
 
-    iter_t i = m_clusters.begin();
-    const iter_t j = m_clusters.end();
+    iter_t i = m_cues.begin();
+    const iter_t j = m_cues.end();
 
     while (i != j)
     {
-        const Cluster& c = *i++;
-        WriteCuePoints(c);
+        const CuePoint& k = *i++;
+        WriteCuePoint(k);
     }
 
     const __int64 stop_pos = m_file.GetPosition();
@@ -736,18 +788,22 @@ void Context::NotifyVideoFrame(
     assert(vframes.back() == pFrame);
 
     const ULONG vt = pFrame->GetTimecode();
+    const ULONG vs = pFrame->GetSize();
 
     StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
 
     if (rframes.empty())
     {
         rframes.push_back(pFrame);
+        m_rframe_bytes = vs;
         return;
     }
 
+    m_rframe_bytes += vs;
+
     if (pFrame->IsKey())
         rframes.push_back(pFrame);
-    else if (m_bLiveMux)
+    else if (m_bLiveMux || m_bKeyframeClusters)
     {
         #if 0 //def _DEBUG
         odbgstream os;
@@ -768,40 +824,31 @@ void Context::NotifyVideoFrame(
         const LONGLONG dt = LONGLONG(vt) - LONGLONG(vt0);
         assert(dt >= 0);
 
-        const LONGLONG scale = GetTimecodeScale();
-        assert(scale >= 1);
-
-        const LONGLONG ns = scale * dt;
-
-        //TODO: allow this to be parameterized
-        if (ns <= 1000000000)  //1 sec
+        if (!IsClusterFull(dt, m_rframe_bytes, false))
             return;
 
         rframes.push_back(pFrame);
     }
 
+    m_rframe_bytes = vs;  //this frame begins the next cluster
+
     //At this point, we have at least 2 rframes, which means
     //at least one cluster is potentially available to be written
     //to the file.  (Here the constraints that the video stream
     //needs to satisfy have been satisified.  We might still have
     //to wait for the audio stream to satisfy its constraints.)
 
-    if ((m_pAudio == 0) || m_bEOSAudio)
+    if (m_audio.empty() || m_bEOSAudio)
     {
         CreateNewCluster(pFrame);
         return;
     }
 
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
+    ULONG at;
 
-    if (aframes.empty())
+    if (!GetAudioHorizon(at))
         return;
 
-    const StreamAudio::AudioFrame* const paf = aframes.back();
-    assert(paf);
-
-    const ULONG at = paf->GetTimecode();
-
     if (at < vt)
         return;
 
@@ -813,31 +860,43 @@ void Context::NotifyAudioFrame(
     StreamAudio* pAudio,
     StreamAudio::AudioFrame* pFrame)
 {
-    pAudio;
     assert(pAudio);
-    assert(pAudio == m_pAudio);
     assert(pFrame);
     assert(m_file.GetStream());
 
     StreamAudio::frames_t& aframes = pAudio->GetFrames();
     aframes.push_back(pFrame);
 
-    const ULONG at = pFrame->GetTimecode();
+    if (aframes.size() == 1)
+        PushAudioHeap(pAudio);
+
+    pAudio->SetLastTimecode(pFrame->GetTimecode());
+
+    m_audio_bytes += pFrame->GetSize();
+
+    //When there are several audio streams, we can only make progress
+    //up to the point that all of them have reached.
+
+    ULONG at;
+
+    if (!GetAudioHorizon(at))
+        return;
 
     if ((m_pVideo == 0) || (m_pVideo->GetFrames().empty() && m_bEOSVideo))
     {
-        const StreamAudio::AudioFrame* const paf = aframes.front();
+        const StreamAudio::AudioFrame* const paf = GetFirstAudioFrame();
         assert(paf);
 
         const ULONG at0 = paf->GetTimecode();
         assert(at >= at0);
 
-        const LONG dt = LONG(at) - LONG(at0);
+        const LONGLONG dt = LONGLONG(at) - LONGLONG(at0);
 
-        //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
-        //THIS IS WRONG AND NEEDS TO BE FIXED
-        if (dt >= kAudioClusterSizeInTimeMs)
-            CreateNewClusterAudioOnly();
+        if ((dt >= GetClusterDuration(true)) ||
+            IsClusterFull(0, m_audio_bytes, true))
+        {
+            CreateNewClusterAudioOnly(at);
+        }
 
         return;
     }
@@ -903,7 +962,7 @@ bool Context::WaitVideo() const
     if (m_bEOSVideo)
         return false;
 
-    if (m_pAudio == 0)
+    if (m_audio.empty())
         return false;
 
     if (m_bEOSAudio)
@@ -923,68 +982,85 @@ bool Context::WaitVideo() const
     const ULONG vt0 = pvf0->GetTimecode();
     const ULONG vt = pvf->GetTimecode();
 
-    const LONG dt = LONG(vt) - LONG(vt0);
+    const LONGLONG dt = LONGLONG(vt) - LONGLONG(vt0);
     assert(dt >= 0);
 
-    //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
-    //THIS IS WRONG AND NEEDS TO BE FIXED
-    if (dt < 1000)
-        return false;
-
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
+    const LONGLONG cluster_duration = GetClusterDuration(false);
 
-    if (aframes.empty())
-        return true;
+    if (dt < cluster_duration)
+        return false;
 
-    const StreamAudio::AudioFrame* const paf = aframes.back();
-    assert(paf);
+    ULONG at;
 
-    const ULONG at = paf->GetTimecode();
+    if (!GetAudioHorizon(at))
+        return true;  //wait for some audio
 
     if (vt <= at)
         return false;
 
-    //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
-    //THIS IS WRONG AND NEEDS TO BE FIXED
-    if ((vt - at) <= 1000)
+    if (LONGLONG(vt - at) <= cluster_duration)
         return false;
 
     return true;
 }
 
 
-bool Context::WaitAudio() const
+bool Context::WaitAudio(const StreamAudio* pAudio) const
 {
+    assert(pAudio);
+
     if (m_file.GetStream() == 0)
         return false;
 
-    if (m_pAudio == 0)
+    if (pAudio->GetEOS())
         return false;
 
-    if (m_bEOSAudio)
+    const StreamAudio::frames_t& aframes = pAudio->GetFrames();
+
+    if (aframes.empty())
         return false;
 
+    const StreamAudio::AudioFrame* const paf = aframes.back();
+    assert(paf);
+
+    const ULONG at = paf->GetTimecode();
+
+    //Audio streams are paced against each other too, since frames can
+    //only be written up to the slowest live audio stream, and a stream
+    //that runs ahead of it would otherwise queue frames without limit.
+
+    const LONGLONG audio_duration = GetClusterDuration(m_pVideo == 0);
+
+    typedef audio_streams_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        const StreamAudio* const p = *i;
+        assert(p);
+
+        if ((p == pAudio) || p->GetEOS())
+            continue;
+
+        const LONG t = p->GetLastTimecode();
+
+        if (t < 0)
+            return true;  //wait for some audio
+
+        if ((at > ULONG(t)) && (LONGLONG(at - ULONG(t)) > audio_duration))
+            return true;
+    }
+
     if (m_pVideo == 0)
         return false;
 
     if (m_bEOSVideo)
         return false;
 
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-
-    if (aframes.empty())
-        return false;
-
     const StreamVideo::frames_t& rframes = m_pVideo->GetKeyFrames();
 
     if (rframes.empty())
         return true;  //wait for some video
 
-    const StreamAudio::AudioFrame* const paf = aframes.back();
-    assert(paf);
-
-    const ULONG at = paf->GetTimecode();
-
     const StreamVideo::VideoFrame* const pvf = rframes.back();
     assert(pvf);
 
@@ -1002,9 +1078,7 @@ bool Context::WaitAudio() const
     if (at <= vt)
         return false;
 
-    //TODO: THIS ASSUMES TIMECODE HAS MS RESOLUTION!
-    //THIS IS WRONG AND NEEDS TO BE FIXED
-    if ((at - vt) <= 1000)
+    if (LONGLONG(at - vt) <= GetClusterDuration(false))
         return false;
 
     return true;
@@ -1026,13 +1100,13 @@ int Context::NotifyVideoEOS(StreamVideo* pSource)
 
     if (m_file.GetStream() == 0)
         __noop;
-    else if ((m_pAudio == 0) || m_bEOSAudio)
+    else if (m_audio.empty() || m_bEOSAudio)
     {
         for (;;)
         {
             if ((m_pVideo != 0) && !m_pVideo->GetFrames().empty())
                 CreateNewCluster(0);
-            else if ((m_pAudio != 0) && !m_pAudio->GetFrames().empty())
+            else if (!m_audio_heap.empty())
                 CreateNewClusterAudioOnly();
             else
                 break;
@@ -1045,25 +1119,61 @@ int Context::NotifyVideoEOS(StreamVideo* pSource)
 
 int Context::NotifyAudioEOS(StreamAudio* pSource)
 {
-    if (m_bEOSAudio)
+    if (pSource == 0)  //graph was stopped
+    {
+        int result = 0;
+
+        typedef audio_streams_t::const_iterator iter_t;
+
+        for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+        {
+            StreamAudio* const pAudio = *i;
+
+            if (!pAudio->GetEOS())
+                result = NotifyAudioEOS(pAudio);
+        }
+
+        return result;
+    }
+
+    if (pSource->GetEOS())
         return 0;
 
 #if 0
     odbgstream os;
-    os << "mux::eosaudio" << endl;
+    os << "mux::eosaudio: track=" << pSource->GetTrackNumber() << endl;
 #endif
 
+    pSource->SetEOS(true);
+
     m_bEOSAudio = true;
 
+    typedef audio_streams_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        if (!(*i)->GetEOS())
+        {
+            m_bEOSAudio = false;
+            break;
+        }
+    }
+
+    //If other audio streams are still running, then we simply stop
+    //waiting for this one; the frames it has already queued are written
+    //as the remaining streams make progress.
+
     if (m_file.GetStream() == 0)
         __noop;
+    else if (!m_bEOSAudio)
+        __noop;
     else if ((m_pVideo == 0) || m_bEOSVideo)
     {
         for (;;)
         {
             if ((m_pVideo != 0) && !m_pVideo->GetFrames().empty())
                 CreateNewCluster(0);
-            else if ((m_pAudio != 0) && !m_pAudio->GetFrames().empty())
+            else if (!m_audio_heap.empty())
                 CreateNewClusterAudioOnly();
             else
                 break;
@@ -1102,18 +1212,14 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
     os << endl;
 #endif
 
-    assert(m_bBufferData == false);
+    assert(m_cBufferData == 0);
     assert(m_pVideo);
 
     const StreamVideo::frames_t& vframes = m_pVideo->GetFrames();
     assert(!vframes.empty());
 
-    clusters_t& cc = m_clusters;
-
-    //const Cluster* const pPrevCluster = cc.empty() ? 0 : &cc.back();
-
-    cc.push_back(Cluster());
-    Cluster& c = cc.back();
+    Cluster& c = m_cluster;
+    ++m_cClusters;
 
     c.m_pos = m_file.GetPosition();
 
@@ -1124,12 +1230,11 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
 
         const ULONG vt = pvf->GetTimecode();
 
-        if ((m_pAudio == 0) || m_pAudio->GetFrames().empty())
+        if (m_audio_heap.empty())
             c.m_timecode = vt;
         else
         {
-            const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-            const StreamAudio::AudioFrame* const paf = aframes.front();
+            const StreamAudio::AudioFrame* const paf = GetFirstAudioFrame();
             const ULONG at = paf->GetTimecode();
 
             c.m_timecode = (at <= vt) ? at : vt;
@@ -1216,7 +1321,7 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
         assert(vt >= c.m_timecode);
         assert((pvf_stop == 0) || (vt < pvf_stop->GetTimecode()));
 
-        if ((m_pAudio == 0) || m_pAudio->GetFrames().empty())
+        if (m_audio_heap.empty())
         {
             if (!rframes.empty() && (pvf == rframes.front()))
                 rframes.pop_front();
@@ -1230,13 +1335,8 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
             continue;
         }
 
-        const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-        typedef StreamAudio::frames_t::const_iterator audio_iter_t;
-
-        audio_iter_t i = aframes.begin();
-        const audio_iter_t j = aframes.end();
-
-        const StreamAudio::AudioFrame* const paf = *i++;  //1st audio frame
+        //1st audio frame, across all audio streams
+        const StreamAudio::AudioFrame* const paf = GetFirstAudioFrame();
         assert(paf);
 
         const ULONG at = paf->GetTimecode();
@@ -1281,11 +1381,11 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
         if (at >= vt_stop)  //weird
             break;
 
-        if (i == j)  //weird
-            break;
+        //2nd audio frame, across all audio streams
+        const StreamAudio::AudioFrame* const paf_stop = GetSecondAudioFrame();
 
-        const StreamAudio::AudioFrame* const paf_stop = *i;  //2nd audio frame
-        assert(paf_stop);
+        if (paf_stop == 0)  //weird
+            break;
 
         const ULONG at_stop = paf_stop->GetTimecode();
 
@@ -1312,29 +1412,35 @@ void Context::CreateNewCluster(const StreamVideo::VideoFrame* pvf_stop)
 
         m_file.SetPosition(pos);
     }
+    else
+    {
+        // In live mode the cluster goes downstream as soon as
+        // it's complete.
+        m_file.Flush();
+    }
 }
 
 
-void Context::CreateNewClusterAudioOnly()
+void Context::CreateNewClusterAudioOnly(ULONG horizon)
 {
-    assert(m_bBufferData == false);
-    assert(m_pAudio);
+    assert(m_cBufferData == 0);
+    assert(!m_audio_heap.empty());
 
-    const StreamAudio::frames_t& aframes = m_pAudio->GetFrames();
-    assert(!aframes.empty());
-
-    const StreamAudio::AudioFrame* const paf_first = aframes.front();
+    const StreamAudio::AudioFrame* const paf_first = GetFirstAudioFrame();
     assert(paf_first);
 
     const StreamAudio::AudioFrame& af_first = *paf_first;
 
     const ULONG af_first_time = af_first.GetTimecode();
+    assert(af_first_time <= horizon);
 
-    clusters_t& cc = m_clusters;
-    assert(cc.empty() || (af_first_time > cc.back().m_timecode));
+    //With several audio streams, the first frame of this cluster can
+    //have the same timecode as the last frame of the previous cluster.
 
-    cc.push_back(Cluster());
-    Cluster& c = cc.back();
+    Cluster& c = m_cluster;
+    assert((m_cClusters == 0) || (af_first_time >= c.m_timecode));
+
+    ++m_cClusters;
 
     c.m_pos = m_file.GetPosition();
     c.m_timecode = af_first_time;
@@ -1393,18 +1499,24 @@ void Context::CreateNewClusterAudioOnly()
 #endif
 
     ULONG cFrames = 0;   //TODO: must write cues for audio
+    ULONG cluster_bytes = 0;
 
-    while (!aframes.empty())
+    while (!m_audio_heap.empty())
     {
-        const StreamAudio::AudioFrame* const paf = aframes.front();
+        const StreamAudio::AudioFrame* const paf = GetFirstAudioFrame();
         assert(paf);
 
         const ULONG t = paf->GetTimecode();
         assert(t >= c.m_timecode);
 
-        const LONG dt = LONG(t) - LONG(c.m_timecode);
+        if (t > horizon)  //other audio streams haven't caught up yet
+            break;
+
+        const LONGLONG dt = LONGLONG(t) - LONGLONG(c.m_timecode);
+
+        cluster_bytes += paf->GetSize();
 
-        if (dt > kAudioClusterSizeInTimeMs)
+        if ((cFrames > 0) && IsClusterFull(dt, cluster_bytes, true))
             break;
 
         WriteAudioFrame(c, cFrames);
@@ -1423,6 +1535,10 @@ void Context::CreateNewClusterAudioOnly()
 
         m_file.SetPosition(pos);
     }
+    else
+    {
+        m_file.Flush();
+    }
 }
 
 
@@ -1488,10 +1604,8 @@ void Context::WriteVideoFrame(
 
     if (pf->IsKey())
     {
-        Cluster::keyframes_t& kk = c.m_keyframes;
-        const Keyframe k(ft, cFrames);
-
-        kk.push_back(k);
+        const CuePoint k(c.m_pos, ft, cFrames);
+        m_cues.push_back(k);
     }
 
     if (ft > m_max_timecode)
@@ -1512,8 +1626,17 @@ void Context::WriteVideoFrame(
 
 void Context::WriteAudioFrame(Cluster& c, ULONG& cFrames)
 {
-   assert(m_pAudio);
-   StreamAudio& s = *m_pAudio;
+   //Remove the stream holding the earliest audio frame from the heap,
+   //and (unless that was its last frame) put it back afterwards, keyed
+   //on its next frame.
+
+   assert(!m_audio_heap.empty());
+   std::pop_heap(m_audio_heap.begin(), m_audio_heap.end(), LaterAudio());
+
+   StreamAudio* const pStream = m_audio_heap.back();
+   assert(pStream);
+
+   StreamAudio& s = *pStream;
 
    StreamAudio::frames_t& aframes = s.GetFrames();
    assert(!aframes.empty());
@@ -1524,6 +1647,9 @@ void Context::WriteAudioFrame(Cluster& c, ULONG& cFrames)
    assert(cFrames < ULONG_MAX);
    ++cFrames;
 
+   assert(m_audio_bytes >= pf->GetSize());
+   m_audio_bytes -= pf->GetSize();
+
    pf->WriteSimpleBlock(s, c.m_timecode);
 
    const ULONG ft = pf->GetTimecode();
@@ -1534,6 +1660,11 @@ void Context::WriteAudioFrame(Cluster& c, ULONG& cFrames)
    aframes.pop_front();
    pf->Release();
 
+   if (aframes.empty())
+      m_audio_heap.pop_back();
+   else
+      std::push_heap(m_audio_heap.begin(), m_audio_heap.end(), LaterAudio());
+
 #if 0
     odbgstream os;
     os << "mux::context::writeaudioframe: t=" << ft
@@ -1564,7 +1695,6 @@ void Context::FlushVideo(StreamVideo* pVideo)
 void Context::FlushAudio(StreamAudio* pAudio)
 {
     assert(pAudio);
-    assert(pAudio == m_pAudio);
 
     const StreamAudio::frames_t& aframes = pAudio->GetFrames();
 
@@ -1593,15 +1723,171 @@ void Context::SetLiveMuxMode(bool is_live)
     m_bLiveMux = is_live;
 }
 
+bool Context::GetKeyframeClusterMode() const
+{
+    return m_bKeyframeClusters;
+}
+
+void Context::SetKeyframeClusterMode(bool keyframe_only)
+{
+    m_bKeyframeClusters = keyframe_only;
+}
+
+LONG Context::GetMaxClusterDuration() const
+{
+    return m_max_cluster_duration;
+}
+
+void Context::SetMaxClusterDuration(LONG ms)
+{
+    assert(ms >= 0);
+    m_max_cluster_duration = ms;
+}
+
+LONG Context::GetMaxClusterSize() const
+{
+    return m_max_cluster_size;
+}
+
+void Context::SetMaxClusterSize(LONG size)
+{
+    assert(size >= 0);
+    m_max_cluster_size = size;
+}
+
+LONGLONG Context::GetClusterDuration(bool audio_only) const
+{
+    LONGLONG ms = m_max_cluster_duration;
+
+    if (ms <= 0)  //use default
+    {
+        ms = audio_only ?
+                kAudioClusterSizeInTimeMs :
+                kVideoClusterSizeInTimeMs;
+    }
+
+    const LONGLONG ns = ms * 1000000;
+
+    const LONGLONG scale = GetTimecodeScale();
+    assert(scale >= 1);
+
+    return ns / scale;
+}
+
+bool Context::IsClusterFull(
+    LONGLONG dt,
+    ULONG bytes,
+    bool audio_only) const
+{
+    if (dt > GetClusterDuration(audio_only))
+        return true;
+
+    if ((m_max_cluster_size > 0) && (bytes > ULONG(m_max_cluster_size)))
+        return true;
+
+    return false;
+}
+
+void Context::PushAudioHeap(StreamAudio* pAudio)
+{
+    assert(pAudio);
+    assert(!pAudio->GetFrames().empty());
+    assert(std::find(m_audio_heap.begin(), m_audio_heap.end(), pAudio) ==
+           m_audio_heap.end());
+
+    m_audio_heap.push_back(pAudio);
+    std::push_heap(m_audio_heap.begin(), m_audio_heap.end(), LaterAudio());
+}
+
+const StreamAudio::AudioFrame* Context::GetFirstAudioFrame() const
+{
+    if (m_audio_heap.empty())
+        return 0;
+
+    const StreamAudio* const pAudio = m_audio_heap.front();
+    assert(pAudio);
+
+    return pAudio->GetFrames().front();
+}
+
+const StreamAudio::AudioFrame* Context::GetSecondAudioFrame() const
+{
+    //The frame that follows the first one is either the next frame
+    //of the stream at the front of the heap, or the oldest frame of
+    //one of the front's children.
+
+    if (m_audio_heap.empty())
+        return 0;
+
+    const StreamAudio::AudioFrame* result = 0;
+
+    const StreamAudio::frames_t& aframes = m_audio_heap.front()->GetFrames();
+    assert(!aframes.empty());
+
+    if (aframes.size() > 1)
+        result = *++aframes.begin();
+
+    const audio_streams_t::size_type n = m_audio_heap.size();
+
+    for (audio_streams_t::size_type i = 1; (i <= 2) && (i < n); ++i)
+    {
+        const StreamAudio::AudioFrame* const paf =
+            m_audio_heap[i]->GetFrames().front();
+
+        if ((result == 0) || (paf->GetTimecode() < result->GetTimecode()))
+            result = paf;
+    }
+
+    return result;
+}
+
+bool Context::GetAudioHorizon(ULONG& horizon) const
+{
+    //Audio frames having a timecode up to the horizon can be written,
+    //because every audio stream that hasn't reached EOS has delivered
+    //a frame at least that late.  Returns false if some stream hasn't
+    //delivered anything yet.
+
+    horizon = ULONG_MAX;
+
+    typedef audio_streams_t::const_iterator iter_t;
+
+    for (iter_t i = m_audio.begin(); i != m_audio.end(); ++i)
+    {
+        const StreamAudio* const pAudio = *i;
+        assert(pAudio);
+
+        if (pAudio->GetEOS())
+            continue;
+
+        const StreamAudio::frames_t& aframes = pAudio->GetFrames();
+
+        if (aframes.empty())
+            return false;
+
+        const ULONG t = aframes.back()->GetTimecode();
+
+        if (t < horizon)
+            horizon = t;
+    }
+
+    return true;
+}
+
 void Context::BufferData()
 {
-    assert(m_bBufferData == false);
-    m_bBufferData = true;
+    //Each Ogg Vorbis stream holds back the track header until
+    //it has received its codec private data.
+    ++m_cBufferData;
 }
 
 void Context::FlushBufferedData()
 {
-    assert(m_bBufferData == true);
+    assert(m_cBufferData > 0);
+
+    if (--m_cBufferData > 0)  //wait for the other streams
+        return;
+
     const uint64 element_size =
         m_buf.GetBufferLength() - m_buf_element_info.num_bytes_to_ignore;
     m_buf.RewriteUInt(m_buf_element_info.offset, element_size,
@@ -1609,12 +1895,11 @@ void Context::FlushBufferedData()
     m_file.Write(m_buf.GetBufferPtr(),
                  static_cast<ULONG>(m_buf.GetBufferLength()));
     m_buf.Reset();
-    m_bBufferData = false;
 }
 
 void Context::ResetBuffer()
 {
-    m_bBufferData = false;
+    m_cBufferData = 0;
     m_buf.Reset();
 }
 
@@ -11,7 +11,7 @@
 #include "webmmuxebmlio.h"
 #include "webmmuxstreamvideo.h"
 #include "webmmuxstreamaudio.h"
-#include <list>
+#include <vector>
 
 namespace WebmMuxLib
 {
@@ -32,8 +32,10 @@ public:
 
    void SetVideoStream(StreamVideo*);
 
-   //TODO: this needs to liberalized to handle multiple audio streams.
-   void SetAudioStream(StreamAudio*);
+   //Audio tracks are numbered (after the video track) in the order
+   //in which their streams were added.
+   void AddAudioStream(StreamAudio*);
+   void RemoveAudioStream(StreamAudio*);
 
    void Open(IStream*);
    void Close();
@@ -46,7 +48,7 @@ public:
     void NotifyAudioFrame(StreamAudio*, StreamAudio::AudioFrame*);
     int NotifyAudioEOS(StreamAudio*);
     void FlushAudio(StreamAudio*);
-    bool WaitAudio() const;
+    bool WaitAudio(const StreamAudio*) const;
 
     ULONG GetTimecodeScale() const;
     ULONG GetTimecode() const;  //of frame most recently written to file
@@ -54,13 +56,36 @@ public:
     bool GetLiveMuxMode() const;
     void SetLiveMuxMode(bool is_live);
 
+    //Cluster policy.  In keyframe cluster mode, video clusters begin
+    //only on keyframes.  Otherwise a cluster is also cut when it would
+    //exceed the maximum duration (ms; 0 means use the default) or the
+    //maximum payload size (bytes; 0 means no limit).
+    bool GetKeyframeClusterMode() const;
+    void SetKeyframeClusterMode(bool);
+    LONG GetMaxClusterDuration() const;
+    void SetMaxClusterDuration(LONG);
+    LONG GetMaxClusterSize() const;
+    void SetMaxClusterSize(LONG);
+
     void BufferData();
     void FlushBufferedData();
 
 private:
 
    StreamVideo* m_pVideo;
-   StreamAudio* m_pAudio;  //TODO: accept multiple audio streams
+
+   typedef std::vector<StreamAudio*> audio_streams_t;
+   audio_streams_t m_audio;
+
+   //The audio streams that have frames queued, kept as a min-heap
+   //keyed on the timecode of each stream's oldest frame.  The stream
+   //at the front of the heap holds the next audio frame in file order.
+   audio_streams_t m_audio_heap;
+
+   void PushAudioHeap(StreamAudio*);
+   const StreamAudio::AudioFrame* GetFirstAudioFrame() const;
+   const StreamAudio::AudioFrame* GetSecondAudioFrame() const;
+   bool GetAudioHorizon(ULONG&) const;
 
    void Final();
 
@@ -87,28 +112,33 @@ private:
    const ULONG m_timecode_scale;  //TODO: video vs. audio
    ULONG m_max_timecode;  //unscaled
 
-    struct Keyframe
-    {
-        ULONG m_timecode;    //unscaled
-        ULONG m_block;       //1-based number of block within cluster
-
-        Keyframe();   //needed for std::list
-        Keyframe(ULONG timecode, ULONG block);
-    };
-
     struct Cluster
     {
         //absolute pos within file (NOT offset relative to segment)
         __int64 m_pos;
 
         ULONG m_timecode;
+    };
+
+    //Only the cluster currently being written is kept.  What the Cues
+    //need from earlier clusters is recorded (as each video keyframe is
+    //written) in a flat array of cue points, which for a 10 hour file
+    //with a keyframe per second comes to well under 1MB.
+
+    Cluster m_cluster;
+    ULONG m_cClusters;  //number of clusters written so far
 
-        typedef std::list<Keyframe> keyframes_t;
-        keyframes_t m_keyframes;
+    struct CuePoint
+    {
+        __int64 m_pos;       //of cluster; absolute pos within file
+        ULONG m_timecode;    //unscaled
+        ULONG m_block;       //1-based number of block within cluster
+
+        CuePoint(__int64 pos, ULONG timecode, ULONG block);
     };
 
-   typedef std::list<Cluster> clusters_t;
-   clusters_t m_clusters;
+    typedef std::vector<CuePoint> cues_t;
+    cues_t m_cues;
 
    //void WriteSecondSeekHead();
    void WriteCues();
@@ -116,7 +146,7 @@ private:
 
     //bool ReadyToCreateNewClusterVideo(const StreamVideo::VideoFrame&) const;
     void CreateNewCluster(const StreamVideo::VideoFrame*);
-    void CreateNewClusterAudioOnly();
+    void CreateNewClusterAudioOnly(ULONG horizon = ULONG_MAX);
 
     void WriteVideoFrame(
         Cluster&,
@@ -127,8 +157,7 @@ private:
 
     void WriteAudioFrame(Cluster&, ULONG&);
 
-    void WriteCuePoints(const Cluster&);
-    void WriteCuePoint(const Cluster&, const Keyframe&);
+    void WriteCuePoint(const CuePoint&);
 
     //EOS can happen either because we receive a notification from the stream,
     //or because the graph was stopped (before reaching end-of-stream proper).
@@ -136,12 +165,21 @@ private:
     //EOS already.
 
     bool m_bEOSVideo;
-    bool m_bEOSAudio;
+    bool m_bEOSAudio;  //all audio streams
     int m_cEOS;
     int EOS(Stream*);
 
     bool m_bLiveMux;
 
+    bool m_bKeyframeClusters;
+    LONG m_max_cluster_duration;  //ms
+    LONG m_max_cluster_size;      //bytes
+    ULONG m_rframe_bytes;  //video payload since most recent rframe
+    ULONG m_audio_bytes;   //audio payload queued
+
+    LONGLONG GetClusterDuration(bool audio_only) const;  //timecode units
+    bool IsClusterFull(LONGLONG dt, ULONG bytes, bool audio_only) const;
+
     struct BufferedElementSizeInfo
     {
         unsigned __int64 offset; // offset to size value in |m_buf|
@@ -150,7 +188,7 @@ private:
                                  // |byte_count|)
     };
 
-    bool m_bBufferData;
+    int m_cBufferData;  //number of streams holding back the track header
     BufferedElementSizeInfo m_buf_element_info;
     void ResetBuffer();
 };
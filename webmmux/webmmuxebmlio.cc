@@ -9,11 +9,22 @@
 #include <strmif.h>
 #include "webmmuxebmlio.h"
 #include <cassert>
+#include <cstring>
 #include <limits>
 #include <malloc.h>  //_malloca
+#include <new>
 
 
-EbmlIO::File::File() : m_pStream(0)
+EbmlIO::File::File() :
+    m_pStream(0),
+    m_buf(0),
+    m_buf_size(0),
+    m_buf_len(0),
+    m_write_through(0),
+    m_buf_pos(0),
+    m_pos(0),
+    m_stream_pos(0),
+    m_writer(*this)
 {
 }
 
@@ -21,13 +32,29 @@ EbmlIO::File::File() : m_pStream(0)
 EbmlIO::File::~File()
 {
     assert(m_pStream == 0);
+    assert(m_buf_len == 0);
+
+    delete[] m_buf;
 }
 
 
 void EbmlIO::File::SetStream(IStream* p)
 {
     assert((m_pStream == 0) || (p == 0));
+
+    if (p == 0)
+        Flush();
+
     m_pStream = p;
+
+    if (m_pStream)
+        m_stream_pos = EbmlIO::SetPosition(m_pStream, 0, STREAM_SEEK_CUR);
+    else
+        m_stream_pos = 0;
+
+    m_pos = m_stream_pos;
+    m_buf_pos = m_stream_pos;
+    m_buf_len = 0;
 }
 
 
@@ -37,8 +64,94 @@ IStream* EbmlIO::File::GetStream() const
 }
 
 
+void EbmlIO::File::SetBufferSize(ULONG size)
+{
+    if (size == m_buf_size)
+        return;
+
+    Flush();
+
+    delete[] m_buf;
+    m_buf = 0;
+    m_buf_size = 0;
+
+    if (size == 0)
+        return;
+
+    m_buf = new (std::nothrow) BYTE[size];
+    assert(m_buf);
+
+    if (m_buf)  //otherwise, fall back to write-through
+        m_buf_size = size;
+}
+
+
+ULONG EbmlIO::File::GetBufferSize() const
+{
+    return m_buf_size;
+}
+
+
+void EbmlIO::File::SetWriteThroughSize(ULONG size)
+{
+    m_write_through = size;
+}
+
+
+void EbmlIO::File::Flush()
+{
+    if (m_buf_len > 0)
+    {
+        SeekStream(m_buf_pos);
+        WriteStream(m_buf, m_buf_len);
+
+        m_buf_len = 0;
+    }
+
+    m_buf_pos = m_pos;
+}
+
+
+void EbmlIO::File::SeekStream(__int64 pos)
+{
+    if (pos == m_stream_pos)
+        return;
+
+    m_stream_pos = EbmlIO::SetPosition(m_pStream, pos, STREAM_SEEK_SET);
+    assert(m_stream_pos == pos);
+}
+
+
+void EbmlIO::File::WriteStream(const void* buf, ULONG cb)
+{
+    EbmlIO::Write(m_pStream, buf, cb);
+    m_stream_pos += cb;
+}
+
+
+void EbmlIO::File::ReadStream(void* buf, ULONG cb)
+{
+    assert(m_pStream);
+
+    Flush();
+    SeekStream(m_pos);
+
+    ULONG cbRead;
+
+    const HRESULT hr = m_pStream->Read(buf, cb, &cbRead);
+    assert(hr == S_OK);
+    assert(cbRead == cb);
+    hr;
+
+    m_stream_pos += cbRead;
+    m_pos = m_stream_pos;
+    m_buf_pos = m_pos;
+}
+
+
 HRESULT EbmlIO::File::SetSize(__int64 size)
 {
+    Flush();
     return EbmlIO::SetSize(m_pStream, size);
 }
 
@@ -47,44 +160,115 @@ __int64 EbmlIO::File::SetPosition(
     __int64 pos,
     STREAM_SEEK origin)
 {
-    return EbmlIO::SetPosition(m_pStream, pos, origin);
+    switch (origin)
+    {
+        case STREAM_SEEK_SET:
+            m_pos = pos;
+            break;
+
+        case STREAM_SEEK_CUR:
+            m_pos += pos;
+            break;
+
+        case STREAM_SEEK_END:
+        default:
+            Flush();
+
+            m_stream_pos = EbmlIO::SetPosition(m_pStream, pos, origin);
+            m_pos = m_stream_pos;
+            m_buf_pos = m_pos;
+
+            return m_pos;
+    }
+
+    assert(m_pos >= 0);
+
+    //Seeking within the staged region is free; we only need to
+    //drain the buffer when we leave it.
+
+    if ((m_pos < m_buf_pos) || (m_pos > (m_buf_pos + m_buf_len)))
+        Flush();
+
+    return m_pos;
 }
 
 
 __int64 EbmlIO::File::GetPosition() const
 {
-    File* const const_file = const_cast<File*>(this);
-    return const_file->SetPosition(0, STREAM_SEEK_CUR);
+    return m_pos;
 }
 
 
 void EbmlIO::File::Write(const void* buf, ULONG cb)
 {
-    EbmlIO::Write(m_pStream, buf, cb);
+    assert(m_pStream);
+    assert(buf || (cb == 0));
+
+    if (cb == 0)
+        return;
+
+    if ((m_pos < m_buf_pos) || (m_pos > (m_buf_pos + m_buf_len)))
+        Flush();
+
+    __int64 off = m_pos - m_buf_pos;
+    assert(off >= 0);
+    assert(off <= m_buf_len);
+
+    const bool bWriteThrough =
+        (cb >= m_buf_size) ||
+        ((m_write_through > 0) && (cb >= m_write_through));
+
+    if (bWriteThrough || ((off + cb) > m_buf_size))
+    {
+        Flush();
+
+        if (bWriteThrough)
+        {
+            SeekStream(m_pos);
+            WriteStream(buf, cb);
+
+            m_pos += cb;
+            m_buf_pos = m_pos;
+
+            return;
+        }
+
+        off = 0;
+    }
+
+    BYTE* const dst = m_buf + off;
+    memcpy(dst, buf, cb);
+
+    m_pos += cb;
+
+    const __int64 len = m_pos - m_buf_pos;
+
+    if (len > m_buf_len)
+        m_buf_len = static_cast<ULONG>(len);
 }
 
 
 void EbmlIO::File::Serialize8UInt(__int64 val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 8);
+    EbmlIO::Serialize(&m_writer, &val, 8);
 }
 
 
 void EbmlIO::File::Serialize4UInt(ULONG val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 4);
+    EbmlIO::Serialize(&m_writer, &val, 4);
 }
 
 
 void EbmlIO::File::Serialize2UInt(USHORT val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 2);
+    EbmlIO::Serialize(&m_writer, &val, 2);
 }
 
 
 void EbmlIO::File::Serialize1UInt(BYTE val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 1);
+    EbmlIO::Serialize(&m_writer, &val, 1);
 }
 
 
@@ -108,97 +292,157 @@ BYTE EbmlIO::File::GetSerializeUIntSize(__int64 val)
 
 void EbmlIO::File::SerializeUInt(__int64 val, BYTE size)
 {
-    EbmlIO::Serialize(m_pStream, &val, size);
+    EbmlIO::Serialize(&m_writer, &val, size);
 }
 
 
 void EbmlIO::File::Serialize2SInt(SHORT val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 2);
+    EbmlIO::Serialize(&m_writer, &val, 2);
 }
 
 
 void EbmlIO::File::Serialize4Float(float val)
 {
-    EbmlIO::Serialize(m_pStream, &val, 4);
+    EbmlIO::Serialize(&m_writer, &val, 4);
 }
 
 
 void EbmlIO::File::WriteID4(ULONG id)
 {
-    EbmlIO::WriteID4(m_pStream, id);
+    EbmlIO::WriteID4(&m_writer, id);
 }
 
 
 void EbmlIO::File::WriteID3(ULONG id)
 {
-    EbmlIO::WriteID3(m_pStream, id);
+    EbmlIO::WriteID3(&m_writer, id);
 }
 
 
 void EbmlIO::File::WriteID2(USHORT id)
 {
-    EbmlIO::WriteID2(m_pStream, id);
+    EbmlIO::WriteID2(&m_writer, id);
 }
 
 
 void EbmlIO::File::WriteID1(BYTE id)
 {
-    EbmlIO::WriteID1(m_pStream, id);
+    EbmlIO::WriteID1(&m_writer, id);
 }
 
 
 ULONG EbmlIO::File::ReadID4()
 {
-    return EbmlIO::ReadID4(m_pStream);
+    return EbmlIO::ReadID4(&m_writer);
 }
 
 
 void EbmlIO::File::Write8UInt(__int64 val)
 {
-    EbmlIO::Write8UInt(m_pStream, val);
+    EbmlIO::Write8UInt(&m_writer, val);
 }
 
 
 void EbmlIO::File::Write4UInt(ULONG val)
 {
-    EbmlIO::Write4UInt(m_pStream, val);
+    EbmlIO::Write4UInt(&m_writer, val);
 }
 
 
 void EbmlIO::File::Write2UInt(USHORT val)
 {
-    EbmlIO::Write2UInt(m_pStream, val);
+    EbmlIO::Write2UInt(&m_writer, val);
 }
 
 
 void EbmlIO::File::Write1UInt(BYTE val)
 {
-    EbmlIO::Write1UInt(m_pStream, val);
+    EbmlIO::Write1UInt(&m_writer, val);
 }
 
 
 void EbmlIO::File::WriteUInt(__int64 val, ULONG size)
 {
-    return EbmlIO::WriteUInt(m_pStream, val, size);
+    return EbmlIO::WriteUInt(&m_writer, val, size);
 }
 
 
 void EbmlIO::File::Write1String(const char* str)
 {
-    EbmlIO::Write1String(m_pStream, str);
+    EbmlIO::Write1String(&m_writer, str);
 }
 
 
 //void EbmlIO::File::Write1String(const char* str, size_t len)
 //{
-//    EbmlIO::Write1String(m_pStream, str, len);
+//    EbmlIO::Write1String(&m_writer, str, len);
 //}
 
 
 void EbmlIO::File::Write1UTF8(const wchar_t* str)
 {
-    EbmlIO::Write1UTF8(m_pStream, str);
+    EbmlIO::Write1UTF8(&m_writer, str);
+}
+
+
+EbmlIO::File::Writer::Writer(File& f) : m_file(f)
+{
+}
+
+
+HRESULT EbmlIO::File::Writer::QueryInterface(const IID& iid, void** ppv)
+{
+    if (ppv == 0)
+        return E_POINTER;
+
+    IUnknown*& pUnk = reinterpret_cast<IUnknown*&>(*ppv);
+
+    if ((iid == __uuidof(IUnknown)) || (iid == __uuidof(ISequentialStream)))
+    {
+        pUnk = static_cast<ISequentialStream*>(this);
+        return S_OK;  //lifetime is that of the file
+    }
+
+    pUnk = 0;
+    return E_NOINTERFACE;
+}
+
+
+ULONG EbmlIO::File::Writer::AddRef()
+{
+    return 1;
+}
+
+
+ULONG EbmlIO::File::Writer::Release()
+{
+    return 1;
+}
+
+
+HRESULT EbmlIO::File::Writer::Read(void* buf, ULONG cb, ULONG* pcbRead)
+{
+    m_file.ReadStream(buf, cb);
+
+    if (pcbRead)
+        *pcbRead = cb;
+
+    return S_OK;
+}
+
+
+HRESULT EbmlIO::File::Writer::Write(
+    const void* buf,
+    ULONG cb,
+    ULONG* pcbWritten)
+{
+    m_file.Write(buf, cb);
+
+    if (pcbWritten)
+        *pcbWritten = cb;
+
+    return S_OK;
 }
 
 
@@ -527,18 +771,18 @@ void EbmlIO::Serialize(
     assert(p);
     assert(q);
     assert(q >= p);
+    assert((q - p) <= 8);
 
-    while (q != p)
-    {
-        --q;
+    //Reverse into a local buffer, so that the value goes out
+    //in a single write instead of one write per byte.
 
-        ULONG cbWritten;
+    BYTE buf[8];
+    BYTE* dst = buf;
 
-        const HRESULT hr = pStream->Write(q, 1, &cbWritten);
-        assert(SUCCEEDED(hr));
-        assert(cbWritten == 1);
-        hr;
-    }
+    while (q != p)
+        *dst++ = *--q;
+
+    Write(pStream, buf, static_cast<ULONG>(dst - buf));
 }
 
 
@@ -23,6 +23,20 @@ namespace EbmlIO
         void SetStream(IStream*);
         IStream* GetStream() const;
 
+        //Write-behind buffering.  When the buffer size is non-zero,
+        //writes are staged in memory and issued to the stream as large
+        //sequential writes.  Seeking back into the staged region (to
+        //patch a size field, say) is done in-buffer, without touching
+        //the stream.  A size of 0 means write-through.
+        void SetBufferSize(ULONG);
+        ULONG GetBufferSize() const;
+        void Flush();
+
+        //Payloads at least this large (frame data, typically) bypass the
+        //staging buffer and go to the stream straight from the caller's
+        //memory, to avoid an extra copy.  A size of 0 disables this.
+        void SetWriteThroughSize(ULONG);
+
         HRESULT SetSize(__int64);
 
         __int64 SetPosition(__int64, STREAM_SEEK origin = STREAM_SEEK_SET);
@@ -62,6 +76,41 @@ namespace EbmlIO
 
         IStream* m_pStream;
 
+        BYTE* m_buf;
+        ULONG m_buf_size;      //capacity
+        ULONG m_buf_len;       //bytes staged
+        ULONG m_write_through;
+        __int64 m_buf_pos;     //stream pos of m_buf[0]
+        __int64 m_pos;         //logical pos
+        __int64 m_stream_pos;  //physical pos of m_pStream
+
+        void SeekStream(__int64);
+        void WriteStream(const void*, ULONG);
+        void ReadStream(void*, ULONG);
+
+        //Adapts the staging buffer to the ISequentialStream-based
+        //serialization functions below.
+        class Writer : public ISequentialStream
+        {
+            Writer(const Writer&);
+            Writer& operator=(const Writer&);
+
+        public:
+            explicit Writer(File&);
+
+            HRESULT STDMETHODCALLTYPE QueryInterface(const IID&, void**);
+            ULONG STDMETHODCALLTYPE AddRef();
+            ULONG STDMETHODCALLTYPE Release();
+
+            HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG*);
+            HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*);
+
+        private:
+            File& m_file;
+        };
+
+        Writer m_writer;
+
     };
 
     HRESULT SetSize(IStream*, __int64);
@@ -7,7 +7,7 @@
 // be found in the AUTHORS file in the root of the source tree.
 
 #include "webmmuxfilter.h"
-#include "cenumpins.h"
+#include "tenumxxx.h"
 #include "graphutil.h"
 #include "webmtypes.h"
 #include <new>
@@ -66,6 +66,197 @@ HRESULT CreateInstance(
 }
 
 
+//Ids of the audio inpins, which are created as they're connected.
+static const wchar_t* const s_audio_inpin_ids[] =
+{
+    L"audio",
+    L"audio 2",
+    L"audio 3",
+    L"audio 4",
+    L"audio 5",
+    L"audio 6",
+    L"audio 7",
+    L"audio 8"
+};
+
+enum { kMaxAudioInpins = sizeof(s_audio_inpin_ids) / sizeof(wchar_t*) };
+
+
+namespace
+{
+
+//Enumerates the pins of the filter.  Audio inpins come and go as
+//streams are connected and disconnected, so the enumerator fails with
+//VFW_E_ENUM_OUT_OF_SYNC once the pins have changed, until it's reset.
+
+class EnumPins : public TEnumXXX<IEnumPins, IPin*>
+{
+    EnumPins& operator=(const EnumPins&);
+
+public:
+
+    explicit EnumPins(Filter*);  //filter is locked by caller
+
+    HRESULT STDMETHODCALLTYPE Reset();
+    HRESULT STDMETHODCALLTYPE Clone(IEnumPins**);
+
+protected:
+
+    virtual ~EnumPins();
+
+    HRESULT GetCount(ULONG&) const;
+    HRESULT GetItem(ULONG, IPin*&);
+
+private:
+
+    EnumPins(const EnumPins&);
+
+    typedef std::vector<IPin*> pins_t;
+
+    Filter* const m_pFilter;
+    ULONG m_version;
+    pins_t m_pins;
+
+    void Init(pins_t&);
+    static void Clear(pins_t&);
+
+};
+
+
+EnumPins::EnumPins(Filter* pFilter) :
+    m_pFilter(pFilter)
+{
+    Init(m_pins);
+}
+
+
+EnumPins::EnumPins(const EnumPins& rhs) :
+    TEnumXXX<IEnumPins, IPin*>(rhs),
+    m_pFilter(rhs.m_pFilter),
+    m_version(rhs.m_version),
+    m_pins(rhs.m_pins)
+{
+    typedef pins_t::const_iterator iter_t;
+
+    for (iter_t i = m_pins.begin(); i != m_pins.end(); ++i)
+        (*i)->AddRef();
+}
+
+
+EnumPins::~EnumPins()
+{
+    Clear(m_pins);
+}
+
+
+void EnumPins::Init(pins_t& pins)
+{
+    //The pins take their reference count from the filter, so holding
+    //them also keeps the filter alive.
+
+    const Filter::audio_inpins_t& audio = m_pFilter->m_inpins_audio;
+
+    pins.reserve(2 + audio.size());
+
+    pins.push_back(&m_pFilter->m_inpin_video);
+
+    typedef Filter::audio_inpins_t::const_iterator iter_t;
+
+    for (iter_t i = audio.begin(); i != audio.end(); ++i)
+        pins.push_back(*i);
+
+    pins.push_back(&m_pFilter->m_outpin);
+
+    typedef pins_t::const_iterator pins_iter_t;
+
+    for (pins_iter_t i = pins.begin(); i != pins.end(); ++i)
+        (*i)->AddRef();
+
+    m_version = m_pFilter->m_pins_version;
+}
+
+
+void EnumPins::Clear(pins_t& pins)
+{
+    while (!pins.empty())
+    {
+        IPin* const p = pins.back();
+        pins.pop_back();
+
+        p->Release();
+    }
+}
+
+
+HRESULT EnumPins::Reset()
+{
+    pins_t pins;
+
+    {
+        Filter::Lock lock;
+
+        const HRESULT hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return hr;
+
+        if (m_version != m_pFilter->m_pins_version)
+        {
+            Init(pins);
+            m_pins.swap(pins);
+        }
+    }
+
+    //The old pins are released after the filter is unlocked, since
+    //they might hold the last references to the filter.
+
+    Clear(pins);
+
+    return TEnumXXX<IEnumPins, IPin*>::Reset();
+}
+
+
+HRESULT EnumPins::Clone(IEnumPins** pp)
+{
+    if (pp == 0)
+        return E_POINTER;
+
+    IEnumPins*& p = *pp;
+
+    p = new (std::nothrow) EnumPins(*this);
+
+    return p ? S_OK : E_OUTOFMEMORY;
+}
+
+
+HRESULT EnumPins::GetCount(ULONG& n) const
+{
+    Filter::Lock lock;
+
+    const HRESULT hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_version != m_pFilter->m_pins_version)
+        return VFW_E_ENUM_OUT_OF_SYNC;
+
+    n = static_cast<ULONG>(m_pins.size());
+    return S_OK;
+}
+
+
+HRESULT EnumPins::GetItem(ULONG i, IPin*& p)
+{
+    p = m_pins[i];
+    p->AddRef();
+
+    return S_OK;
+}
+
+}  //end unnamed namespace
+
+
 #pragma warning(disable:4355)  //'this' ptr in member init list
 Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
     : m_pClassFactory(pClassFactory),
@@ -74,15 +265,18 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_state(State_Stopped),
       m_clock(0),
       m_inpin_video(this),
-      m_inpin_audio(this),
+      m_pins_version(0),
       m_outpin(this)
 {
     m_pClassFactory->LockServer(TRUE);
 
-    const HRESULT hr = CLockable::Init();
+    HRESULT hr = CLockable::Init();
     hr;
     assert(SUCCEEDED(hr));
 
+    hr = CreateAudioInpin();
+    assert(SUCCEEDED(hr));
+
     m_info.pGraph = 0;
     m_info.achName[0] = L'\0';
 
@@ -101,6 +295,18 @@ Filter::~Filter()
     os << "mkvmux::dtor" << endl;
 #endif
 
+    while (!m_inpins_audio.empty())
+    {
+        delete m_inpins_audio.back();
+        m_inpins_audio.pop_back();
+    }
+
+    while (!m_spare_audio_inpins.empty())
+    {
+        delete m_spare_audio_inpins.back();
+        m_spare_audio_inpins.pop_back();
+    }
+
     m_pClassFactory->LockServer(FALSE);
 }
 
@@ -149,6 +355,10 @@ HRESULT Filter::nondelegating_t::QueryInterface(
     {
         pUnk = static_cast<IWebmMux*>(m_pFilter);
     }
+    else if (iid == __uuidof(IWebmMux2))
+    {
+        pUnk = static_cast<IWebmMux2*>(m_pFilter);
+    }
     else
     {
 #if 0
@@ -236,7 +446,9 @@ HRESULT Filter::Stop()
 
             m_outpin.Final();  //close mkv file if req'd
 
-            m_inpin_audio.Final();
+            for (ULONG i = 0; i < m_inpins_audio.size(); ++i)
+                m_inpins_audio[i]->Final();
+
             m_inpin_video.Final();
 
             break;
@@ -277,7 +489,10 @@ HRESULT Filter::Pause()
     {
         case State_Stopped:
             m_inpin_video.Init();
-            m_inpin_audio.Init();
+
+            for (ULONG i = 0; i < m_inpins_audio.size(); ++i)
+                m_inpins_audio[i]->Init();
+
             m_outpin.Init();
             break;
 
@@ -310,7 +525,10 @@ HRESULT Filter::Run(REFERENCE_TIME start)
     {
         case State_Stopped:
             m_inpin_video.Init();
-            m_inpin_audio.Init();
+
+            for (ULONG i = 0; i < m_inpins_audio.size(); ++i)
+                m_inpins_audio[i]->Init();
+
             m_outpin.Init();
             break;
 
@@ -318,7 +536,10 @@ HRESULT Filter::Run(REFERENCE_TIME start)
         case State_Running:
         default:
             m_inpin_video.Run();
-            m_inpin_audio.Run();
+
+            for (ULONG i = 0; i < m_inpins_audio.size(); ++i)
+                m_inpins_audio[i]->Run();
+
             break;
     }
 
@@ -398,9 +619,22 @@ HRESULT Filter::GetSyncSource(
 
 HRESULT Filter::EnumPins(IEnumPins** pp)
 {
-    IPin* const pa[3] = { &m_inpin_video, &m_inpin_audio, &m_outpin };
+    if (pp == 0)
+        return E_POINTER;
+
+    IEnumPins*& p = *pp;
+    p = 0;
+
+    Lock lock;
+
+    const HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
 
-    return CEnumPins::CreateInstance(pa, 3, pp);
+    p = new (std::nothrow) WebmMuxLib::EnumPins(this);
+
+    return p ? S_OK : E_OUTOFMEMORY;
 }
 
 
@@ -418,16 +652,27 @@ HRESULT Filter::FindPin(
     if (id == 0)
         return E_INVALIDARG;
 
-    enum { n = 3 };
+    Lock lock;
 
-    Pin* const pins[n] =
-    {
-        &m_inpin_video,
-        &m_inpin_audio,
-        &m_outpin
-    };
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    const ULONG audio_count = static_cast<ULONG>(m_inpins_audio.size());
+    const ULONG n = 2 + audio_count;
+
+    const size_t cb = n * sizeof(Pin*);
+    Pin** const pins = (Pin**)_alloca(cb);
+
+    pins[0] = &m_inpin_video;
+
+    for (ULONG i = 0; i < audio_count; ++i)
+        pins[1 + i] = m_inpins_audio[i];
 
-    for (int i = 0; i < n; ++i)
+    pins[n - 1] = &m_outpin;
+
+    for (ULONG i = 0; i < n; ++i)
     {
         Pin* const pin = pins[i];
 
@@ -566,7 +811,7 @@ HRESULT Filter::GetCapabilities(DWORD* pdw)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = GetAudioConnection())
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -646,7 +891,7 @@ HRESULT Filter::IsFormatSupported(const GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = GetAudioConnection())
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -691,7 +936,7 @@ HRESULT Filter::QueryPreferredFormat(GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = GetAudioConnection())
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -732,7 +977,7 @@ HRESULT Filter::GetTimeFormat(GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = GetAudioConnection())
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -773,7 +1018,7 @@ HRESULT Filter::IsUsingTimeFormat(const GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = GetAudioConnection())
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -819,7 +1064,7 @@ HRESULT Filter::SetTimeFormat(const GUID* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = GetAudioConnection())
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -872,27 +1117,54 @@ HRESULT Filter::GetDuration(LONGLONG* p)
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_pPinConnection)
+    //Without video, the duration is that of the longest audio stream.
+
+    typedef std::vector<GraphUtil::IMediaSeekingPtr> seek_t;
+    seek_t seek;
+
+    for (ULONG i = 0; i < m_inpins_audio.size(); ++i)
     {
+        IPin* const pin = m_inpins_audio[i]->m_pPinConnection;
+
+        if (pin == 0)
+            continue;
+
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
         if (bool(pSeek))
-        {
-            lock.Release();
+            seek.push_back(pSeek);
+    }
 
-            hr = pSeek->GetDuration(p);
+    lock.Release();
 
-            //if (SUCCEEDED(hr))
-            //{
-            //    odbgstream os;
-            //    os << "mkvmux::filter::GetDuration: at=" << *p << endl;
-            //}
+    if (seek.empty())
+        return E_FAIL;
 
-            return hr;
+    if (p == 0)
+        return E_POINTER;
+
+    LONGLONG& duration = *p;
+    duration = -1;
+
+    HRESULT hrResult = E_FAIL;
+
+    for (seek_t::size_type i = 0; i < seek.size(); ++i)
+    {
+        LONGLONG d;
+
+        hr = seek[i]->GetDuration(&d);
+
+        if (FAILED(hr))
+        {
+            hrResult = hr;
+            continue;
         }
+
+        if (d > duration)
+            duration = d;
     }
 
-    return E_FAIL;
+    return (duration >= 0) ? S_OK : hrResult;
 }
 
 
@@ -989,7 +1261,7 @@ HRESULT Filter::ConvertTimeFormat(
         }
     }
 
-    if (IPin* pin = m_inpin_audio.m_connection)
+    if (IPin* pin = GetAudioConnection())
     {
         const GraphUtil::IMediaSeekingPtr pSeek(pin);
 
@@ -1140,10 +1412,13 @@ HRESULT Filter::SetPositions(
     if (FAILED(hr))
         return hr;
 
-    hr = m_inpin_audio.ResetPosition();
+    for (ULONG i = 0; i < m_inpins_audio.size(); ++i)
+    {
+        hr = m_inpins_audio[i]->ResetPosition();
 
-    if (FAILED(hr))
-        return hr;
+        if (FAILED(hr))
+            return hr;
+    }
 
     if (dwCurr_ & AM_SEEKING_ReturnTime)
         tCurr = 0;
@@ -1346,6 +1621,129 @@ HRESULT Filter::GetMuxMode(WebmMuxMode* pMuxMode)
 }
 
 
+HRESULT Filter::SetClusterMode(WebmMuxClusterMode mode)
+{
+    if ((mode != kWebmMuxClusterModeDefault) &&
+        (mode != kWebmMuxClusterModeKeyframe))
+    {
+        return E_INVALIDARG;
+    }
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetKeyframeClusterMode(mode == kWebmMuxClusterModeKeyframe);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetClusterMode(WebmMuxClusterMode* pMode)
+{
+    if (pMode == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_ctx.GetKeyframeClusterMode())
+        *pMode = kWebmMuxClusterModeKeyframe;
+    else
+        *pMode = kWebmMuxClusterModeDefault;
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetMaxClusterDuration(long ms)
+{
+    if (ms < 0)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetMaxClusterDuration(ms);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetMaxClusterDuration(long* pms)
+{
+    if (pms == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *pms = m_ctx.GetMaxClusterDuration();
+
+    return S_OK;
+}
+
+
+HRESULT Filter::SetMaxClusterSize(long size)
+{
+    if (size < 0)
+        return E_INVALIDARG;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_state != State_Stopped)
+        return VFW_E_NOT_STOPPED;
+
+    m_ctx.SetMaxClusterSize(size);
+
+    return S_OK;
+}
+
+
+HRESULT Filter::GetMaxClusterSize(long* psize)
+{
+    if (psize == 0)
+        return E_POINTER;
+
+    Lock lock;
+
+    HRESULT hr = lock.Seize(this);
+
+    if (FAILED(hr))
+        return hr;
+
+    *psize = m_ctx.GetMaxClusterSize();
+
+    return S_OK;
+}
+
+
 HRESULT Filter::OnEndOfStream()
 {
 #if 1
@@ -1425,4 +1823,131 @@ HRESULT Filter::OnEndOfStream()
 }
 
 
+HRESULT Filter::CreateAudioInpin()
+{
+    const audio_inpins_t::size_type n = m_inpins_audio.size();
+
+    if (n >= kMaxAudioInpins)
+        return E_FAIL;
+
+    //Pins are removed from the end (see OnDisconnectAudio), so the
+    //last spare inpin is the one with the id for this position.
+
+    InpinAudio* pin;
+
+    if (m_spare_audio_inpins.empty())
+    {
+        pin = new (std::nothrow) InpinAudio(this, s_audio_inpin_ids[n]);
+
+        if (pin == 0)
+            return E_OUTOFMEMORY;
+    }
+    else
+    {
+        pin = m_spare_audio_inpins.back();
+        assert(wcscmp(pin->m_id, s_audio_inpin_ids[n]) == 0);
+
+        m_spare_audio_inpins.pop_back();
+    }
+
+    m_inpins_audio.push_back(pin);
+    ++m_pins_version;
+
+    return S_OK;
+}
+
+
+void Filter::OnConnectAudio(const InpinAudio* pin)
+{
+    //Once the last audio inpin has been connected, add another one
+    //so that the graph can connect a further audio stream.
+
+    assert(!m_inpins_audio.empty());
+
+    if (pin != m_inpins_audio.back())
+        return;
+
+    const HRESULT hr = CreateAudioInpin();
+    hr;  //we're allowed to run out of audio inpins
+}
+
+
+IPin* Filter::GetAudioConnection() const
+{
+    //The first audio inpin need not be connected, once streams have
+    //been disconnected and others connected.
+
+    typedef audio_inpins_t::const_iterator iter_t;
+
+    for (iter_t i = m_inpins_audio.begin(); i != m_inpins_audio.end(); ++i)
+    {
+        if (IPin* const pin = (*i)->m_pPinConnection)
+            return pin;
+    }
+
+    return 0;
+}
+
+
+void Filter::OnDisconnectAudio(const InpinAudio* pin)
+{
+    //Remove the spare inpins that have accumulated at the end, leaving
+    //just one unconnected inpin there.  The pin being disconnected is
+    //still marked as connected, and it is never removed here, since
+    //the caller still holds it.  Removed inpins aren't deleted, since
+    //an enumerator or another filter might still refer to them.
+
+    for (;;)
+    {
+        const audio_inpins_t::size_type n = m_inpins_audio.size();
+
+        if (n < 2)
+            return;
+
+        InpinAudio* const last = m_inpins_audio[n - 1];
+
+        if ((last == pin) || bool(last->m_pPinConnection))
+            return;
+
+        const InpinAudio* const prev = m_inpins_audio[n - 2];
+
+        if ((prev != pin) && bool(prev->m_pPinConnection))
+            return;
+
+        m_inpins_audio.pop_back();
+        m_spare_audio_inpins.push_back(last);
+
+        ++m_pins_version;
+    }
+}
+
+
+void Filter::NotifySample(const Inpin* pSource)
+{
+    //Wake up every other inpin, since any one of them could be
+    //waiting for the source stream to catch up.
+
+    if (pSource != &m_inpin_video)
+    {
+        const BOOL b = SetEvent(m_inpin_video.m_hSample);
+        b;
+        assert(b);
+    }
+
+    typedef audio_inpins_t::const_iterator iter_t;
+
+    for (iter_t i = m_inpins_audio.begin(); i != m_inpins_audio.end(); ++i)
+    {
+        const InpinAudio* const pin = *i;
+
+        if (pin == pSource)
+            continue;
+
+        const BOOL b = SetEvent(pin->m_hSample);
+        b;
+        assert(b);
+    }
+}
+
+
 } //end namespace WebmMuxLib
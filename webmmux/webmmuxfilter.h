@@ -9,6 +9,7 @@
 #pragma once
 #include <strmif.h>
 #include <string>
+#include <vector>
 #include "webmmuxinpinvideo.h"
 #include "webmmuxinpinaudio.h"
 #include "webmmuxoutpin.h"
@@ -22,7 +23,7 @@ namespace WebmMuxLib
 class Filter : public IBaseFilter,
                public IMediaSeeking,
                public IAMFilterMiscFlags,
-               public IWebmMux,
+               public IWebmMux2,
                public CLockable
 {
     friend HRESULT CreateInstance(
@@ -107,6 +108,17 @@ public:
     HRESULT STDMETHODCALLTYPE SetMuxMode(WebmMuxMode);
     HRESULT STDMETHODCALLTYPE GetMuxMode(WebmMuxMode*);
 
+    //IWebmMux2
+
+    HRESULT STDMETHODCALLTYPE SetClusterMode(WebmMuxClusterMode);
+    HRESULT STDMETHODCALLTYPE GetClusterMode(WebmMuxClusterMode*);
+
+    HRESULT STDMETHODCALLTYPE SetMaxClusterDuration(long);
+    HRESULT STDMETHODCALLTYPE GetMaxClusterDuration(long*);
+
+    HRESULT STDMETHODCALLTYPE SetMaxClusterSize(long);
+    HRESULT STDMETHODCALLTYPE GetMaxClusterSize(long*);
+
 private:
 
     class nondelegating_t : public IUnknown
@@ -141,11 +153,30 @@ public:
 
     FILTER_STATE m_state;
     InpinVideo m_inpin_video;
-    InpinAudio m_inpin_audio;
+
+    //There is always one unconnected audio inpin (up to the maximum
+    //number of audio streams), so that another stream can be connected.
+    typedef std::vector<InpinAudio*> audio_inpins_t;
+    audio_inpins_t m_inpins_audio;
+
+    //Audio inpins that have been removed are kept until the filter is
+    //destroyed, since they share its reference count.  The version is
+    //incremented whenever an audio inpin is added or removed.
+    audio_inpins_t m_spare_audio_inpins;
+    ULONG m_pins_version;
+
     Outpin m_outpin;
     Context m_ctx;
 
     HRESULT OnEndOfStream();
+    void OnConnectAudio(const InpinAudio*);
+    void OnDisconnectAudio(const InpinAudio*);
+    IPin* GetAudioConnection() const;  //first connected audio stream
+    void NotifySample(const Inpin*);
+
+private:
+
+    HRESULT CreateAudioInpin();
 
 };
 
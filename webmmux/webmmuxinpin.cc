@@ -218,6 +218,8 @@ HRESULT Inpin::ReceiveConnection(
 
     m_pPinConnection = pin;
 
+    OnConnect();  //dispatch to subclass
+
     return S_OK;
 }
 
@@ -426,8 +428,7 @@ HRESULT Inpin::Receive(IMediaSample* pSample)
     if (hr != S_OK)
         return hr;
 
-    const BOOL b = SetEvent(m_hSample);  //notify other pin
-    assert(b);
+    m_pFilter->NotifySample(this);  //wake other pins
 
     return Wait(lock);
 }
@@ -466,10 +467,8 @@ HRESULT Inpin::Wait(CLockable::Lock& lock)
     //If we're paused, then write frame, and block caller.
     //If we transition from paused, then wake up and release caller.
 
-    const HANDLE hOther = GetOtherHandle();
-
     enum { cHandles = 2 };
-    HANDLE hh[cHandles] = { m_hStateChangeOrFlush, hOther };
+    HANDLE hh[cHandles] = { m_hStateChangeOrFlush, m_hSample };
 
 #ifdef DEBUG_WAIT
     wodbgstream os;
@@ -627,8 +626,7 @@ HRESULT Inpin::ReceiveMultiple(
         ++m;
     }
 
-    const BOOL b = SetEvent(m_hSample);  //notify other pin
-    assert(b);
+    m_pFilter->NotifySample(this);  //wake other pins
 
     return Wait(lock);
 }
@@ -647,6 +645,11 @@ HRESULT Inpin::OnReceiveConnection(IPin*, const AM_MEDIA_TYPE&)
 }
 
 
+void Inpin::OnConnect()
+{
+}
+
+
 HRESULT Inpin::OnEndOfStream()
 {
 #if 0
@@ -664,8 +667,7 @@ HRESULT Inpin::OnEndOfStream()
        << endl;
 #endif
 
-    const BOOL b = SetEvent(m_hSample);  //notify other pin
-    assert(b);
+    m_pFilter->NotifySample(this);  //wake other pins
 
     if (result <= 0)
         return S_OK;
@@ -88,11 +88,12 @@ public:
 
     HRESULT ResetPosition();
 
-    HANDLE m_hSample;
+    HANDLE m_hSample;  //another inpin received a sample (or EOS)
 
 protected:
 
    virtual HRESULT OnReceiveConnection(IPin*, const AM_MEDIA_TYPE&);
+   virtual void OnConnect();  //connection has been established
    virtual HRESULT OnEndOfStream();
 
 private:
@@ -107,7 +108,6 @@ protected:
     virtual void OnFinal() = 0;
 
     HRESULT Wait(CLockable::Lock&);
-    virtual HANDLE GetOtherHandle() const = 0;
 
     HANDLE m_hStateChangeOrFlush;
 
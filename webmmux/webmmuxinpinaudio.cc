@@ -13,12 +13,13 @@
 #include <uuids.h>
 #include <vfwmsgs.h>
 #include <cassert>
+#include <algorithm>
 
 namespace WebmMuxLib
 {
 
-InpinAudio::InpinAudio(Filter* p) :
-    Inpin(p, L"audio")
+InpinAudio::InpinAudio(Filter* p, const wchar_t* id) :
+    Inpin(p, id)
 {
     CMediaTypes& mtv = m_preferred_mtv;
 
@@ -96,7 +97,7 @@ HRESULT InpinAudio::OnInit()
     else
         return E_FAIL;  //should never happen
 
-    ctx.SetAudioStream(pStream);  //TODO: accept multiple audio streams
+    ctx.AddAudioStream(pStream);
     m_pStream = pStream;
 
     return S_OK;
@@ -105,15 +106,39 @@ HRESULT InpinAudio::OnInit()
 
 void InpinAudio::OnFinal()
 {
+   if (m_pStream == 0)  //not connected
+      return;
+
    Context& ctx = m_pFilter->m_ctx;
-   ctx.SetAudioStream(0);
+   ctx.RemoveAudioStream(static_cast<StreamAudio*>(m_pStream));
+}
+
+
+HRESULT InpinAudio::OnReceiveConnection(IPin*, const AM_MEDIA_TYPE&)
+{
+    //A spare inpin that the filter has removed (see
+    //Filter::OnDisconnectAudio) can't be connected until it is added
+    //to the filter again.
+
+    const Filter::audio_inpins_t& pins = m_pFilter->m_inpins_audio;
+
+    if (std::find(pins.begin(), pins.end(), this) == pins.end())
+        return E_UNEXPECTED;
+
+    return S_OK;
 }
 
 
-HANDLE InpinAudio::GetOtherHandle() const
+void InpinAudio::OnConnect()
 {
-    const InpinVideo& iv = m_pFilter->m_inpin_video;
-    return iv.m_hSample;
+    m_pFilter->OnConnectAudio(this);
+}
+
+
+HRESULT InpinAudio::OnDisconnect()
+{
+    m_pFilter->OnDisconnectAudio(this);
+    return S_OK;
 }
 
 
@@ -21,7 +21,7 @@ class InpinAudio : public Inpin
 
 public:
 
-    explicit InpinAudio(Filter*);
+    InpinAudio(Filter*, const wchar_t* id);
     ~InpinAudio();
 
     HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE*);
@@ -31,7 +31,9 @@ protected:
 
    HRESULT OnInit();
    void OnFinal();
-   HANDLE GetOtherHandle() const;
+   HRESULT OnReceiveConnection(IPin*, const AM_MEDIA_TYPE&);
+   void OnConnect();
+   HRESULT OnDisconnect();
 
 };
 
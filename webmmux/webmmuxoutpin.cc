@@ -256,23 +256,24 @@ HRESULT Outpin::QueryInternalConnections(IPin** pa, ULONG* pn)
     if (pn == 0)
         return E_POINTER;
 
+    const Filter::audio_inpins_t& audio = m_pFilter->m_inpins_audio;
+    const ULONG n = 1 + static_cast<ULONG>(audio.size());
+
     if (*pn == 0)
     {
         if (pa == 0)  //query for required number
         {
-            *pn = 2;
+            *pn = n;
             return S_OK;
         }
 
         return S_FALSE;  //means "insufficient number of array elements"
     }
 
-    *pn = 0;
-
     if (pa == 0)
         return E_POINTER;
 
-    if (*pn < 2)
+    if (*pn < n)
         return S_FALSE;  //means "insufficient number of array elements"
 
     IPin*& vpin = pa[0];
@@ -280,12 +281,15 @@ HRESULT Outpin::QueryInternalConnections(IPin** pa, ULONG* pn)
     vpin = &m_pFilter->m_inpin_video;
     vpin->AddRef();
 
-    IPin*& apin = pa[1];
+    for (ULONG i = 1; i < n; ++i)
+    {
+        IPin*& apin = pa[i];
 
-    apin = &m_pFilter->m_inpin_audio;
-    apin->AddRef();
+        apin = audio[i - 1];
+        apin->AddRef();
+    }
 
-    *pn = 2;
+    *pn = n;
     return S_OK;
 }
 
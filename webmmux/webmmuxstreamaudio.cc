@@ -30,7 +30,9 @@ StreamAudio::StreamAudio(
     ULONG cb) :
     Stream(ctx),
     m_pFormat(malloc(cb)),
-    m_cFormat(cb)
+    m_cFormat(cb),
+    m_bEOS(false),
+    m_last_timecode(-1)
 {
     assert(m_pFormat);
     memcpy(m_pFormat, pb, cb);
@@ -45,7 +47,7 @@ StreamAudio::~StreamAudio()
 
 bool StreamAudio::Wait() const
 {
-    return m_context.WaitAudio();
+    return m_context.WaitAudio(this);
 }
 
 
@@ -182,6 +184,37 @@ StreamAudio::frames_t& StreamAudio::GetFrames()
     return m_frames;
 }
 
+
+const StreamAudio::frames_t& StreamAudio::GetFrames() const
+{
+    return m_frames;
+}
+
+
+bool StreamAudio::GetEOS() const
+{
+    return m_bEOS;
+}
+
+
+void StreamAudio::SetEOS(bool eos)
+{
+    m_bEOS = eos;
+}
+
+
+LONG StreamAudio::GetLastTimecode() const
+{
+    return m_last_timecode;
+}
+
+
+void StreamAudio::SetLastTimecode(LONG t)
+{
+    m_last_timecode = t;
+}
+
+
 void StreamAudio::Flush()
 {
     m_context.FlushAudio(this);
@@ -51,11 +51,24 @@ public:
 
     typedef std::list<AudioFrame*> frames_t;
     frames_t& GetFrames();
+    const frames_t& GetFrames() const;
+
+    //EOS as seen by the context (either the stream itself reached
+    //end-of-stream, or the graph was stopped).
+    bool GetEOS() const;
+    void SetEOS(bool);
+
+    //Timecode of the frame most recently received, or -1 if none
+    //(frames are removed from the list once they're written).
+    LONG GetLastTimecode() const;
+    void SetLastTimecode(LONG);
 
 private:
     void* const m_pFormat;
     const ULONG m_cFormat;
     frames_t m_frames;
+    bool m_bEOS;
+    LONG m_last_timecode;
 
 };
 
@@ -54,9 +54,13 @@ StreamVideoVPx::VPxFrame::VPxFrame(
         m_duration = 0;
     else
     {
-        ns = (sp - st) * 100;  //duration (ns units)
+        //Difference of the scaled times, rather than the scaled
+        //difference, so that durations of adjacent frames sum to
+        //their timecodes instead of drifting.
+
+        ns = sp * 100;  //stop time (ns units)
         tc = ns / scale;
-        m_duration = static_cast<ULONG>(tc);
+        m_duration = static_cast<ULONG>(tc) - m_timecode;
     }
 }
 
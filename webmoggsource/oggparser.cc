@@ -1,5 +1,7 @@
 #include "oggparser.h"
+#include <cstddef>
 #include <cstring>
+#include <cstdlib>
 #include <cassert>
 //#include <malloc.h>
 
@@ -13,16 +15,19 @@ long oggparser::ReadInt(
 {
     val = 0;
 
-    for (long i = 0; i < len; ++i)
-    {
-        unsigned char b;
+    if ((len < 0) || (len > 8))
+        return -1;
 
-        const long result = pReader->Read(pos++, 1, &b);
+    unsigned char buf[8];
 
-        if (result < 0)  //error
-            return len;
+    const long result = pReader->Read(pos, len, buf);
+
+    if (result < 0)  //error
+        return result;
 
-        const long long bb = static_cast<long long>(b) << (i * 8);
+    for (long i = 0; i < len; ++i)
+    {
+        const long long bb = static_cast<long long>(buf[i]) << (i * 8);
 
         val |= bb;
     }
@@ -31,142 +36,192 @@ long oggparser::ReadInt(
 }
 
 
-namespace oggparser
+namespace
 {
 
-IOggReader::~IOggReader()
+//Ogg uses the (unreflected) CRC-32 generator polynomial 0x04C11DB7,
+//with an initial value of 0 and no final xor.
+
+class CrcTable
 {
-}
+public:
+    CrcTable();
+    unsigned long t[256];
+};
 
 
-long OggPage::Read(IOggReader* pReader, long long& pos)
+CrcTable::CrcTable()
 {
-    if (pos < 0)
-        return -1;
+    for (unsigned long i = 0; i < 256; ++i)
+    {
+        unsigned long r = i << 24;
 
-    long result = pReader->Read(pos, 4, capture_pattern);
+        for (int j = 0; j < 8; ++j)
+            r = (r & 0x80000000) ? ((r << 1) ^ 0x04C11DB7) : (r << 1);
 
-    if (result < 0)  //error
-        return result;
+        t[i] = r & 0xFFFFFFFF;
+    }
+}
 
-    if (memcmp(capture_pattern, "OggS", 4) != 0)
-        return E_FILE_FORMAT_INVALID;
 
-    pos += 4;  //consume capture_pattern
+const CrcTable s_crc_table;
 
-    long long version_;
+unsigned long UpdateCrc(
+    unsigned long crc,
+    const unsigned char* buf,
+    long len)
+{
+    const unsigned long* const t = s_crc_table.t;
 
-    result = ReadInt(pReader, pos, 1, version_);
+    for (long i = 0; i < len; ++i)
+        crc = ((crc << 8) ^ t[((crc >> 24) ^ buf[i]) & 0xFF]) & 0xFFFFFFFF;
 
-    if (result < 0)  //error
-        return result;
+    return crc;
+}
 
-    ++pos;  //consume version
 
-    version = static_cast<unsigned char>(version_);
+unsigned long GetInt(const unsigned char* buf, long len)
+{
+    unsigned long val = 0;
 
-    long long header_;
+    for (long i = len - 1; i >= 0; --i)
+        val = (val << 8) | buf[i];
 
-    result = ReadInt(pReader, pos, 1, header_);
+    return val;
+}
 
-    if (result < 0)  //error
-        return result;
+}  //end anonymous namespace
+
+
+namespace oggparser
+{
 
-    ++pos;  //consume header flag
+IOggReader::~IOggReader()
+{
+}
 
-    header = static_cast<unsigned char>(header_);
 
-    result = ReadInt(pReader, pos, 8, granule_pos);
+unsigned long OggPage::ComputeCrc(
+    unsigned long crc,
+    const unsigned char* buf,
+    long len)
+{
+    return UpdateCrc(crc, buf, len);
+}
 
-    if (result < 0)  //error
-        return result;
 
-    pos += 8;  //consume granule pos
+long OggPage::Read(IOggReader* pReader, long long& pos, bool verify_crc)
+{
+    if (pos < 0)
+        return -1;
 
-    long long serial_num_;
+    //The fixed part of the header, and then the segment table, are each
+    //fetched with a single read; each field is decoded from the buffer.
 
-    result = ReadInt(pReader, pos, 4, serial_num_);
+    unsigned char hdr[kHeaderSize];
+
+    long result = pReader->Read(pos, kHeaderSize, hdr);
 
     if (result < 0)  //error
         return result;
 
-    pos += 4;  //consume serial number
+    memcpy(capture_pattern, hdr, 4);
 
-    serial_num = static_cast<unsigned long>(serial_num_);
+    if (memcmp(capture_pattern, "OggS", 4) != 0)
+        return E_FILE_FORMAT_INVALID;
 
-    long long sequence_num_;
+    version = hdr[4];
+    header = hdr[5];
 
-    result = ReadInt(pReader, pos, 4, sequence_num_);
+    granule_pos = static_cast<long long>(GetInt(hdr + 6, 4));
+    granule_pos |= static_cast<long long>(GetInt(hdr + 10, 4)) << 32;
 
-    if (result < 0)  //error
-        return result;
+    serial_num = GetInt(hdr + 14, 4);
+    sequence_num = GetInt(hdr + 18, 4);
 
-    pos += 4;  //consume page sequence number
+    //http://www.ross.net/crc/download/crc_v3.txt
+
+    crc = GetInt(hdr + 22, 4);
+
+    const long segments_count = hdr[26];
+
+    if (segments_count <= 0)   //TODO: confirm this
+        return E_FILE_FORMAT_INVALID;
 
-    sequence_num = static_cast<unsigned long>(sequence_num_);
+    pos += kHeaderSize;  //consume header, including segment count
 
-    long long crc_;
+    unsigned char lacing[255];
 
-    result = ReadInt(pReader, pos, 4, crc_);
+    result = pReader->Read(pos, segments_count, lacing);
 
     if (result < 0)  //error
         return result;
 
-    pos += 4;  //consume crc
+    if (verify_crc)
+    {
+        memset(hdr + 22, 0, 4);  //crc is computed with crc field zeroed
 
-    //http://www.ross.net/crc/download/crc_v3.txt
+        unsigned long crc_ = UpdateCrc(0, hdr, kHeaderSize);
+        crc_ = UpdateCrc(crc_, lacing, segments_count);
 
-    crc = static_cast<unsigned long>(crc_);
+        long long payload_pos = pos + segments_count;
+        long payload_len = 0;
 
-    long long segments_count;
+        for (long i = 0; i < segments_count; ++i)
+            payload_len += lacing[i];
 
-    result = ReadInt(pReader, pos, 1, segments_count);
+        unsigned char buf[4096];
 
-    if (result < 0)  //error
-        return result;
+        while (payload_len > 0)
+        {
+            const long len = (payload_len < long(sizeof buf)) ?
+                                payload_len :
+                                long(sizeof buf);
 
-    if (segments_count <= 0)   //TODO: confirm this
-        return E_FILE_FORMAT_INVALID;
+            result = pReader->Read(payload_pos, len, buf);
+
+            if (result < 0)  //error
+                return result;
+
+            crc_ = UpdateCrc(crc_, buf, len);
 
-    ++pos;  //consume segment count
+            payload_pos += len;
+            payload_len -= len;
+        }
+
+        if (crc_ != crc)
+            return E_FILE_FORMAT_INVALID;
+    }
+
+    pos += segments_count;  //consume segment table
 
     descriptors.clear();
 
-    while (segments_count > 0)
+    long i = 0;
+
+    while (i < segments_count)
     {
         descriptors.push_back(Descriptor());
 
-        {
-            Descriptor& data = descriptors.back();
+        Descriptor& payload = descriptors.back();
 
-            data.pos = -1;  //fill in later
-            data.len = 0;
-        }
+        payload.pos = -1;  //fill in later
+        payload.len = 0;
 
         for (;;)
         {
-            long long lacing_value;
-
-            result = ReadInt(pReader, pos, 1, lacing_value);
-
-            if (result < 0)  //error
-                return result;
+            const long lacing_value = lacing[i++];
 
-            ++pos;  //consume lacing value
+            payload.len += lacing_value;
 
+            if (i >= segments_count)
             {
-                Descriptor& payload = descriptors.back();
-                payload.len += static_cast<long>(lacing_value);
-
-                if (--segments_count <= 0)
-                {
-                    if (lacing_value == 255)  //pkt continued on next page
-                        payload.len = -payload.len;
-                    else  //pkt completed on curr page
-                        header |= OggPage::fDone;
-
-                    break;
-                }
+                if (lacing_value == 255)  //pkt continued on next page
+                    payload.len = -payload.len;
+                else  //pkt completed on curr page
+                    header |= OggPage::fDone;
+
+                break;
             }
 
             if (lacing_value != 255)
@@ -419,7 +474,8 @@ OggStream::OggStream(IOggReader* p) :
     m_page_base(0),
     m_pos(0),
     m_base(0),
-    m_serial_num(0)
+    m_serial_num(0),
+    m_verify_crc(false)
 {
 }
 
@@ -441,7 +497,7 @@ long OggStream::Init(
 
     for (;;)
     {
-        long result = page.Read(m_pReader, m_pos);
+        long result = page.Read(m_pReader, m_pos, m_verify_crc);
 
         if (result < 0)
             return result;
@@ -508,6 +564,12 @@ long OggStream::Init(
 }
 
 
+void OggStream::SetVerifyCrc(bool verify_crc)
+{
+    m_verify_crc = verify_crc;
+}
+
+
 long OggStream::Reset()
 {
     m_pos = m_base;
@@ -674,7 +736,7 @@ long OggStream::ParsePage()
 
     const long long page_pos = m_pos;
 
-    const long result = page.Read(m_pReader, m_pos);
+    const long result = page.Read(m_pReader, m_pos, m_verify_crc);
 
     if (result < 0)  //error
         return result;
@@ -941,19 +1003,30 @@ long OggPage::Match(
         const OggPage::Descriptor& d = *i++;
 
         long long pos = d.pos;
-        const long long pos_end = d.pos + d.len;
+        const long long pos_end = d.pos + labs(d.len);
 
         while ((*str != '\0') && (pos != pos_end))
         {
-            unsigned char c;
+            unsigned char buf[16];
+
+            long len = static_cast<long>(strlen(str));
+
+            if (len > long(sizeof buf))
+                len = long(sizeof buf);
 
-            const long result = pReader->Read(pos++, 1, &c);
+            if (len > (pos_end - pos))
+                len = static_cast<long>(pos_end - pos);
+
+            const long result = pReader->Read(pos, len, buf);
 
             if (result < 0)  //error
                 return result;
 
-            if (*str++ != c)
+            if (memcmp(str, buf, len) != 0)
                 return 0;  //does not match
+
+            pos += len;
+            str += len;
         }
 
         if (*str == '\0')
@@ -44,6 +44,8 @@ public:
     //1: segment_table
     //n: segments
 
+    enum { kHeaderSize = 27 };  //through page_segments
+
     enum HeaderFlags
     {
         fContinued = 0x01,
@@ -67,6 +69,12 @@ public:
         unsigned char* buf);
     static long Match(const descriptors_t&, IOggReader*, const char*);
 
+    //Ogg CRC-32 (table-driven), continued from |crc| over |len| bytes.
+    static unsigned long ComputeCrc(
+        unsigned long crc,
+        const unsigned char* buf,
+        long len);
+
     unsigned char capture_pattern[4];
     unsigned char version;
     unsigned char header;
@@ -76,7 +84,9 @@ public:
     unsigned long crc;  //signed or unsigned?
     descriptors_t descriptors;
 
-    long Read(IOggReader*, long long&);
+    //The page CRC is checked only if verify_crc is true, since that
+    //requires reading the page payload.
+    long Read(IOggReader*, long long&, bool verify_crc = false);
 };
 
 //rfc5334.txt
@@ -111,6 +121,8 @@ public:
     long Reset();
     long GetPacket(Packet&);
 
+    void SetVerifyCrc(bool);  //default is false
+
 private:
 
     unsigned long m_serial_num;
@@ -118,6 +130,7 @@ private:
     unsigned long m_page_base;
     long long m_pos;
     long long m_base;
+    bool m_verify_crc;
 
     long GetPacket(Packet&, int);
     long ParsePacket(Packet&);
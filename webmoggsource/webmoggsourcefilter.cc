@@ -643,6 +643,12 @@ HRESULT Filter::OggInit()
     //TODO: use logical bitstream id instead of hard-coding 1
     //OggTrackAudio* const pTrack = new OggTrackAudio(&m_stream, 1);
 
+#ifdef _DEBUG
+    //Checking page CRCs costs a second read of each page's payload,
+    //so it is only done in debug builds.
+    m_stream.SetVerifyCrc(true);
+#endif
+
     OggTrackAudio* pTrack;
 
     HRESULT hr = OggTrackAudio::Create(&m_stream, pTrack);
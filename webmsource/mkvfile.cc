@@ -80,6 +80,8 @@ HRESULT MkvFile::Open(const wchar_t* strFileName)
     m_length = size.QuadPart;
     assert(m_length >= 0);
 
+    m_map.Open(m_hFile, m_length, kMapWindow);  //OK if this fails
+
     return S_OK;
 }
 
@@ -89,6 +91,9 @@ HRESULT MkvFile::Close()
     if (m_hFile == INVALID_HANDLE_VALUE)
         return S_FALSE;
 
+    m_map.Close();
+    m_cache.Clear();
+
     const BOOL b = CloseHandle(m_hFile);
 
     m_hFile = INVALID_HANDLE_VALUE;
@@ -124,8 +129,28 @@ int MkvFile::Read(
     if (pos >= m_length)
         return -1;  //?
 
+    if (m_map.IsOpen() && (m_map.Read(pos, len, buf) == 0))
+        return 0;
+
+    //The cache is only created once the mapped view fails to serve
+    //a read, since usually it serves them all.
+
+    if ((m_cache.page_count() == 0) && !m_cache.Init(kPageSize, kPageCount))
+        return -1;
+
+    return m_cache.Read(this, pos, len, buf);
+}
+
+
+long MkvFile::ReadPage(
+    long long pos,
+    long len,
+    unsigned char* buf)
+{
     const HRESULT hr = SetPosition(pos);
-    assert(SUCCEEDED(hr));
+
+    if (FAILED(hr))
+        return -1;
 
     DWORD cbRead;
     const BOOL b = ReadFile(m_hFile, buf, len, &cbRead, 0);
@@ -138,7 +163,7 @@ int MkvFile::Read(
         return -1;
     }
 
-    return (cbRead >= ULONG(len)) ? 0 : -1;
+    return cbRead;  //short at end of file
 }
 
 
@@ -9,11 +9,14 @@
 #pragma once
 #include "mkvparser.hpp"
 #include "mkvparserstreamreader.h"
+#include "mappedfile.h"
+#include "pagecache.h"
 
 namespace WebmSource
 {
 
-class MkvFile : public mkvparser::IStreamReader
+class MkvFile : public mkvparser::IStreamReader,
+                private WebmUtil::PageCache::Source
 {
     MkvFile(const MkvFile&);
     MkvFile& operator=(const MkvFile&);
@@ -33,7 +36,27 @@ private:
     HANDLE m_hFile;
     LONGLONG m_length;
 
+    //The parser makes many small reads (element headers, etc), so we
+    //read the file in large pages and satisfy the reads from the cache.
+    enum { kPageSize = 64 * 1024 };
+    enum { kPageCount = 64 };
+
+    WebmUtil::PageCache m_cache;
+
+    //Local files are read through a mapped view where possible, which
+    //avoids a system call per read.  The page cache is the fallback, for
+    //files that cannot be mapped, or reads that don't fit in the window;
+    //its storage is allocated on the first such read.
+#ifdef _WIN64
+    enum { kMapWindow = 1024 * 1024 * 1024 };
+#else
+    enum { kMapWindow = 32 * 1024 * 1024 };  //conserve address space
+#endif
+
+    WebmUtil::MappedFile m_map;
+
     HRESULT SetPosition(LONGLONG) const;
+    long ReadPage(long long pos, long len, unsigned char* buf);
 
 };
 
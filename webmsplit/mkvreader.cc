@@ -13,13 +13,26 @@
 #include <algorithm>
 #include <vfwmsgs.h>
 #include "clockable.h"
+#include "isharedsample.h"
 #pragma warning(default:4702)
 
 namespace WebmSplit
 {
 
-MkvReader::MkvReader() : m_sync_read(true)
+MkvReader::MkvReader() :
+    m_sync_read(true),
+    m_read_ahead(0),
+    m_read_ahead_pos(-1),
+    m_read_ahead_hint(-1),
+    m_waiting(false),
+    m_copy_frames(false)
 {
+    const BOOL b = QueryPerformanceFrequency(&m_freq);
+    b;
+    assert(b);
+    assert(m_freq.QuadPart > 0);
+
+    ResetStats();
 }
 
 
@@ -68,7 +81,7 @@ HRESULT MkvReader::SetSource(IAsyncReader* pSource)
     const int kNumBuffers = k5MBPS / kPageSize;
 
     ALLOCATOR_PROPERTIES props = {0};
-    props.cBuffers = kNumBuffers;
+    props.cBuffers = kNumBuffers + kSharedPages;
     props.cbBuffer = kPageSize;
 
     hr = pSource->RequestAllocator(0, &props, &m_pAllocator);
@@ -107,6 +120,12 @@ HRESULT MkvReader::Commit()
 
     assert(m_pages.empty());
     assert(m_free_pages.empty());
+    assert(m_pending.empty());
+
+    m_read_ahead = 0;
+    m_read_ahead_pos = -1;
+    m_read_ahead_hint = -1;
+    m_copy_frames = false;
 
     if (m_pAllocator == 0)
         return VFW_E_NO_ALLOCATOR;
@@ -116,15 +135,24 @@ HRESULT MkvReader::Commit()
     if (FAILED(hr))
         return hr;
 
-    const long n = m_props.cBuffers;
+    //A shared page keeps referring to its sample until the downstream
+    //samples are released, so the page takes a fresh sample from the
+    //allocator when it's reused.  We don't let the cache use all of the
+    //samples, so that the fresh sample is normally available at once.
+
+    long n = m_props.cBuffers;
     assert(n > 0);
 
+    if (n > 2 * kSharedPages)
+        n -= kSharedPages;
+
     for (long i = 0; i < n; ++i)
     {
         Page page;
 
         page.cRef = 0;
         page.pSample = 0;
+        page.bShared = false;
 
         m_pages.push_back(page);
     }
@@ -154,6 +182,7 @@ HRESULT MkvReader::Decommit()
     //no thread synchronization is performed.
 
     m_free_pages.clear();
+    m_pending.clear();
 
     while (!m_pages.empty())
     {
@@ -221,7 +250,10 @@ int MkvReader::Read(
         const LONGLONG page_end = page.GetPos() + page_size;
 
         if (pos < page_end)  //cache hit
+        {
             Read(page_iter, pos, len, &buf);
+            ++m_stats.cHits;
+        }
     }
 
     while (len > 0)
@@ -252,6 +284,7 @@ int MkvReader::Read(
             assert(pos < (page.GetPos() + page_size));
 
             Read(page_iter, pos, len, &buf);
+            ++m_stats.cHits;
         }
     }
 
@@ -311,6 +344,7 @@ int MkvReader::InsertPage(
     LONGLONG pos,
     cache_t::iterator& cache_iter)
 {
+    CollectPages();  //doesn't change the cache, so next remains valid
     FreeOne(next);
 
     if (m_free_pages.empty())  //error: all samples are busy
@@ -329,10 +363,12 @@ int MkvReader::InsertPage(
     const pages_list_t::iterator page_iter = free_page->second;
     assert(page_iter->cRef == 0);
 
-    if (page_iter->GetPos() == page_pos)
+    if (page_iter->GetPos() == page_pos)  //prefetched
     {
         m_free_pages.erase(free_page);
         cache_iter = m_cache.insert(next, page_iter);
+
+        ++m_stats.cHits;
         return 0;  //success
     }
 
@@ -368,38 +404,414 @@ int MkvReader::InsertPage(
     if ((page_end <= total) && (page_end > available))
         return mkvparser::E_BUFFER_NOT_FULL;
 
-    HRESULT hr;
+    m_free_pages.erase(free_page);
 
-    Page& page = *page_iter;
+    //We now own this page, and any pages we take for read-ahead.
+    //Taking free pages doesn't disturb the cache, so next remains valid.
+    //If the page we need is still in flight as read-ahead, we read it
+    //again synchronously rather than block on the source with the lock
+    //held; the late copy is discarded when it arrives.
+
+    if (ReadPage(page_iter, page_pos) < 0)
+    {
+        ReleasePage(page_iter);
+        return -1;  //generic error value
+    }
+
+    pages_list_t::iterator pages[kMaxReadAhead];
+
+    const int n = GetReadAhead(page_pos, available, pages);
+
+    if (n > 0)
+        RequestPages(pages, n, page_pos + page_size);
+
+    cache_iter = m_cache.insert(next, page_iter);
+    return 0;  //success
+}
+
+
+int MkvReader::GetReadAhead(
+    LONGLONG page_pos,
+    LONGLONG available,
+    pages_list_t::iterator* pages)
+{
+    //The read-ahead window doubles each time the parser misses at the
+    //position where the previous window ended, and collapses after
+    //a seek.  We only prefetch pages that are already available, so
+    //that the requests complete without delay.
+
+    if (m_waiting)  //our async requests could be confused with Wait's
+        return 0;
+
+    if (page_pos != m_read_ahead_pos)
+        m_read_ahead = 0;
+    else if (m_read_ahead <= 0)
+        m_read_ahead = 1;
+    else if (m_read_ahead < kMaxReadAhead)
+        m_read_ahead *= 2;
+
+    const DWORD page_size = m_props.cbBuffer;
+
+    LONGLONG stop_pos = page_pos + page_size * LONGLONG(1 + m_read_ahead);
+
+    if (m_read_ahead_hint > stop_pos)
+    {
+        const LONGLONG max_pos = page_pos + page_size * (1 + kMaxReadAhead);
+        stop_pos = (m_read_ahead_hint < max_pos) ? m_read_ahead_hint : max_pos;
+    }
+
+    if (stop_pos > available)
+        stop_pos = available;
+
+    int n = 0;
+    LONGLONG pos = page_pos + page_size;
+
+    while ((n < kMaxReadAhead) && ((pos + page_size) <= stop_pos))
+    {
+        if (IsCached(pos))
+            break;
+
+        if (m_free_pages.find(pos) != m_free_pages.end())  //prefetched
+            break;
+
+        if (IsPending(pos))
+            break;
+
+        //Only recycle free pages outside of the window we're reading.
+
+        free_pages_t::iterator free_page = m_free_pages.begin();
+
+        if ((free_page == m_free_pages.end()) ||
+            (free_page->first >= page_pos))
+        {
+            free_page = m_free_pages.lower_bound(stop_pos);
+
+            if (free_page == m_free_pages.end())
+                break;
+        }
+
+        assert(free_page->second->cRef == 0);
+
+        pages[n++] = free_page->second;
+        m_free_pages.erase(free_page);
+
+        pos += page_size;
+    }
+
+    m_read_ahead_pos = pos;
+
+    return n;
+}
+
+
+HRESULT MkvReader::PreparePage(Page& page, LONGLONG pos)
+{
+    assert(page.cRef == 0);
+
+    //We're holding the filter lock, so we must not block on the
+    //allocator.  If no sample is available, the caller releases the page.
+
+    HRESULT hr = DetachPage(page);
+
+    if (FAILED(hr))
+        return hr;
 
     if (page.pSample == 0)
     {
-        hr = m_pAllocator->GetBuffer(&page.pSample, 0, 0, 0);
-        assert(SUCCEEDED(hr));
-        assert(page.pSample);
+        IMediaSample* pSample;
+
+        hr = m_pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
+
+        if (FAILED(hr))
+            return hr;
+
+        assert(pSample);
+        page.pSample.Attach(pSample);
     }
 
-    LONGLONG st = page_pos * 10000000;
-    LONGLONG sp = page_end * 10000000;
+    const DWORD page_size = m_props.cbBuffer;
+
+    LONGLONG st = pos * 10000000;
+    LONGLONG sp = (pos + page_size) * 10000000;
 
     hr = page.pSample->SetTime(&st, &sp);
     assert(SUCCEEDED(hr));
 
-    hr = m_pSource->SyncReadAligned(page.pSample);
+    return S_OK;
+}
+
+
+int MkvReader::ReadPage(pages_list_t::iterator page_iter, LONGLONG pos)
+{
+    Page& page = *page_iter;
+
+    if (FAILED(PreparePage(page, pos)))
+        return -1;
+
+    ++m_stats.cMisses;
+
+    const LONGLONG start = GetCounter();
+
+    const HRESULT hr = m_pSource->SyncReadAligned(page.pSample);
+
+    m_stats.stall_time += GetCounter() - start;
+
+    return SUCCEEDED(hr) ? 0 : -1;  //VFW_S_WRONG_STATE
+}
+
+
+void MkvReader::RequestPages(
+    pages_list_t::iterator* pages,
+    int n,
+    LONGLONG page_pos)
+{
+    //We don't wait for the requests here, since we're holding the filter
+    //lock.  Completed requests are collected later, either by polling
+    //(CollectPages) or by Wait, which blocks without the lock.
+
+    const DWORD page_size = m_props.cbBuffer;
+
+    for (int i = 0; i < n; ++i)
+    {
+        const pages_list_t::iterator page_iter = pages[i];
+        Page& page = *page_iter;
+
+        const LONGLONG pos = page_pos + LONGLONG(i) * page_size;
+
+        HRESULT hr = PreparePage(page, pos);
+
+        if (SUCCEEDED(hr))
+            hr = m_pSource->Request(page.pSample, kReadAheadToken);
+
+        if (FAILED(hr))
+        {
+            ReleasePage(page_iter);
+            continue;
+        }
+
+        m_pending.push_back(page_iter);
+        ++m_stats.cPrefetched;
+    }
+}
+
+
+void MkvReader::CollectPages()
+{
+    if (m_waiting)  //Wait is blocked on the source, and collects for us
+        return;
+
+    while (!m_pending.empty())
+    {
+        IMediaSample* pSample;
+        DWORD_PTR token;
+
+        const HRESULT hr = m_pSource->WaitForNext(0, &pSample, &token);
+
+        if (pSample == 0)  //nothing has completed yet
+            break;
+
+        assert(token == kReadAheadToken);
+        OnPageRead(pSample, hr);
+    }
+}
+
+
+void MkvReader::OnPageRead(IMediaSample* pSample, HRESULT hr)
+{
+    typedef pending_t::iterator iter_t;
+
+    iter_t i = m_pending.begin();
+    const iter_t j = m_pending.end();
+
+    while ((i != j) && ((*i)->pSample != pSample))
+        ++i;
+
+    assert(i != j);
+
+    if (i == j)
+        return;
+
+    const pages_list_t::iterator page_iter = *i;
+    m_pending.erase(i);
+
+    if (FAILED(hr))  //async read request failed, or was cancelled
+    {
+        ReleasePage(page_iter);
+        return;
+    }
+
+    //The parser might have needed the page before the request completed,
+    //in which case it was read synchronously into another page.
+
+    const LONGLONG pos = page_iter->GetPos();
+
+    if (IsCached(pos) || (m_free_pages.find(pos) != m_free_pages.end()))
+    {
+        ReleasePage(page_iter);
+        return;
+    }
+
+    const free_pages_t::value_type value(pos, page_iter);
+    m_free_pages.insert(value);
+}
+
+
+bool MkvReader::IsPending(LONGLONG pos) const
+{
+    typedef pending_t::const_iterator iter_t;
+
+    iter_t i = m_pending.begin();
+    const iter_t j = m_pending.end();
+
+    while (i != j)
+    {
+        if ((*i++)->GetPos() == pos)
+            return true;
+    }
+
+    return false;
+}
+
+
+void MkvReader::ReleasePage(pages_list_t::iterator page_iter)
+{
+    Page& page = *page_iter;
+    assert(page.cRef == 0);
 
-    if (FAILED(hr))  //VFW_S_WRONG_STATE
+    if (page.pSample)
     {
         const ULONG cRef = page.pSample->Release();
         cRef;
 
         page.pSample = 0;
+    }
 
-        return -1;  //generic error value
+    page.bShared = false;
+    assert(page.GetPos() < 0);
+
+    const free_pages_t::value_type value(-1, page_iter);
+    m_free_pages.insert(value);
+}
+
+
+HRESULT MkvReader::DetachPage(Page& page)
+{
+    //We're about to read new data into the page.  If downstream samples
+    //might still refer to its sample, then the page gives up the sample
+    //(it returns to the allocator when they're done with it) instead of
+    //overwriting it, and takes a fresh one.
+
+    if (!page.bShared)
+        return S_OK;
+
+    IMediaSample* pSample;
+
+    const HRESULT hr = m_pAllocator->GetBuffer(&pSample, 0, 0, AM_GBF_NOWAIT);
+
+    if (SUCCEEDED(hr))
+    {
+        assert(pSample);
+        page.pSample.Attach(pSample);  //releases our reference to the old
+
+        page.bShared = false;
+        return S_OK;
     }
 
-    m_free_pages.erase(free_page);
-    cache_iter = m_cache.insert(next, page_iter);
-    return 0;  //success
+    //The spare samples are all held downstream.  We stop sharing frames,
+    //so that they're returned, and the page keeps its own sample if
+    //downstream is already done with it.
+
+    m_copy_frames = true;
+
+    page.pSample->AddRef();
+    const ULONG cRef = page.pSample->Release();
+
+    if (cRef > 1)  //downstream samples still refer to it
+        return hr;
+
+    page.bShared = false;
+    return S_OK;
+}
+
+
+HRESULT MkvReader::ShareFrame(
+    const mkvparser::Block::Frame& f,
+    IMediaSample* pSample)
+{
+    if (m_sync_read)  //cache isn't in use
+        return S_FALSE;
+
+    if (m_copy_frames)  //no spare samples to replace shared pages
+        return S_FALSE;
+
+    if (pSample == 0)
+        return E_POINTER;
+
+    const LONGLONG pos = f.pos;
+    const long len = f.len;
+
+    if ((pos < 0) || (len <= 0) || m_cache.empty())
+        return S_FALSE;
+
+    //The frame belongs to the current block, which is locked, so its
+    //pages are in the cache.  We can only share a frame that lies
+    //within a single page.
+
+    typedef cache_t::const_iterator iter_t;
+
+    const iter_t i = m_cache.begin();
+    const iter_t j = m_cache.end();
+
+    iter_t next = std::upper_bound(i, j, pos, PageLess());
+
+    if (next == i)
+        return S_FALSE;
+
+    const cache_t::value_type page_iter = *--next;
+    Page& page = *page_iter;
+
+    const LONGLONG page_pos = page.GetPos();
+    assert(page_pos <= pos);
+
+    const LONG page_size = m_props.cbBuffer;
+    const LONGLONG off = pos - page_pos;
+
+    if ((off + len) > page_size)  //frame spans pages
+        return S_FALSE;
+
+    ISharedSample* pShared;
+
+    HRESULT hr = pSample->QueryInterface(&pShared);
+
+    if (FAILED(hr))
+        return S_FALSE;
+
+    BYTE* ptr;
+
+    hr = page.pSample->GetPointer(&ptr);
+    assert(SUCCEEDED(hr));
+    assert(ptr);
+
+    hr = pShared->SetBuffer(page.pSample, ptr + off, len);
+
+    pShared->Release();
+
+    if (FAILED(hr))
+        return hr;
+
+    page.bShared = true;
+    return S_OK;
+}
+
+
+bool MkvReader::IsCached(LONGLONG pos) const
+{
+    typedef cache_t::const_iterator iter_t;
+
+    const iter_t i = m_cache.begin();
+    const iter_t j = m_cache.end();
+
+    return std::binary_search(i, j, pos, PageLess());
 }
 
 
@@ -548,15 +960,6 @@ HRESULT MkvReader::Wait(
     Page& page = *page_iter;
     assert(page.cRef == 0);
 
-    HRESULT hr;
-
-    if (page.pSample == 0)
-    {
-        hr = m_pAllocator->GetBuffer(&page.pSample, 0, 0, 0);
-        assert(SUCCEEDED(hr));
-        assert(page.pSample);
-    }
-
 #if 0
     LONGLONG total, avail;
 
@@ -570,11 +973,14 @@ HRESULT MkvReader::Wait(
     const DWORD page_size = m_props.cbBuffer;
     const LONGLONG page_pos = page_size * LONGLONG(stop_pos / page_size);
 
-    LONGLONG st = page_pos * 10000000;
-    LONGLONG sp = (page_pos + page_size) * 10000000;
+    HRESULT hr = PreparePage(page, page_pos);
+
+    if (FAILED(hr))  //no sample is available for the page
+    {
+        ReleasePage(page_iter);
+        return hr;
+    }
 
-    hr = page.pSample->SetTime(&st, &sp);
-    assert(SUCCEEDED(hr));
     assert(page.GetPos() == page_pos);
 
     hr = m_pSource->Request(page.pSample, 0);
@@ -586,13 +992,32 @@ HRESULT MkvReader::Wait(
         IMediaSample* pSample;
         DWORD_PTR token;
 
-        hr = lock.Release();
-        assert(SUCCEEDED(hr));
+        ++m_stats.cWaits;
+        m_waiting = true;
 
-        hrWait = m_pSource->WaitForNext(timeout, &pSample, &token);
+        for (;;)
+        {
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
 
-        hr = lock.Seize(INFINITE);
-        assert(SUCCEEDED(hr));
+            const LONGLONG start = GetCounter();
+
+            hrWait = m_pSource->WaitForNext(timeout, &pSample, &token);
+
+            const LONGLONG stop = GetCounter();
+
+            hr = lock.Seize(INFINITE);
+            assert(SUCCEEDED(hr));
+
+            m_stats.stall_time += stop - start;
+
+            if ((pSample == 0) || (token != kReadAheadToken))
+                break;
+
+            OnPageRead(pSample, hrWait);  //completed read-ahead
+        }
+
+        m_waiting = false;
 
         if (SUCCEEDED(hrWait))
         {
@@ -626,6 +1051,9 @@ HRESULT MkvReader::Wait(
 
         if (pSample == 0)
             break;
+
+        if (token == kReadAheadToken)
+            OnPageRead(pSample, hrWait);
     }
 
     const ULONG cRef = page.pSample->Release();
@@ -641,6 +1069,47 @@ HRESULT MkvReader::Wait(
 }
 
 
+void MkvReader::SetReadAheadHint(LONGLONG pos)
+{
+    m_read_ahead_hint = pos;
+}
+
+
+void MkvReader::GetStats(Stats& s) const
+{
+    s = m_stats;
+
+    //stall_time is accumulated in performance counter ticks
+
+    const double ticks = static_cast<double>(m_stats.stall_time);
+    const double freq = static_cast<double>(m_freq.QuadPart);
+
+    s.stall_time = static_cast<LONGLONG>(ticks * 10000000 / freq);
+}
+
+
+void MkvReader::ResetStats()
+{
+    m_stats.cHits = 0;
+    m_stats.cMisses = 0;
+    m_stats.cPrefetched = 0;
+    m_stats.cWaits = 0;
+    m_stats.stall_time = 0;
+}
+
+
+LONGLONG MkvReader::GetCounter() const
+{
+    LARGE_INTEGER t;
+
+    const BOOL b = QueryPerformanceCounter(&t);
+    b;
+    assert(b);
+
+    return t.QuadPart;
+}
+
+
 HRESULT MkvReader::BeginFlush()
 {
     return m_pSource->BeginFlush();
@@ -649,6 +1118,12 @@ HRESULT MkvReader::BeginFlush()
 
 HRESULT MkvReader::EndFlush()
 {
+    //While the source is flushing, the requests still outstanding are
+    //completed (as cancelled) without delay.
+
+    CollectPages();
+    assert(m_waiting || m_pending.empty());
+
     return m_pSource->EndFlush();
 }
 
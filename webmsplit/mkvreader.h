@@ -37,9 +37,27 @@ public:
 
     HRESULT LockPages(const mkvparser::BlockEntry*);
     void UnlockPages(const mkvparser::BlockEntry*);
+    HRESULT ShareFrame(const mkvparser::Block::Frame&, IMediaSample*);
 
     HRESULT Wait(CLockable&, LONGLONG pos, LONG size, DWORD timeout_ms);
 
+    //Position (absolute) up to which the parser is expected to read
+    //sequentially, typically the start of the cluster that follows the
+    //one being loaded.  Pass -1 if unknown.
+    void SetReadAheadHint(LONGLONG pos);
+
+    struct Stats
+    {
+        ULONGLONG cHits;        //page found in cache, or already prefetched
+        ULONGLONG cMisses;      //page had to be read from source
+        ULONGLONG cPrefetched;  //pages requested ahead of the parser
+        ULONGLONG cWaits;       //calls to Wait (data not yet available)
+        LONGLONG stall_time;    //time blocked on source, in 100ns units
+    };
+
+    void GetStats(Stats&) const;
+    void ResetStats();
+
     HRESULT BeginFlush();
     HRESULT EndFlush();
 
@@ -54,6 +72,7 @@ private:
     {
         int cRef;
         GraphUtil::IMediaSamplePtr pSample;
+        bool bShared;  //downstream samples might refer to pSample
 
         LONGLONG GetPos() const;
     };
@@ -99,6 +118,41 @@ private:
     void FreeOne(cache_t::iterator&);
     void PurgeOne();
 
+    enum { kMaxReadAhead = 64 };  //pages
+
+    int GetReadAhead(LONGLONG, LONGLONG, pages_list_t::iterator*);
+    HRESULT PreparePage(Page&, LONGLONG pos);
+    int ReadPage(pages_list_t::iterator, LONGLONG pos);
+    void RequestPages(pages_list_t::iterator*, int n, LONGLONG pos);
+    void CollectPages();
+    void OnPageRead(IMediaSample*, HRESULT);
+    bool IsPending(LONGLONG pos) const;
+    void ReleasePage(pages_list_t::iterator);
+    HRESULT DetachPage(Page&);
+
+    //Samples from the source allocator that we hold back from the cache,
+    //for pages that give up their sample to downstream samples.
+    enum { kSharedPages = 256 };
+    bool IsCached(LONGLONG pos) const;
+
+    //Read-ahead pages with an async request outstanding.  They belong to
+    //neither the cache nor the free list until the request completes.
+    typedef std::list<pages_list_t::iterator> pending_t;
+    pending_t m_pending;
+
+    enum { kReadAheadToken = 1 };  //Wait uses token 0
+
+    LONG m_read_ahead;  //current window, in pages
+    LONGLONG m_read_ahead_pos;  //where next sequential miss is expected
+    LONGLONG m_read_ahead_hint;
+    bool m_waiting;  //async request of Wait is outstanding
+    bool m_copy_frames;  //allocator ran out of spare samples
+
+    Stats m_stats;
+    LARGE_INTEGER m_freq;
+
+    LONGLONG GetCounter() const;
+
 #if 0 //def _DEBUG
     LONGLONG m_total;
     LONGLONG m_avail;
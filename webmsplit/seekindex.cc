@@ -0,0 +1,221 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#include <windows.h>
+#include "seekindex.h"
+#include "mkvparser.hpp"
+#include <cassert>
+#include <algorithm>
+
+namespace WebmSplit
+{
+
+
+SeekIndex::SeekIndex() : m_pSegment(0)
+{
+    Clear();
+}
+
+
+SeekIndex::~SeekIndex()
+{
+}
+
+
+void SeekIndex::Init(mkvparser::Segment* pSegment)
+{
+    Clear();
+    m_pSegment = pSegment;
+}
+
+
+void SeekIndex::Clear()
+{
+    m_pSegment = 0;
+    m_pLast = 0;
+    m_last_ns = -1;
+    m_count = 0;
+    m_bDone = false;
+    m_tracks.clear();
+}
+
+
+ULONG SeekIndex::GetCount() const
+{
+    return m_count;
+}
+
+
+bool SeekIndex::IsDone() const
+{
+    return m_bDone;
+}
+
+
+void SeekIndex::Export(WebmUtil::IndexCache& cache) const
+{
+    using namespace mkvparser;
+
+    assert(m_pSegment);
+
+    const Cluster* pCluster = m_pSegment->GetFirst();
+
+    while ((pCluster != 0) && !pCluster->EOS())
+    {
+        cache.AddCluster(pCluster->GetPosition(), pCluster->GetTime());
+        pCluster = m_pSegment->GetNext(pCluster);
+    }
+
+    typedef tracks_t::const_iterator track_iter_t;
+
+    for (track_iter_t i = m_tracks.begin(); i != m_tracks.end(); ++i)
+    {
+        const entries_t& entries = i->second;
+
+        typedef entries_t::const_iterator entry_iter_t;
+
+        for (entry_iter_t j = entries.begin(); j != entries.end(); ++j)
+        {
+            const LONGLONG pos = j->pCluster->GetPosition();
+            cache.AddKeyframe(i->first, j->time_ns, pos);
+        }
+    }
+}
+
+
+void SeekIndex::Update()
+{
+    using namespace mkvparser;
+
+    if ((m_pSegment == 0) || m_bDone)
+        return;
+
+    const Cluster* pCluster;
+
+    if (m_pLast == 0)
+        pCluster = m_pSegment->GetFirst();
+    else
+        pCluster = m_pSegment->GetNext(m_pLast);
+
+    const bool bDoneParsing = m_pSegment->DoneParsing();
+
+    while ((pCluster != 0) && !pCluster->EOS())
+    {
+        const Cluster* const pNext = m_pSegment->GetNext(pCluster);
+
+        if (((pNext == 0) || pNext->EOS()) && !bDoneParsing)
+            break;  //this cluster might still be loading
+
+        Add(pCluster);
+
+        m_pLast = pCluster;
+        m_last_ns = pCluster->GetTime();
+        ++m_count;
+
+        pCluster = pNext;
+    }
+
+    if (bDoneParsing && ((pCluster == 0) || pCluster->EOS()))
+        m_bDone = true;
+}
+
+
+void SeekIndex::Add(const mkvparser::Cluster* pCluster)
+{
+    using namespace mkvparser;
+
+    const Tracks* const pTracks = m_pSegment->GetTracks();
+    assert(pTracks);
+
+    const ULONG n = pTracks->GetTracksCount();
+
+    for (ULONG i = 0; i < n; ++i)
+    {
+        const Track* const pTrack = pTracks->GetTrackByIndex(i);
+
+        if ((pTrack == 0) || (pTrack->GetType() != 1))  //not video
+            continue;
+
+        //Returns the first keyframe of the track in this cluster.
+
+        const BlockEntry* const pEntry = pCluster->GetEntry(pTrack);
+
+        if ((pEntry == 0) || pEntry->EOS())
+            continue;
+
+        const Block* const pBlock = pEntry->GetBlock();
+        assert(pBlock);
+
+        Entry e;
+
+        e.time_ns = pBlock->GetTime(pCluster);
+        e.pCluster = pCluster;
+
+        entries_t& entries = m_tracks[pTrack->GetNumber()];
+        assert(entries.empty() || (entries.back().time_ns <= e.time_ns));
+
+        entries.push_back(e);
+    }
+}
+
+
+const mkvparser::BlockEntry* SeekIndex::Find(
+    const mkvparser::Track* pTrack,
+    LONGLONG ns) const
+{
+    using namespace mkvparser;
+
+    assert(pTrack);
+
+    //Clusters are loaded in time order, so if the last cluster indexed
+    //begins after ns, then we have already indexed every cluster that
+    //could contain the keyframe we're looking for.
+
+    if (!m_bDone && ((m_pLast == 0) || (ns >= m_last_ns)))
+        return 0;
+
+    const tracks_t::const_iterator iter = m_tracks.find(pTrack->GetNumber());
+
+    if (iter == m_tracks.end())
+        return pTrack->GetEOS();
+
+    const entries_t& entries = iter->second;
+    assert(!entries.empty());
+
+    typedef entries_t::const_iterator entry_iter_t;
+
+    const entry_iter_t i = entries.begin();
+    const entry_iter_t j = entries.end();
+
+    entry_iter_t k = std::upper_bound(i, j, ns, EntryLess());
+
+    if (k == i)  //ns precedes the first keyframe
+    {
+        const BlockEntry* const pEntry = i->pCluster->GetEntry(pTrack);
+        assert(pEntry);
+        assert(!pEntry->EOS());
+
+        return pEntry;
+    }
+
+    const Entry& e = *--k;
+    assert(e.time_ns <= ns);
+
+    //The last keyframe in this cluster at or before ns.  There must be
+    //one, since the cluster's first keyframe qualifies.
+
+    const BlockEntry* const pEntry = e.pCluster->GetEntry(pTrack, ns);
+    assert(pEntry);
+    assert(!pEntry->EOS());
+    assert(pEntry->GetBlock()->IsKey());
+
+    return pEntry;
+}
+
+
+}  //end namespace WebmSplit
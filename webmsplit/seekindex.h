@@ -0,0 +1,92 @@
+// Copyright (c) 2014 The WebM project authors. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS.  All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+
+#pragma once
+#include <map>
+#include <vector>
+#include "indexcache.h"
+
+namespace mkvparser
+{
+class Segment;
+class Cluster;
+class Track;
+class BlockEntry;
+}
+
+namespace WebmSplit
+{
+
+//Table of the clusters that contain a keyframe, for each video track,
+//built as the clusters are loaded.  It lets us find the keyframe that
+//precedes a seek time by binary search, when the file has no Cues,
+//without walking back over clusters that don't have keyframes.
+
+class SeekIndex
+{
+    SeekIndex(const SeekIndex&);
+    SeekIndex& operator=(const SeekIndex&);
+
+public:
+    SeekIndex();
+    ~SeekIndex();
+
+    void Init(mkvparser::Segment*);
+    void Clear();
+
+    //Indexes the clusters loaded since the last call.  The last cluster
+    //loaded isn't indexed until the one after it has been loaded (or
+    //parsing is done), since it might not have been parsed fully.
+    void Update();
+
+    //Returns the last keyframe of the track at or before time ns (or the
+    //first keyframe of the track, if ns precedes it), or the track's EOS
+    //if the track has no keyframes.  Returns NULL if the clusters indexed
+    //so far don't reach beyond ns, in which case the caller should load
+    //another cluster and try again.
+    const mkvparser::BlockEntry* Find(
+        const mkvparser::Track*,
+        LONGLONG ns) const;
+
+    ULONG GetCount() const;  //number of clusters indexed
+    bool IsDone() const;
+
+    //Copies the cluster positions and the keyframe table into the cache,
+    //so they can be saved for the next time the file is opened.
+    void Export(WebmUtil::IndexCache&) const;
+
+private:
+    mkvparser::Segment* m_pSegment;
+    const mkvparser::Cluster* m_pLast;  //last cluster indexed
+    LONGLONG m_last_ns;  //time of last cluster indexed
+    ULONG m_count;
+    bool m_bDone;  //all clusters have been indexed
+
+    struct Entry
+    {
+        LONGLONG time_ns;  //of first keyframe in cluster
+        const mkvparser::Cluster* pCluster;
+    };
+
+    struct EntryLess
+    {
+        bool operator()(LONGLONG ns, const Entry& rhs) const
+        {
+            return (ns < rhs.time_ns);
+        }
+    };
+
+    typedef std::vector<Entry> entries_t;
+    typedef std::map<long long, entries_t> tracks_t;  //by track number
+    tracks_t m_tracks;
+
+    void Add(const mkvparser::Cluster*);
+
+};
+
+}  //end namespace WebmSplit
@@ -15,6 +15,7 @@
 #include "mkvparserstreamaudio.h"
 #include "webmsplitoutpin.h"
 #include "webmtypes.h"
+#include "registry.h"
 #include <new>
 #include <cassert>
 #include <vfwmsgs.h>
@@ -91,7 +92,9 @@ Filter::Filter(IClassFactory* pClassFactory, IUnknown* pOuter)
       m_seekBase_ns(-1),
       m_currTime(kNoSeek),
       m_inpin(this),
-      m_cStarvation(-1)  //means "not starving"
+      m_cStarvation(-1),  //means "not starving"
+      m_pReadAheadCue(0),
+      m_bIndexSaved(false)
 {
     m_pClassFactory->LockServer(TRUE);
 
@@ -139,6 +142,8 @@ void Filter::Init()
     if (m_pSegment->DoneParsing())
         return;  //nothing for thread to do
 
+    m_pReadAheadCue = 0;
+
     const uintptr_t h = _beginthreadex(
                             0,  //security
                             0,  //stack size
@@ -198,6 +203,19 @@ void Filter::Final()
     b;
     assert(b);
 
+#ifdef _DEBUG
+    MkvReader::Stats s;
+    m_inpin.m_reader.GetStats(s);
+
+    odbgstream os;
+    os << "WebmSplit::Filter::Final: reader hits=" << s.cHits
+       << " misses=" << s.cMisses
+       << " prefetched=" << s.cPrefetched
+       << " waits=" << s.cWaits
+       << " stall_ms=" << (s.stall_time / 10000)
+       << endl;
+#endif
+
     m_hThread = 0;
 
     //os << "WebmSplit::Filter::Final: calling EndFlush" << endl;
@@ -911,10 +929,229 @@ HRESULT Filter::Open()
     m_seekBase_ns = -1;
     m_currTime = kNoSeek;
 
+    m_seek_index.Init(m_pSegment);
+    m_seek_index.Update();  //clusters loaded during Open
+
     return S_OK;
 }
 
 
+void Filter::OpenIndexCache(IPin* pPin)
+{
+    //If the upstream filter reads a local file, we look for a sidecar
+    //file holding the cluster and keyframe tables that we built the last
+    //time that file was opened.  With it, we can seek and read ahead in a
+    //file without Cues before its clusters have been parsed.  The sidecar
+    //is ignored if the file's size, time or header has changed.
+
+    m_index_path.clear();
+    m_index_cache.Clear();
+    m_bIndexSaved = false;
+
+    if (!IsIndexCacheEnabled())
+        return;
+
+    PIN_INFO info;
+
+    HRESULT hr = pPin->QueryPinInfo(&info);
+
+    if (FAILED(hr) || (info.pFilter == 0))
+        return;
+
+    const GraphUtil::IFileSourceFilterPtr pSource(info.pFilter);
+    info.pFilter->Release();
+
+    if (!bool(pSource))
+        return;
+
+    LPOLESTR name;
+
+    hr = pSource->GetCurFile(&name, 0);
+
+    if (FAILED(hr) || (name == 0))
+        return;
+
+    const bool bKey = GetIndexKey(name, m_index_key);
+
+    if (bKey)
+    {
+        m_index_path = name;
+        m_index_path += L".webmidx";
+    }
+
+    CoTaskMemFree(name);
+
+    if (!bKey)
+        return;
+
+    const HANDLE hFile = CreateFileW(
+                            m_index_path.c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            0,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            0);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    //The sidecar is small (16 bytes per cluster and 24 per keyframe),
+    //so we simply read all of it.
+
+    enum { kMaxSize = 64 * 1024 * 1024 };
+
+    LARGE_INTEGER size;
+
+    if (GetFileSizeEx(hFile, &size) &&
+        (size.QuadPart > 0) &&
+        (size.QuadPart <= kMaxSize))
+    {
+        const DWORD len = static_cast<DWORD>(size.QuadPart);
+        std::vector<unsigned char> buf(len);
+
+        DWORD n;
+
+        if (ReadFile(hFile, &buf[0], len, &n, 0) && (n == len))
+            m_index_cache.Read(&buf[0], n, m_index_key);
+    }
+
+    CloseHandle(hFile);
+
+    m_bIndexSaved = !m_index_cache.empty();  //sidecar is up to date
+}
+
+
+bool Filter::IsIndexCacheEnabled()
+{
+    //Writing a file next to the media is a surprising side effect of
+    //playback, so the sidecar is only used if the user has set the value
+    //IndexCache (a nonzero DWORD) under HKCU\Software\WebM\WebmSplit.
+
+    const Registry::Key key(HKEY_CURRENT_USER, L"Software\\WebM\\WebmSplit");
+
+    if (!key.is_open())
+        return false;
+
+    DWORD value;
+
+    if (key.query(L"IndexCache", value) != ERROR_SUCCESS)
+        return false;
+
+    return (value != 0);
+}
+
+
+bool Filter::GetIndexKey(
+    const wchar_t* filename,
+    WebmUtil::IndexCache::Key& key)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+
+    if (!GetFileAttributesExW(filename, GetFileExInfoStandard, &data))
+        return false;
+
+    ULARGE_INTEGER size;
+    size.LowPart = data.nFileSizeLow;
+    size.HighPart = data.nFileSizeHigh;
+
+    ULARGE_INTEGER mtime;
+    mtime.LowPart = data.ftLastWriteTime.dwLowDateTime;
+    mtime.HighPart = data.ftLastWriteTime.dwHighDateTime;
+
+    key.file_size = static_cast<LONGLONG>(size.QuadPart);
+    key.mtime = static_cast<LONGLONG>(mtime.QuadPart);
+
+    //The size and time alone could match a file that was rewritten in
+    //place, so we also hash its header (the EBML header, and the start
+    //of the segment).
+
+    LONGLONG len = key.file_size;
+
+    if (len > WebmUtil::IndexCache::kHeaderHashSize)
+        len = WebmUtil::IndexCache::kHeaderHashSize;
+
+    if (len <= 0)
+        return false;
+
+    std::vector<unsigned char> buf(static_cast<size_t>(len));
+
+    const long n = static_cast<long>(len);
+
+    if (m_inpin.m_reader.Read(0, n, &buf[0]) != 0)
+        return false;
+
+    key.header_hash = WebmUtil::IndexCache::Hash(&buf[0], n);
+    return true;
+}
+
+
+bool Filter::ExportIndexCache(
+    std::wstring& path,
+    std::vector<unsigned char>& buf)
+{
+    //Once parsing is done, we write the tables we built for the seek
+    //index to the sidecar file, for the next time this file is opened.
+    //Files with Cues don't need one.  We only try once per open; if the
+    //file can't be written (read-only media, say), we do without.
+    //
+    //This is called with the filter locked, so it only builds the image
+    //of the cache; the caller writes the file after releasing the lock.
+
+    if (m_index_path.empty() || m_bIndexSaved || !m_seek_index.IsDone())
+        return false;
+
+    m_bIndexSaved = true;
+
+    if (m_pSegment->GetCues())
+        return false;
+
+    WebmUtil::IndexCache cache;
+    cache.set_key(m_index_key);
+
+    m_seek_index.Export(cache);
+
+    if (cache.empty())
+        return false;
+
+    cache.Write(buf);
+    path = m_index_path;
+
+    return true;
+}
+
+
+void Filter::SaveIndexCache(
+    const std::wstring& path,
+    const std::vector<unsigned char>& buf)
+{
+    assert(!path.empty());
+    assert(!buf.empty());
+
+    const HANDLE hFile = CreateFileW(
+                            path.c_str(),
+                            GENERIC_WRITE,
+                            0,
+                            0,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            0);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    const DWORD len = static_cast<DWORD>(buf.size());
+    DWORD n;
+
+    const BOOL b = WriteFile(hFile, &buf[0], len, &n, 0);
+
+    CloseHandle(hFile);
+
+    if (!b || (n != len))
+        DeleteFileW(path.c_str());
+}
+
+
 void Filter::CreateOutpin(mkvparser::Stream* s)
 {
     //Outpin* const p = new (std::nothrow) Outpin(this, s);
@@ -1055,6 +1292,8 @@ unsigned Filter::Main()
         if (FAILED(hr))
             return 1;
 
+        m_inpin.m_reader.SetReadAheadHint(GetReadAheadHint());
+
         for (;;)
         {
             LONGLONG pos;
@@ -1080,7 +1319,18 @@ unsigned Filter::Main()
         OnNewCluster();
 
         if (bDone)
+        {
+            std::wstring path;
+            std::vector<unsigned char> buf;
+
+            if (ExportIndexCache(path, buf))
+            {
+                lock.Release();
+                SaveIndexCache(path, buf);
+            }
+
             return 0;
+        }
 
         if (m_state == State_Stopped)
             return 0;
@@ -1088,8 +1338,97 @@ unsigned Filter::Main()
 }
 
 
+LONGLONG Filter::GetReadAheadHint()
+{
+    //Use the cue points parsed so far to find the cluster that follows
+    //the one about to be loaded; the reader may prefetch up to its start.
+    //Clusters are loaded in order, so we resume the search from where
+    //we left off last time.
+
+    using namespace mkvparser;
+
+    const Cluster* const pLast = m_pSegment->GetLast();
+
+    LONGLONG pos = -1;  //relative to segment
+
+    if ((pLast != 0) && !pLast->EOS())
+        pos = pLast->GetPosition();
+
+    const Cues* const pCues = m_pSegment->GetCues();
+
+    if (pCues == 0)
+    {
+        //Without Cues, the sidecar index (if we have one) tells us where
+        //the clusters are.
+
+        if (m_index_cache.empty())
+            return -1;
+
+        pos = m_index_cache.GetNextClusterPos(pos);  //about to be loaded
+
+        if (pos < 0)
+            return -1;
+
+        pos = m_index_cache.GetNextClusterPos(pos);
+
+        if (pos < 0)
+            return -1;
+
+        return m_pSegment->m_start + pos;
+    }
+
+    const Tracks* const pTracks = m_pSegment->GetTracks();
+    const ULONG count = pTracks->GetTracksCount();
+
+    const CuePoint* pCP = m_pReadAheadCue;
+
+    if (pCP == 0)
+        pCP = pCues->GetFirst();
+
+    int n = 0;  //number of clusters found beyond pos
+
+    while (pCP)
+    {
+        LONGLONG cluster_pos = -1;
+
+        for (ULONG idx = 0; idx < count; ++idx)
+        {
+            const Track* const pTrack = pTracks->GetTrackByIndex(idx);
+
+            if (pTrack == 0)
+                continue;
+
+            const CuePoint::TrackPosition* const pTP = pCP->Find(pTrack);
+
+            if (pTP == 0)
+                continue;
+
+            if ((cluster_pos < 0) || (pTP->m_pos < cluster_pos))
+                cluster_pos = pTP->m_pos;
+        }
+
+        if (cluster_pos > pos)
+        {
+            if (n == 0)
+                m_pReadAheadCue = pCP;
+
+            if (++n >= 2)
+                return m_pSegment->m_start + cluster_pos;
+
+            pos = cluster_pos;
+        }
+
+        pCP = pCues->GetNext(pCP);
+    }
+
+    return -1;
+}
+
+
 void Filter::OnNewCluster()
 {
+    m_seek_index.Update();
+
     const BOOL b = SetEvent(m_hNewCluster);  //see Filter::GetState
     b;
     assert(b);
@@ -1139,6 +1478,12 @@ HRESULT Filter::OnDisconnectInpin()
     m_pSeekBase = 0;
     m_seekBase_ns = -1;
 
+    m_seek_index.Clear();
+
+    m_index_path.clear();
+    m_index_cache.Clear();
+    m_bIndexSaved = false;
+
     delete m_pSegment;
     m_pSegment = 0;
 
@@ -1294,24 +1639,7 @@ void Filter::SetCurrPositionVideo(
         }
     }
 
-    const mkvparser::BlockEntry* pCurr = 0;
-
-    for (;;)
-    {
-        long status = pTrack->Seek(ns, pCurr);
-
-        if ((status >= 0) ||
-            (status != mkvparser::E_BUFFER_NOT_FULL) ||
-            !bInCache)
-        {
-            break;
-        }
-
-        status = m_pSegment->LoadCluster();
-
-        if (status < 0)
-            break;
-    }
+    const BlockEntry* const pCurr = FindKeyframe(pTrack, ns, bInCache);
 
     if ((pCurr == 0) || pCurr->EOS())
     {
@@ -1432,24 +1760,7 @@ void Filter::SetCurrPositionAudio(
         }
     }
 
-    const BlockEntry* pCurr = 0;
-
-    for (;;)
-    {
-        long status = pVideoTrack->Seek(ns, pCurr);
-
-        if ((status >= 0) ||
-            (status != mkvparser::E_BUFFER_NOT_FULL) ||
-            !bInCache)
-        {
-            break;
-        }
-
-        status = m_pSegment->LoadCluster();
-
-        if (status < 0)
-            break;
-    }
+    const BlockEntry* pCurr = FindKeyframe(pVideoTrack, ns, bInCache);
 
     if ((pCurr == 0) || pCurr->EOS())
     {
@@ -1476,6 +1787,96 @@ void Filter::SetCurrPositionAudio(
 }
 
 
+const mkvparser::BlockEntry* Filter::FindKeyframe(
+    const mkvparser::Track* pTrack,
+    LONGLONG ns,
+    bool bInCache)
+{
+    //If the whole file is available, we load clusters until the index
+    //reaches beyond the seek time.  Each cluster is indexed once, so
+    //repeated seeks (scrubbing, say) cost a binary search.
+
+    m_seek_index.Update();
+
+    if (m_seek_index.Find(pTrack, ns) == 0)
+    {
+        //The index doesn't reach the seek time yet, but the sidecar index
+        //(if we have one) tells us which cluster has the keyframe.
+
+        const mkvparser::BlockEntry* const pCurr =
+            FindCachedKeyframe(pTrack, ns);
+
+        if (pCurr)
+            return pCurr;
+    }
+
+    for (;;)
+    {
+        m_seek_index.Update();
+
+        if (const mkvparser::BlockEntry* pCurr = m_seek_index.Find(pTrack, ns))
+            return pCurr;
+
+        if (!bInCache || m_pSegment->DoneParsing())
+            break;
+
+        const long status = m_pSegment->LoadCluster();
+
+        if (status < 0)
+            break;
+    }
+
+    //The index doesn't reach the seek time yet, so the best we can do
+    //is to search the clusters loaded so far.
+
+    const mkvparser::BlockEntry* pCurr = 0;
+
+    const long status = pTrack->Seek(ns, pCurr);
+    status;
+
+    return pCurr;
+}
+
+
+const mkvparser::BlockEntry* Filter::FindCachedKeyframe(
+    const mkvparser::Track* pTrack,
+    LONGLONG ns)
+{
+    using namespace mkvparser;
+
+    typedef WebmUtil::IndexCache::Keyframe Keyframe;
+
+    const Keyframe* const k = m_index_cache.FindKeyframe(
+                                pTrack->GetNumber(),
+                                ns);
+
+    if (k == 0)
+        return 0;
+
+    //As for a cue point, we preload just the cluster with the keyframe,
+    //instead of loading all of the clusters that precede it.
+
+    const Cluster* const pCluster =
+        m_pSegment->FindOrPreloadCluster(k->cluster_pos);
+
+    if ((pCluster == 0) || pCluster->EOS())
+        return 0;
+
+    if (ns < k->time_ns)  //ns precedes the track's first keyframe
+        ns = k->time_ns;
+
+    const BlockEntry* const pCurr = pCluster->GetEntry(pTrack, ns);
+
+    if ((pCurr == 0) || pCurr->EOS())
+        return 0;
+
+    if (!pCurr->GetBlock()->IsKey())  //sidecar doesn't match the file
+        return 0;
+
+    return pCurr;
+}
+
+
 bool Filter::InCache()
 {
     LONGLONG total, avail;
@@ -11,12 +11,14 @@
 #include <string>
 #include <vector>
 #include "webmsplitinpin.h"
+#include "seekindex.h"
 #include "clockable.h"
 
 namespace mkvparser
 {
 class IMkvReader;
 class Cluster;
+class CuePoint;
 class Stream;
 }
 
@@ -111,6 +113,7 @@ public:
     HRESULT OnDisconnectInpin();
     void OnStarvation(ULONG);
 
+    void OpenIndexCache(IPin*);  //called before Open
     HRESULT Open();
     void CreateOutpin(mkvparser::Stream*);
 
@@ -121,9 +124,22 @@ private:
     mkvparser::Segment* m_pSegment;
     HANDLE m_hNewCluster;
     long m_cStarvation;
+    const mkvparser::CuePoint* m_pReadAheadCue;
+    SeekIndex m_seek_index;  //for files without Cues
+
+    std::wstring m_index_path;  //sidecar index cache file
+    WebmUtil::IndexCache::Key m_index_key;
+    WebmUtil::IndexCache m_index_cache;  //loaded from sidecar
+    bool m_bIndexSaved;
 
     static unsigned __stdcall ThreadProc(void*);
     unsigned Main();
+    LONGLONG GetReadAheadHint();
+    static bool IsIndexCacheEnabled();
+    bool GetIndexKey(const wchar_t*, WebmUtil::IndexCache::Key&);
+    bool ExportIndexCache(std::wstring&, std::vector<unsigned char>&);
+    static void SaveIndexCache(const std::wstring&,
+                               const std::vector<unsigned char>&);
 
     void Init();
     void Final();
@@ -136,6 +152,15 @@ private:
     void SetCurrPositionVideo(LONGLONG ns, mkvparser::Stream*);
     void SetCurrPositionAudio(LONGLONG ns, mkvparser::Stream*);
 
+    const mkvparser::BlockEntry* FindKeyframe(
+        const mkvparser::Track*,
+        LONGLONG ns,
+        bool bInCache);
+
+    const mkvparser::BlockEntry* FindCachedKeyframe(
+        const mkvparser::Track*,
+        LONGLONG ns);
+
 };
 
 }  //end namespace WebmSplit
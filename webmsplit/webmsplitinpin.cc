@@ -186,6 +186,8 @@ HRESULT Inpin::ReceiveConnection(
 
     m_reader.m_sync_read = true;
 
+    m_pFilter->OpenIndexCache(pin);
+
 #if 1
     hr = m_pFilter->Open();
 #else
@@ -13,6 +13,7 @@
 #include "webmsplitfilter.h"
 #include "webmsplitoutpin.h"
 #include "cmediasample.h"
+#include "csharedsample.h"
 #include "mkvparser.hpp"
 #include <vfwmsgs.h>
 #include <cassert>
@@ -38,7 +39,9 @@ Outpin::Outpin(
     Pin(pFilter, PINDIR_OUTPUT, pStream->GetId().c_str()),
     m_pStream(pStream),
     m_hThread(0),
-    m_cRef(0)
+    m_cRef(0),
+    m_bWaitNewCluster(0),
+    m_cNextSamples(-1)
 {
     m_pStream->GetMediaTypes(m_preferred_mtv);
 
@@ -160,6 +163,9 @@ void Outpin::StartThread()
     b = ResetEvent(m_hNewCluster);
     assert(b);
 
+    m_bWaitNewCluster = 0;
+    m_cNextSamples = -1;  //stream position might have changed
+
     const uintptr_t h = _beginthreadex(
                             0,  //security
                             0,  //stack size
@@ -208,6 +214,9 @@ void Outpin::OnNewCluster()
     if (m_hThread == 0)
         return;
 
+    if (InterlockedCompareExchange(&m_bWaitNewCluster, 0, 1) == 0)
+        return;  //streaming thread isn't waiting
+
     const BOOL b = SetEvent(m_hNewCluster);
     b;
     assert(b);
@@ -425,41 +434,65 @@ HRESULT Outpin::Connect(
         m_connection_mtv.Add(mt);
     }
 
+    ALLOCATOR_PROPERTIES props, actual;
+
+    props.cBuffers = -1;    //number of buffers
+    props.cbBuffer = -1;    //size of each buffer, excluding prefix
+    props.cbAlign = -1;     //applies to prefix, too
+    props.cbPrefix = -1;    //imediasample::getbuffer does NOT include prefix
+
+    hr = pInputPin->GetAllocatorRequirements(&props);
+
+    m_pStream->UpdateAllocatorProperties(props);
+
     GraphUtil::IMemAllocatorPtr pAllocator;
 
-    hr = pInputPin->GetAllocator(&pAllocator);
+    //Laced audio frames are delivered without being copied, by samples
+    //that refer to the reader's cache pages (see MkvReader::ShareFrame).
+    //The downstream filter must agree to treat the samples as read-only,
+    //and can't ask for aligned or prefixed buffers.
 
-    if (FAILED(hr))
+    if ((m_pStream->m_pTrack->GetType() == 2) &&  //audio
+        (props.cbAlign <= 1) &&
+        (props.cbPrefix <= 0))
     {
-        //hr = CMemAllocator::CreateInstance(&pAllocator);
-        hr = CMediaSample::CreateAllocator(&pAllocator);
+        hr = CSharedSample::CreateAllocator(&pAllocator);
+
+        if (SUCCEEDED(hr))
+            hr = pAllocator->SetProperties(&props, &actual);
+
+        if (SUCCEEDED(hr))
+            hr = pInputPin->NotifyAllocator(pAllocator, TRUE);  //read-only
 
         if (FAILED(hr))
-            return VFW_E_NO_ALLOCATOR;
+            pAllocator = 0;  //fall back to copying
     }
 
-    assert(bool(pAllocator));
-
-    ALLOCATOR_PROPERTIES props, actual;
+    if (!bool(pAllocator))
+    {
+        hr = pInputPin->GetAllocator(&pAllocator);
 
-    props.cBuffers = -1;    //number of buffers
-    props.cbBuffer = -1;    //size of each buffer, excluding prefix
-    props.cbAlign = -1;     //applies to prefix, too
-    props.cbPrefix = -1;    //imediasample::getbuffer does NOT include prefix
+        if (FAILED(hr))
+        {
+            //hr = CMemAllocator::CreateInstance(&pAllocator);
+            hr = CMediaSample::CreateAllocator(&pAllocator);
 
-    hr = pInputPin->GetAllocatorRequirements(&props);
+            if (FAILED(hr))
+                return VFW_E_NO_ALLOCATOR;
+        }
 
-    m_pStream->UpdateAllocatorProperties(props);
+        assert(bool(pAllocator));
 
-    hr = pAllocator->SetProperties(&props, &actual);
+        hr = pAllocator->SetProperties(&props, &actual);
 
-    if (FAILED(hr))
-        return hr;
+        if (FAILED(hr))
+            return hr;
 
-    hr = pInputPin->NotifyAllocator(pAllocator, 0);  //allow writes
+        hr = pInputPin->NotifyAllocator(pAllocator, 0);  //allow writes
 
-    if (FAILED(hr) && (hr != E_NOTIMPL))
-        return hr;
+        if (FAILED(hr) && (hr != E_NOTIMPL))
+            return hr;
+    }
 
     m_pPinConnection = pin;
     m_pAllocator = pAllocator;
@@ -1386,90 +1419,137 @@ HRESULT Outpin::PopulateSamples(mkvparser::Stream::samples_t& samples)
         assert(samples.empty());
 
         Filter::Lock lock;
+        HRESULT hr;
 
-        HRESULT hr = lock.Seize(m_pFilter);
+        long count = m_cNextSamples;
+        m_cNextSamples = -1;
 
-        if (FAILED(hr))
-            return hr;
+        if (count < 0)  //we don't know the count yet
+        {
+            hr = lock.Seize(m_pFilter);
 
-        long count;
+            if (FAILED(hr))
+                return hr;
 
-        hr = m_pStream->GetSampleCount(count);
+            hr = m_pStream->GetSampleCount(count);
+
+            if (hr == VFW_E_BUFFER_UNDERFLOW)
+            {
+                hr = WaitNewCluster(lock);
+
+                if (FAILED(hr))
+                    return hr;
+
+                continue;
+            }
+
+            if (FAILED(hr))
+                return hr;
 
-        if (SUCCEEDED(hr))
-        {
             if (hr != S_OK)  //EOS
                 return hr;
 
             hr = lock.Release();
             assert(SUCCEEDED(hr));
+        }
 
-            //We have a count.  Now get some (empty) buffers.
+        //We have a count.  Now get some (empty) buffers.
 
-            samples.reserve(count);
+        samples.reserve(count);
 
-            for (long idx = 0; idx < count; ++idx)
-            {
-                IMediaSample* sample;
+        for (long idx = 0; idx < count; ++idx)
+        {
+            IMediaSample* sample;
 
-                hr = m_pAllocator->GetBuffer(&sample, 0, 0, 0);
+            hr = m_pAllocator->GetBuffer(&sample, 0, 0, 0);
 
-                if (hr != S_OK)
-                    return E_FAIL;  //we're done
+            if (hr != S_OK)
+                return E_FAIL;  //we're done
 
-                samples.push_back(sample);
-            }
+            samples.push_back(sample);
+        }
 
-            hr = lock.Seize(m_pFilter);
+        hr = lock.Seize(m_pFilter);
 
-            if (FAILED(hr))
-                return hr;
+        if (FAILED(hr))
+            return hr;
 
-            //We have buffers.  Now populate them.
+        //We have buffers.  Now populate them.
 
-            hr = m_pStream->PopulateSamples(samples);
+        hr = m_pStream->PopulateSamples(samples);
 
-            if (SUCCEEDED(hr))
-            {
-                if (hr != 2)
-                    return hr;
+        if (hr == VFW_E_BUFFER_UNDERFLOW)  //next block not loaded yet
+        {
+            mkvparser::Stream::Clear(samples);
 
-                hr = lock.Release();
-                assert(SUCCEEDED(hr));
+            hr = WaitNewCluster(lock);
 
-                mkvparser::Stream::Clear(samples);
-                continue;
-            }
-            else
-            {
-                assert(SUCCEEDED(hr));
+            if (FAILED(hr))
                 return hr;
-            }
+
+            continue;
         }
 
-        if (hr != VFW_E_BUFFER_UNDERFLOW)
+        if (FAILED(hr))
+        {
+            assert(SUCCEEDED(hr));
             return hr;
+        }
 
-        m_pFilter->OnStarvation(m_pStream->GetClusterCount());
+        if (hr == 2)  //try again
+        {
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
 
-        hr = lock.Release();
-        assert(SUCCEEDED(hr));
+            mkvparser::Stream::Clear(samples);
+            continue;
+        }
 
-        enum { nh = 2 };
-        const HANDLE hh[nh] = { m_hStop, m_hNewCluster };
+        if (hr == S_OK)
+        {
+            //We still hold the lock, so count the samples for the next
+            //block now, to save seizing the lock again on the next call.
 
-        const DWORD dw = WaitForMultipleObjects(nh, hh, 0, INFINITE);
-        assert(dw >= WAIT_OBJECT_0);
-        assert(dw < (WAIT_OBJECT_0 + nh));
+            long next_count;
 
-        if (dw == WAIT_OBJECT_0)  //hStop
-            return E_FAIL;  //NOTE: this return here is not an error
+            if (m_pStream->GetSampleCount(next_count) == S_OK)
+                m_cNextSamples = next_count;
+        }
 
-        assert(dw == (WAIT_OBJECT_0 + 1));  //hNewCluster
+        return hr;
     }
 }
 
 
+HRESULT Outpin::WaitNewCluster(CLockable::Lock& lock)
+{
+    //The stream ran out of loaded clusters.  We hold the filter lock,
+    //so the parser thread can't have loaded anything since the stream
+    //looked.  Announce that we're waiting before we release the lock,
+    //so that the parser thread wakes us after its next cluster.
+
+    m_pFilter->OnStarvation(m_pStream->GetClusterCount());
+
+    InterlockedExchange(&m_bWaitNewCluster, 1);
+
+    HRESULT hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    enum { nh = 2 };
+    const HANDLE hh[nh] = { m_hStop, m_hNewCluster };
+
+    const DWORD dw = WaitForMultipleObjects(nh, hh, 0, INFINITE);
+    assert(dw >= WAIT_OBJECT_0);
+    assert(dw < (WAIT_OBJECT_0 + nh));
+
+    if (dw == WAIT_OBJECT_0)  //hStop
+        return E_FAIL;  //NOTE: this return here is not an error
+
+    assert(dw == (WAIT_OBJECT_0 + 1));  //hNewCluster
+    return S_OK;
+}
+
+
 mkvparser::Stream* Outpin::GetStream() const
 {
     return m_pStream;
@@ -10,6 +10,7 @@
 #include "webmsplitpin.h"
 #include <comdef.h>
 #include "graphutil.h"
+#include "clockable.h"
 
 namespace mkvparser
 {
@@ -34,6 +35,7 @@ protected:
     HRESULT GetName(PIN_INFO&) const;
 
     HRESULT PopulateSamples(mkvparser::Stream::samples_t&);
+    HRESULT WaitNewCluster(CLockable::Lock&);
 
     mkvparser::Stream* m_pStream;
     GraphUtil::IMemAllocatorPtr m_pAllocator;
@@ -43,6 +45,16 @@ protected:
     HANDLE m_hNewCluster;
     ULONG m_cRef;
 
+    //Set by the streaming thread (while it holds the filter lock) just
+    //before it blocks waiting for the parser thread to load another
+    //cluster.  The parser thread signals m_hNewCluster only when this
+    //is set, so a pin that isn't starving doesn't get woken up.
+    volatile LONG m_bWaitNewCluster;
+
+    //Sample count of the next block, obtained while the lock was held
+    //to populate the previous block; negative means "not known".
+    long m_cNextSamples;
+
 public:
     static Outpin* Create(Filter*, mkvparser::Stream*);
     ULONG Destroy();  //when inpin becomes disconnected
@@ -49,8 +49,6 @@ Inpin::Inpin(Filter* p) :
 
     m_preferred_mtv.Add(mt);
 
-    m_packet.packetno = -1;
-
     m_hSamples = CreateEvent(0, 0, 0, 0);
     assert(m_hSamples);
 }
@@ -224,6 +222,22 @@ HRESULT Inpin::EndOfStream()
     if (m_bFlush)
         return S_FALSE;  //?
 
+    //Deliver what's left in the decoder before the EOS marker.  Getting
+    //the output buffer can block, so we do that without the lock.
+
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    PopulateSamples(true);
+
+    hr = lock.Seize(m_pFilter);
+
+    if (FAILED(hr))
+        return hr;
+
+    if (m_bFlush)
+        return S_FALSE;
+
     m_bEndOfStream = true;
 
     m_buffers.push_back(0);
@@ -368,16 +382,7 @@ HRESULT Inpin::EndFlush()
             pSample->Release();
     }
 
-    typedef channels_t::iterator iter_t;
-
-    iter_t i = m_channels.begin();
-    const iter_t j = m_channels.end();
-
-    while (i != j)
-    {
-        samples_t& ss = *i++;
-        ss.clear();
-    }
+    m_decoder.Flush();
 
     Outpin& outpin = m_pFilter->m_outpin;
 
@@ -434,16 +439,7 @@ void Inpin::OnCompletion()
         pSample->Release();
     }
 
-    typedef channels_t::iterator iter_t;
-
-    iter_t i = m_channels.begin();
-    const iter_t j = m_channels.end();
-
-    while (i != j)
-    {
-        samples_t& ss = *i++;
-        ss.clear();
-    }
+    m_decoder.Flush();
 
     m_bDone = true;
 }
@@ -591,24 +587,37 @@ HRESULT Inpin::GetAllocatorRequirements(ALLOCATOR_PROPERTIES* pp)
 }
 
 
+//#define DEBUG_RECEIVE
+#undef DEBUG_RECEIVE
+
 HRESULT Inpin::Receive(IMediaSample* pInSample)
 {
     if (pInSample == 0)
         return E_INVALIDARG;
 
-    HRESULT hr;
+    long m;
 
-//#define DEBUG_RECEIVE
-#undef DEBUG_RECEIVE
+    return ReceiveBatch(&pInSample, 1, m);
+}
 
-#ifdef DEBUG_RECEIVE
-    __int64 start_reftime_, stop_reftime_;
-    hr = pInSample->GetTime(&start_reftime_, &stop_reftime_);
-#endif
+
+HRESULT Inpin::ReceiveBatch(
+    IMediaSample* const* pSamples,
+    long n,
+    long& m)
+{
+    //The whole batch is decoded while the filter is locked once, and
+    //then delivered (with the filter unlocked) in as few output samples
+    //as will hold it, instead of locking and delivering per packet.
+
+    assert(pSamples);
+    assert(n > 0);
+
+    m = 0;
 
     Filter::Lock lock;
 
-    hr = lock.Seize(m_pFilter);
+    HRESULT hr = lock.Seize(m_pFilter);
 
     if (FAILED(hr))
         return hr;
@@ -643,40 +652,70 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     if (m_bDone)
         return S_FALSE;
 
-    if (m_first_reftime < 0)
+    for (long i = 0; i < n; ++i)
     {
-        LONGLONG sp;
+        IMediaSample* const pInSample = pSamples[i];
+        assert(pInSample);
 
-        hr = pInSample->GetTime(&m_first_reftime, &sp);
+        if ((m_first_reftime >= 0) || SetFirstReftime(pInSample))
+            Decode(pInSample);
+    }
 
-        if (FAILED(hr))
-            return S_OK;
+    m = n;
 
-        if (m_first_reftime < 0)
-            return S_OK;
+    hr = lock.Release();
+    assert(SUCCEEDED(hr));
+
+    if (FAILED(hr))
+        return hr;
+
+    return PopulateSamples(false);
+}
+
+
+bool Inpin::SetFirstReftime(IMediaSample* pInSample)
+{
+    assert(m_first_reftime < 0);
+
+    LONGLONG sp;
 
-        m_start_reftime = m_first_reftime;
-        m_samples = 0;
+    HRESULT hr = pInSample->GetTime(&m_first_reftime, &sp);
+
+    if (FAILED(hr))
+        return false;
+
+    if (m_first_reftime < 0)
+        return false;
+
+    m_start_reftime = m_first_reftime;
+    m_samples = 0;
 
 #ifdef DEBUG_RECEIVE
-        odbgstream os;
-        os << std::fixed << std::setprecision(3);
+    odbgstream os;
+    os << std::fixed << std::setprecision(3);
 
-        os << "\nwebmvorbisdec::Inpin::Receive: RESET FIRST REFTIME;"
-           << " st=" << m_start_reftime
-           << " st[sec]=" << (double(m_start_reftime) / 10000000)
-           << endl;
+    os << "\nwebmvorbisdec::Inpin::Receive: RESET FIRST REFTIME;"
+       << " st=" << m_start_reftime
+       << " st[sec]=" << (double(m_start_reftime) / 10000000)
+       << endl;
 #endif
 
-        const int status = vorbis_synthesis_restart(&m_dsp_state);
-        status;
-        assert(status == 0);  //success
+    m_decoder.Flush();
 
-        m_bDiscontinuity = true;
-    }
+    m_bDiscontinuity = true;
+
+    return true;
+}
 
+
+void Inpin::Decode(IMediaSample* pInSample)
+{
 #ifdef DEBUG_RECEIVE
     {
+        __int64 start_reftime_, stop_reftime_;
+        const HRESULT hr = pInSample->GetTime(&start_reftime_,
+                                              &stop_reftime_);
+
         odbgstream os;
         os << "webmvorbisdec::inpin::receive: ";
 
@@ -697,20 +736,6 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     }
 #endif
 
-    Decode(pInSample);
-
-    hr = lock.Release();
-    assert(SUCCEEDED(hr));
-
-    if (FAILED(hr))
-        return hr;
-
-    return PopulateSamples();
-}
-
-
-void Inpin::Decode(IMediaSample* pInSample)
-{
     BYTE* buf_in;
 
     HRESULT hr = pInSample->GetPointer(&buf_in);
@@ -720,50 +745,8 @@ void Inpin::Decode(IMediaSample* pInSample)
     const long len_in = pInSample->GetActualDataLength();
     assert(len_in >= 0);
 
-    ogg_packet& pkt = m_packet;
-
-    pkt.packet = buf_in;
-    pkt.bytes = len_in;
-    ++pkt.packetno;
-
-    int status = vorbis_synthesis(&m_block, &pkt);
-    assert(status == 0);  //TODO
-
-    status = vorbis_synthesis_blockin(&m_dsp_state, &m_block);
-    assert(status == 0);  //TODO
-
-    typedef VorbisTypes::VORBISFORMAT2 FMT;
-
-    const AM_MEDIA_TYPE& mt = m_connection_mtv[0];
-    assert(mt.cbFormat > sizeof(FMT));
-    assert(mt.pbFormat);
-
-    const FMT& fmt = (const FMT&)(*mt.pbFormat);
-    assert(fmt.channels > 0);
-    assert(fmt.samplesPerSec > 0);
-
-    float** sv;
-
-    const int pcmout_count = vorbis_synthesis_pcmout(&m_dsp_state, &sv);
-
-    if (pcmout_count <= 0)
-        return;
-
-    assert(sv);
-
-    for (DWORD i = 0; i < fmt.channels; ++i)
-    {
-        const float* const first = sv[i];
-        const float* const last = first + pcmout_count;
-
-        samples_t& ss = m_channels[i];
-        ss.insert(ss.end(), first, last);
-    }
-
-    sv = 0;
-
-    status = vorbis_synthesis_read(&m_dsp_state, pcmout_count);
-    assert(status == 0);
+    hr = m_decoder.Decode(buf_in, len_in);
+    assert(SUCCEEDED(hr));  //TODO
 }
 
 
@@ -778,7 +761,7 @@ void Inpin::PopulateSample(
     const DWORD channels = wfx.nChannels;
     assert(channels > 0);
     assert(channels <= 2);  //TODO
-    assert(channels == m_channels.size());
+    assert(channels == DWORD(m_decoder.GetVorbisChannels()));
 
     const long block_align = wfx.nBlockAlign;
     assert(size_t(block_align) == (channels * sizeof(float)));
@@ -812,28 +795,9 @@ void Inpin::PopulateSample(
     assert(SUCCEEDED(hr));
     assert(dst);
 
-    BYTE* const dst_end = dst + len_out;
-    dst_end;
-
-    for (long i = 0; i < samples; ++i)
-    {
-        for (DWORD j = 0; j < channels; ++j)
-        {
-            samples_t& ss = m_channels[j];
-            assert(!ss.empty());
-
-            const float& s = ss.front();
-
-            memcpy(dst, &s, sizeof(float));  //TODO: proper channel mapping
-
-            dst += sizeof(float);
-            assert(dst <= dst_end);
-
-            ss.pop_front();  //OK for deque (horrible for vector)
-        }
-    }
-
-    assert(dst == dst_end);
+    hr = m_decoder.ConsumeOutputSamples(reinterpret_cast<float*>(dst),
+                                        samples);
+    assert(SUCCEEDED(hr));
 
     hr = pOutSample->SetActualDataLength(len_out);
     assert(SUCCEEDED(hr));
@@ -874,9 +838,11 @@ void Inpin::PopulateSample(
 }
 
 
-HRESULT Inpin::PopulateSamples()
+HRESULT Inpin::PopulateSamples(bool drain)
 {
-    //Filter is NOT locked
+    //Filter is NOT locked.  If drain is true, the samples that remain
+    //are delivered in a short final buffer, rather than held back until
+    //a full buffer's worth has been decoded.
 
     const Outpin& outpin = m_pFilter->m_outpin;
 
@@ -921,13 +887,26 @@ HRESULT Inpin::PopulateSamples()
         const WAVEFORMATEX* const pwfx = outpin.GetFormat();
         assert(pwfx);
         assert(pwfx->nChannels > 0);
-        assert(pwfx->nChannels == m_channels.size());
+        assert(pwfx->nChannels == m_decoder.GetVorbisChannels());
 
-        const long actual = m_channels[0].size();
-        const long target = pwfx->nSamplesPerSec / Pin::kSampleRateDivisor;
+        unsigned int actual;
 
-        if (actual < target)
-            return S_OK;
+        hr = m_decoder.GetOutputSamplesAvailable(&actual);
+        assert(SUCCEEDED(hr));
+        //Fill each output buffer completely.  The outpin sizes buffers to
+        //hold at least 1/kSampleRateDivisor sec, or larger if downstream
+        //asks for that in its allocator requirements.
+
+        long target = pOutSample->GetSize() / pwfx->nBlockAlign;
+        assert(target >= 1);
+
+        if (long(actual) < target)
+        {
+            if (!drain || (actual == 0))
+                return S_OK;
+
+            target = actual;
+        }
 
         PopulateSample(pOutSample, target, *pwfx);
 
@@ -955,7 +934,7 @@ int Inpin::GetSample(IMediaSample** ppSample)
     {
         pSample = 0;
 
-        if (m_packet.packetno < 0)  //stopped
+        if (!m_decoder.IsOpen())  //stopped
             return -2;  //terminate
 
         assert(m_pFilter->m_state != State_Stopped);
@@ -990,20 +969,7 @@ HRESULT Inpin::ReceiveMultiple(
     if (pSamples == 0)
         return E_INVALIDARG;
 
-    for (long i = 0; i < n; ++i)
-    {
-        IMediaSample* const pSample = pSamples[i];
-        assert(pSample);
-
-        const HRESULT hr = Receive(pSample);
-
-        if (hr != S_OK)
-            return hr;
-
-        ++m;
-    }
-
-    return S_OK;
+    return ReceiveBatch(pSamples, n, m);
 }
 
 
@@ -1041,9 +1007,7 @@ HRESULT Inpin::Start()
     m_bFlush = false;
     m_bDone = false;
 
-    ogg_packet& pkt = m_packet;
-
-    assert(pkt.packetno < 0);
+    assert(!m_decoder.IsOpen());
 
     if (!bool(m_pPinConnection))
         return S_FALSE;
@@ -1088,54 +1052,28 @@ HRESULT Inpin::Start()
     pb += setup_len;
     assert(pb == pb_end);
 
-    pkt.packet = id_buf;
-    pkt.bytes = id_len;
-    pkt.b_o_s = 1;
-    pkt.e_o_s = 0;
-    pkt.granulepos = 0;
-    pkt.packetno = 0;
-
-    int status = vorbis_synthesis_idheader(&pkt);
-    assert(status == 1);  //TODO
-
-    vorbis_info& info = m_info;
-    vorbis_info_init(&info);
+    const BYTE* headers[3] = { id_buf, comment_buf, setup_buf };
 
-    vorbis_comment& comment = m_comment;
-    vorbis_comment_init(&comment);
+    const int status = m_decoder.CreateDecoder(
+                        headers,
+                        fmt.headerSize,
+                        WebmMfVorbisDecLib::VORBIS_SETUP_HEADER_COUNT);
+    assert(SUCCEEDED(status));  //TODO
 
-    status = vorbis_synthesis_headerin(&info, &comment, &pkt);
-    assert(status == 0);
-    assert((info.channels >= 0) && (DWORD(info.channels) == fmt.channels));
-    assert((info.rate >= 0) && (DWORD(info.rate) == fmt.samplesPerSec));
-
-    pkt.packet = comment_buf;
-    pkt.bytes = comment_len;
-    pkt.b_o_s = 0;
-    ++pkt.packetno;
-
-    status = vorbis_synthesis_headerin(&info, &comment, &pkt);
-    assert(status == 0);
-
-    pkt.packet = setup_buf;
-    pkt.bytes = setup_len;
-    ++pkt.packetno;
-
-    status = vorbis_synthesis_headerin(&info, &comment, &pkt);
-    assert(status == 0);
-
-    status = vorbis_synthesis_init(&m_dsp_state, &info);
-    assert(status == 0);
+    if (FAILED(status))
+        return VFW_E_TYPE_NOT_ACCEPTED;
 
-    status = vorbis_block_init(&m_dsp_state, &m_block);
-    assert(status == 0);
+    assert(DWORD(m_decoder.GetVorbisChannels()) == fmt.channels);
+    assert(DWORD(m_decoder.GetVorbisRate()) == fmt.samplesPerSec);
 
     m_first_reftime = -1;
     //m_start_reftime
     //m_samples
 
-    m_channels.clear();
-    m_channels.resize(fmt.channels);
+    //Room for one output buffer's worth, plus the largest Vorbis block.
+    const long capacity = fmt.samplesPerSec / Pin::kSampleRateDivisor + 8192;
+
+    m_decoder.ReserveOutputSamples(capacity);
 
     assert(m_buffers.empty());
 
@@ -1157,18 +1095,12 @@ void Inpin::Stop()
     const BOOL b = SetEvent(m_hSamples);  //tell thread to terminate
     assert(b);
 
-    m_channels.clear();
     m_first_reftime = -1;
 
-    if (m_packet.packetno < 0)
+    if (!m_decoder.IsOpen())
         return;
 
-    vorbis_block_clear(&m_block);
-    vorbis_dsp_clear(&m_dsp_state);
-    vorbis_comment_clear(&m_comment);
-    vorbis_info_clear(&m_info);
-
-    m_packet.packetno = -1;
+    m_decoder.DestroyDecoder();
 }
 
 
@@ -9,9 +9,7 @@
 #pragma once
 #include "webmvorbisdecoderpin.h"
 #include "graphutil.h"
-#include "vorbis/codec.h"
-#include <vector>
-#include <deque>
+#include "vorbisdecoder.h"
 #include <list>
 
 namespace WebmVorbisDecoderLib
@@ -99,28 +97,21 @@ private:
     bool m_bFlush;
     bool m_bDone;
 
-    ogg_packet m_packet;
-
-    vorbis_info m_info;
-    vorbis_comment m_comment;
-    vorbis_dsp_state m_dsp_state;
-    vorbis_block m_block;
-
     LONGLONG m_first_reftime;
     LONGLONG m_start_reftime;
     double m_samples;
     bool m_bDiscontinuity;
 
-    typedef std::deque<float> samples_t;
-    typedef std::vector<samples_t> channels_t;
-    channels_t m_channels;
+    WebmMfVorbisDecLib::VorbisDecoder m_decoder;
 
     typedef std::list<IMediaSample*> buffers_t;
     buffers_t m_buffers;
 
+    HRESULT ReceiveBatch(IMediaSample* const*, long, long&);
+    bool SetFirstReftime(IMediaSample*);
     void Decode(IMediaSample*);
     void PopulateSample(IMediaSample*, long, const WAVEFORMATEX&);
-    HRESULT PopulateSamples();
+    HRESULT PopulateSamples(bool drain);
 
 };
 
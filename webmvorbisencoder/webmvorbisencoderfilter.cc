@@ -236,6 +236,10 @@ HRESULT Filter::Stop()
             //Now stop outpin, to terminate its thread too.
             m_outpin.Stop();
 
+            //With the outpin's allocator decommitted, the encoder
+            //thread cannot be blocked, so it's safe to wait for it.
+            m_inpin.StopThread();
+
             break;
 
         case State_Stopped:
@@ -19,6 +19,7 @@
 #include <uuids.h>
 #include <mmreg.h>
 #include <cassert>
+#include <process.h>
 //#include <amvideo.h>
 //#include <evcode.h>
 #ifdef _DEBUG
@@ -41,9 +42,12 @@ Inpin::Inpin(Filter* pFilter) :
     m_bFlush(false),
     m_bDone(false),
     m_bStopped(true),
+    m_bReset(false),
     m_first_reftime(-1),
     m_start_reftime(-1),
-    m_start_samples(-1)
+    m_start_samples(-1),
+    m_pcm_count(0),
+    m_hThread(0)
 {
     AM_MEDIA_TYPE mt;
 
@@ -66,12 +70,26 @@ Inpin::Inpin(Filter* pFilter) :
 
     m_hSamples = CreateEvent(0, 0, 0, 0);
     assert(m_hSamples);
+
+    m_hPcm = CreateEvent(0, 0, 0, 0);
+    assert(m_hPcm);
+
+    m_hRoom = CreateEvent(0, 0, 0, 0);
+    assert(m_hRoom);
 }
 
 
 Inpin::~Inpin()
 {
-    const BOOL b = CloseHandle(m_hSamples);
+    assert(m_hThread == 0);
+
+    BOOL b = CloseHandle(m_hSamples);
+    assert(b);
+
+    b = CloseHandle(m_hPcm);
+    assert(b);
+
+    b = CloseHandle(m_hRoom);
     assert(b);
 }
 
@@ -369,17 +387,9 @@ HRESULT Inpin::EndOfStream()
 
     m_bEndOfStream = true;
 
-    const int status = vorbis_analysis_wrote(&m_dsp_state, 0);  //means "EOS"
-    status;
-    assert(status == 0);
-
-    hr = lock.Release();
-    assert(SUCCEEDED(hr));
-
-    if (FAILED(hr))
-        return hr;
+    QueuePcm(0, 0);  //tell encoder thread to flush the encoder
 
-    return PopulateSamples();
+    return S_OK;
 }
 
 
@@ -430,6 +440,9 @@ HRESULT Inpin::BeginFlush()
 
     m_bFlush = true;
 
+    const BOOL bRoom = SetEvent(m_hRoom);  //release Receive, if waiting
+    assert(bRoom);
+
     Outpin& outpin = m_pFilter->m_outpin;
 
     if (IPin* const pPin = outpin.m_pPinConnection)
@@ -507,6 +520,16 @@ HRESULT Inpin::EndFlush()
     m_first_reftime = -1;
     m_bDone = false;
 
+    //Discard the queued PCM, and have the encoder thread discard what it
+    //has already written into libvorbis, before it takes any new PCM.
+
+    FlushPcm();
+
+    m_bReset = true;
+
+    const BOOL bPcm = SetEvent(m_hPcm);
+    assert(bPcm);
+
     while (!m_buffers.empty())
     {
         IMediaSample* const pSample = m_buffers.front();
@@ -807,46 +830,108 @@ HRESULT Inpin::Receive(IMediaSample* pInSample)
     }
 #endif
 
-    Encode(pInSample);
+    const long len = pInSample->GetActualDataLength();
+
+    if (len <= 0)
+        return S_OK;
+
+    const long block_align = sizeof(float) * m_info.channels;
+    assert(len % block_align == 0);
+    block_align;
+
+    //Wait for the encoder thread to make room in the PCM queue.  This
+    //only happens if encoding has fallen behind.
+
+    while (m_pcm_count >= kMaxPcmQueue)
+    {
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return hr;
+
+        const DWORD dw = WaitForSingleObject(m_hRoom, INFINITE);
+
+        if (dw == WAIT_FAILED)
+            return E_FAIL;
+
+        assert(dw == WAIT_OBJECT_0);
+
+        hr = lock.Seize(m_pFilter);
+
+        if (FAILED(hr))
+            return hr;
+
+        if (m_bStopped)
+            return VFW_E_NOT_RUNNING;
+
+        if (m_bFlush)
+            return S_FALSE;
+    }
+
+    BYTE* buf;
 
-    hr = lock.Release();
+    hr = pInSample->GetPointer(&buf);
     assert(SUCCEEDED(hr));
+    assert(buf);
 
-    if (FAILED(hr))
-        return hr;
+    QueuePcm(reinterpret_cast<const float*>(buf), len / sizeof(float));
 
-    return PopulateSamples();
+    return S_OK;
 }
 
 
-void Inpin::Encode(IMediaSample* s)
+void Inpin::QueuePcm(const float* src, long count)
 {
-    assert(s);
+    //Filter is locked.
 
-    const long len = s->GetActualDataLength();
+    if (m_pcm_pool.empty())
+        m_pcm_pool.push_back(pcm_t());
+
+    m_pcm_queue.splice(m_pcm_queue.end(), m_pcm_pool, m_pcm_pool.begin());
+    ++m_pcm_count;
+
+    pcm_t& pcm = m_pcm_queue.back();
+    pcm.assign(src, src + count);  //reuses chunk's storage
+
+    const BOOL b = SetEvent(m_hPcm);
+    b;
+    assert(b);
+}
+
+
+void Inpin::FlushPcm()
+{
+    //Filter is locked.
+
+    m_pcm_pool.splice(m_pcm_pool.end(), m_pcm_queue);
+    m_pcm_count = 0;
+}
+
+
+void Inpin::Encode(const pcm_t& pcm)
+{
+    //Called on the encoder thread.  Filter is NOT locked.
+
+    if (pcm.empty())  //end of stream
+    {
+        const int status = vorbis_analysis_wrote(&m_dsp_state, 0);
+        status;
+        assert(status == 0);
 
-    if (len <= 0)
         return;
+    }
 
     const int channels = m_info.channels;
     assert(channels > 0);
 
-    const long block_align = sizeof(float) * channels;
-    assert(len % block_align == 0);
+    const long sample_count = static_cast<long>(pcm.size());
+    assert(sample_count % channels == 0);
 
-    const long block_count = len / block_align;
+    const long block_count = sample_count / channels;
     assert(block_count > 0);  //distinguished value 0 means "end of stream"
 
-    const long sample_count = len / sizeof(float);
-    assert(sample_count > 0);
-
-    BYTE* buf;
-
-    HRESULT hr = s->GetPointer(&buf);
-    assert(SUCCEEDED(hr));
-    assert(buf);
-
-    const float* const src_begin = reinterpret_cast<float*>(buf);
+    const float* const src_begin = &pcm[0];
     const float* src = src_begin;
 
     const float* const src_end = src_begin + sample_count;
@@ -876,12 +961,16 @@ void Inpin::Encode(IMediaSample* s)
 
 HRESULT Inpin::PopulateSamples()
 {
-    //Filter is NOT locked
+    //Called on the encoder thread, which owns the encoder state while
+    //it runs, so analysis happens with the filter NOT locked.
 
     const Outpin& outpin = m_pFilter->m_outpin;
 
     for (;;)
     {
+        //Get the output buffer first, so that a packet isn't lost if
+        //this fails.
+
         GraphUtil::IMediaSamplePtr pOutSample;
 
         HRESULT hr = outpin.m_pAllocator->GetBuffer(&pOutSample, 0, 0, 0);
@@ -889,38 +978,6 @@ HRESULT Inpin::PopulateSamples()
         if (FAILED(hr))
             return hr;
 
-        Filter::Lock lock;
-
-        hr = lock.Seize(m_pFilter);
-        assert(SUCCEEDED(hr));
-
-        if (FAILED(hr))
-            return hr;
-
-        if (m_pFilter->m_state == State_Stopped)
-            return VFW_E_NOT_RUNNING;
-
-        if (m_bStopped)  //weird
-            return VFW_E_WRONG_STATE;
-
-        //if (m_bEndOfStream)
-        //  return VFW_SAMPLE_REJECTED_EOS;
-
-        if (m_bFlush)
-            return S_FALSE;
-
-        if (m_bDone)
-            return S_FALSE;
-
-        if (!bool(outpin.m_pPinConnection))  //weird
-            return S_FALSE;
-
-        if (!bool(outpin.m_pInputPin))  //weird
-            return S_FALSE;
-
-        //if (!bool(outpin.m_pAllocator))  //weird
-        //    return S_FALSE;
-
         int status = vorbis_analysis_blockout(&m_dsp_state, &m_block);
 
         if (status < 0)  //error
@@ -954,6 +1011,38 @@ HRESULT Inpin::PopulateSamples()
         assert(status == 0);
         //TODO: vet seq no.
 
+        Filter::Lock lock;
+
+        hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return hr;
+
+        if (m_pFilter->m_state == State_Stopped)
+            return VFW_E_NOT_RUNNING;
+
+        if (m_bStopped)  //weird
+            return VFW_E_WRONG_STATE;
+
+        //if (m_bEndOfStream)
+        //  return VFW_SAMPLE_REJECTED_EOS;
+
+        if (m_bFlush || m_bReset)  //packet precedes the flush
+            return S_FALSE;
+
+        if (m_bDone)
+            return S_FALSE;
+
+        if (!bool(outpin.m_pPinConnection))  //weird
+            return S_FALSE;
+
+        if (!bool(outpin.m_pInputPin))  //weird
+            return S_FALSE;
+
+        //if (!bool(outpin.m_pAllocator))  //weird
+        //    return S_FALSE;
+
         PopulateSample(pOutSample, pkt);
 
         m_buffers.push_back(pOutSample.Detach());
@@ -1177,28 +1266,41 @@ IBaseFilter* Inpin::GetFilter()  //no addref here
 void Inpin::Start()
 {
     assert(m_buffers.empty());
+    assert(m_hThread == 0);
+
+    FlushPcm();
 
     m_bEndOfStream = false;
     m_bFlush = false;
     m_bDone = false;
     m_bStopped = false;
+    m_bReset = false;
     m_first_reftime = -1;
     m_start_reftime = -1;
     m_start_samples = -1;
 
     if (m_info.channels > 0)  //connected
     {
-        int result = vorbis_block_clear(&m_block);
-        assert(result == 0);
+        InitEncoder();
+        StartThread();
+    }
+}
 
-        vorbis_dsp_clear(&m_dsp_state);
 
-        result = vorbis_analysis_init(&m_dsp_state, &m_info);
-        assert(result == 0);
+void Inpin::InitEncoder()
+{
+    //Called with the encoder thread not running, or on the encoder thread.
 
-        result = vorbis_block_init(&m_dsp_state, &m_block);
-        assert(result == 0);
-    }
+    int result = vorbis_block_clear(&m_block);
+    assert(result == 0);
+
+    vorbis_dsp_clear(&m_dsp_state);
+
+    result = vorbis_analysis_init(&m_dsp_state, &m_info);
+    assert(result == 0);
+
+    result = vorbis_block_init(&m_dsp_state, &m_block);
+    assert(result == 0);
 }
 
 
@@ -1213,7 +1315,15 @@ void Inpin::Stop()
             pSample->Release();
     }
 
-    const BOOL b = SetEvent(m_hSamples);  //tell thread to terminate
+    FlushPcm();
+
+    BOOL b = SetEvent(m_hSamples);  //tell thread to terminate
+    assert(b);
+
+    b = SetEvent(m_hPcm);  //tell encoder thread to terminate
+    assert(b);
+
+    b = SetEvent(m_hRoom);  //release Receive, if waiting
     assert(b);
 
     m_bStopped = true;
@@ -1223,4 +1333,122 @@ void Inpin::Stop()
     //bDone state immediately.
 }
 
+
+void Inpin::StartThread()
+{
+    assert(m_hThread == 0);
+
+    const uintptr_t h = _beginthreadex(
+                            0,  //security
+                            0,  //stack size
+                            &Inpin::ThreadProc,
+                            this,
+                            0,   //run immediately
+                            0);  //thread id
+
+    m_hThread = reinterpret_cast<HANDLE>(h);
+    assert(m_hThread);
+}
+
+
+void Inpin::StopThread()
+{
+    //The outpin's allocator must be decommitted before calling this,
+    //so that the encoder thread cannot be blocked in GetBuffer, and Stop
+    //must have been called, to release the thread from its waits.  The
+    //thread owns the encoder state while it runs, so we must not give up
+    //waiting for it.
+
+    if (m_hThread == 0)
+        return;
+
+    const DWORD dw = WaitForSingleObject(m_hThread, INFINITE);
+    dw;
+    assert(dw == WAIT_OBJECT_0);
+
+    const BOOL b = CloseHandle(m_hThread);
+    b;
+    assert(b);
+
+    m_hThread = 0;
+}
+
+
+unsigned Inpin::ThreadProc(void* pv)
+{
+    Inpin* const pPin = static_cast<Inpin*>(pv);
+    assert(pPin);
+
+    return pPin->Main();
+}
+
+
+unsigned Inpin::Main()
+{
+    pcm_list_t chunk;  //PCM being encoded
+
+    for (;;)
+    {
+        Filter::Lock lock;
+
+        HRESULT hr = lock.Seize(m_pFilter);
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return 0;
+
+        m_pcm_pool.splice(m_pcm_pool.end(), chunk);  //recycle storage
+
+        if (m_bStopped)
+            return 0;  //terminate thread
+
+        if (m_bReset)  //flushed
+        {
+            m_bReset = false;
+
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            if (FAILED(hr))
+                return 0;
+
+            InitEncoder();
+            continue;
+        }
+
+        if (m_bFlush || m_pcm_queue.empty())
+        {
+            hr = lock.Release();
+            assert(SUCCEEDED(hr));
+
+            if (FAILED(hr))
+                return 0;
+
+            const DWORD dw = WaitForSingleObject(m_hPcm, INFINITE);
+
+            if (dw == WAIT_FAILED)
+                return 0;
+
+            assert(dw == WAIT_OBJECT_0);
+            continue;
+        }
+
+        chunk.splice(chunk.end(), m_pcm_queue, m_pcm_queue.begin());
+        --m_pcm_count;
+
+        const BOOL b = SetEvent(m_hRoom);
+        b;
+        assert(b);
+
+        hr = lock.Release();
+        assert(SUCCEEDED(hr));
+
+        if (FAILED(hr))
+            return 0;
+
+        Encode(chunk.front());
+        PopulateSamples();
+    }
+}
+
 }  //end namespace WebmVorbisEncoderLib
@@ -94,6 +94,7 @@ public:
 
     void Start();  //from stopped to running/paused
     void Stop();   //from running/paused to stopped
+    void StopThread();  //call after Stop, with filter unlocked
 
     HANDLE m_hSamples;
     int GetSample(IMediaSample**);
@@ -106,6 +107,7 @@ private:
     bool m_bFlush;
     bool m_bDone;
     bool m_bStopped;
+    bool m_bReset;  //encoder thread must discard the PCM held by libvorbis
 
     vorbis_info m_info;
     vorbis_dsp_state m_dsp_state;
@@ -119,13 +121,38 @@ private:
     typedef std::list<IMediaSample*> buffers_t;
     buffers_t m_buffers;
 
+    //Receive copies interleaved PCM into a bounded queue, and the
+    //encoder thread performs the analysis, so that upstream never waits
+    //for the encoder unless it falls more than kMaxPcmQueue buffers
+    //behind.  An empty chunk signals end-of-stream.
+
+    enum { kMaxPcmQueue = 16 };
+
+    typedef std::vector<float> pcm_t;
+    typedef std::list<pcm_t> pcm_list_t;
+    pcm_list_t m_pcm_queue;
+    pcm_list_t m_pcm_pool;    //recycled chunks
+    long m_pcm_count;         //chunks in m_pcm_queue
+
+    HANDLE m_hPcm;   //signalled when PCM is queued, or to terminate thread
+    HANDLE m_hRoom;  //signalled when space is available in PCM queue
+    HANDLE m_hThread;
+
+    static unsigned __stdcall ThreadProc(void*);
+    unsigned Main();
+    void StartThread();
+
+    void QueuePcm(const float*, long);
+    void FlushPcm();
+
     void OnConnect(
         const WAVEFORMATEX& wfx,
         const ogg_packet& ident,
         const ogg_packet& comment,
         const ogg_packet& code);
 
-    void Encode(IMediaSample*);
+    void InitEncoder();
+    void Encode(const pcm_t&);
     HRESULT PopulateSamples();
     void PopulateSample(IMediaSample*, const ogg_packet&);
 